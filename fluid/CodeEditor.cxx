@@ -402,7 +402,7 @@ CodeEditor::CodeEditor(int X, int Y, int W, int H, const char *L) :
   delete[] style;
   free(text);
 
-  mBuffer->add_modify_callback(style_update, this);
+  mBuffer->add_modify_callback(style_update, this, 0);
   add_key_binding(FL_Enter, FL_TEXT_EDITOR_ANY_STATE,
                   (Fl_Text_Editor::Key_Func)auto_indent);
 }
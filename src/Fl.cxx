@@ -28,6 +28,7 @@
 #include "Fl_Window_Driver.H"
 #include "Fl_System_Driver.H"
 #include <FL/Fl_Window.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/Fl_Tooltip.H>
 #include <FL/fl_draw.H>
 
@@ -440,6 +441,7 @@ void Fl::run_checks()
     while (next_check) {
       Check* checkp = next_check;
       next_check = checkp->next;
+      Fl_Profiler::Scope scope(Fl_Profiler::CHECK);
       (checkp->cb)(checkp->arg);
     }
     next_check = first_check;
@@ -687,7 +689,8 @@ void Fl::redraw() {
   Causes all the windows that need it to be redrawn and graphics forced
   out through the pipes.
 
-  This is what wait() does before looking for events.
+  This is what wait() does before looking for events, unless a
+  frame_rate() is set.
 
   Note: in multi-threaded applications you should only call Fl::flush()
   from the main thread. If a child thread needs to trigger a redraw event,
@@ -696,15 +699,20 @@ void Fl::redraw() {
 */
 void Fl::flush() {
   if (damage()) {
+    Fl_Profiler::Scope scope(Fl_Profiler::FLUSH);
     damage_ = 0;
     for (Fl_X* i = Fl_X::first; i; i = i->next) {
       Fl_Window* wi = i->w;
       if (Fl_Window_Driver::driver(wi)->wait_for_expose_value) {damage_ = 1; continue;}
       if (!wi->visible_r()) continue;
       if (wi->damage()) {
-        Fl_Window_Driver::driver(wi)->flush();
+        Fl_Window_Driver *d = Fl_Window_Driver::driver(wi);
+        double start = system_driver()->monotonic_time();
+        d->flush();
+        d->add_frame_time(system_driver()->monotonic_time() - start);
         wi->clear_damage();
       }
+      Fl_Window_Driver::driver(wi)->damage_rects.clear();
       // destroy damage regions for windows that don't use them:
       if (i->region) {
         fl_graphics_driver->XDestroyRegion(i->region);
@@ -715,6 +723,98 @@ void Fl::flush() {
   screen_driver()->flush();
 }
 
+// The time between two frames if redrawing is paced, or 0
+static double frame_period;
+// The time when the next frame may be drawn
+static double next_frame;
+
+static void frame_timeout(void*) {
+  // nothing to do, wait() calls Fl_Screen_Driver::paced_flush() after timeouts
+}
+
+/**
+  Limits how often the event loop redraws windows.
+
+  Normally every call of Fl::wait() ends with Fl::flush(), so windows may
+  be redrawn after every event, timeout or awake callback. If events
+  come in faster than the screen refreshes, most of these frames are
+  never seen. With a frame rate, the event loop redraws windows at most
+  \p fps times per second: damage that happens before the next frame is
+  due is left for that frame, and meanwhile events, timeouts and awake
+  callbacks are handled as usual. An explicit call of Fl::flush() still
+  redraws at once.
+
+  \param[in] fps frames per second, e.g. the refresh rate of the screen,
+    or 0 to redraw after every event (the default)
+
+  \see Fl::frame_stats()
+*/
+void Fl::frame_rate(double fps) {
+  frame_period = fps > 0 ? 1.0 / fps : 0.0;
+  next_frame = 0;
+}
+
+/**
+  Returns the frame rate that the event loop redraws windows with, or 0
+  if it redraws them after every event.
+*/
+double Fl::frame_rate() {
+  return frame_period > 0 ? 1.0 / frame_period : 0.0;
+}
+
+/*
+  Redraws the windows like Fl::flush(), unless a frame_rate() is set and
+  the next frame is not due yet. In that case, a timeout makes sure that
+  the event loop wakes up when the frame is due. Called by wait().
+*/
+void Fl_Screen_Driver::paced_flush() {
+  if (frame_period > 0 && Fl::damage()) {
+    double now = Fl::system_driver()->monotonic_time();
+    if (now < next_frame) {
+      if (!Fl::has_timeout(frame_timeout))
+        Fl::add_timeout(next_frame - now, frame_timeout);
+      flush();
+      return;
+    }
+    // keep the phase of the frames, unless they are late
+    next_frame = next_frame + frame_period > now ? next_frame + frame_period
+                                                 : now + frame_period;
+  }
+  Fl::flush();
+}
+
+static int compare_times(const void *a, const void *b) {
+  double d = *(const double*)a - *(const double*)b;
+  return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+/**
+  Gets statistics of the time that redrawing a window took.
+
+  FLTK measures how long every redraw of a window in Fl::flush() takes,
+  and keeps the last 256 times. This returns the shortest, the average
+  and the 99th percentile of them, in seconds, to find windows that take
+  too long to draw for the frame_rate().
+
+  \param[in] win the window
+  \param[out] min, avg, p99 the times, or 0 if there are none
+  \return the number of times that the statistics are made of
+*/
+int Fl::frame_stats(const Fl_Window *win, double &min, double &avg, double &p99) {
+  min = avg = p99 = 0;
+  Fl_Window_Driver *d = win ? Fl_Window_Driver::driver(win) : 0;
+  if (!d || !d->frame_count) return 0;
+  int n = d->frame_count < Fl_Window_Driver::FRAME_TIMES ? d->frame_count
+                                                        : Fl_Window_Driver::FRAME_TIMES;
+  double times[Fl_Window_Driver::FRAME_TIMES], sum = 0;
+  for (int i = 0; i < n; i++) sum += times[i] = d->frame_times[i];
+  qsort(times, n, sizeof(double), compare_times);
+  min = times[0];
+  avg = sum / n;
+  p99 = times[(99 * n + 99) / 100 - 1];
+  return n;
+}
+
 
 ////////////////////////////////////////////////////////////////
 // Event handlers:
@@ -1101,6 +1201,7 @@ static Fl_Widget *find_active(Fl_Widget *wi) {
 // values to account for nested windows. 'window' is the outermost
 // window the event was posted to by the system:
 static int send_event(int event, Fl_Widget* to, Fl_Window* window) {
+  Fl_Profiler::Scope scope(Fl_Profiler::HANDLE, to);
   int dx, dy;
   int old_event = Fl::e_number;
   if (window) {
@@ -1217,6 +1318,7 @@ int Fl::handle(int e, Fl_Window* window)
  */
 int Fl::handle_(int e, Fl_Window* window)
 {
+  Fl_Profiler::Scope scope(Fl_Profiler::EVENT);
   e_number = e;
   if (fl_local_grab) return fl_local_grab(e);
 
@@ -1547,6 +1649,7 @@ void Fl_Widget::damage(uchar fl) {
       fl_graphics_driver->XDestroyRegion(i->region);
       i->region = 0;
     }
+    Fl_Window_Driver::driver((Fl_Window*)this)->damage_rects.clear();
     damage_ |= fl;
     Fl::damage(FL_DAMAGE_CHILD);
   }
@@ -1577,16 +1680,20 @@ void Fl_Widget::damage(uchar fl, int X, int Y, int W, int H) {
     return;
   }
 
+  Fl_Damage_Rects &rects = Fl_Window_Driver::driver((Fl_Window*)wi)->damage_rects;
   if (wi->damage()) {
-    // if we already have damage we must merge with existing region:
+    // if we already have damage we must merge with existing region,
+    // unless the rectangles of the region cover the damage already:
     if (i->region) {
-      fl_graphics_driver->add_rectangle_to_region(i->region, X, Y, W, H);
+      rects.add(i->region, X, Y, W, H);
     }
     wi->damage_ |= fl;
   } else {
     // create a new region:
     if (i->region) fl_graphics_driver->XDestroyRegion(i->region);
     i->region = fl_graphics_driver->XRectangleRegion(X,Y,W,H);
+    rects.clear();
+    rects.add(0, X, Y, W, H);
     wi->damage_ = fl;
   }
   Fl::damage(FL_DAMAGE_CHILD);
@@ -122,6 +122,7 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
   uchar   bit,          // Bit in image
           byte;         // Byte in image
   uchar   *ptr;         // Pointer into pixels
+  const uchar *row;     // Scanline of uncompressed image data
   uchar   colormap[256][3]; // Colormap
   uchar   havemask;     // Single bit mask follows image data
   int     use_5_6_5;    // Use 5:6:5 for R:G:B channels in 16 bit images
@@ -193,10 +194,8 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
   //         w(), h(), depth, compression, colors_used, repcount);
 
   // Skip remaining header bytes...
-  while (repcount > 0) {
-    rdr.read_byte();
-    repcount --;
-  }
+  if (repcount > 0)
+    rdr.skip(repcount);
 
   // Check header data...
   if (!w() || !h() || !depth) {
@@ -259,64 +258,53 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
     switch (depth)
     {
       case 1 : // Bitmap
-        for (x = w(), bit = 128; x > 0; x --) {
-          if (bit == 128) byte = rdr.read_byte();
-
-          if (byte & bit) {
-            *ptr++ = colormap[1][2];
-            *ptr++ = colormap[1][1];
-            *ptr++ = colormap[1][0];
-          } else {
-            *ptr++ = colormap[0][2];
-            *ptr++ = colormap[0][1];
-            *ptr++ = colormap[0][0];
-          }
-
-          if (bit > 1)
-            bit >>= 1;
-          else
-            bit = 128;
-        }
-
-        // Read remaining bytes to align to 32 bits...
-        for (temp = (w() + 7) / 8; temp & 3; temp ++) {
-          rdr.read_byte();
+        if ((row = rdr.get(((w() + 31) / 32) * 4)) == NULL) break;
+        for (x = 0; x < w(); x ++, ptr += 3) {
+          temp = (row[x >> 3] >> (7 - (x & 7))) & 1;
+          ptr[0] = colormap[temp][2];
+          ptr[1] = colormap[temp][1];
+          ptr[2] = colormap[temp][0];
         }
         break;
 
       case 4 : // 16-color
-        for (x = w(), bit = 0xf0; x > 0; x --) {
+        if (compression != BI_RLE4) {
+          if ((row = rdr.get(((w() + 7) / 8) * 4)) == NULL) break;
+          for (x = 0; x < w(); x ++, ptr += 3) {
+            temp = (x & 1) ? row[x >> 1] & 15 : row[x >> 1] >> 4;
+            ptr[0] = colormap[temp][2];
+            ptr[1] = colormap[temp][1];
+            ptr[2] = colormap[temp][0];
+          }
+          break;
+        }
+        for (x = w(), bit = 0xf0; x > 0 && !rdr.eof(); x --) {
           // Get a new repcount as needed...
           if (repcount == 0) {
-            if (compression != BI_RLE4) {
-              repcount = 2;
-              color = -1;
-            } else {
-              while (align > 0) {
-                align --;
-                rdr.read_byte();
-              }
+            while (align > 0) {
+              align --;
+              rdr.read_byte();
+            }
 
+            if ((repcount = rdr.read_byte()) == 0) {
               if ((repcount = rdr.read_byte()) == 0) {
-                if ((repcount = rdr.read_byte()) == 0) {
-                  // End of line...
-                  x ++;
-                  continue;
-                } else if (repcount == 1) {
-                  // End of image...
-                  break;
-                } else if (repcount == 2) {
-                  // Delta...
-                  repcount = rdr.read_byte() * rdr.read_byte() * w();
-                  color = 0;
-                } else {
-                  // Absolute...
-                  color = -1;
-                  align = ((4 - (repcount & 3)) / 2) & 1;
-                }
+                // End of line...
+                x ++;
+                continue;
+              } else if (repcount == 1) {
+                // End of image...
+                break;
+              } else if (repcount == 2) {
+                // Delta...
+                repcount = rdr.read_byte() * rdr.read_byte() * w();
+                color = 0;
               } else {
-                color = rdr.read_byte();
+                // Absolute...
+                color = -1;
+                align = ((4 - (repcount & 3)) / 2) & 1;
               }
+            } else {
+              color = rdr.read_byte();
             }
           }
 
@@ -343,25 +331,21 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
             *ptr++ = colormap[temp & 15][1];
             *ptr++ = colormap[temp & 15][0];
           }
-
-        }
-
-        if (!compression) {
-          // Read remaining bytes to align to 32 bits...
-          for (temp = (w() + 1) / 2; temp & 3; temp ++) {
-            rdr.read_byte();
-          }
         }
         break;
 
       case 8 : // 256-color
-        for (x = w(); x > 0; x --) {
-          // Get a new repcount as needed...
-          if (compression != BI_RLE8) {
-            repcount = 1;
-            color = -1;
+        if (compression != BI_RLE8) {
+          if ((row = rdr.get(((w() + 3) / 4) * 4)) == NULL) break;
+          for (x = 0; x < w(); x ++, ptr += bDepth) {
+            ptr[0] = colormap[row[x]][2];
+            ptr[1] = colormap[row[x]][1];
+            ptr[2] = colormap[row[x]][0];
           }
-
+          break;
+        }
+        for (x = w(); x > 0 && !rdr.eof(); x --) {
+          // Get a new repcount as needed...
           if (repcount == 0) {
             while (align > 0) {
               align --;
@@ -402,18 +386,12 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
           *ptr++ = colormap[temp][0];
           if (havemask) ptr++;
         }
-
-        if (!compression) {
-          // Read remaining bytes to align to 32 bits...
-          for (temp = w(); temp & 3; temp ++) {
-            rdr.read_byte();
-          }
-        }
         break;
 
       case 16 : // 16-bit 5:5:5 or 5:6:5 RGB
-        for (x = w(); x > 0; x --, ptr += bDepth) {
-          uchar b = rdr.read_byte(), a = rdr.read_byte() ;
+        if ((row = rdr.get(((w() * 2 + 3) / 4) * 4)) == NULL) break;
+        for (x = w(); x > 0; x --, ptr += bDepth, row += 2) {
+          uchar b = row[0], a = row[1];
           if (use_5_6_5) {
             ptr[2] = (uchar)(( b << 3 ) & 0xf8);
             ptr[1] = (uchar)(((a << 5) & 0xe0) | ((b >> 3) & 0x1c));
@@ -424,54 +402,42 @@ void Fl_BMP_Image::load_bmp_(Fl_Image_Reader &rdr)
             ptr[0] = (uchar)((a<<1) & 0xf8);
           }
         }
-
-        // Read remaining bytes to align to 32 bits...
-        for (temp = w() * 2; temp & 3; temp ++) {
-          rdr.read_byte();
-        }
         break;
 
       case 24 : // 24-bit RGB
-        for (x = w(); x > 0; x --, ptr += bDepth) {
-          ptr[2] = rdr.read_byte();
-          ptr[1] = rdr.read_byte();
-          ptr[0] = rdr.read_byte();
-        }
-
-        // Read remaining bytes to align to 32 bits...
-        for (temp = w() * 3; temp & 3; temp ++) {
-          rdr.read_byte();
+        if ((row = rdr.get(((w() * 3 + 3) / 4) * 4)) == NULL) break;
+        for (x = w(); x > 0; x --, ptr += bDepth, row += 3) {
+          ptr[0] = row[2];
+          ptr[1] = row[1];
+          ptr[2] = row[0];
         }
         break;
 
       case 32 : // 32-bit RGBA
-        for (x = w(); x > 0; x --, ptr += bDepth) {
-          ptr[2] = rdr.read_byte();
-          ptr[1] = rdr.read_byte();
-          ptr[0] = rdr.read_byte();
-          ptr[3] = rdr.read_byte();
+        if ((row = rdr.get(w() * 4)) == NULL) break;
+        for (x = w(); x > 0; x --, ptr += bDepth, row += 4) {
+          ptr[0] = row[2];
+          ptr[1] = row[1];
+          ptr[2] = row[0];
+          ptr[3] = row[3];
         }
         break;
     }
+
+    // Stop at the end of a truncated file, the rest of the image is black...
+    if (rdr.eof()) {
+      if (row_order < 0) memset((uchar *)array, 0, (y + 1) * w() * d());
+      else memset((uchar *)array + y * w() * d(), 0, (h() - y) * w() * d());
+      break;
+    }
   }
 
-  if (havemask) {
+  if (havemask && !rdr.eof()) {
     for (y = h() - 1; y >= 0; y --) {
+      if ((row = rdr.get(((w() + 31) / 32) * 4)) == NULL) break;
       ptr = (uchar *)array + y * w() * d() + 3;
-      for (x = w(), bit = 128; x > 0; x --, ptr+=bDepth) {
-        if (bit == 128) byte = rdr.read_byte();
-        if (byte & bit)
-          *ptr = 0;
-        else
-          *ptr = 255;
-        if (bit > 1)
-          bit >>= 1;
-        else
-          bit = 128;
-      }
-      // Read remaining bytes to align to 32 bits...
-      for (temp = (w() + 7) / 8; temp & 3; temp ++)
-        rdr.read_byte();
+      for (x = 0; x < w(); x ++, ptr += bDepth)
+        *ptr = (row[x >> 3] & (128 >> (x & 7))) ? 0 : 255;
     }
   }
   // File is closed when returning...
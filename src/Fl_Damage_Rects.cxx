@@ -0,0 +1,104 @@
+//
+// "$Id$"
+//
+// Damaged rectangles of a window for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Damage_Rects.H"
+#include <FL/Fl_Graphics_Driver.H>
+
+static double area(int x, int y, int r, int b) {
+  return (r > x && b > y) ? double(r - x) * (b - y) : 0.0;
+}
+
+/*
+ The area of the bounding box of two rectangles that neither of them covers.
+ */
+template <class Rect> static double waste(const Rect &a, const Rect &b) {
+  double box = area(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y,
+                    a.r > b.r ? a.r : b.r, a.b > b.b ? a.b : b.b);
+  double overlap = area(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y,
+                        a.r < b.r ? a.r : b.r, a.b < b.b ? a.b : b.b);
+  return box - area(a.x, a.y, a.r, a.b) - area(b.x, b.y, b.r, b.b) + overlap;
+}
+
+template <class Rect> static void unite(Rect &a, const Rect &b) {
+  if (b.x < a.x) a.x = b.x;
+  if (b.y < a.y) a.y = b.y;
+  if (b.r > a.r) a.r = b.r;
+  if (b.b > a.b) a.b = b.b;
+}
+
+
+int Fl_Damage_Rects::add(Fl_Region region, int X, int Y, int W, int H)
+{
+  Rect n = { X, Y, X + W, Y + H, 1 };
+  for (int i = 0; i < n_; i++) {
+    const Rect &o = r_[i];
+    if (o.x <= n.x && o.y <= n.y && o.r >= n.r && o.b >= n.b)
+      return 0;
+  }
+  insert(n);
+  // too many rectangles: merge the two whose bounding box wastes least
+  while (n_ > MAX_RECTS) {
+    int bi = 0, bj = 1;
+    double best = -1;
+    for (int i = 0; i < n_; i++) {
+      for (int j = i + 1; j < n_; j++) {
+        double w = waste(r_[i], r_[j]);
+        if (best < 0 || w < best) { best = w; bi = i; bj = j; }
+      }
+    }
+    Rect m = r_[bj];
+    remove(bj);
+    unite(m, r_[bi]);
+    remove(bi);
+    m.fresh = 1;
+    insert(m);
+  }
+  for (int i = 0; i < n_; i++) {
+    Rect &o = r_[i];
+    if (!o.fresh) continue;
+    if (region)
+      fl_graphics_driver->add_rectangle_to_region(region, o.x, o.y, o.r - o.x, o.b - o.y);
+    o.fresh = 0;
+  }
+  return 1;
+}
+
+
+/*
+ Adds a rectangle, after merging it with every rectangle that it overlaps
+ much or covers. A merged rectangle must be added to the region again.
+ */
+void Fl_Damage_Rects::insert(Rect n)
+{
+  for (int i = 0; i < n_;) {
+    Rect &o = r_[i];
+    if (waste(o, n) <= (area(o.x, o.y, o.r, o.b) + area(n.x, n.y, n.r, n.b)) / 4) {
+      unite(n, o);
+      n.fresh = 1;
+      remove(i);
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+  r_[n_++] = n;
+}
+
+//
+// End of "$Id$".
+//
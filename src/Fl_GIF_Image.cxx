@@ -194,7 +194,7 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
   for (;;) {
 
     int i = rdr.read_byte();
-    if (i<0) {
+    if (rdr.eof()) {
       Fl::error("Fl_GIF_Image: %s - unexpected EOF", rdr.name());
       w(0); h(0); d(0); ld(ERR_FORMAT);
       return;
@@ -248,7 +248,7 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
     }
 
     // skip the data:
-    while (blocklen>0) {while (blocklen--) {ch = rdr.read_byte();} blocklen = rdr.read_byte();}
+    while (blocklen>0) {rdr.skip(blocklen); blocklen = rdr.read_byte();}
   }
 
   if (BitsPerPixel >= CodeSize)
@@ -279,6 +279,12 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
 #endif
   }
 
+  if (Width <= 0 || Height <= 0) {
+    Fl::error("Fl_GIF_Image: %s - invalid image size %dx%d", rdr.name(), Width, Height);
+    w(0); h(0); d(0); ld(ERR_FORMAT);
+    return;
+  }
+
   uchar *Image = new uchar[Width*Height];
 
   int YC = 0, Pass = 0; /* Used to de-interlace the picture */
@@ -298,36 +304,34 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
   short int Prefix[4096];
   uchar Suffix[4096];
 
-  int blocklen = rdr.read_byte();
-  uchar thisbyte = rdr.read_byte(); blocklen--;
-  int frombit = 0;
+  // The codes are read from a bit buffer that is filled from whole data
+  // blocks, which may be up to 255 bytes long
+  uchar block[255];
+  int blockpos = 0, blocklen = 0;
+  unsigned int bitbuf = 0;
+  int nbits = 0;
 
   for (;;) {
 
     /* Fetch the next code from the raster data stream.  The codes can be
-     * any length from 3 to 12 bits, packed into 8-bit bytes, so we have to
-     * maintain our location as a pointer and a bit offset.
-     * In addition, GIF adds totally useless and annoying block counts
-     * that must be correctly skipped over. */
-    int CurCode = thisbyte;
-    if (frombit+CodeSize > 7) {
-      if (blocklen <= 0) {
+     * any length from 3 to 12 bits, packed into 8-bit bytes and split into
+     * data blocks. A block of length 0 ends the data. */
+    while (nbits < CodeSize) {
+      if (blockpos >= blocklen) {
         blocklen = rdr.read_byte();
-        if (blocklen <= 0) break;
-      }
-      thisbyte = rdr.read_byte(); blocklen--;
-      CurCode |= thisbyte<<8;
-    }
-    if (frombit+CodeSize > 15) {
-      if (blocklen <= 0) {
-        blocklen = rdr.read_byte();
-        if (blocklen <= 0) break;
+        if (blocklen <= 0 || (int)rdr.read(block, blocklen) < blocklen) {
+          blocklen = 0;
+          break;
+        }
+        blockpos = 0;
       }
-      thisbyte = rdr.read_byte(); blocklen--;
-      CurCode |= thisbyte<<16;
+      bitbuf |= (unsigned int)block[blockpos++] << nbits;
+      nbits += 8;
     }
-    CurCode = (CurCode>>frombit)&ReadMask;
-    frombit = (frombit+CodeSize)%8;
+    if (nbits < CodeSize) break;
+    int CurCode = bitbuf & ReadMask;
+    bitbuf >>= CodeSize;
+    nbits -= CodeSize;
 
     if (CurCode == ClearCode) {
       CodeSize = InitCodeSize;
@@ -339,17 +343,23 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
 
     if (CurCode == EOFCode) break;
 
-    uchar OutCode[1025]; // temporary array for reversing codes
-    uchar *tp = OutCode;
+    // The string of a code is built backwards from its last pixel, then
+    // copied into the image a scanline at a time
+    uchar OutCode[4097];
+    uchar *tp = OutCode + sizeof(OutCode);
     int i;
     if (CurCode < FreeCode) i = CurCode;
-    else if (CurCode == FreeCode) {*tp++ = (uchar)FinChar; i = OldCode;}
+    else if (CurCode == FreeCode) {*--tp = (uchar)FinChar; i = OldCode;}
     else {Fl::error("Fl_GIF_Image: %s - LZW Barf!", rdr.name()); break;}
 
-    while (i >= ColorMapSize) {*tp++ = Suffix[i]; i = Prefix[i];}
-    *tp++ = FinChar = i;
-    do {
-      *p++ = *--tp;
+    while (i >= ColorMapSize && tp > OutCode + 1) {*--tp = Suffix[i]; i = Prefix[i];}
+    *--tp = FinChar = i;
+    int n = (int)(OutCode + sizeof(OutCode) - tp);
+    while (n > 0) {
+      int k = (int)(eol - p);
+      if (k > n) k = n;
+      memcpy(p, tp, k);
+      p += k; tp += k; n -= k;
       if (p >= eol) {
         if (!Interlace) YC++;
         else switch (Pass) {
@@ -362,7 +372,7 @@ void Fl_GIF_Image::load_gif_(Fl_Image_Reader &rdr)
         p = Image + YC*Width;
         eol = p+Width;
       }
-    } while (tp > OutCode);
+    }
 
     if (OldCode != ClearCode) {
       Prefix[FreeCode] = (short)OldCode;
@@ -22,7 +22,9 @@
 // handling is designed so windows themselves work correctly.
 
 #include <FL/Fl_Group.H>
+#include <FL/Fl_Profiler.H>
 #include "Fl_Window_Driver.H"
+#include "Fl_Group_Index.H"
 #include <FL/Fl_Rect.H>
 #include <FL/fl_draw.H>
 
@@ -94,6 +96,7 @@ extern Fl_Widget* fl_oldfocus; // set by Fl::focus
 // windows so they are relative to that window.
 
 static int send(Fl_Widget* o, int event) {
+  Fl_Profiler::Scope scope(Fl_Profiler::HANDLE, o);
   if (!o->as_window()) return o->handle(event);
   switch ( event )
   {
@@ -143,11 +146,22 @@ static int navkey() {
   return 0;
 }
 
+// Returns the number of children that may contain the mouse, and sets
+// list to their indexes, or to NULL if all children must be tested:
+int Fl_Group::event_children(const int *&list) {
+  if (!index_) {
+    list = 0;
+    return children_;
+  }
+  return index_->at(this, Fl::event_x(), Fl::event_y(), list);
+}
+
 int Fl_Group::handle(int event) {
 
   Fl_Widget*const* a = array();
   int i;
   Fl_Widget* o;
+  const int *list;
 
   switch (event) {
 
@@ -174,8 +188,8 @@ int Fl_Group::handle(int event) {
     return navigation(navkey());
 
   case FL_SHORTCUT:
-    for (i = children(); i--;) {
-      o = a[i];
+    for (i = event_children(list); i--;) {
+      o = a[list ? list[i] : i];
       if (o->takesevents() && Fl::event_inside(o) && send(o,FL_SHORTCUT))
 	return 1;
     }
@@ -189,8 +203,8 @@ int Fl_Group::handle(int event) {
 
   case FL_ENTER:
   case FL_MOVE:
-    for (i = children(); i--;) {
-      o = a[i];
+    for (i = event_children(list); i--;) {
+      o = a[list ? list[i] : i];
       if (o->visible() && Fl::event_inside(o)) {
 	if (o->contains(Fl::belowmouse())) {
 	  return send(o,FL_MOVE);
@@ -205,8 +219,8 @@ int Fl_Group::handle(int event) {
 
   case FL_DND_ENTER:
   case FL_DND_DRAG:
-    for (i = children(); i--;) {
-      o = a[i];
+    for (i = event_children(list); i--;) {
+      o = a[list ? list[i] : i];
       if (o->takesevents() && Fl::event_inside(o)) {
 	if (o->contains(Fl::belowmouse())) {
 	  return send(o,FL_DND_DRAG);
@@ -220,8 +234,8 @@ int Fl_Group::handle(int event) {
     return 0;
 
   case FL_PUSH:
-    for (i = children(); i--;) {
-      o = a[i];
+    for (i = event_children(list); i--;) {
+      o = a[list ? list[i] : i];
       if (o->takesevents() && Fl::event_inside(o)) {
 	Fl_Widget_Tracker wp(o);
 	if (send(o,FL_PUSH)) {
@@ -238,8 +252,8 @@ int Fl_Group::handle(int event) {
     if (o == this) return 0;
     else if (o) send(o,event);
     else {
-      for (i = children(); i--;) {
-	o = a[i];
+      for (i = event_children(list); i--;) {
+	o = a[list ? list[i] : i];
 	if (o->takesevents() && Fl::event_inside(o)) {
 	  if (send(o,event)) return 1;
 	}
@@ -248,8 +262,8 @@ int Fl_Group::handle(int event) {
     return 0;
 
   case FL_MOUSEWHEEL:
-    for (i = children(); i--;) {
-      o = a[i];
+    for (i = event_children(list); i--;) {
+      o = a[list ? list[i] : i];
       if (o->takesevents() && Fl::event_inside(o) && send(o,FL_MOUSEWHEEL))
 	return 1;
     }
@@ -368,6 +382,7 @@ Fl_Group::Fl_Group(int X,int Y,int W,int H,const char *l)
   resizable_ = this;
   bounds_ = 0; // this is allocated when first resize() is done
   sizes_ = 0; // see bounds_ (FLTK 1.3 compatibility)
+  index_ = 0;
 
   // Subclasses may want to construct child objects as part of their
   // constructor, so make sure they are add()'d to this object.
@@ -453,6 +468,7 @@ void Fl_Group::clear() {
 */
 Fl_Group::~Fl_Group() {
   clear();
+  delete index_;
 }
 
 /**
@@ -569,6 +585,41 @@ void Fl_Group::init_sizes() {
   bounds_ = 0;
   delete[] sizes_;	// FLTK 1.3 compatibility
   sizes_ = 0;		// FLTK 1.3 compatibility
+  if (index_) index_->invalidate();
+}
+
+/**
+  Turns the spatial index of the children on or off.
+
+  A group with thousands of children spends most of the time that it
+  handles a mouse event, or redraws some damaged children, testing which
+  children contain the mouse or are not clipped. With the spatial index,
+  the group divides the bounding box of its children into a grid, and
+  only tests the children in the cell under the mouse, or in the cells
+  that intersect the clip region. This affects FL_PUSH, FL_DRAG,
+  FL_RELEASE, FL_MOVE, FL_ENTER, FL_DND_ENTER, FL_DND_DRAG, FL_SHORTCUT
+  and FL_MOUSEWHEEL, and draw_children() when only children are damaged.
+  The order in which children get events or are drawn does not change.
+
+  The index is built when it is used first, and built again after
+  children were added, removed or resized. If you change the position
+  or size of a child in a derived class without calling its resize()
+  method, call init_sizes() to make sure the index is up to date.
+
+  The default is to not use an index (0), which is faster for groups
+  with few children.
+
+  \param[in] on non-zero to use a spatial index
+*/
+void Fl_Group::spatial_index(int on) {
+  if (!on) {
+    delete index_;
+    index_ = 0;
+  } else if (!index_) {
+    index_ = new Fl_Group_Index;
+  } else {
+    index_->invalidate();
+  }
 }
 
 /**
@@ -808,7 +859,15 @@ void Fl_Group::draw_children() {
       draw_outside_label(o);
     }
   } else {	// only redraw the children that need it:
-    for (int i=children_; i--;) update_child(**a++);
+    const int *list = 0;
+    int n = children_;
+    if (index_) {	// ...and may be in the clip region
+      int X, Y, W, H;
+      index_->bounds(this, X, Y, W, H);
+      fl_clip_box(X, Y, W, H, X, Y, W, H);
+      n = index_->in(this, X, Y, W, H, list);
+    }
+    for (int i = 0; i < n; i++) update_child(*a[list ? list[i] : i]);
   }
 
   if (clip_children()) fl_pop_clip();
@@ -833,6 +892,7 @@ void Fl_Group::draw() {
 void Fl_Group::update_child(Fl_Widget& widget) const {
   if (widget.damage() && widget.visible() && widget.type() < FL_WINDOW &&
       fl_not_clipped(widget.x(), widget.y(), widget.w(), widget.h())) {
+    Fl_Profiler::Scope scope(Fl_Profiler::DRAW, &widget);
     widget.draw();
     widget.clear_damage();
   }
@@ -848,6 +908,7 @@ void Fl_Group::draw_child(Fl_Widget& widget) const {
   if (widget.visible() && widget.type() < FL_WINDOW &&
       fl_not_clipped(widget.x(), widget.y(), widget.w(), widget.h())) {
     widget.clear_damage(FL_DAMAGE_ALL);
+    Fl_Profiler::Scope scope(Fl_Profiler::DRAW, &widget);
     widget.draw();
     widget.clear_damage();
   }
@@ -0,0 +1,244 @@
+//
+// "$Id$"
+//
+// Spatial index of the children of an Fl_Group for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Group_Index.H"
+#include <FL/Fl_Group.H>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the grid has at most this many columns and rows
+static const int MAX_CELLS = 1024;
+
+// children that overlap more cells are in the big list
+static const int BIG_CELLS = 64;
+
+
+Fl_Group_Index::Fl_Group_Index()
+{
+  valid_ = 0;
+  x_ = y_ = w_ = h_ = 0;
+  cols_ = rows_ = 0;
+  start_ = cells_ = big_ = stamp_ = scratch_ = 0;
+  nbig_ = nstamp_ = query_ = nscratch_ = 0;
+}
+
+
+Fl_Group_Index::~Fl_Group_Index()
+{
+  free(start_);
+  free(cells_);
+  free(big_);
+  free(stamp_);
+  free(scratch_);
+}
+
+
+int Fl_Group_Index::col(int X) const
+{
+  return (int)((long long)(X - x_) * cols_ / w_);
+}
+
+
+int Fl_Group_Index::row(int Y) const
+{
+  return (int)((long long)(Y - y_) * rows_ / h_);
+}
+
+
+void Fl_Group_Index::build(const Fl_Group *g)
+{
+  int n = g->children(), i;
+  Fl_Widget *const *a = g->array();
+  valid_ = 1;
+  nbig_ = 0;
+  cols_ = rows_ = 0;
+  // the bounding box of all children that are not empty
+  int X = 0, Y = 0, R = 0, B = 0, found = 0;
+  for (i = 0; i < n; i++) {
+    Fl_Widget *o = a[i];
+    if (o->w() <= 0 || o->h() <= 0) continue;
+    if (!found || o->x() < X) X = o->x();
+    if (!found || o->y() < Y) Y = o->y();
+    if (!found || o->x() + o->w() > R) R = o->x() + o->w();
+    if (!found || o->y() + o->h() > B) B = o->y() + o->h();
+    found = 1;
+  }
+  x_ = X; y_ = Y; w_ = R - X; h_ = B - Y;
+  if (!found) return;
+
+  // about one cell per child, as square as possible
+  cols_ = (int)sqrt((double)n * w_ / h_);
+  if (cols_ > w_) cols_ = w_;
+  if (cols_ > MAX_CELLS) cols_ = MAX_CELLS;
+  if (cols_ < 1) cols_ = 1;
+  rows_ = (n + cols_ - 1) / cols_;
+  if (rows_ > h_) rows_ = h_;
+  if (rows_ > MAX_CELLS) rows_ = MAX_CELLS;
+  if (rows_ < 1) rows_ = 1;
+  int ncells = cols_ * rows_;
+
+  // count the children of every cell, then fill the cells from the end,
+  // so that each lists its children in ascending order
+  free(start_);
+  start_ = (int *)calloc(ncells + 1, sizeof(int));
+  big_ = (int *)realloc(big_, (n ? n : 1) * sizeof(int));
+  int total = 0;
+  for (i = 0; i < n; i++) {
+    Fl_Widget *o = a[i];
+    if (o->w() <= 0 || o->h() <= 0) continue;
+    int c0 = col(o->x()), c1 = col(o->x() + o->w() - 1);
+    int r0 = row(o->y()), r1 = row(o->y() + o->h() - 1);
+    if ((c1 - c0 + 1) * (r1 - r0 + 1) > BIG_CELLS) {
+      big_[nbig_++] = i;
+      continue;
+    }
+    for (int r = r0; r <= r1; r++)
+      for (int c = c0; c <= c1; c++)
+        start_[r * cols_ + c + 1]++;
+    total += (c1 - c0 + 1) * (r1 - r0 + 1);
+  }
+  for (i = 0; i < ncells; i++)
+    start_[i + 1] += start_[i];
+  free(cells_);
+  cells_ = (int *)malloc((total ? total : 1) * sizeof(int));
+  int *end = (int *)malloc(ncells * sizeof(int));
+  memcpy(end, start_ + 1, ncells * sizeof(int));
+  for (i = n; i--;) {
+    Fl_Widget *o = a[i];
+    if (o->w() <= 0 || o->h() <= 0) continue;
+    int c0 = col(o->x()), c1 = col(o->x() + o->w() - 1);
+    int r0 = row(o->y()), r1 = row(o->y() + o->h() - 1);
+    if ((c1 - c0 + 1) * (r1 - r0 + 1) > BIG_CELLS) continue;
+    for (int r = r0; r <= r1; r++)
+      for (int c = c0; c <= c1; c++)
+        cells_[--end[r * cols_ + c]] = i;
+  }
+  free(end);
+  // the big list was filled in ascending order
+  if (nstamp_ < n) {
+    stamp_ = (int *)realloc(stamp_, n * sizeof(int));
+    nstamp_ = n;
+  }
+  memset(stamp_, 0, n * sizeof(int));
+  query_ = 0;
+}
+
+
+int *Fl_Group_Index::scratch(int n)
+{
+  if (n > nscratch_) {
+    nscratch_ = n > 2 * nscratch_ ? n : 2 * nscratch_;
+    scratch_ = (int *)realloc(scratch_, nscratch_ * sizeof(int));
+  }
+  return scratch_;
+}
+
+
+/*
+ Merges the ascending list a with the big list into the scratch buffer.
+ */
+int Fl_Group_Index::merge(const int *a, int na)
+{
+  int *s = scratch(na + nbig_);
+  int i = 0, j = 0, k = 0;
+  while (i < na && j < nbig_)
+    s[k++] = a[i] < big_[j] ? a[i++] : big_[j++];
+  while (i < na) s[k++] = a[i++];
+  while (j < nbig_) s[k++] = big_[j++];
+  return k;
+}
+
+
+int Fl_Group_Index::at(const Fl_Group *g, int X, int Y, const int *&list)
+{
+  if (!valid_) build(g);
+  list = scratch_;
+  if (!cols_ || X < x_ || Y < y_ || X >= x_ + w_ || Y >= y_ + h_)
+    return 0;
+  int c = row(Y) * cols_ + col(X);
+  const int *a = cells_ + start_[c];
+  int na = start_[c + 1] - start_[c];
+  if (!nbig_) {
+    list = a;
+    return na;
+  }
+  int n = merge(a, na);
+  list = scratch_;
+  return n;
+}
+
+
+static int compare_ints(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+
+int Fl_Group_Index::in(const Fl_Group *g, int X, int Y, int W, int H, const int *&list)
+{
+  if (!valid_) build(g);
+  list = scratch_;
+  if (!cols_) return 0;
+  if (X < x_) { W -= x_ - X; X = x_; }
+  if (Y < y_) { H -= y_ - Y; Y = y_; }
+  if (X + W > x_ + w_) W = x_ + w_ - X;
+  if (Y + H > y_ + h_) H = y_ + h_ - Y;
+  if (W <= 0 || H <= 0) return 0;
+  int c0 = col(X), c1 = col(X + W - 1), r0 = row(Y), r1 = row(Y + H - 1);
+  // if the rectangle covers half of the grid, testing all children is faster
+  if (2 * (c1 - c0 + 1) * (r1 - r0 + 1) > cols_ * rows_) {
+    list = 0;
+    return g->children();
+  }
+  if (++query_ <= 0) {   // wrapped around
+    memset(stamp_, 0, nstamp_ * sizeof(int));
+    query_ = 1;
+  }
+  int n = 0;
+  for (int r = r0; r <= r1; r++) {
+    for (int c = c0; c <= c1; c++) {
+      int cell = r * cols_ + c;
+      for (int k = start_[cell]; k < start_[cell + 1]; k++) {
+        int i = cells_[k];
+        if (stamp_[i] == query_) continue;
+        stamp_[i] = query_;
+        int *s = scratch(n + 1);
+        s[n++] = i;
+      }
+    }
+  }
+  for (int k = 0; k < nbig_; k++) {
+    int *s = scratch(n + 1);
+    s[n++] = big_[k];
+  }
+  qsort(scratch_, n, sizeof(int), compare_ints);
+  list = scratch_;
+  return n;
+}
+
+
+void Fl_Group_Index::bounds(const Fl_Group *g, int &X, int &Y, int &W, int &H)
+{
+  if (!valid_) build(g);
+  X = x_; Y = y_; W = w_; H = h_;
+}
+
+//
+// End of "$Id$".
+//
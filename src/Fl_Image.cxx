@@ -23,6 +23,7 @@
 #include <FL/Fl_Menu_Item.H>
 #include <FL/Fl_Image.H>
 #include "flstring.h"
+#include "Fl_Image_Resample.H"
 
 void fl_restore_clip(); // from fl_rect.cxx
 
@@ -221,6 +222,13 @@ Fl_Image::measure(const Fl_Label *lo,		// I - Label
 
 /** Sets the RGB image scaling method used for copy(int, int).
     Applies to all RGB images, defaults to FL_RGB_SCALING_NEAREST.
+
+    FL_RGB_SCALING_BILINEAR interpolates between the pixels, and averages
+    them when an image shrinks to less than half its size.
+    FL_RGB_SCALING_LANCZOS uses a Lanczos filter that keeps more detail,
+    which is best to make thumbnails of large images.
+    Large images are scaled by several threads if FLTK was built with
+    thread support.
 */
 void Fl_Image::RGB_scaling(Fl_RGB_Scaling method) {
   RGB_scaling_ = method;
@@ -430,116 +438,13 @@ Fl_Image *Fl_RGB_Image::copy(int W, int H) {
   if (W <= 0 || H <= 0) return 0;
 
   // OK, need to resize the image data; allocate memory and create new image
-  uchar		*new_ptr;	// Pointer into new array
-  const uchar	*old_ptr;	// Pointer into old array
-  int		dx, dy,		// Destination coordinates
-		line_d;		// stride from line to line
-
-  // Allocate memory for the new image...
   new_array = new uchar [W * H * d()];
   new_image = new Fl_RGB_Image(new_array, W, H, d());
   new_image->alloc_array = 1;
 
-  line_d = ld() ? ld() : data_w() * d();
-
-  if (Fl_Image::RGB_scaling() == FL_RGB_SCALING_NEAREST) {
-
-    int		c,		// Channel number
-		sy,		// Source coordinate
-		xerr, yerr,	// X & Y errors
-		xmod, ymod,	// X & Y moduli
-		xstep, ystep;	// X & Y step increments
-
-    // Figure out Bresenham step/modulus values...
-    xmod   = data_w() % W;
-    xstep  = (data_w() / W) * d();
-    ymod   = data_h() % H;
-    ystep  = data_h() / H;
-
-    // Scale the image using a nearest-neighbor algorithm...
-    for (dy = H, sy = 0, yerr = H, new_ptr = new_array; dy > 0; dy --) {
-      for (dx = W, xerr = W, old_ptr = array + sy * line_d; dx > 0; dx --) {
-        for (c = 0; c < d(); c ++) *new_ptr++ = old_ptr[c];
-
-        old_ptr += xstep;
-        xerr    -= xmod;
-
-        if (xerr <= 0) {
-          xerr    += W;
-	  old_ptr += d();
-        }
-      }
-
-      sy   += ystep;
-      yerr -= ymod;
-      if (yerr <= 0) {
-        yerr += H;
-        sy ++;
-      }
-    }
-  } else {
-    // Bilinear scaling (FL_RGB_SCALING_BILINEAR)
-    const float xscale = (data_w() - 1) / (float) W;
-    const float yscale = (data_h() - 1) / (float) H;
-    for (dy = 0; dy < H; dy++) {
-      float oldy = dy * yscale;
-      if (oldy >= data_h())
-        oldy = float(data_h() - 1);
-      const float yfract = oldy - (unsigned) oldy;
-
-      for (dx = 0; dx < W; dx++) {
-        new_ptr = new_array + dy * W * d() + dx * d();
-
-        float oldx = dx * xscale;
-        if (oldx >= data_w())
-          oldx = float(data_w() - 1);
-        const float xfract = oldx - (unsigned) oldx;
-
-        const unsigned leftx = (unsigned)oldx;
-        const unsigned lefty = (unsigned)oldy;
-        const unsigned rightx = (unsigned)(oldx + 1 >= data_w() ? oldx : oldx + 1);
-        const unsigned righty = (unsigned)oldy;
-        const unsigned dleftx = (unsigned)oldx;
-        const unsigned dlefty = (unsigned)(oldy + 1 >= data_h() ? oldy : oldy + 1);
-        const unsigned drightx = (unsigned)rightx;
-        const unsigned drighty = (unsigned)dlefty;
-
-        uchar left[4], right[4], downleft[4], downright[4];
-        memcpy(left, array + lefty * line_d + leftx * d(), d());
-        memcpy(right, array + righty * line_d + rightx * d(), d());
-        memcpy(downleft, array + dlefty * line_d + dleftx * d(), d());
-        memcpy(downright, array + drighty * line_d + drightx * d(), d());
-
-        int i;
-        if (d() == 4) {
-          for (i = 0; i < 3; i++) {
-            left[i] = (uchar)(left[i] * left[3] / 255.0f);
-            right[i] = (uchar)(right[i] * right[3] / 255.0f);
-            downleft[i] = (uchar)(downleft[i] * downleft[3] / 255.0f);
-            downright[i] = (uchar)(downright[i] * downright[3] / 255.0f);
-          }
-        }
-
-	const float leftf = 1 - xfract;
-	const float rightf = xfract;
-	const float upf = 1 - yfract;
-	const float downf = yfract;
-
-        for (i = 0; i < d(); i++) {
-          new_ptr[i] = (uchar)((left[i] * leftf +
-                   right[i] * rightf) * upf +
-                   (downleft[i] * leftf +
-                   downright[i] * rightf) * downf);
-        }
-
-        if (d() == 4 && new_ptr[3]) {
-          for (i = 0; i < 3; i++) {
-            new_ptr[i] = (uchar)(new_ptr[i] / (new_ptr[3] / 255.0f));
-          }
-        }
-      }
-    }
-  }
+  // Scale the image with the chosen method...
+  fl_resample(array, data_w(), data_h(), ld(), d(), new_array, W, H,
+              Fl_Image::RGB_scaling());
 
   return new_image;
 }
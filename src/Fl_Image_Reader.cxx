@@ -25,6 +25,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#endif
+
 /*
   This internal (undocumented) class reads data chunks from a file or from
   memory in LSB-first byte order.
@@ -35,6 +44,13 @@
   methods.
 */
 
+// files of at least this size are mapped into memory
+static const long MAP_SIZE = 65536;
+
+// the size of the buffer of a file that is not mapped, and of the window
+// of memory data
+static const size_t BUFFER_SIZE = 65536;
+
 // Initialize the reader to access the file system, filename is copied
 // and stored.
 int Fl_Image_Reader::open(const char *filename) {
@@ -45,6 +61,36 @@ int Fl_Image_Reader::open(const char *filename) {
     return -1;
   }
   pIsFile = 1;
+
+  // map large files into memory, read others through the buffer
+#ifdef _WIN32
+  HANDLE fh = (HANDLE)_get_osfhandle(_fileno(pFile));
+  LARGE_INTEGER size;
+  if (fh != INVALID_HANDLE_VALUE && GetFileSizeEx(fh, &size) &&
+      size.QuadPart >= MAP_SIZE && (ULONGLONG)size.QuadPart <= (size_t)-1) {
+    HANDLE mh = CreateFileMapping(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mh) {
+      // the view keeps the mapping alive
+      pMap = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mh);
+      if (pMap) pMapSize = (size_t)size.QuadPart;
+    }
+  }
+#else
+  struct stat st;
+  if (fstat(fileno(pFile), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size >= MAP_SIZE && (off_t)(size_t)st.st_size == st.st_size) {
+    void *m = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(pFile), 0);
+    if (m != MAP_FAILED) {
+      pMap = m;
+      pMapSize = (size_t)st.st_size;
+    }
+  }
+#endif
+  if (pMap) {
+    pStart = pData = (const unsigned char *)pMap;
+    pEnd = pStart + pMapSize;
+  }
   return 0;
 }
 
@@ -53,7 +99,7 @@ int Fl_Image_Reader::open(const char *imagename, const unsigned char *data) {
   if (imagename)
     pName = strdup(imagename);
   if (data) {
-    pStart = pData = data;
+    pStart = pData = pEnd = data;
     pIsData = 1;
     return 0;
   } else {
@@ -63,6 +109,15 @@ int Fl_Image_Reader::open(const char *imagename, const unsigned char *data) {
 
 // Close and destroy the reader
 Fl_Image_Reader::~Fl_Image_Reader() {
+  if (pMap) {
+#ifdef _WIN32
+    UnmapViewOfFile(pMap);
+#else
+    munmap(pMap, pMapSize);
+#endif
+  }
+  if (pBuffer)
+    ::free(pBuffer);
   if (pIsFile && pFile) {
     fclose(pFile);
   }
@@ -70,62 +125,97 @@ Fl_Image_Reader::~Fl_Image_Reader() {
     ::free(pName);
 }
 
-// Read a single byte from memory or a file
-uchar Fl_Image_Reader::read_byte() {
-  if (pIsFile) {
-    return getc(pFile);
-  } else if (pIsData) {
-    return *pData++;
-  } else {
-    return 0;
+// Make at least n bytes available at pData if possible, and return the
+// number of bytes available
+size_t Fl_Image_Reader::fill(size_t n) {
+  size_t avail = (size_t)(pEnd - pData);
+  if (pIsData) {
+    // memory has no known end, move the window
+    pEnd = pData + (n > BUFFER_SIZE ? n : BUFFER_SIZE);
+    return (size_t)(pEnd - pData);
+  }
+  if (!pIsFile || pMap) {
+    if (avail < n) pEof = 1;
+    return avail;
   }
+  // move the bytes that are left to the start of the buffer, and read more
+  pBufferPos += (long)(pData - pBuffer);
+  if (n > pBufferSize) {
+    size_t size = n > BUFFER_SIZE ? n : BUFFER_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(size);
+    if (!buffer) {
+      pEof = 1;
+      return avail;
+    }
+    if (avail) memcpy(buffer, pData, avail);
+    if (pBuffer) ::free(pBuffer);
+    pBuffer = buffer;
+    pBufferSize = size;
+  } else if (avail) {
+    memmove(pBuffer, pData, avail);
+  }
+  avail += fread(pBuffer + avail, 1, pBufferSize - avail, pFile);
+  pData = pBuffer;
+  pEnd = pBuffer + avail;
+  if (avail < n) pEof = 1;
+  return avail;
 }
 
-// Read a 16-bit unsigned integer, LSB-first
-unsigned short Fl_Image_Reader::read_word() {
-  unsigned char b0, b1;  // Bytes from file
-  if (pIsFile) {
-    b0 = (uchar)getc(pFile);
-    b1 = (uchar)getc(pFile);
-    return ((b1 << 8) | b0);
-  } else if (pIsData) {
-    b0 = *pData++;
-    b1 = *pData++;
-    return ((b1 << 8) | b0);
-  } else {
-    return 0;
+// Read up to n bytes into buf, returns the number of bytes read
+size_t Fl_Image_Reader::read(void *buf, size_t n) {
+  unsigned char *to = (unsigned char *)buf;
+  size_t done = 0;
+  while (done < n) {
+    size_t avail = (size_t)(pEnd - pData);
+    if (!avail && !(avail = fill(n - done < BUFFER_SIZE ? n - done : BUFFER_SIZE)))
+      break;
+    if (avail > n - done) avail = n - done;
+    memcpy(to + done, pData, avail);
+    pData += avail;
+    done += avail;
   }
+  if (done < n) pEof = 1;
+  return done;
 }
 
-// Read a 32-bit unsigned integer, LSB-first
-unsigned int Fl_Image_Reader::read_dword() {
-  unsigned char b0, b1, b2, b3;  // Bytes from file
-  if (pIsFile) {
-    b0 = (uchar)getc(pFile);
-    b1 = (uchar)getc(pFile);
-    b2 = (uchar)getc(pFile);
-    b3 = (uchar)getc(pFile);
-    return ((((((b3 << 8) | b2) << 8) | b1) << 8) | b0);
-  } else if (pIsData) {
-    b0 = *pData++;
-    b1 = *pData++;
-    b2 = *pData++;
-    b3 = *pData++;
-    return ((((((b3 << 8) | b2) << 8) | b1) << 8) | b0);
-  } else {
-    return 0;
+// Skip n bytes
+void Fl_Image_Reader::skip(size_t n) {
+  if ((size_t)(pEnd - pData) >= n || pIsData) {
+    pData += n;
+    if (pData > pEnd) pEnd = pData;
+  } else if (pMap) {
+    pData = pEnd;
+    pEof = 1;
+  } else if (pIsFile) {
+    // like a read, a skip past the end of the file sets eof(), so that a
+    // truncated image is noticed; seek() would clear it
+    long pos = pBufferPos + (long)(pData - pBuffer) + (long)n;
+    long size = fseek(pFile, 0, SEEK_END) == 0 ? ftell(pFile) : -1;
+    if (size >= 0 && pos > size) {
+      pos = size;
+      pEof = 1;
+    }
+    fseek(pFile, pos, SEEK_SET);
+    pBufferPos = pos;
+    pData = pEnd = pBuffer;
   }
 }
 
-// Read a 32-bit signed integer, LSB-first
-// int Fl_Image_Reader::read_long() -- implementation in header file
-
 // Move the current read position to a byte offset from the beginning
 // of the file or the original start address in memory
 void Fl_Image_Reader::seek(unsigned int n) {
-  if (pIsFile) {
-    fseek(pFile, n , SEEK_SET);
-  } else if (pIsData) {
-    pData = pStart + n;
+  pEof = 0;
+  if (pIsData) {
+    pData = pEnd = pStart + n;
+  } else if (pMap) {
+    pData = n <= pMapSize ? pStart + n : pEnd;
+  } else if (pIsFile) {
+    if ((long)n >= pBufferPos && (long)n <= pBufferPos + (long)(pEnd - pBuffer)) {
+      pData = pBuffer + (n - pBufferPos);
+    } else {
+      fseek(pFile, n , SEEK_SET);
+      pBufferPos = n;
+      pData = pEnd = pBuffer;
+    }
   }
 }
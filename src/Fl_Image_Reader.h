@@ -22,21 +22,33 @@
   duplication and may be extended to be used in similar cases. Future
   options might be to read data in MSB-first byte order or to add more
   methods.
+
+  All data is read from a window of bytes in memory, so that reading a
+  byte is a compare and an increment. Large files are mapped into memory
+  and read without copying, other files are read through a buffer. Image
+  decoders can get a whole scanline at once with get() and convert it in
+  a tight loop.
+
+  Reading or skipping past the end of a file sets eof(), reading returns
+  0 bytes then. Memory data has no known size and is never at the end.
 */
 
 #ifndef FL_IMAGE_READER_H
 #define FL_IMAGE_READER_H
 
 #include <stdio.h>
+#include <stddef.h>
 
 class Fl_Image_Reader
 {
 public:
   // Create the reader.
   Fl_Image_Reader() :
-  pIsFile(0), pIsData(0),
-  pFile(0L), pData(0L),
+  pIsFile(0), pIsData(0), pEof(0),
+  pFile(0L), pData(0L), pEnd(0L),
   pStart(0L),
+  pBuffer(0L), pBufferSize(0), pBufferPos(0),
+  pMap(0L), pMapSize(0),
   pName(0L)
   {}
 
@@ -51,38 +63,96 @@ public:
   ~Fl_Image_Reader();
 
   // Read a single byte from memory or a file
-  unsigned char read_byte();
+  unsigned char read_byte() {
+    if (pData < pEnd) return *pData++;
+    return fill(1) ? *pData++ : 0;
+  }
 
   // Read a 16-bit unsigned integer, LSB-first
-  unsigned short read_word();
+  unsigned short read_word() {
+    if (pEnd - pData >= 2 || fill(2) >= 2) {
+      pData += 2;
+      return (unsigned short)(pData[-2] | (pData[-1] << 8));
+    }
+    unsigned char b0 = read_byte();
+    return (unsigned short)(b0 | (read_byte() << 8));
+  }
 
   // Read a 32-bit unsigned integer, LSB-first
-  unsigned int read_dword();
+  unsigned int read_dword() {
+    if (pEnd - pData >= 4 || fill(4) >= 4) {
+      pData += 4;
+      return pData[-4] | (pData[-3] << 8) | (pData[-2] << 16) |
+             ((unsigned int)pData[-1] << 24);
+    }
+    unsigned int w0 = read_word();
+    return w0 | ((unsigned int)read_word() << 16);
+  }
 
   // Read a 32-bit signed integer, LSB-first
   int read_long() {
     return (int)read_dword();
   };
 
+  // Read up to n bytes into buf, returns the number of bytes read
+  size_t read(void *buf, size_t n);
+
+  // Return a pointer to the next n bytes without reading them, or NULL if
+  // there are less than n bytes left
+  const unsigned char *peek(size_t n) {
+    return ((size_t)(pEnd - pData) >= n || fill(n) >= n) ? pData : 0L;
+  }
+
+  // Read the next n bytes and return a pointer to them, which is valid
+  // until the next call, or NULL if there are less than n bytes left
+  const unsigned char *get(size_t n) {
+    const unsigned char *p = peek(n);
+    if (p) pData += n;
+    else skip(n);
+    return p;
+  }
+
+  // Skip n bytes
+  void skip(size_t n);
+
   // Move the current read position to a byte offset from the beginning
   // of the file or the original start address in memory
   void seek(unsigned int n);
 
+  // return non-zero if a read went past the end of the file
+  int eof() const { return pEof; }
+
   // return the name or filename for this reader
   const char *name() { return pName; }
 
 private:
 
+  // make at least n bytes available at pData if possible, and return
+  // the number of bytes available
+  size_t fill(size_t n);
+
   // open() sets this if we read from a file
   char pIsFile;
   // open() sets this if we read from memory
   char pIsData;
+  // a read went past the end of the file
+  char pEof;
   // a pointer to the opened file
   FILE *pFile;
-  // a pointer to the current byte in memory
+  // a pointer to the current byte in memory, the file mapping or the buffer
   const unsigned char *pData;
-  // a pointer to the start of the image data
+  // the end of the bytes that can be read at pData
+  const unsigned char *pEnd;
+  // a pointer to the start of the image data or the file mapping
   const unsigned char *pStart;
+  // the buffer of a file that is not mapped, its size, and the file
+  // position of its first byte
+  unsigned char *pBuffer;
+  size_t pBufferSize;
+  long pBufferPos;
+  // the file mapping and its size
+  void *pMap;
+  size_t pMapSize;
   // a copy of the name associated with this reader
   char *pName;
 };
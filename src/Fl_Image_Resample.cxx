@@ -0,0 +1,533 @@
+//
+// "$Id$"
+//
+// RGB image resampling for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "config_lib.h"
+#include "Fl_Image_Resample.H"
+#include "Fl_Thread_Pool.H"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// The vector versions assume a little-endian CPU.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define FL_RESAMPLE_SSE2 1
+#  include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#  define FL_RESAMPLE_NEON 1
+#  include <arm_neon.h>
+#endif
+
+// the weights are fixed point numbers with this many fraction bits
+#define BITS 14
+#define ONE (1 << BITS)
+#define HALF (1 << (BITS - 1))
+
+// an image is cut into stripes when it needs more multiplications than this
+static const double STRIPE_WORK = 2e6;
+// the fewest lines of a stripe
+static const int STRIPE_LINES = 16;
+
+static int max_threads = 0;
+
+enum { BOX, TRIANGLE, LANCZOS };
+
+#if defined(FL_RESAMPLE_SSE2)
+// two weights in every 32 bit lane, for _mm_madd_epi16()
+static inline __m128i weight_pair(short w0, short w1) {
+  return _mm_set1_epi32((int)((unsigned short)w0 | ((unsigned)(unsigned short)w1 << 16)));
+}
+#endif
+
+static inline uchar clamp(int v) {
+  return v < 0 ? 0 : v > 255 ? 255 : (uchar)v;
+}
+
+////////////////////////////////////////////////////////////////
+// Filter weights:
+
+// The taps weights of output pixel i apply to the input pixels
+// start[i] to start[i] + taps - 1, and add up to ONE.
+struct Fl_Resample_Axis {
+  int taps;
+  int *start;
+  short *weight;
+  Fl_Resample_Axis() : taps(0), start(0), weight(0) {}
+  ~Fl_Resample_Axis() { free(start); free(weight); }
+  void make(int in, int out, int filter);
+};
+
+static double sinc(double x) {
+  if (x == 0) return 1;
+  x *= 3.14159265358979323846;
+  return sin(x) / x;
+}
+
+void Fl_Resample_Axis::make(int in, int out, int filter) {
+  double scale = (double)in / out;
+  double fscale = scale > 1 ? scale : 1;       // the filter widens to shrink
+  double support = (filter == BOX ? 0.5 : filter == TRIANGLE ? 1 : 3) * fscale;
+  int most = (int)ceil(support) * 2 + 2;
+  if (most > in) most = in;
+  double *w = (double *)malloc(sizeof(double) * out * most);
+  int *first = (int *)malloc(sizeof(int) * out);
+  int *n = (int *)malloc(sizeof(int) * out);
+  taps = 1;
+  for (int i = 0; i < out; i++) {
+    double center = (i + 0.5) * scale;
+    int lo = (int)floor(center - support), hi = (int)ceil(center + support);
+    if (lo < 0) lo = 0;
+    if (hi > in) hi = in;
+    if (hi - lo > most) hi = lo + most;
+    double *wi = w + i * most, sum = 0;
+    int k;
+    for (k = lo; k < hi; k++) {
+      double v;
+      if (filter == BOX) {              // the part of the pixel in the box
+        double a = center - support, b = center + support;
+        v = (b < k + 1 ? b : k + 1) - (a > k ? a : k);
+        if (v < 0) v = 0;
+      } else {
+        double x = (k + 0.5 - center) / fscale;
+        if (filter == TRIANGLE) v = x < 0 ? 1 + x : 1 - x;
+        else v = x > -3 && x < 3 ? sinc(x) * sinc(x / 3) : 0;
+        if (v < 0 && filter == TRIANGLE) v = 0;
+      }
+      wi[k - lo] = v;
+      sum += v;
+    }
+    // drop the pixels that do not count
+    int m = hi - lo;
+    while (m > 1 && fabs(wi[m - 1]) < 1e-9) m--;
+    int skip = 0;
+    while (skip < m - 1 && fabs(wi[skip]) < 1e-9) skip++;
+    if (sum == 0) {                     // can not happen, but be safe
+      int c = (int)center;
+      lo = c < in ? c : in - 1;
+      wi[0] = sum = 1;
+      m = 1; skip = 0;
+    }
+    for (k = 0; k < m - skip; k++) wi[k] = wi[k + skip] / sum;
+    first[i] = lo + skip;
+    n[i] = m - skip;
+    if (n[i] > taps) taps = n[i];
+  }
+  start = (int *)malloc(sizeof(int) * out);
+  weight = (short *)calloc(out * taps, sizeof(short));
+  for (int i = 0; i < out; i++) {
+    // all pixels use taps weights, shift the first ones back at the end
+    int s = first[i] < in - taps ? first[i] : in - taps;
+    start[i] = s;
+    short *wi = weight + i * taps + (first[i] - s);
+    int sum = 0, big = 0;
+    for (int k = 0; k < n[i]; k++) {
+      wi[k] = (short)floor(w[i * most + k] * ONE + 0.5);
+      sum += wi[k];
+      if (wi[k] > wi[big]) big = k;
+    }
+    wi[big] += ONE - sum;               // a plain color stays the same
+  }
+  free(w);
+  free(first);
+  free(n);
+}
+
+////////////////////////////////////////////////////////////////
+// Line converters:
+
+// Copies a line of gray+alpha, RGB or RGBA pixels to 4 bytes per pixel,
+// with premultiplied colors.
+static void expand(const uchar *from, uchar *to, int w, int d) {
+  int i;
+  switch (d) {
+    case 2:
+      for (i = 0; i < w; i++, from += 2, to += 4) {
+        int a = from[1], g = from[0] * a + 128;
+        to[0] = (uchar)((g + (g >> 8)) >> 8);
+        to[1] = (uchar)a;
+        to[2] = to[3] = 0;
+      }
+      break;
+    case 3:
+      for (i = 0; i < w; i++, from += 3, to += 4) {
+        to[0] = from[0]; to[1] = from[1]; to[2] = from[2]; to[3] = 0;
+      }
+      break;
+    default:
+      i = 0;
+#if defined(FL_RESAMPLE_SSE2)
+      {
+        const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(128);
+        const __m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        for (; i + 4 <= w; i += 4, from += 16, to += 16) {
+          __m128i v = _mm_loadu_si128((const __m128i *)from);
+          __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+          __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+          __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+          // multiply all by alpha, but the alpha by 255
+          alo = _mm_or_si128(_mm_andnot_si128(amask, alo), _mm_and_si128(amask, _mm_set1_epi16(255)));
+          ahi = _mm_or_si128(_mm_andnot_si128(amask, ahi), _mm_and_si128(amask, _mm_set1_epi16(255)));
+          lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+          hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+          lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+          hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+          _mm_storeu_si128((__m128i *)to, _mm_packus_epi16(lo, hi));
+        }
+      }
+#endif
+      for (; i < w; i++, from += 4, to += 4) {
+        int a = from[3];
+        if (a == 255) {
+          memcpy(to, from, 4);
+        } else {
+          for (int c = 0; c < 3; c++) {
+            int v = from[c] * a + 128;
+            to[c] = (uchar)((v + (v >> 8)) >> 8);
+          }
+          to[3] = (uchar)a;
+        }
+      }
+      break;
+  }
+}
+
+// Turns a line of premultiplied gray+alpha or RGBA pixels back into
+// straight colors.
+static void unpremultiply(uchar *p, int w, int d) {
+  for (int i = 0; i < w; i++, p += d) {
+    int a = p[d - 1];
+    if (a == 255) continue;
+    if (a == 0) {
+      memset(p, 0, d - 1);
+      continue;
+    }
+    unsigned r = ((255u << 16) + a / 2) / a;
+    for (int c = 0; c < d - 1; c++) {
+      unsigned v = (p[c] * r + 32768) >> 16;
+      p[c] = v > 255 ? 255 : (uchar)v;
+    }
+  }
+}
+
+// Filters a line of 1 byte pixels.
+static void filter1(const uchar *in, uchar *out, int w, const Fl_Resample_Axis &ax) {
+  const int taps = ax.taps;
+  const short *wt = ax.weight;
+  for (int x = 0; x < w; x++, wt += taps) {
+    const uchar *p = in + ax.start[x];
+    int t = 0, acc = HALF;
+#if defined(FL_RESAMPLE_SSE2)
+    if (taps >= 8) {
+      const __m128i zero = _mm_setzero_si128();
+      __m128i a = _mm_setzero_si128();
+      for (; t + 8 <= taps; t += 8) {
+        __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + t)), zero);
+        a = _mm_add_epi32(a, _mm_madd_epi16(px, _mm_loadu_si128((const __m128i *)(wt + t))));
+      }
+      a = _mm_add_epi32(a, _mm_srli_si128(a, 8));
+      a = _mm_add_epi32(a, _mm_srli_si128(a, 4));
+      acc += _mm_cvtsi128_si32(a);
+    }
+#elif defined(FL_RESAMPLE_NEON)
+    if (taps >= 8) {
+      int32x4_t a = vdupq_n_s32(0);
+      for (; t + 8 <= taps; t += 8) {
+        int16x8_t px = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p + t)));
+        int16x8_t wv = vld1q_s16(wt + t);
+        a = vmlal_s16(a, vget_low_s16(px), vget_low_s16(wv));
+        a = vmlal_s16(a, vget_high_s16(px), vget_high_s16(wv));
+      }
+      acc += vaddvq_s32(a);
+    }
+#endif
+    for (; t < taps; t++) acc += wt[t] * p[t];
+    out[x] = clamp(acc >> BITS);
+  }
+}
+
+// Filters a line of 4 byte pixels made by expand() into pixels of d bytes.
+static void filter4(const uchar *in, uchar *out, int w, int d, const Fl_Resample_Axis &ax) {
+  const int taps = ax.taps;
+  const short *wt = ax.weight;
+  for (int x = 0; x < w; x++, wt += taps, out += d) {
+    const uchar *p = in + ax.start[x] * 4;
+    uchar px[4];
+    int t = 0;
+#if defined(FL_RESAMPLE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_set1_epi32(HALF);
+    for (; t + 4 <= taps; t += 4, p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)p);
+      __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+      lo = _mm_unpacklo_epi16(lo, _mm_srli_si128(lo, 8));
+      hi = _mm_unpacklo_epi16(hi, _mm_srli_si128(hi, 8));
+      a = _mm_add_epi32(a, _mm_madd_epi16(lo, weight_pair(wt[t], wt[t + 1])));
+      a = _mm_add_epi32(a, _mm_madd_epi16(hi, weight_pair(wt[t + 2], wt[t + 3])));
+    }
+    for (; t + 2 <= taps; t += 2, p += 8) {
+      // interleave the channels of both pixels to multiply them in pairs
+      __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), zero);
+      v = _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+      __m128i wp = weight_pair(wt[t], wt[t + 1]);
+      a = _mm_add_epi32(a, _mm_madd_epi16(v, wp));
+    }
+    if (t < taps) {
+      int v32;
+      memcpy(&v32, p, 4);
+      __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v32), zero);
+      v = _mm_unpacklo_epi16(v, zero);
+      a = _mm_add_epi32(a, _mm_madd_epi16(v, weight_pair(wt[t], 0)));
+    }
+    a = _mm_srai_epi32(a, BITS);
+    a = _mm_packs_epi32(a, a);
+    int r = _mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+    memcpy(px, &r, 4);
+#elif defined(FL_RESAMPLE_NEON)
+    int32x4_t a = vdupq_n_s32(HALF);
+    for (; t + 2 <= taps; t += 2, p += 8) {
+      int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+      a = vmlal_n_s16(a, vget_low_s16(v), wt[t]);
+      a = vmlal_n_s16(a, vget_high_s16(v), wt[t + 1]);
+    }
+    if (t < taps) {
+      uint32_t v32;
+      memcpy(&v32, p, 4);
+      int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v32))));
+      a = vmlal_n_s16(a, vget_low_s16(v), wt[t]);
+    }
+    int16x4_t r = vqshrn_n_s32(a, BITS);
+    uint32_t r32 = vget_lane_u32(vreinterpret_u32_u8(vqmovun_s16(vcombine_s16(r, r))), 0);
+    memcpy(px, &r32, 4);
+#else
+    int a0 = HALF, a1 = HALF, a2 = HALF, a3 = HALF;
+    for (; t < taps; t++, p += 4) {
+      int f = wt[t];
+      a0 += f * p[0]; a1 += f * p[1]; a2 += f * p[2]; a3 += f * p[3];
+    }
+    px[0] = clamp(a0 >> BITS); px[1] = clamp(a1 >> BITS);
+    px[2] = clamp(a2 >> BITS); px[3] = clamp(a3 >> BITS);
+#endif
+    if (d == 4) memcpy(out, px, 4);
+    else if (d == 3) { out[0] = px[0]; out[1] = px[1]; out[2] = px[2]; }
+    else { out[0] = px[0]; out[1] = px[1]; }
+  }
+}
+
+// Adds up the n bytes of the lines with the weights.
+static void filter_lines(const uchar *const *line, const short *wt, int taps,
+                         uchar *out, int n) {
+  int i = 0;
+#if defined(FL_RESAMPLE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i a0 = _mm_set1_epi32(HALF), a1 = a0, a2 = a0, a3 = a0;
+    int t = 0;
+    for (; t + 2 <= taps; t += 2) {
+      // interleave the bytes of both lines to multiply them in pairs
+      __m128i p = _mm_loadu_si128((const __m128i *)(line[t] + i));
+      __m128i q = _mm_loadu_si128((const __m128i *)(line[t + 1] + i));
+      __m128i wp = weight_pair(wt[t], wt[t + 1]);
+      __m128i lo = _mm_unpacklo_epi8(p, q), hi = _mm_unpackhi_epi8(p, q);
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wp));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wp));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wp));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wp));
+    }
+    if (t < taps) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(line[t] + i));
+      __m128i wp = weight_pair(wt[t], 0);
+      __m128i lo = _mm_unpacklo_epi8(p, zero), hi = _mm_unpackhi_epi8(p, zero);
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), wp));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), wp));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), wp));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), wp));
+    }
+    __m128i lo = _mm_packs_epi32(_mm_srai_epi32(a0, BITS), _mm_srai_epi32(a1, BITS));
+    __m128i hi = _mm_packs_epi32(_mm_srai_epi32(a2, BITS), _mm_srai_epi32(a3, BITS));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(FL_RESAMPLE_NEON)
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t a0 = vdupq_n_s32(HALF), a1 = a0;
+    for (int t = 0; t < taps; t++) {
+      int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(line[t] + i)));
+      a0 = vmlal_n_s16(a0, vget_low_s16(p), wt[t]);
+      a1 = vmlal_n_s16(a1, vget_high_s16(p), wt[t]);
+    }
+    int16x8_t r = vcombine_s16(vqshrn_n_s32(a0, BITS), vqshrn_n_s32(a1, BITS));
+    vst1_u8(out + i, vqmovun_s16(r));
+  }
+#endif
+  for (; i < n; i++) {
+    int acc = HALF;
+    for (int t = 0; t < taps; t++) acc += wt[t] * line[t][i];
+    out[i] = clamp(acc >> BITS);
+  }
+}
+
+////////////////////////////////////////////////////////////////
+// The resampler:
+
+struct Fl_Resampler {
+  const uchar *src;
+  int sw, sh, ld, d;
+  uchar *dst;
+  int dw, dh;
+  int nearest;
+  Fl_Resample_Axis x, y;        // the filters
+  int *xoff, *yoff;             // nearest: the source of each pixel and line
+  void lines(int y0, int y1) const;
+  void nearest_lines(int y0, int y1) const;
+  void filtered_lines(int y0, int y1) const;
+};
+
+template <int D> static void copy_nearest(const uchar *from, uchar *to, const int *xoff, int w) {
+  for (int i = 0; i < w; i++, to += D) memcpy(to, from + xoff[i], D);
+}
+
+void Fl_Resampler::nearest_lines(int y0, int y1) const {
+  for (int i = y0; i < y1; i++) {
+    const uchar *from = src + yoff[i];
+    uchar *to = dst + (size_t)i * dw * d;
+    switch (d) {
+      case 1: copy_nearest<1>(from, to, xoff, dw); break;
+      case 2: copy_nearest<2>(from, to, xoff, dw); break;
+      case 3: copy_nearest<3>(from, to, xoff, dw); break;
+      default: copy_nearest<4>(from, to, xoff, dw); break;
+    }
+  }
+}
+
+void Fl_Resampler::filtered_lines(int y0, int y1) const {
+  // filter the source lines that the output lines need horizontally...
+  int s0 = sh, s1 = 0, i;
+  for (i = y0; i < y1; i++) {
+    if (y.start[i] < s0) s0 = y.start[i];
+    if (y.start[i] + y.taps > s1) s1 = y.start[i] + y.taps;
+  }
+  int n = dw * d;
+  uchar *tmp = (uchar *)malloc((size_t)(s1 - s0) * n + (d > 1 ? sw * 4 : 0));
+  uchar *wide = tmp + (size_t)(s1 - s0) * n;
+  for (i = s0; i < s1; i++) {
+    const uchar *from = src + (size_t)i * ld;
+    uchar *to = tmp + (size_t)(i - s0) * n;
+    if (d == 1) {
+      filter1(from, to, dw, x);
+    } else {
+      expand(from, wide, sw, d);
+      filter4(wide, to, dw, d, x);
+    }
+  }
+  // ...then vertically
+  const uchar **line = (const uchar **)malloc(y.taps * sizeof(uchar *));
+  for (i = y0; i < y1; i++) {
+    for (int t = 0; t < y.taps; t++) line[t] = tmp + (size_t)(y.start[i] + t - s0) * n;
+    uchar *to = dst + (size_t)i * n;
+    filter_lines(line, y.weight + i * y.taps, y.taps, to, n);
+    if (d == 2 || d == 4) unpremultiply(to, dw, d);
+  }
+  free(line);
+  free(tmp);
+}
+
+void Fl_Resampler::lines(int y0, int y1) const {
+  if (nearest) nearest_lines(y0, y1);
+  else filtered_lines(y0, y1);
+}
+
+class Fl_Resample_Stripe : public Fl_Thread_Pool::Job {
+public:
+  const Fl_Resampler *r;
+  int y0, y1;
+  int finished;
+  Fl_Resample_Stripe() : r(0), y0(0), y1(0), finished(0) {}
+  void run() { r->lines(y0, y1); finished = 1; }
+};
+
+/**
+  Scales an image of d bytes per pixel, see Fl_Image_Resample.H.
+  */
+void fl_resample(const uchar *src, int sw, int sh, int ld, int d,
+                 uchar *dst, int dw, int dh, Fl_RGB_Scaling method) {
+  Fl_Resampler r;
+  r.src = src; r.sw = sw; r.sh = sh; r.ld = ld ? ld : sw * d; r.d = d;
+  r.dst = dst; r.dw = dw; r.dh = dh;
+  r.nearest = (method == FL_RGB_SCALING_NEAREST);
+  r.xoff = r.yoff = 0;
+  double work;
+  int i;
+  if (r.nearest) {
+    // the same pixels as the Bresenham steps FLTK used before
+    r.xoff = (int *)malloc(sizeof(int) * dw);
+    r.yoff = (int *)malloc(sizeof(int) * dh);
+    for (i = 0; i < dw; i++) r.xoff[i] = (int)((long long)i * sw / dw) * d;
+    for (i = 0; i < dh; i++) r.yoff[i] = (int)((long long)i * sh / dh) * r.ld;
+    work = (double)dw * dh * d / 4;
+  } else {
+    int fx = method == FL_RGB_SCALING_LANCZOS ? LANCZOS : sw >= 2 * dw ? BOX : TRIANGLE;
+    int fy = method == FL_RGB_SCALING_LANCZOS ? LANCZOS : sh >= 2 * dh ? BOX : TRIANGLE;
+    r.x.make(sw, dw, fx);
+    r.y.make(sh, dh, fy);
+    work = ((double)sh * r.x.taps + (double)dh * r.y.taps) * dw * d;
+  }
+
+  // cut the image into stripes for the worker threads
+  Fl_Thread_Pool *pool = work > STRIPE_WORK ? Fl_Thread_Pool::shared() : 0;
+  int stripes = pool ? pool->threads() + 1 : 1;
+  if (max_threads > 0 && stripes > max_threads) stripes = max_threads;
+  if (stripes > dh / STRIPE_LINES) stripes = dh / STRIPE_LINES;
+  if (stripes <= 1) {
+    r.lines(0, dh);
+  } else {
+    Fl_Resample_Stripe *job = new Fl_Resample_Stripe[stripes];
+    for (i = 0; i < stripes; i++) {
+      job[i].r = &r;
+      job[i].y0 = (int)((long long)dh * i / stripes);
+      job[i].y1 = (int)((long long)dh * (i + 1) / stripes);
+    }
+    for (i = 1; i < stripes; i++) pool->submit(job + i);
+    job[0].run();
+    // wait for the stripes that are running, and do those not yet started
+    for (i = 1; i < stripes; i++) {
+      pool->cancel(job + i);
+      if (!job[i].finished) job[i].run();
+    }
+    delete[] job;
+  }
+  free(r.xoff);
+  free(r.yoff);
+}
+
+int fl_resample_threads(int n) {
+  int old = max_threads;
+  max_threads = n;
+  return old;
+}
+
+const char *fl_resample_isa() {
+#if defined(FL_RESAMPLE_SSE2)
+  return "SSE2";
+#elif defined(FL_RESAMPLE_NEON)
+  return "NEON";
+#else
+  return "none";
+#endif
+}
+
+//
+// End of "$Id$".
+//
@@ -29,9 +29,11 @@
 #include <FL/Fl_Shared_Image.H>
 #include <FL/fl_utf8.h>
 #include <FL/Fl.H>
+#include "Fl_Image_Reduction.H"
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <setjmp.h>
 
 
@@ -134,6 +136,43 @@ Fl_JPEG_Image::Fl_JPEG_Image(const char *name, const unsigned char *data)
 }
 
 
+/**
+ \brief The constructor loads a JPEG image file at a reduced size.
+
+ Use this to show thumbnails of large photos: the image is decoded at
+ 1/2, 1/4 or 1/8 of its size, whichever is the smallest that is still at
+ least \p W x \p H pixels. libjpeg then computes fewer pixels, and the
+ image needs less memory. w() and h() return the reduced size, which the
+ image can be scaled down to \p W x \p H from with copy() or scale().
+ \p W or \p H can be 0 if only the other one matters, if both are 0
+ the image is decoded at its full size.
+
+ If \p cb is not NULL, the image array is allocated and cleared first,
+ and \p cb is called several times while the image is decoded, so that
+ a partial image can be shown. It is called for bands of lines of
+ baseline JPEG files. Progressive JPEG files are shown at a low quality
+ first, and \p cb is called for the whole image after the first scans
+ and then after twice as many scans as before each time, until the image
+ is complete. If the image fails to load, the callback may have been
+ called before.
+
+ \param[in] filename a full path and name pointing to a valid jpeg file.
+ \param[in] W, H the smallest size the image is needed at, or 0
+ \param[in] cb the function called while the image is decoded, or NULL
+ \param[in] data the user data passed to \p cb
+
+ \see Fl_JPEG_Image::Fl_JPEG_Image(const char *filename)
+ \see Fl_Image_Progress_Callback
+ \since 1.4.0
+ */
+Fl_JPEG_Image::Fl_JPEG_Image(const char *filename, int W, int H,
+                             Fl_Image_Progress_Callback cb, void *data)
+: Fl_RGB_Image(0,0,0)
+{
+  load_jpg_(filename, 0L, 0L, W, H, cb, data);
+}
+
+
 // data source manager for reading jpegs from memory
 // init_source (j_decompress_ptr cinfo)
 // fill_input_buffer (j_decompress_ptr cinfo)
@@ -202,6 +241,30 @@ static void jpeg_mem_src(j_decompress_ptr cinfo, const unsigned char *data)
   src->data = data;
   src->s = data;
 }
+
+
+// Reads all lines of an output pass into the image array, calls cb after
+// every band of lines if band is not 0.
+static void jpeg_read_lines(j_decompress_ptr dinfo, Fl_RGB_Image *img, int band,
+                            Fl_Image_Progress_Callback cb, void *cb_data)
+{
+  JSAMPROW rows[16];            // Sample row pointers
+  int ld = dinfo->output_width * dinfo->output_components;
+  int y0 = dinfo->output_scanline;
+  while (dinfo->output_scanline < dinfo->output_height) {
+    int y = dinfo->output_scanline;
+    int n = dinfo->output_height - y;
+    if (n > 16) n = 16;
+    for (int i = 0; i < n; i ++)
+      rows[i] = (JSAMPROW)(img->array + (y + i) * ld);
+    jpeg_read_scanlines(dinfo, rows, (JDIMENSION)n);
+    y = dinfo->output_scanline;
+    if (band && (y - y0 >= band || y == (int)dinfo->output_height)) {
+      cb(img, y0, y - y0, cb_data);
+      y0 = y;
+    }
+  }
+}
 #endif // HAVE_LIBJPEG
 
 
@@ -212,12 +275,23 @@ static void jpeg_mem_src(j_decompress_ptr cinfo, const unsigned char *data)
  supposed to be added to teh Fl_Shared_Image list.
  */
 void Fl_JPEG_Image::load_jpg_(const char *filename, const char *sharename, const unsigned char *data)
+{
+  load_jpg_(filename, sharename, data, 0, 0, 0, 0);
+}
+
+
+/*
+ This method reads JPEG image data like the one above, decoded at a
+ reduced size that is at least W x H pixels, and calls cb with cb_data
+ while it decodes if cb is not NULL.
+ */
+void Fl_JPEG_Image::load_jpg_(const char *filename, const char *sharename, const unsigned char *data,
+                              int W, int H, Fl_Image_Progress_Callback cb, void *cb_data)
 {
 #ifdef HAVE_LIBJPEG
   FILE                   *fp = 0L;  // File pointer
   jpeg_decompress_struct  dinfo;    // Decompressor info
   fl_jpeg_error_mgr       jerr;     // Error handler info
-  JSAMPROW                row;      // Sample row pointer
 
   // the following variables are pointers allocating some private space that
   // is not reset by 'setjmp()'
@@ -299,6 +373,10 @@ void Fl_JPEG_Image::load_jpg_(const char *filename, const char *sharename, const
   dinfo.out_color_components = 3;
   dinfo.output_components    = 3;
 
+  // Let libjpeg scale the image down while it computes the inverse DCT
+  dinfo.scale_num            = 1;
+  dinfo.scale_denom          = fl_image_reduction(dinfo.image_width, dinfo.image_height, W, H);
+
   jpeg_calc_output_dimensions(&dinfo);
 
   w(dinfo.output_width);
@@ -309,13 +387,34 @@ void Fl_JPEG_Image::load_jpg_(const char *filename, const char *sharename, const
   array = new uchar[w() * h() * d()];
   alloc_array = 1;
 
-  jpeg_start_decompress(&dinfo);
-
-  while (dinfo.output_scanline < dinfo.output_height) {
-    row = (JSAMPROW)(array +
-                     dinfo.output_scanline * dinfo.output_width *
-                     dinfo.output_components);
-    jpeg_read_scanlines(&dinfo, &row, (JDIMENSION)1);
+  if (!cb) {
+    jpeg_start_decompress(&dinfo);
+    jpeg_read_lines(&dinfo, this, 0, 0, 0);
+  } else if (!jpeg_has_multiple_scans(&dinfo)) {
+    memset((uchar *)array, 0, w() * h() * d());
+    jpeg_start_decompress(&dinfo);
+    int band = (h() + 15) / 16;
+    jpeg_read_lines(&dinfo, this, band < 8 ? 8 : band, cb, cb_data);
+  } else {
+    // Show a progressive JPEG after scans 1, 2, 4, 8... and when complete,
+    // each output pass computes the whole image from the scans read so far
+    memset((uchar *)array, 0, w() * h() * d());
+    dinfo.buffered_image = TRUE;
+    jpeg_start_decompress(&dinfo);
+    int scans = 1;
+    for (;;) {
+      int ret;
+      do {
+        ret = jpeg_consume_input(&dinfo);
+      } while (ret != JPEG_REACHED_EOI &&
+               !(ret == JPEG_SCAN_COMPLETED && dinfo.input_scan_number >= scans));
+      jpeg_start_output(&dinfo, dinfo.input_scan_number);
+      jpeg_read_lines(&dinfo, this, 0, 0, 0);
+      jpeg_finish_output(&dinfo);
+      cb(this, 0, h(), cb_data);
+      if (jpeg_input_complete(&dinfo)) break;
+      scans *= 2;
+    }
   }
 
   jpeg_finish_decompress(&dinfo);
@@ -31,12 +31,14 @@
 #include <config.h>
 #include <FL/Fl.H>
 #include "Fl_System_Driver.H"
+#include "Fl_Image_Reduction.H"
 #include <FL/Fl_PNG_Image.H>
 #include <FL/Fl_Shared_Image.H>
 #include <FL/fl_utf8.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
 extern "C"
@@ -71,6 +73,65 @@ extern "C" {
     png_mem_data->current += length;
   }
 } // extern "C"
+
+
+// The first row and column, the distance of the rows and columns, and
+// the size of the block each pixel fills until later passes refine it,
+// of the 7 passes of an Adam7 interlaced image
+static const int adam7_y0[7] = {0, 0, 4, 0, 2, 0, 1};
+static const int adam7_x0[7] = {0, 4, 0, 2, 0, 1, 0};
+static const int adam7_dy[7] = {8, 8, 8, 4, 4, 2, 2};
+static const int adam7_dx[7] = {8, 8, 4, 4, 2, 2, 1};
+static const int adam7_bh[7] = {8, 8, 4, 4, 2, 2, 1};
+static const int adam7_bw[7] = {8, 4, 4, 2, 2, 1, 1};
+
+
+// Adds a row of w pixels of d bytes to the sums of blocks of f pixels,
+// colors are multiplied with alpha if the image has an alpha channel.
+static void png_sum_row(const uchar *p, int w, int d, int f, unsigned *sum) {
+  for (int x = 0; x < w; x += f, sum += d) {
+    const uchar *e = p + (w - x < f ? w - x : f) * d;
+    unsigned s0 = 0, s1 = 0, s2 = 0, a = 0;
+    switch (d) {
+      case 1:
+        for (; p < e; p += 1) s0 += p[0];
+        sum[0] += s0;
+        break;
+      case 2:
+        for (; p < e; p += 2) { s0 += p[0] * p[1]; a += p[1]; }
+        sum[0] += s0; sum[1] += a;
+        break;
+      case 3:
+        for (; p < e; p += 3) { s0 += p[0]; s1 += p[1]; s2 += p[2]; }
+        sum[0] += s0; sum[1] += s1; sum[2] += s2;
+        break;
+      default:
+        for (; p < e; p += 4) {
+          unsigned pa = p[3];
+          s0 += p[0] * pa; s1 += p[1] * pa; s2 += p[2] * pa; a += pa;
+        }
+        sum[0] += s0; sum[1] += s1; sum[2] += s2; sum[3] += a;
+        break;
+    }
+  }
+}
+
+
+// Stores the averages of the sums of blocks of f x rows pixels in a row
+// of W pixels of d bytes of the image that is w pixels wide.
+static void png_average_row(const unsigned *sum, int w, int d, int f, int rows, uchar *p) {
+  int alpha = !(d & 1);
+  for (int x = 0; x < w; x += f, sum += d, p += d) {
+    unsigned n = (w - x < f ? w - x : f) * rows;
+    if (alpha) {
+      unsigned a = sum[d - 1];
+      for (int c = 0; c < d - 1; c ++) p[c] = a ? (uchar)((sum[c] + a / 2) / a) : 0;
+      p[d - 1] = (uchar)((a + n / 2) / n);
+    } else {
+      for (int c = 0; c < d; c ++) p[c] = (uchar)((sum[c] + n / 2) / n);
+    }
+  }
+}
 #endif // HAVE_LIBPNG && HAVE_LIBZ
 
 
@@ -112,14 +173,58 @@ Fl_PNG_Image::Fl_PNG_Image (
 }
 
 
-void Fl_PNG_Image::load_png_(const char *name_png, const unsigned char *buffer_png, int maxsize)
+/**
+ \brief The constructor loads a PNG image file at a reduced size.
+
+ Use this to show thumbnails of large images: the image is loaded at
+ 1/2, 1/4 or 1/8 of its size, whichever is the smallest that is still at
+ least \p W x \p H pixels. w() and h() return the reduced size, which
+ the image can be scaled down to \p W x \p H from with copy() or scale().
+ \p W or \p H can be 0 if only the other one matters, if both are 0 the
+ image is loaded at its full size.
+
+ The lines of the image are decoded one at a time and averaged into the
+ reduced image, so that only the reduced image is kept in memory. Of an
+ interlaced image, only the passes that contain the pixels of the reduced
+ image are decoded, e.g. only the first one at 1/8 of the size, and
+ these pixels are kept.
+
+ If \p cb is not NULL, the image array is allocated and cleared first,
+ and \p cb is called several times while the image is decoded, so that
+ a partial image can be shown: for bands of lines, or for the whole image
+ after each pass of an interlaced image, which fills the pixels that are
+ not decoded yet with the nearest decoded ones. If the image fails to
+ load, the callback may have been called before.
+
+ \param[in] filename Name of PNG file to read
+ \param[in] W, H the smallest size the image is needed at, or 0
+ \param[in] cb the function called while the image is decoded, or NULL
+ \param[in] data the user data passed to \p cb
+
+ \see Fl_PNG_Image::Fl_PNG_Image(const char *filename)
+ \see Fl_Image_Progress_Callback
+ \since 1.4.0
+ */
+Fl_PNG_Image::Fl_PNG_Image(const char *filename, int W, int H,
+                           Fl_Image_Progress_Callback cb, void *data)
+: Fl_RGB_Image(0,0,0)
+{
+  load_png_(filename, NULL, 0, W, H, cb, data);
+}
+
+
+void Fl_PNG_Image::load_png_(const char *name_png, const unsigned char *buffer_png, int maxsize,
+                             int W, int H, Fl_Image_Progress_Callback cb, void *cb_data)
 {
 #if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
   int i;		// Looping var
   int channels;		// Number of color channels
   png_structp pp;	// PNG read pointer
   png_infop info = 0;	// PNG info pointers
-  png_bytep *rows;	// PNG row pointers
+  // Buffers that are freed when an error longjmp()s back
+  png_bytep * volatile rows = 0;	// PNG row pointers
+  uchar * volatile line = 0;		// a decoded line of a reduced image
+  unsigned * volatile sum = 0;		// the sums of blocks of a reduced image
   fl_png_memory png_mem_data;
   int from_memory = (buffer_png != NULL); // true if reading image from memory
 
@@ -148,6 +253,9 @@ void Fl_PNG_Image::load_png_(const char *name_png, const unsigned char *buffer_p
   }
 
   if (setjmp(png_jmpbuf(pp))) {
+    delete[] rows;
+    delete[] line;
+    delete[] sum;
     png_destroy_read_struct(&pp, &info, NULL);
     if (!from_memory) fclose(fp);
     Fl::warning("PNG file or data \"%s\" is too large or contains errors!\n", display_name);
@@ -199,26 +307,128 @@ void Fl_PNG_Image::load_png_(const char *name_png, const unsigned char *buffer_p
     png_set_tRNS_to_alpha(pp);
 #  endif // HAVE_PNG_GET_VALID && HAVE_PNG_SET_TRNS_TO_ALPHA
 
+  int f = fl_image_reduction(w(), h(), W, H);
+  int pw = w(), ph = h();	// the size of the PNG image
+  int rw = (pw + f - 1) / f;	// the size of the image that is kept
+  int rh = (ph + f - 1) / f;
+  w(rw);
+  h(rh);
+
   if (((size_t)w()) * h() * d() > max_size() ) longjmp(png_jmpbuf(pp), 1);
   array = new uchar[w() * h() * d()];
   alloc_array = 1;
+  if (cb) memset((uchar *)array, 0, w() * h() * d());
 
-  // Allocate pointers...
-  rows = new png_bytep[h()];
-
-  for (i = 0; i < h(); i ++)
-    rows[i] = (png_bytep)(array + i * w() * d());
+  int ld = w() * d();
+  int band = 0;		// the lines between calls of cb
+  if (cb) {
+    band = (h() + 15) / 16;
+    if (band < 8) band = 8;
+  }
 
-  // Read the image, handling interlacing as needed...
-  for (i = png_set_interlace_handling(pp); i > 0; i --)
-    png_read_rows(pp, rows, NULL, h());
+  if (f == 1) {
+    // Allocate pointers...
+    rows = new png_bytep[h()];
+
+    for (i = 0; i < h(); i ++)
+      rows[i] = (png_bytep)(array + i * ld);
+
+    int passes = png_set_interlace_handling(pp);
+    if (!cb) {
+      // Read the image, handling interlacing as needed...
+      for (i = passes; i > 0; i --)
+        png_read_rows(pp, rows, NULL, h());
+      if (channels == 4) Fl::system_driver()->png_extra_rgba_processing((uchar*)array, w(), h());
+    } else if (passes > 1) {
+      // Let libpng fill the pixels of later passes with the decoded ones,
+      // which changes every line in every pass
+      for (i = passes; i > 0; i --) {
+        for (int y = 0; y < h(); y ++) {
+          png_read_rows(pp, NULL, rows + y, 1);
+          if (channels == 4) Fl::system_driver()->png_extra_rgba_processing(rows[y], w(), 1);
+        }
+        cb(this, 0, h(), cb_data);
+      }
+    } else {
+      for (int y = 0; y < h(); y += band) {
+        int n = h() - y < band ? h() - y : band;
+        png_read_rows(pp, rows + y, NULL, n);
+        if (channels == 4) Fl::system_driver()->png_extra_rgba_processing(rows[y], w(), n);
+        cb(this, y, n, cb_data);
+      }
+    }
 
-  if (channels == 4) Fl::system_driver()->png_extra_rgba_processing((uchar*)array, w(), h());
+    // Free memory and return...
+    delete[] rows;
+    rows = 0;
+
+    png_read_end(pp, info);
+  } else if (png_get_interlace_type(pp, info) == PNG_INTERLACE_NONE) {
+    // Average blocks of f x f pixels of the lines as they are decoded
+    png_read_update_info(pp, info);
+    line = new uchar[png_get_rowbytes(pp, info)];
+    sum = new unsigned[ld];
+    int y0 = 0;		// the first line since the last call of cb
+    for (int py = 0, y = 0; py < ph; y ++) {
+      memset(sum, 0, ld * sizeof(unsigned));
+      int n;
+      for (n = 0; n < f && py < ph; n ++, py ++) {
+        png_read_row(pp, line, NULL);
+        png_sum_row(line, pw, d(), f, sum);
+      }
+      uchar *p = (uchar *)array + y * ld;
+      png_average_row(sum, pw, d(), f, n, p);
+      if (channels == 4) Fl::system_driver()->png_extra_rgba_processing(p, w(), 1);
+      if (cb && (y + 1 - y0 >= band || y + 1 == h())) {
+        cb(this, y0, y + 1 - y0, cb_data);
+        y0 = y + 1;
+      }
+    }
+    delete[] line;
+    line = 0;
+    delete[] sum;
+    sum = 0;
 
-  // Free memory and return...
-  delete[] rows;
+    png_read_end(pp, info);
+  } else {
+    // Read the passes of the interlaced image one after another, as long
+    // as they have pixels of the reduced image, i.e. in every f-th row and
+    // column, and let every pixel fill its block until a later pass
+    png_read_update_info(pp, info);
+    line = new uchar[png_get_rowbytes(pp, info)];
+    int npasses = f == 8 ? 1 : (f == 4 ? 3 : 5);
+    for (int pass = 0; pass < npasses; pass ++) {
+      int x0 = adam7_x0[pass], dx = adam7_dx[pass];
+      int y0 = adam7_y0[pass], dy = adam7_dy[pass];
+      if (pw <= x0 || ph <= y0) continue;	// libpng skips empty passes
+      int cols = (pw - x0 + dx - 1) / dx;
+      int bw = adam7_bw[pass] / f, bh = adam7_bh[pass] / f;
+      if (bw < 1) bw = 1;
+      if (bh < 1) bh = 1;
+      for (int py = y0; py < ph; py += dy) {
+        png_read_row(pp, line, NULL);
+        if (py % f) continue;
+        // every decoded pixel is processed once, before it fills its block
+        if (channels == 4) Fl::system_driver()->png_extra_rgba_processing(line, cols, 1);
+        int y = py / f;
+        int n = h() - y < bh ? h() - y : bh;
+        for (int c = 0, px = x0; c < cols; c ++, px += dx) {
+          if (px % f) continue;
+          int x = px / f;
+          int m = w() - x < bw ? w() - x : bw;
+          uchar *p = (uchar *)array + y * ld + x * d();
+          for (int k = 0; k < n; k ++)
+            for (int j = 0; j < m; j ++)
+              memcpy(p + k * ld + j * d(), line + c * d(), d());
+        }
+      }
+      if (cb) cb(this, 0, h(), cb_data);
+    }
+    delete[] line;
+    line = 0;
+    // the remaining passes are not needed, png_read_end() would read them
+  }
 
-  png_read_end(pp, info);
   png_destroy_read_struct(&pp, &info, NULL);
 
   if (from_memory) {
@@ -0,0 +1,431 @@
+//
+// "$Id$"
+//
+// Event loop profiler for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl_Profiler.H>
+#include <FL/Fl.H>
+#include <FL/Fl_Widget.H>
+#include "Fl_System_Driver.H"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flstring.h"
+
+char Fl_Profiler::enabled_ = 0;
+int Fl_Profiler::trace_size_ = 100000;
+
+/*
+ The histograms count times in nanoseconds like HdrHistogram: times below
+ LINEAR have a bucket each, larger times share SUB_BUCKETS buckets per
+ power of 2, which keeps them exact to about 3%. Times of more than 2^41 ns
+ (about 36 minutes) go to the last bucket.
+ */
+static const int SUB_BUCKETS = 32;
+static const int LINEAR = 2 * SUB_BUCKETS;
+static const int MAX_EXPONENT = 40;
+static const int BUCKETS = LINEAR + (MAX_EXPONENT - 5) * SUB_BUCKETS;
+
+struct Histogram {
+  unsigned long counts[BUCKETS];
+  unsigned long n;
+  double total, total2, max;    // in seconds
+};
+
+// the draw() and handle() times of a widget
+struct Widget_Stats {
+  const Fl_Widget *widget;      // NULL after the widget was deleted
+  char *name;
+  int next;                     // in the hash chain
+  unsigned long count[2];       // HANDLE, DRAW
+  double total[2], max[2];
+};
+
+struct Trace_Event {
+  double start, duration;
+  int widget;                   // index in stats, or -1
+  int phase;
+};
+
+static Histogram *histograms;   // PHASES of them
+static double epoch = -1;       // the time of the first enable()
+
+/*
+ The times of at most MAX_STATS widgets are kept, in the order in which
+ they were first measured. Deleted widgets keep their times, so the times
+ of widgets beyond that, e.g. of a program that keeps creating and deleting
+ them, are summed up in one entry.
+ */
+static const int MAX_STATS = 4096;
+
+static Widget_Stats *stats;
+static int nstats, stats_alloc;
+static int *stats_hash, hash_size;
+static int other_stats = -1;    // the entry of all other widgets
+static double reset_time = -1;  // phases that started before were reset
+
+static Trace_Event *trace;
+static unsigned long trace_count;       // all events, the last trace_size_ are kept
+
+static const char *phase_names[Fl_Profiler::PHASES] = {
+  "wait", "event", "handle", "flush", "draw",
+  "timeout", "check", "idle", "fd", "awake"
+};
+
+
+static int bucket_of(double seconds) {
+  double ns = seconds * 1e9;
+  if (ns < LINEAR) return ns > 0 ? (int)ns : 0;
+  if (ns >= 2199023255552.0) return BUCKETS - 1;       // 2^41
+  unsigned long long v = (unsigned long long)ns;
+  int e = 6;
+  while (v >> (e + 1)) e++;
+  return LINEAR + (e - 6) * SUB_BUCKETS + (int)((v >> (e - 5)) & (SUB_BUCKETS - 1));
+}
+
+// the largest time, in seconds, that goes to bucket i
+static double bucket_value(int i) {
+  if (i < LINEAR) return i * 1e-9;
+  int e = 6 + (i - LINEAR) / SUB_BUCKETS, sub = (i - LINEAR) % SUB_BUCKETS;
+  return (((unsigned long long)(SUB_BUCKETS + sub + 1) << (e - 5)) - 1) * 1e-9;
+}
+
+
+static unsigned hash(const Fl_Widget *w) {
+  unsigned long long p = (unsigned long long)(size_t)w;
+  return (unsigned)((p >> 4) ^ (p >> 16)) & (hash_size - 1);
+}
+
+static int find_stats(const Fl_Widget *w) {
+  if (!hash_size) return -1;
+  for (int i = stats_hash[hash(w)]; i >= 0; i = stats[i].next)
+    if (stats[i].widget == w) return i;
+  return -1;
+}
+
+// the widget's label is copied, it may be gone when the trace is written
+static char *widget_name(const Fl_Widget *w) {
+  char buf[64];
+  const char *l = w->label();
+  if (l && *l)
+    snprintf(buf, sizeof(buf), "%.40s", l);
+  else
+    snprintf(buf, sizeof(buf), "%p", (const void *)w);
+  return strdup(buf);
+}
+
+static void rehash() {
+  for (int i = 0; i < hash_size; i++) stats_hash[i] = -1;
+  for (int i = 0; i < nstats; i++) {
+    if (!stats[i].widget) continue;
+    unsigned h = hash(stats[i].widget);
+    stats[i].next = stats_hash[h];
+    stats_hash[h] = i;
+  }
+}
+
+static int add_stats(const Fl_Widget *w) {
+  if (w && nstats >= MAX_STATS - 1) {
+    if (other_stats < 0) {
+      other_stats = add_stats(0);
+      stats[other_stats].name = strdup("(other widgets)");
+    }
+    return other_stats;
+  }
+  if (nstats >= stats_alloc) {
+    stats_alloc = stats_alloc ? 2 * stats_alloc : 256;
+    stats = (Widget_Stats *)realloc(stats, stats_alloc * sizeof(Widget_Stats));
+  }
+  if (nstats >= hash_size) {
+    hash_size = hash_size ? 2 * hash_size : 256;
+    stats_hash = (int *)realloc(stats_hash, hash_size * sizeof(int));
+    rehash();
+  }
+  Widget_Stats &s = stats[nstats];
+  memset(&s, 0, sizeof(s));
+  s.next = -1;
+  if (!w) return nstats++;
+  s.widget = w;
+  s.name = widget_name(w);
+  unsigned h = hash(w);
+  s.next = stats_hash[h];
+  stats_hash[h] = nstats;
+  return nstats++;
+}
+
+
+/**
+ Starts or stops measuring the event loop.
+
+ The measured times are kept when the profiler is stopped, and are added
+ to when it is started again, until reset() is called.
+ */
+void Fl_Profiler::enable(int on) {
+  if (on && !histograms) {
+    histograms = (Histogram *)calloc(PHASES, sizeof(Histogram));
+    if (trace_size_ > 0)
+      trace = (Trace_Event *)malloc(trace_size_ * sizeof(Trace_Event));
+  }
+  if (on && epoch < 0)
+    epoch = Fl::system_driver()->monotonic_time();
+  enabled_ = on ? 1 : 0;
+}
+
+/**
+ Forgets all measured times. The phases that are running are not measured.
+ */
+void Fl_Profiler::reset() {
+  if (histograms) memset(histograms, 0, PHASES * sizeof(Histogram));
+  for (int i = 0; i < nstats; i++) free(stats[i].name);
+  nstats = 0;
+  other_stats = -1;
+  reset_time = Fl::system_driver()->monotonic_time();
+  if (hash_size) rehash();
+  trace_count = 0;
+}
+
+/**
+ Sets how many phases the trace keeps. When more are measured, the trace
+ drops the oldest ones. The default is 100000, 0 turns off the trace.
+
+ This forgets the trace.
+ */
+void Fl_Profiler::trace_size(int events) {
+  if (events < 0) events = 0;
+  trace_size_ = events;
+  trace_count = 0;
+  if (!histograms) return;      // allocated by enable()
+  free(trace);
+  trace = events ? (Trace_Event *)malloc(events * sizeof(Trace_Event)) : 0;
+}
+
+/** Returns the name of a phase in the output, e.g. "flush", or NULL. */
+const char *Fl_Profiler::name(Phase phase) {
+  return phase >= 0 && phase < PHASES ? phase_names[phase] : 0;
+}
+
+/** Returns how often a phase was measured. */
+unsigned long Fl_Profiler::count(Phase phase) {
+  return histograms && name(phase) ? histograms[phase].n : 0;
+}
+
+/** Returns the time that all measured phases of a kind took, in seconds. */
+double Fl_Profiler::total(Phase phase) {
+  return histograms && name(phase) ? histograms[phase].total : 0;
+}
+
+/** Returns the longest time a phase took, in seconds. */
+double Fl_Profiler::longest(Phase phase) {
+  return histograms && name(phase) ? histograms[phase].max : 0;
+}
+
+/**
+ Returns the time, in seconds, that the given percentage of the measured
+ phases of a kind took at most, e.g. 99 for the 99th percentile. The time
+ is exact to about 3%.
+ */
+double Fl_Profiler::percentile(Phase phase, double percent) {
+  if (!count(phase)) return 0;
+  const Histogram &h = histograms[phase];
+  double want = ceil(percent / 100 * h.n);
+  if (want < 1) want = 1;
+  unsigned long sum = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    sum += h.counts[i];
+    if (sum >= want) {
+      double v = bucket_value(i);
+      return v < h.max ? v : h.max;
+    }
+  }
+  return h.max;
+}
+
+/**
+ Returns how often the draw() or handle() method of a widget was called,
+ and in \p total and \p longest the sum and the longest of their times, in
+ seconds. The times of a widget include those of its children.
+
+ \param[in] w the widget
+ \param[in] phase Fl_Profiler::DRAW or Fl_Profiler::HANDLE
+ \param[out] total, longest the times, or 0 if there are none
+ */
+unsigned long Fl_Profiler::widget_stats(const Fl_Widget *w, Phase phase,
+                                        double &total, double &longest) {
+  total = longest = 0;
+  int i = w ? find_stats(w) : -1;
+  if (i < 0 || (phase != HANDLE && phase != DRAW)) return 0;
+  int k = phase == DRAW;
+  total = stats[i].total[k];
+  longest = stats[i].max[k];
+  return stats[i].count[k];
+}
+
+/*
+ Stops taking times of a deleted widget. Its times stay in the output.
+ */
+void Fl_Profiler::forget(const Fl_Widget *w) {
+  int i = find_stats(w);
+  if (i < 0) return;
+  int *p = &stats_hash[hash(w)];
+  while (*p != i) p = &stats[*p].next;
+  *p = stats[i].next;
+  stats[i].widget = 0;
+}
+
+/*
+ Finds the times of the widget when the phase starts, while the widget
+ exists: draw() and handle() may delete it.
+ */
+double Fl_Profiler::begin(Phase phase, const Fl_Widget *w, int &s) {
+  s = -1;
+  if (w && (phase == HANDLE || phase == DRAW)) {
+    s = find_stats(w);
+    if (s < 0) s = add_stats(w);
+  }
+  return Fl::system_driver()->monotonic_time();
+}
+
+void Fl_Profiler::end(Phase phase, int s, double start) {
+  if (!enabled_ || start <= reset_time) return;
+  double d = Fl::system_driver()->monotonic_time() - start;
+  if (d < 0) d = 0;
+  Histogram &h = histograms[phase];
+  h.counts[bucket_of(d)]++;
+  h.n++;
+  h.total += d;
+  h.total2 += d * d;
+  if (d > h.max) h.max = d;
+  if (s >= 0) {
+    int k = phase == DRAW;
+    stats[s].count[k]++;
+    stats[s].total[k] += d;
+    if (d > stats[s].max[k]) stats[s].max[k] = d;
+  }
+  if (trace) {
+    Trace_Event &e = trace[trace_count % trace_size_];
+    e.start = start;
+    e.duration = d;
+    e.widget = s;
+    e.phase = phase;
+    trace_count++;
+  }
+}
+
+
+static int compare_stats(const void *a, const void *b) {
+  const Widget_Stats &s = stats[*(const int *)a], &t = stats[*(const int *)b];
+  double d = (t.total[0] + t.total[1]) - (s.total[0] + s.total[1]);
+  return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+/**
+ Writes the histograms of the phases in the percentile distribution format
+ of HdrHistogram, with times in milliseconds, followed by a table of the
+ widgets that took the most time in draw() and handle().
+
+ Every histogram starts with a line "# Phase: <name>". Phases that were not
+ measured are left out.
+
+ \return 0, or -1 if writing failed
+ */
+int Fl_Profiler::write_histograms(FILE *f) {
+  for (int p = 0; p < PHASES; p++) {
+    if (!count((Phase)p)) continue;
+    const Histogram &h = histograms[p];
+    fprintf(f, "# Phase: %s\n", phase_names[p]);
+    fprintf(f, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+            "1/(1-Percentile)");
+    unsigned long sum = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+      if (!h.counts[i]) continue;
+      sum += h.counts[i];
+      double v = bucket_value(i), q = (double)sum / h.n;
+      if (v > h.max) v = h.max;
+      if (sum < h.n)
+        fprintf(f, "%12.3f %2.12f %10lu %14.2f\n", v * 1e3, q, sum, 1 / (1 - q));
+      else
+        fprintf(f, "%12.3f %2.12f %10lu\n", v * 1e3, q, sum);
+    }
+    double mean = h.total / h.n, var = h.total2 / h.n - mean * mean;
+    fprintf(f, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+            mean * 1e3, var > 0 ? sqrt(var) * 1e3 : 0.0);
+    fprintf(f, "#[Max     = %12.3f, Total count    = %12lu]\n", h.max * 1e3, h.n);
+    fprintf(f, "#[Buckets = %12d, SubBuckets     = %12d]\n\n",
+            MAX_EXPONENT - 5, SUB_BUCKETS);
+  }
+  if (nstats) {
+    int *order = (int *)malloc(nstats * sizeof(int));
+    for (int i = 0; i < nstats; i++) order[i] = i;
+    qsort(order, nstats, sizeof(int), compare_stats);
+    fputs("# Widgets: times in milliseconds, including the children\n", f);
+    fprintf(f, "#%-40s %8s %10s %8s %8s %10s %8s\n", " widget",
+            "handles", "total", "max", "draws", "total", "max");
+    for (int i = 0; i < nstats && i < 50; i++) {
+      const Widget_Stats &s = stats[order[i]];
+      fprintf(f, " %-40s %8lu %10.3f %8.3f %8lu %10.3f %8.3f\n", s.name,
+              s.count[0], s.total[0] * 1e3, s.max[0] * 1e3,
+              s.count[1], s.total[1] * 1e3, s.max[1] * 1e3);
+    }
+    free(order);
+  }
+  return ferror(f) ? -1 : 0;
+}
+
+static void write_json_string(FILE *f, const char *s) {
+  putc('"', f);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+    else if (c < 0x20) fprintf(f, "\\u%04x", c);
+    else putc(c, f);
+  }
+  putc('"', f);
+}
+
+/**
+ Writes the last trace_size() measured phases in the Chrome trace event
+ format. The phases of widgets are named after the label of the widget,
+ or its address if it has none.
+
+ \return 0, or -1 if writing failed
+ */
+int Fl_Profiler::write_trace(FILE *f) {
+  fputs("{\"traceEvents\":[", f);
+  if (trace) {
+    unsigned long first = trace_count > (unsigned long)trace_size_ ?
+                          trace_count - trace_size_ : 0;
+    for (unsigned long n = first; n < trace_count; n++) {
+      const Trace_Event &e = trace[n % trace_size_];
+      fputs(n > first ? ",\n" : "\n", f);
+      fputs("{\"name\":", f);
+      if (e.widget >= 0) {
+        char name[80];
+        snprintf(name, sizeof(name), "%s %s", phase_names[e.phase], stats[e.widget].name);
+        write_json_string(f, name);
+      } else {
+        write_json_string(f, phase_names[e.phase]);
+      }
+      fprintf(f, ",\"cat\":\"fltk\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+              "\"ts\":%.3f,\"dur\":%.3f}", (e.start - epoch) * 1e6, e.duration * 1e6);
+    }
+  }
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+  return ferror(f) ? -1 : 0;
+}
+
+//
+// End of "$Id$".
+//
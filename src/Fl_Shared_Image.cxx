@@ -27,6 +27,8 @@
 #include <FL/Fl_XPM_Image.H>
 #include <FL/Fl_Preferences.H>
 #include <FL/fl_draw.H>
+#include "Fl_System_Driver.H"
+#include "Fl_Thread_Pool.H"
 
 //
 // Global class vars...
@@ -40,13 +42,70 @@ Fl_Shared_Handler *Fl_Shared_Image::handlers_ = 0;// Additional format handlers
 int	Fl_Shared_Image::num_handlers_ = 0;	// Number of format handlers
 int	Fl_Shared_Image::alloc_handlers_ = 0;	// Allocated format handlers
 
+// The cache is a hash table of the images by name, with linear probing.
+// Images of the same name with other sizes are found by probing further.
+static Fl_Shared_Image **hash_table = 0;	// hash_size slots
+static int	hash_size = 0;			// a power of 2
+static int	hash_count = 0;			// images in the table
 
-//
-// Typedef the C API sort function type the only way I know how...
-//
+// Released images are kept while their pixels fit in the budget
+static size_t	cache_budget_ = 0;		// 0 = delete released images
+static size_t	unused_bytes = 0;		// pixels of released images
+static Fl_Shared_Image *lru_first = 0, *lru_last = 0;
+static unsigned long cache_hits_ = 0, cache_misses_ = 0, cache_evictions_ = 0;
+
+
+static unsigned hash_name(const char *name) {
+  unsigned h = 2166136261U;	// FNV-1a
+  while (*name) {
+    h ^= (uchar)*name++;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static void hash_insert(Fl_Shared_Image *img) {
+  if (2 * (hash_count + 1) > hash_size) {
+    Fl_Shared_Image **old = hash_table;
+    int old_size = hash_size;
+    hash_size = hash_size ? 2 * hash_size : 64;
+    hash_table = (Fl_Shared_Image **)calloc(hash_size, sizeof(Fl_Shared_Image *));
+    hash_count = 0;
+    for (int i = 0; i < old_size; i++)
+      if (old[i]) hash_insert(old[i]);
+    free(old);
+  }
+  unsigned mask = hash_size - 1, i = hash_name(img->name()) & mask;
+  while (hash_table[i]) i = (i + 1) & mask;
+  hash_table[i] = img;
+  hash_count++;
+}
+
+// returns the slot of img, or -1 if it is not in the cache
+static int hash_find(Fl_Shared_Image *img) {
+  if (!hash_size) return -1;
+  unsigned mask = hash_size - 1;
+  for (unsigned i = hash_name(img->name()) & mask; hash_table[i]; i = (i + 1) & mask)
+    if (hash_table[i] == img) return (int)i;
+  return -1;
+}
 
-extern "C" {
-  typedef int (*compare_func_t)(const void *, const void *);
+static void hash_remove(Fl_Shared_Image *img) {
+  int slot = hash_find(img);
+  if (slot < 0) return;
+  unsigned mask = hash_size - 1, i = (unsigned)slot, j = i;
+  hash_table[i] = 0;
+  hash_count--;
+  // move the images behind it that would no longer be found
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!hash_table[j]) break;
+    unsigned k = hash_name(hash_table[j]->name()) & mask;
+    if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+    hash_table[i] = hash_table[j];
+    hash_table[j] = 0;
+    i = j;
+  }
 }
 
 
@@ -78,11 +137,10 @@ int Fl_Shared_Image::num_images() {
   An image is marked \p original if it was directly loaded from a file or
   from memory as opposed to copied and resized images.
 
-  This comparison is used in Fl_Shared_Image::find() to find an image that
-  matches the requested one or to find the position where a new image
-  should be entered into the sorted list of shared images.
+  Fl_Shared_Image::find() finds images with the same rules, by their
+  name in a hash table.
 
-  It is usually used in two steps:
+  Images are usually looked up in two steps:
 
     -# search with exact width and height
     -# if not found, search again with width = 0 (and height = 0)
@@ -123,6 +181,9 @@ Fl_Shared_Image::Fl_Shared_Image() : Fl_Image(0,0,0) {
   original_    = 0;
   image_       = 0;
   alloc_image_ = 0;
+  reloadable_  = 0;
+  lru_prev_    = 0;
+  lru_next_    = 0;
 }
 
 
@@ -143,6 +204,9 @@ Fl_Shared_Image::Fl_Shared_Image(const char *n,		// I - Filename
   image_       = img;
   alloc_image_ = !img;
   original_    = 1;
+  reloadable_  = !img;
+  lru_prev_    = 0;
+  lru_next_    = 0;
 
   if (!img) reload();
   else update();
@@ -152,7 +216,7 @@ Fl_Shared_Image::Fl_Shared_Image(const char *n,		// I - Filename
 /**
   Adds a shared image to the image cache.
 
-  This \b protected method adds an image to the cache, an ordered list
+  This \b protected method adds an image to the cache, a hash table
   of shared images. The cache is searched for a matching image whenever
   one is requested, for instance with Fl_Shared_Image::get() or
   Fl_Shared_Image::find().
@@ -163,7 +227,7 @@ Fl_Shared_Image::add() {
 
   if (num_images_ >= alloc_images_) {
     // Allocate more memory...
-    temp = new Fl_Shared_Image *[alloc_images_ + 32];
+    temp = new Fl_Shared_Image *[alloc_images_ ? 2 * alloc_images_ : 32];
 
     if (alloc_images_) {
       memcpy(temp, images_, alloc_images_ * sizeof(Fl_Shared_Image *));
@@ -172,16 +236,13 @@ Fl_Shared_Image::add() {
     }
 
     images_       = temp;
-    alloc_images_ += 32;
+    alloc_images_ = alloc_images_ ? 2 * alloc_images_ : 32;
   }
 
   images_[num_images_] = this;
   num_images_ ++;
 
-  if (num_images_ > 1) {
-    qsort(images_, num_images_, sizeof(Fl_Shared_Image *),
-          (compare_func_t)compare);
-  }
+  hash_insert(this);
 }
 
 
@@ -224,6 +285,20 @@ void Fl_Shared_Image::release() {
   refcount_ --;
   if (refcount_ > 0) return;
 
+  if (cache_budget_ && reloadable_ && image_ && hash_find(this) >= 0) {
+    // keep the image in the cache, as the most recently used one
+    lru_prev_ = lru_last;
+    lru_next_ = 0;
+    if (lru_last) lru_last->lru_next_ = this;
+    else lru_first = this;
+    lru_last = this;
+    unused_bytes += bytes();
+    trim_cache();
+    return;
+  }
+
+  hash_remove(this);
+
   for (i = 0; i < num_images_; i ++)
     if (images_[i] == this) {
       num_images_ --;
@@ -247,37 +322,150 @@ void Fl_Shared_Image::release() {
 }
 
 
-/** Reloads the shared image from disk. */
-void Fl_Shared_Image::reload() {
-  // Load image from disk...
+/*
+  Returns roughly how much memory the pixels of the image take.
+*/
+size_t Fl_Shared_Image::bytes() const {
+  if (!image_) return 0;
+  size_t n = (size_t)image_->w() * image_->h();
+  if (image_->d() > 0) return n * image_->d();
+  if (image_->d() == 0) return n / 8;	// bitmap
+  return n;				// pixmap, one character per pixel
+}
+
+
+/*
+  Takes a released image from the list of released images.
+*/
+void Fl_Shared_Image::lru_remove() {
+  if (lru_prev_) lru_prev_->lru_next_ = lru_next_;
+  else lru_first = lru_next_;
+  if (lru_next_) lru_next_->lru_prev_ = lru_prev_;
+  else lru_last = lru_prev_;
+  lru_prev_ = lru_next_ = 0;
+  unused_bytes -= bytes();
+}
+
+
+/*
+  Frees the pixels of a released image, but keeps it in the cache with
+  its name and size, so that it is loaded again when it is used.
+*/
+void Fl_Shared_Image::evict() {
+  lru_remove();
+  if (alloc_image_) delete image_;
+  image_       = 0;
+  alloc_image_ = 0;
+  data(0, 0);
+  cache_evictions_ ++;
+}
+
+
+/*
+  Evicts the least recently used released images until the others fit
+  in the cache budget.
+*/
+void Fl_Shared_Image::trim_cache() {
+  while (unused_bytes > cache_budget_ && lru_first)
+    lru_first->evict();
+}
+
+
+/*
+  Finds an image in the cache like find(), without using it.
+*/
+Fl_Shared_Image *Fl_Shared_Image::lookup(const char *name, int W, int H) {
+  if (!hash_size) return 0;
+  unsigned mask = hash_size - 1;
+  for (unsigned i = hash_name(name) & mask; hash_table[i]; i = (i + 1) & mask) {
+    Fl_Shared_Image *img = hash_table[i];
+    if (strcmp(img->name_, name)) continue;
+    if ((W == 0 && img->original_) || (img->w() == W && img->h() == H))
+      return img;
+  }
+  return 0;
+}
+
+
+/*
+  Increases the refcount of an image of the cache. A released image is
+  taken from the list of released images, and its pixels are made again
+  if they were evicted, from the original image if it is in memory, or
+  else from the file. Returns NULL and removes the image from the cache
+  if that fails.
+*/
+Fl_Shared_Image *Fl_Shared_Image::use() {
+  if (refcount_ == 0 && image_) {
+    lru_remove();
+  } else if (refcount_ == 0) {
+    Fl_Shared_Image *o = original_ ? 0 : lookup(name_, 0, 0);
+    refcount_ ++;
+    if (o && o->image_) {
+      image_       = o->image_->copy(w(), h());
+      alloc_image_ = 1;
+      update();
+      cache_hits_ ++;
+    } else {
+      reload();
+      cache_misses_ ++;
+      if (!image_) {
+        release();
+        return 0;
+      }
+    }
+    return this;
+  }
+  cache_hits_ ++;
+  refcount_ ++;
+  return this;
+}
+
+
+/*
+  Loads an image file, or returns NULL if it cannot be loaded. This does
+  not use the image cache, so that get_async() can call it in other
+  threads.
+*/
+Fl_Image *Fl_Shared_Image::load(const char *name) {
   int		i;		// Looping var
   FILE		*fp;		// File pointer
   uchar		header[64];	// Buffer for auto-detecting files
   Fl_Image	*img;		// New image
 
-  if (!name_) return;
-
-  if ((fp = fl_fopen(name_, "rb")) != NULL) {
+  if ((fp = fl_fopen(name, "rb")) != NULL) {
     if (fread(header, 1, sizeof(header), fp)==0) { /* ignore */ }
     fclose(fp);
   } else {
-    return;
+    return 0;
   }
 
   // Load the image as appropriate...
   if (memcmp(header, "#define", 7) == 0) // XBM file
-    img = new Fl_XBM_Image(name_);
+    img = new Fl_XBM_Image(name);
   else if (memcmp(header, "/* XPM */", 9) == 0) // XPM file
-    img = new Fl_XPM_Image(name_);
+    img = new Fl_XPM_Image(name);
   else {
     // Not a standard format; try an image handler...
     for (i = 0, img = 0; i < num_handlers_; i ++) {
-      img = (handlers_[i])(name_, header, sizeof(header));
+      img = (handlers_[i])(name, header, sizeof(header));
 
       if (img) break;
     }
   }
 
+  return img;
+}
+
+
+/** Reloads the shared image from disk. */
+void Fl_Shared_Image::reload() {
+  // Load image from disk...
+  Fl_Image	*img;		// New image
+
+  if (!name_) return;
+
+  img = load(name_);
+
   if (img) {
     if (alloc_image_) delete image_;
 
@@ -321,6 +509,7 @@ Fl_Shared_Image::copy(int W, int H) {
   temp_shared->refcount_    = 1;
   temp_shared->image_       = temp_image;
   temp_shared->alloc_image_ = 1;
+  temp_shared->reloadable_  = reloadable_;
 
   temp_shared->update();
 
@@ -385,7 +574,7 @@ void Fl_Shared_Image::uncache()
 
 /** Finds a shared image from its name and size specifications.
 
-  This uses a binary search in the image cache.
+  This looks the image up in a hash table of the image cache.
 
   If the image \p name exists with the exact width \p W and height \p H,
   then it is returned.
@@ -396,31 +585,14 @@ void Fl_Shared_Image::uncache()
   In either case the refcount of the returned image is increased.
   The found image should be released with Fl_Shared_Image::release()
   when no longer needed.
+
+  If the image was released and its pixels were evicted from the cache
+  (see cache_budget()), they are loaded again.
 */
 Fl_Shared_Image* Fl_Shared_Image::find(const char *name, int W, int H) {
-  Fl_Shared_Image	*key,		// Image key
-			**match;	// Matching image
-
-  if (num_images_) {
-    key = new Fl_Shared_Image();
-    key->name_ = new char[strlen(name) + 1];
-    strcpy((char *)key->name_, name);
-    key->w(W);
-    key->h(H);
-
-    match = (Fl_Shared_Image **)bsearch(&key, images_, num_images_,
-                                        sizeof(Fl_Shared_Image *),
-                                        (compare_func_t)compare);
+  Fl_Shared_Image	*match = lookup(name, W, H);	// Matching image
 
-    delete key;
-
-    if (match) {
-      (*match)->refcount_ ++;
-      return *match;
-    }
-  }
-
-  return 0;
+  return match ? match->use() : 0;
 }
 
 
@@ -466,6 +638,7 @@ Fl_Shared_Image* Fl_Shared_Image::get(const char *name, int W, int H) {
 
   if ((temp = find(name)) == NULL) {
     temp = new Fl_Shared_Image(name);
+    cache_misses_ ++;
 
     if (!temp->image_) {
       delete temp;
@@ -476,8 +649,11 @@ Fl_Shared_Image* Fl_Shared_Image::get(const char *name, int W, int H) {
   }
 
   if ((temp->w() != W || temp->h() != H) && W && H) {
+    Fl_Shared_Image *original = temp;
     temp = (Fl_Shared_Image *)temp->copy(W, H);
     temp->add();
+    // with a cache budget, the original is released and may be evicted
+    if (cache_budget_) original->release();
   }
 
   return temp;
@@ -500,6 +676,351 @@ Fl_Shared_Image *Fl_Shared_Image::get(Fl_RGB_Image *rgb, int own_it)
 }
 
 
+////////////////////////////////////////////////////////////////
+// Loading images in the background...
+
+// a call of get_async() that waits for its image
+struct Fl_Shared_Image_Request {
+  int W, H;
+  Fl_Shared_Image_Callback cb;
+  void *data;
+  Fl_Widget *widget;            // watched, NULL after it was deleted
+  int has_widget;
+  Fl_Shared_Image *image;       // the result, with a reference
+  Fl_Shared_Image_Request *next;
+};
+
+/*
+  Loads an image file for all requests of get_async() with its name, in a
+  thread of Fl_Thread_Pool. At most one job per worker thread is loading,
+  the others are queued here, so that a directory full of images does not
+  hold up other jobs of the pool, and requests whose widget is deleted
+  in the meantime cost nothing.
+*/
+class Fl_Shared_Image::Async_Job : public Fl_Thread_Pool::Job {
+public:
+  enum { QUEUED, LOADING, DONE };
+
+  char *name;
+  Fl_Image *image;
+  Fl_Shared_Image_Request *requests;
+  Async_Job *next;
+  int state;
+  int threaded;                 // run() is called by a worker thread
+
+  static Async_Job *first;      // all jobs, in the order of the requests
+  static int loading;           // the number of jobs in state LOADING
+
+  Async_Job(const char *n) : image(0), requests(0), next(0), state(QUEUED), threaded(0) {
+    name = strdup(n);
+  }
+  ~Async_Job() { free(name); }
+  void run() {
+    image = load(name);
+    if (threaded) Fl::awake(loaded, this);
+  }
+
+  void remove_requests(Fl_Shared_Image_Callback cb, void *data, int all);
+  void unlink();
+  static void start();
+  static void load_now(void *job);
+  static void loaded(void *job);
+};
+
+Fl_Shared_Image::Async_Job *Fl_Shared_Image::Async_Job::first = 0;
+int Fl_Shared_Image::Async_Job::loading = 0;
+
+/*
+  Forgets the requests for cb and data, or, if all is 0, those whose
+  widget was deleted.
+*/
+void Fl_Shared_Image::Async_Job::remove_requests(Fl_Shared_Image_Callback cb,
+                                                 void *data, int all) {
+  Fl_Shared_Image_Request **p = &requests;
+  while (*p) {
+    Fl_Shared_Image_Request *r = *p;
+    if (all ? (r->cb == cb && r->data == data) : (r->has_widget && !r->widget)) {
+      *p = r->next;
+      if (r->has_widget) Fl::release_widget_pointer(r->widget);
+      if (r->image) r->image->release();
+      free(r);
+    } else {
+      p = &r->next;
+    }
+  }
+}
+
+void Fl_Shared_Image::Async_Job::unlink() {
+  Async_Job **p = &first;
+  while (*p != this) p = &(*p)->next;
+  *p = next;
+}
+
+/*
+  Starts loading queued images while there are idle worker threads.
+  Without threads, the images are loaded one at a time by the event loop.
+*/
+void Fl_Shared_Image::Async_Job::start() {
+  Fl_Thread_Pool *pool = Fl_Thread_Pool::shared();
+  int threads = pool->threads();
+  if (threads && Fl::system_driver()->init_awake()) threads = 0;
+  Async_Job *next_job;
+  for (Async_Job *job = first; job && loading < (threads ? threads : 1); job = next_job) {
+    next_job = job->next;
+    if (job->state != QUEUED) continue;
+    job->remove_requests(0, 0, 0);
+    if (!job->requests) {
+      job->unlink();
+      delete job;
+      continue;
+    }
+    job->state = LOADING;
+    loading++;
+    if (threads) {
+      job->threaded = 1;
+      pool->submit(job);
+    } else {
+      Fl::add_timeout(0.0, load_now, job);
+    }
+  }
+}
+
+void Fl_Shared_Image::Async_Job::load_now(void *v) {
+  Async_Job *job = (Async_Job *)v;
+  job->remove_requests(0, 0, 0);
+  if (job->requests) job->run();
+  loaded(job);
+}
+
+/*
+  Adds the loaded image to the cache and calls the callbacks of the
+  requests, in the main thread.
+*/
+void Fl_Shared_Image::Async_Job::loaded(void *v) {
+  Async_Job *job = (Async_Job *)v;
+  // the worker may not have returned from run() yet
+  if (job->threaded) Fl_Thread_Pool::shared()->cancel(job);
+  job->state = DONE;
+  loading--;
+  job->remove_requests(0, 0, 0);
+
+  Fl_Shared_Image *shared = 0;
+  int own = 0, cached = 0;
+  if (job->image && job->requests) {
+    // the reference of find() or of the new image goes to the first
+    // request for the original size; a new image keeps it otherwise,
+    // like with get()
+    shared = lookup(job->name, 0, 0);
+    if (shared && !shared->image_ && !shared->refcount_) {
+      // the pixels were evicted, the entry takes the loaded ones
+      shared->image_       = job->image;
+      shared->alloc_image_ = 1;
+      shared->refcount_    = 1;
+      shared->update();
+      cache_misses_ ++;
+    } else if (shared && shared->use()) {
+      delete job->image;
+      cached = 1;
+    } else {
+      shared = new Fl_Shared_Image(job->name, job->image);
+      shared->alloc_image_ = 1;
+      shared->reloadable_  = 1;
+      shared->add();
+      cache_misses_ ++;
+    }
+    own = 1;
+  } else {
+    delete job->image;
+  }
+  job->image = 0;
+
+  // all images are made before the callbacks release any of them
+  Fl_Shared_Image_Request *r;
+  for (r = job->requests; r && shared; r = r->next) {
+    if (!r->cb) continue;
+    if (own && (!r->W || !r->H || (r->W == shared->w() && r->H == shared->h()))) {
+      r->image = shared;
+      own = 0;
+    } else {
+      r->image = get(job->name, r->W, r->H);
+    }
+  }
+  if (own && (cached || cache_budget_)) shared->release();
+
+  // a callback may call get_async() or cancel_async()
+  while ((r = job->requests) != NULL) {
+    job->requests = r->next;
+    if (r->has_widget) Fl::release_widget_pointer(r->widget);
+    if (r->cb) r->cb(r->image, r->data);
+    free(r);
+  }
+  job->unlink();
+  delete job;
+  start();
+}
+
+
+/**
+  Loads an image in the background.
+
+  This is like get(), but if the image is not in the cache, it is loaded
+  by a worker thread, and \p cb is called with the image when it is ready,
+  so that the user interface does not freeze while many images load.
+  Requests for a file that is already being loaded wait for the same
+  thread. At most one image per worker thread is loaded at a time, the
+  other requests are queued.
+
+  The callback is called in the main thread by the event loop, with the
+  image as if it was returned by get(), or NULL if the file could not be
+  loaded. The image must be released with release() when no longer needed.
+
+  If \p widget is given, the request is forgotten when the widget is
+  deleted before the image is loaded, and the callback is not called.
+  cancel_async() forgets requests explicitly. \p cb may be NULL to load
+  an image into the cache in advance.
+
+  The image format handlers (see add_handler()) are called by the worker
+  threads, they must not call other FLTK functions. Without thread
+  support, the images are loaded one at a time by the event loop.
+
+  \param name name of the image file
+  \param W, H desired size, or 0 for the original size
+  \param cb function to call when the image is loaded
+  \param data user data passed to \p cb
+  \param widget the widget that wants the image, or NULL
+
+  \return the image with its refcount increased if it was in the cache,
+          and \p cb is not called, or NULL if it is being loaded
+
+  \see Fl_Shared_Image::get(const char *name, int W, int H)
+  \see Fl_Shared_Image::cancel_async()
+  \since FLTK 1.4.0
+*/
+Fl_Shared_Image *Fl_Shared_Image::get_async(const char *name, int W, int H,
+                                            Fl_Shared_Image_Callback cb, void *data,
+                                            Fl_Widget *widget) {
+  Fl_Shared_Image *temp;
+  // evicted images are loaded in the background too
+  if ((temp = lookup(name, W, H)) != NULL && (temp->image_ || temp->refcount_))
+    return temp->use();
+  if ((temp = lookup(name, 0, 0)) != NULL && temp->image_) {
+    // only a copy of another size is needed
+    return get(name, W, H);
+  }
+
+  Async_Job *job, **p;
+  for (p = &Async_Job::first; (job = *p) != NULL; p = &job->next)
+    if (job->state != Async_Job::DONE && !strcmp(job->name, name)) break;
+  if (!job) *p = job = new Async_Job(name);
+
+  Fl_Shared_Image_Request *r = (Fl_Shared_Image_Request *)malloc(sizeof(Fl_Shared_Image_Request));
+  r->W = W;
+  r->H = H;
+  r->cb = cb;
+  r->data = data;
+  r->widget = widget;
+  r->has_widget = widget != 0;
+  r->image = 0;
+  if (widget) Fl::watch_widget_pointer(r->widget);
+  Fl_Shared_Image_Request **q = &job->requests;
+  while (*q) q = &(*q)->next;
+  r->next = 0;
+  *q = r;
+
+  Async_Job::start();
+  return 0;
+}
+
+
+/**
+  Forgets all requests of get_async() with the callback \p cb and the user
+  data \p data whose image is not loaded yet, so that \p cb is not called
+  for them.
+
+  \since FLTK 1.4.0
+*/
+void Fl_Shared_Image::cancel_async(Fl_Shared_Image_Callback cb, void *data) {
+  Async_Job *next;
+  for (Async_Job *job = Async_Job::first; job; job = next) {
+    next = job->next;
+    job->remove_requests(cb, data, 1);
+    if (job->state == Async_Job::QUEUED && !job->requests) {
+      job->unlink();
+      delete job;
+    }
+  }
+}
+
+
+/**
+  Sets how much memory the pixels of released images may take.
+
+  By default, an image is deleted when it is released for the last time,
+  i.e. when its refcount() gets 0. With a budget, released images that
+  were loaded from a file stay in the cache, so that using them again
+  with find() or get() does not load the file again. When their pixels
+  take more than \p bytes, the pixels of the least recently released
+  images are freed, but the images stay in the cache with their name and
+  size, and are loaded again when they are used.
+
+  With a budget, the original image that get() makes a copy of another
+  size from is released, like the copy will be, instead of being kept in
+  memory until the end of the program.
+
+  images() and num_images() include the released images.
+
+  \param[in] bytes the budget, or 0 to delete released images again
+
+  \see cache_hits(), cache_misses(), cache_evictions()
+  \since FLTK 1.4.0
+*/
+void Fl_Shared_Image::cache_budget(size_t bytes) {
+  cache_budget_ = bytes;
+  if (bytes) {
+    trim_cache();
+    return;
+  }
+  for (int i = num_images_ - 1; i >= 0; i --) {
+    Fl_Shared_Image *img = images_[i];
+    if (img->refcount_) continue;
+    if (img->image_) img->lru_remove();
+    img->refcount_ = 1;
+    img->release();
+  }
+}
+
+/** Returns the memory budget of released images, see cache_budget(size_t). */
+size_t Fl_Shared_Image::cache_budget() {
+  return cache_budget_;
+}
+
+/** Returns how much memory the pixels of the released images take now. */
+size_t Fl_Shared_Image::cache_bytes() {
+  return unused_bytes;
+}
+
+/**
+  Returns how often find() and get() found an image whose pixels were in
+  memory, or could be copied from the original image in memory.
+*/
+unsigned long Fl_Shared_Image::cache_hits() {
+  return cache_hits_;
+}
+
+/**
+  Returns how often get(), find() and get_async() had to load an image
+  file, because it was not in the cache or its pixels were evicted.
+*/
+unsigned long Fl_Shared_Image::cache_misses() {
+  return cache_misses_;
+}
+
+/** Returns how often the pixels of a released image were freed. */
+unsigned long Fl_Shared_Image::cache_evictions() {
+  return cache_evictions_;
+}
+
+
 /** Adds a shared image handler, which is basically a test function
     for adding new formats.
 */
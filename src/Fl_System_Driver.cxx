@@ -494,6 +494,13 @@ void Fl_System_Driver::gettime(time_t *sec, int *usec) {
   *usec = 0;
 }
 
+double Fl_System_Driver::monotonic_time() {
+  time_t sec;
+  int usec;
+  gettime(&sec, &usec);
+  return sec + usec / 1e6;
+}
+
 /**
  \}
  \endcond
@@ -24,6 +24,12 @@
 #include <FL/Fl.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <FL/fl_ask.H>
+#include "Fl_Text_Piece_Table.H"
+#include "Fl_Text_Line_Index.H"
+#include "Fl_Text_Scan.H"
+#include "Fl_Text_Undo_History.H"
+#include "Fl_System_Driver.H"
+#include <limits.h>
 
 
 /*
@@ -68,32 +74,6 @@ static int min(int i1, int i2)
 #endif
 
 
-static char *undobuffer;
-static int undobufferlength;
-static Fl_Text_Buffer *undowidget;
-static int undoat;		// points after insertion
-static int undocut;		// number of characters deleted there
-static int undoinsert;		// number of characters inserted
-static int undoyankcut;		// length of valid contents of buffer, even if undocut=0
-
-/*
- Resize the undo buffer to match at least the requested size.
- */
-static void undobuffersize(int n)
-{
-  if (n > undobufferlength) {
-    if (undobuffer) {
-      do {
-	undobufferlength *= 2;
-      } while (undobufferlength < n);
-      undobuffer = (char *) realloc(undobuffer, undobufferlength);
-    } else {
-      undobufferlength = n + 9;
-      undobuffer = (char *) malloc(undobufferlength);
-    }
-  }
-}
-
 static void def_transcoding_warning_action(Fl_Text_Buffer *text)
 {
   fl_alert("%s", text->file_encoding_warning_message);
@@ -102,13 +82,25 @@ static void def_transcoding_warning_action(Fl_Text_Buffer *text)
 /*
  Initialize all variables.
  */
-Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize)
+Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize,
+                               Storage storage)
 {
   mLength = 0;
   mPreferredGapSize = preferredGapSize;
-  mBuf = (char *) malloc(requestedSize + mPreferredGapSize);
-  mGapStart = 0;
-  mGapEnd = requestedSize + mPreferredGapSize;
+  if (storage == PIECE_TABLE) {
+    mPieces = new Fl_Text_Piece_Table();
+    mBuf = NULL;
+    mGapStart = mGapEnd = 0;
+  } else {
+    mPieces = NULL;
+    mBuf = (char *) malloc(requestedSize + mPreferredGapSize);
+    mGapStart = 0;
+    mGapEnd = requestedSize + mPreferredGapSize;
+  }
+  mMapping = NULL;
+  mMappingSize = mMappingChecked = 0;
+  mLineIndex = NULL;
+  mUndo = new Fl_Text_Undo_History(this);
   mTabDist = 8;
   mPrimary.mSelected = 0;
   mPrimary.mStart = mPrimary.mEnd = 0;
@@ -118,10 +110,15 @@ Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize)
   mHighlight.mStart = mHighlight.mEnd = 0;
   mModifyProcs = NULL;
   mCbArgs = NULL;
+  mCbDeletedText = NULL;
   mNModifyProcs = 0;
   mNPredeleteProcs = 0;
   mPredeleteProcs = NULL;
   mPredeleteCbArgs = NULL;
+  mBatchLevel = 0;
+  mBatchPending = 0;
+  mBatchPos = mBatchDeleted = mBatchInserted = 0;
+  mBatchDeletedText = NULL;
   mCursorPosHint = 0;
   mCanUndo = 1;
   input_file_was_transcoded = 0;
@@ -135,9 +132,15 @@ Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize)
 Fl_Text_Buffer::~Fl_Text_Buffer()
 {
   free(mBuf);
+  delete mPieces;
+  unmap_();
+  delete mLineIndex;
+  delete mUndo;
+  free(mBatchDeletedText);
   if (mNModifyProcs != 0) {
     delete[]mModifyProcs;
     delete[]mCbArgs;
+    delete[]mCbDeletedText;
   }
   if (mNPredeleteProcs > 0) {
     delete[] mPredeleteProcs;
@@ -152,8 +155,12 @@ Fl_Text_Buffer::~Fl_Text_Buffer()
  */
 char *Fl_Text_Buffer::text() const {
   char *t = (char *) malloc(mLength + 1);
-  memcpy(t, mBuf, mGapStart);
-  memcpy(t+mGapStart, mBuf+mGapEnd, mLength - mGapStart);
+  if (mPieces) {
+    mPieces->copy(0, mLength, t);
+  } else {
+    memcpy(t, mBuf, mGapStart);
+    memcpy(t+mGapStart, mBuf+mGapEnd, mLength - mGapStart);
+  }
   t[mLength] = '\0';
   return t;
 } 
@@ -170,27 +177,36 @@ void Fl_Text_Buffer::text(const char *t)
   // then don't return so that internal cleanup can happen
   if (!t) t="";
 
-  call_predelete_callbacks(0, length());
-  
   /* Save information for redisplay, and get rid of the old buffer */
-  const char *deletedText = text();
+  char *deletedText;
   int deletedLength = mLength;
-  free((void *) mBuf);
-  
-  /* Start a new buffer with a gap of mPreferredGapSize at the end */
+  flush_batch_();
+  begin_change_(0, deletedLength, &deletedText);
   int insertedLength = (int) strlen(t);
-  mBuf = (char *) malloc(insertedLength + mPreferredGapSize);
   mLength = insertedLength;
-  mGapStart = insertedLength;
-  mGapEnd = mGapStart + mPreferredGapSize;
-  memcpy(mBuf, t, insertedLength);
+
+  if (mPieces) {
+    mPieces->clear();
+    unmap_();
+    mPieces->insert(0, t, insertedLength);
+  } else {
+    free((void *) mBuf);
+
+    /* Start a new buffer with a gap of mPreferredGapSize at the end */
+    mBuf = (char *) malloc(insertedLength + mPreferredGapSize);
+    mGapStart = insertedLength;
+    mGapEnd = mGapStart + mPreferredGapSize;
+    memcpy(mBuf, t, insertedLength);
+  }
+  if (mLineIndex)
+    mLineIndex->reset();
+  mUndo->clear();
   
   /* Zero all of the existing selections */
   update_selections(0, deletedLength, 0);
   
   /* Call the saved display routine(s) to update the screen */
-  call_modify_callbacks(0, deletedLength, insertedLength, 0, deletedText);
-  free((void *) deletedText);
+  end_change_(0, 0, deletedLength, insertedLength, deletedText);
 }
 
 
@@ -222,17 +238,29 @@ char *Fl_Text_Buffer::text_range(int start, int end) const {
   s = (char *) malloc(copiedLength + 1);
   
   /* Copy the text from the buffer to the returned string */
-  if (end <= mGapStart) {
-    memcpy(s, mBuf + start, copiedLength);
+  copy_range_(start, end, s);
+  s[copiedLength] = '\0';
+  return s;
+}
+
+
+/*
+ Copy the bytes between start and end to dest.
+ */
+void Fl_Text_Buffer::copy_range_(int start, int end, char *dest) const
+{
+  int copiedLength = end - start;
+  if (mPieces) {
+    mPieces->copy(start, end, dest);
+  } else if (end <= mGapStart) {
+    memcpy(dest, mBuf + start, copiedLength);
   } else if (start >= mGapStart) {
-    memcpy(s, mBuf + start + (mGapEnd - mGapStart), copiedLength);
+    memcpy(dest, mBuf + start + (mGapEnd - mGapStart), copiedLength);
   } else {
     int part1Length = mGapStart - start;
-    memcpy(s, mBuf + start, part1Length);
-    memcpy(s + part1Length, mBuf + mGapEnd, copiedLength - part1Length);
+    memcpy(dest, mBuf + start, part1Length);
+    memcpy(dest + part1Length, mBuf + mGapEnd, copiedLength - part1Length);
   }
-  s[copiedLength] = '\0';
-  return s;
 }
 
 /*
@@ -282,13 +310,14 @@ void Fl_Text_Buffer::insert(int pos, const char *text)
     pos = 0;
   
   /* Even if nothing is deleted, we must call these callbacks */
-  call_predelete_callbacks(pos, 0);
+  char *deletedText;
+  int merged = begin_change_(pos, 0, &deletedText);
   
   /* insert and redisplay */
   int nInserted = insert_(pos, text);
   mCursorPosHint = pos + nInserted;
   IS_UTF8_ALIGNED2(this, (mCursorPosHint))
-  call_modify_callbacks(pos, 0, nInserted, 0, NULL);
+  end_change_(merged, pos, 0, nInserted, deletedText);
 }
 
 
@@ -354,13 +383,12 @@ void Fl_Text_Buffer::replace(int start, int end, const char *text)
   IS_UTF8_ALIGNED2(this, (end))
   IS_UTF8_ALIGNED(text)
   
-  call_predelete_callbacks(start, end - start);
-  const char *deletedText = text_range(start, end);
+  char *deletedText;
+  int merged = begin_change_(start, end - start, &deletedText);
   remove_(start, end);
   int nInserted = insert_(start, text);
   mCursorPosHint = start + nInserted;
-  call_modify_callbacks(start, end - start, nInserted, 0, deletedText);
-  free((void *) deletedText);
+  end_change_(merged, start, end - start, nInserted, deletedText);
 }
 
 
@@ -391,13 +419,12 @@ void Fl_Text_Buffer::remove(int start, int end)
   if (start == end)
     return;
   
-  call_predelete_callbacks(start, end - start);
+  char *deletedText;
+  int merged = begin_change_(start, end - start, &deletedText);
   /* Remove and redisplay */
-  const char *deletedText = text_range(start, end);
   remove_(start, end);
   mCursorPosHint = start;
-  call_modify_callbacks(start, end - start, 0, 0, deletedText);
-  free((void *) deletedText);
+  end_change_(merged, start, end - start, 0, deletedText);
 }
 
 
@@ -413,7 +440,20 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
   IS_UTF8_ALIGNED2(this, (toPos))
   
   int copiedLength = fromEnd - fromStart;
-  
+
+  if (mPieces) {
+    char *t = fromBuf->text_range(fromStart, fromEnd);
+    mPieces->insert(toPos, t, copiedLength);
+    free(t);
+    mLength += copiedLength;
+    if (mLineIndex)
+      mLineIndex->inserted(toPos, copiedLength);
+    if (mCanUndo)
+      mUndo->inserted(toPos, copiedLength);
+    update_selections(toPos, 0, copiedLength);
+    return;
+  }
+
   /* Prepare the buffer to receive the new text.  If the new text fits in
    the current buffer, just move the gap (if necessary) to where
    the text should be inserted.  If the new text is too large, reallocate
@@ -425,7 +465,9 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
     move_gap(toPos);
   
   /* Insert the new text (toPos now corresponds to the start of the gap) */
-  if (fromEnd <= fromBuf->mGapStart) {
+  if (fromBuf->mPieces) {
+    fromBuf->mPieces->copy(fromStart, fromEnd, &mBuf[toPos]);
+  } else if (fromEnd <= fromBuf->mGapStart) {
     memcpy(&mBuf[toPos], &fromBuf->mBuf[fromStart], copiedLength);
   } else if (fromStart >= fromBuf->mGapStart) {
     memcpy(&mBuf[toPos],
@@ -439,6 +481,10 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
   }
   mGapStart += copiedLength;
   mLength += copiedLength;
+  if (mLineIndex)
+    mLineIndex->inserted(toPos, copiedLength);
+  if (mCanUndo)
+    mUndo->inserted(toPos, copiedLength);
   update_selections(toPos, 0, copiedLength);
 }
 
@@ -450,39 +496,28 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
  */ 
 int Fl_Text_Buffer::undo(int *cursorPos)
 {
-  if (undowidget != this || (!undocut && !undoinsert && !mCanUndo))
-    return 0;
-  
-  int ilen = undocut;
-  int xlen = undoinsert;
-  int b = undoat - xlen;
-  
-  if (xlen && undoyankcut && !ilen) {
-    ilen = undoyankcut;
-  }
-  
-  if (xlen && ilen) {
-    undobuffersize(ilen + 1);
-    undobuffer[ilen] = 0;
-    char *tmp = strdup(undobuffer);
-    replace(b, undoat, tmp);
-    if (cursorPos)
-      *cursorPos = mCursorPosHint;
-    free(tmp);
-  } else if (xlen) {
-    remove(b, undoat);
-    if (cursorPos)
-      *cursorPos = mCursorPosHint;
-  } else if (ilen) {
-    undobuffersize(ilen + 1);
-    undobuffer[ilen] = 0;
-    insert(undoat, undobuffer);
-    if (cursorPos)
-      *cursorPos = mCursorPosHint;
-    undoyankcut = 0;
-  }
-  
-  return 1;
+  return mUndo->undo(cursorPos);
+}
+
+
+/*
+ Redo the last undone changes. Returns 1 if the redo was applied.
+ */
+int Fl_Text_Buffer::redo(int *cursorPos)
+{
+  return mUndo->redo(cursorPos);
+}
+
+
+int Fl_Text_Buffer::can_undo() const
+{
+  return mUndo->can_undo();
+}
+
+
+int Fl_Text_Buffer::can_redo() const
+{
+  return mUndo->can_redo();
 }
 
 
@@ -492,9 +527,27 @@ int Fl_Text_Buffer::undo(int *cursorPos)
 void Fl_Text_Buffer::canUndo(char flag)
 {
   mCanUndo = flag;
-  // disabling undo also clears the last undo operation!
-  if (!mCanUndo && undowidget==this) 
-    undowidget = 0;
+  // disabling undo also clears the undo history!
+  if (!mCanUndo)
+    mUndo->clear();
+}
+
+
+void Fl_Text_Buffer::undo_memory_limit(int bytes)
+{
+  mUndo->limit(bytes);
+}
+
+
+int Fl_Text_Buffer::undo_memory_limit() const
+{
+  return mUndo->limit();
+}
+
+
+int Fl_Text_Buffer::undo_memory() const
+{
+  return mUndo->bytes();
 }
 
 
@@ -509,16 +562,17 @@ void Fl_Text_Buffer::tab_distance(int tabDist)
 {
   /* First call the pre-delete callbacks with the previous tab setting 
    still active. */
-  call_predelete_callbacks(0, mLength);
+  char *deletedText;
+  flush_batch_();
+  begin_change_(0, mLength, &deletedText);
   
   /* Change the tab setting */
   mTabDist = tabDist;
   
   /* Force any display routines to redisplay everything (unfortunately,
-   this means copying the whole buffer contents to provide "deletedText" */
-  const char *deletedText = text();
-  call_modify_callbacks(0, mLength, mLength, 0, deletedText);
-  free((void *) deletedText);
+   this means copying the whole buffer contents to provide "deletedText",
+   if any of them needs it) */
+  end_change_(0, 0, mLength, mLength, deletedText);
 }
 
 
@@ -694,24 +748,29 @@ char *Fl_Text_Buffer::highlight_text()
  Add a callback that is called whenever text is modified.
  */
 void Fl_Text_Buffer::add_modify_callback(Fl_Text_Modify_Cb bufModifiedCB,
-					 void *cbArg)
+					 void *cbArg, int deletedText)
 {
   Fl_Text_Modify_Cb *newModifyProcs =
   new Fl_Text_Modify_Cb[mNModifyProcs + 1];
   void **newCBArgs = new void *[mNModifyProcs + 1];
+  char *newDeletedText = new char[mNModifyProcs + 1];
   for (int i = 0; i < mNModifyProcs; i++) {
     newModifyProcs[i + 1] = mModifyProcs[i];
     newCBArgs[i + 1] = mCbArgs[i];
+    newDeletedText[i + 1] = mCbDeletedText[i];
   }
   if (mNModifyProcs != 0) {
     delete[]mModifyProcs;
     delete[]mCbArgs;
+    delete[]mCbDeletedText;
   }
   newModifyProcs[0] = bufModifiedCB;
   newCBArgs[0] = cbArg;
+  newDeletedText[0] = deletedText != 0;
   mNModifyProcs++;
   mModifyProcs = newModifyProcs;
   mCbArgs = newCBArgs;
+  mCbDeletedText = newDeletedText;
 }
 
 
@@ -745,24 +804,31 @@ void Fl_Text_Buffer::remove_modify_callback(Fl_Text_Modify_Cb bufModifiedCB,
     mModifyProcs = NULL;
     delete[]mCbArgs;
     mCbArgs = NULL;
+    delete[]mCbDeletedText;
+    mCbDeletedText = NULL;
     return;
   }
   Fl_Text_Modify_Cb *newModifyProcs = new Fl_Text_Modify_Cb[mNModifyProcs];
   void **newCBArgs = new void *[mNModifyProcs];
+  char *newDeletedText = new char[mNModifyProcs];
   
   /* copy out the remaining members and free the old lists */
   for (i = 0; i < toRemove; i++) {
     newModifyProcs[i] = mModifyProcs[i];
     newCBArgs[i] = mCbArgs[i];
+    newDeletedText[i] = mCbDeletedText[i];
   }
   for (; i < mNModifyProcs; i++) {
     newModifyProcs[i] = mModifyProcs[i + 1];
     newCBArgs[i] = mCbArgs[i + 1];
+    newDeletedText[i] = mCbDeletedText[i + 1];
   }
   delete[]mModifyProcs;
   delete[]mCbArgs;
+  delete[]mCbDeletedText;
   mModifyProcs = newModifyProcs;
   mCbArgs = newCBArgs;
+  mCbDeletedText = newDeletedText;
 }
 
 
@@ -853,6 +919,12 @@ char *Fl_Text_Buffer::line_text(int pos) const {
  */
 int Fl_Text_Buffer::line_start(int pos) const 
 {
+  if (mLineIndex) {
+    if (pos > mLength)
+      pos = mLength;
+    int n = mLineIndex->lines_before(pos);
+    return n ? mLineIndex->newline_pos(n) + 1 : 0;
+  }
   if (!findchar_backward(pos, '\n', &pos))
     return 0;
   return pos + 1;
@@ -863,6 +935,14 @@ int Fl_Text_Buffer::line_start(int pos) const
  Find the end of the line.
  */
 int Fl_Text_Buffer::line_end(int pos) const {
+  if (mLineIndex) {
+    if (pos < 0)
+      pos = 0;
+    if (pos >= mLength)
+      return mLength;
+    pos = mLineIndex->newline_pos(mLineIndex->lines_before(pos) + 1);
+    return pos < 0 ? mLength : pos;
+  }
   if (!findchar_forward(pos, '\n', &pos))
     pos = mLength;
   return pos;
@@ -949,6 +1029,20 @@ int Fl_Text_Buffer::skip_displayed_characters(int lineStartPos, int nChars)
 }
 
 
+/*
+ Enable or disable the line index.
+ */
+void Fl_Text_Buffer::index_lines(int onoff)
+{
+  if (onoff && !mLineIndex) {
+    mLineIndex = new Fl_Text_Line_Index(this);
+  } else if (!onoff && mLineIndex) {
+    delete mLineIndex;
+    mLineIndex = NULL;
+  }
+}
+
+
 /*
  Count the number of newline characters between start and end.
  startPos and endPos must be at a character boundary.
@@ -957,23 +1051,33 @@ int Fl_Text_Buffer::skip_displayed_characters(int lineStartPos, int nChars)
 int Fl_Text_Buffer::count_lines(int startPos, int endPos) const {
   IS_UTF8_ALIGNED2(this, (startPos))
   IS_UTF8_ALIGNED2(this, (endPos))
-  
-  int gapLen = mGapEnd - mGapStart;
+
+  if (mLineIndex) {
+    if (endPos > mLength)
+      endPos = mLength;
+    if (startPos >= endPos)
+      return 0;
+    return mLineIndex->lines_before(endPos) - mLineIndex->lines_before(startPos);
+  }
+  return count_lines_(startPos, endPos);
+}
+
+
+/*
+ Count the newlines between start and end by scanning the text.
+ */
+int Fl_Text_Buffer::count_lines_(int startPos, int endPos) const {
+  if (endPos > mLength)
+    endPos = mLength;
   int lineCount = 0;
-  
+
   int pos = startPos;
-  while (pos < mGapStart)
-  {
-    if (pos == endPos)
-      return lineCount;
-    if (mBuf[pos++] == '\n')
-      lineCount++;
-  } 
-  while (pos < mLength) {
-    if (pos == endPos)
-      return lineCount;
-    if (mBuf[pos++ + gapLen] == '\n')
-      lineCount++;
+  while (pos < endPos) {
+    int segStart, segLen;
+    const char *seg = segment(pos, &segStart, &segLen);
+    int n = min(segStart + segLen, endPos) - pos;
+    lineCount += fl_text_count(seg + (pos - segStart), n, '\n');
+    pos += n;
   }
   return lineCount;
 }
@@ -990,30 +1094,36 @@ int Fl_Text_Buffer::skip_lines(int startPos, int nLines)
   
   if (nLines == 0)
     return startPos;
-  
-  int gapLen = mGapEnd - mGapStart;
+
+  if (mLineIndex) {
+    if (startPos >= mLength)
+      return startPos;
+    if (startPos < 0)
+      startPos = 0;
+    if (nLines < 1)
+      nLines = 1;
+    int pos = mLineIndex->newline_pos(mLineIndex->lines_before(startPos) + nLines);
+    return pos < 0 ? mLength : pos + 1;
+  }
+  return skip_lines_(startPos, nLines);
+}
+
+
+/*
+ Skip n lines ahead by scanning the text.
+ */
+int Fl_Text_Buffer::skip_lines_(int startPos, int nLines) const
+{
   int pos = startPos;
   int lineCount = 0;
-  while (pos < mGapStart) {
-    if (mBuf[pos++] == '\n') {
-      lineCount++;
-      if (lineCount == nLines) {
-        IS_UTF8_ALIGNED2(this, (pos))
-	return pos;
-      }
-    }
-  }
-  while (pos < mLength) {
-    if (mBuf[pos++ + gapLen] == '\n') {
-      lineCount++;
-      if (lineCount >= nLines) {
-        IS_UTF8_ALIGNED2(this, (pos))
-	return pos;
-      }
+  while ((pos = scan_forward_(pos, mLength, '\n', '\n')) >= 0) {
+    pos++;
+    if (++lineCount >= nLines) {
+      IS_UTF8_ALIGNED2(this, (pos))
+      return pos;
     }
   }
-  IS_UTF8_ALIGNED2(this, (pos))
-  return pos;
+  return max(startPos, mLength);
 }
 
 
@@ -1029,26 +1139,21 @@ int Fl_Text_Buffer::rewind_lines(int startPos, int nLines)
   int pos = startPos - 1;
   if (pos <= 0)
     return 0;
+  if (pos >= mLength)
+    pos = mLength - 1;
+
+  if (mLineIndex) {
+    int n = mLineIndex->lines_before(pos + 1) - nLines;
+    return n > 0 ? mLineIndex->newline_pos(n) + 1 : 0;
+  }
   
-  int gapLen = mGapEnd - mGapStart;
   int lineCount = -1;
-  while (pos >= mGapStart) {
-    if (mBuf[pos + gapLen] == '\n') {
-      if (++lineCount >= nLines) {
-        IS_UTF8_ALIGNED2(this, (pos+1))
-	return pos + 1;
-      }
-    }
-    pos--;
-  }
-  while (pos >= 0) {
-    if (mBuf[pos] == '\n') {
-      if (++lineCount >= nLines) {
-        IS_UTF8_ALIGNED2(this, (pos+1))
-	return pos + 1;
-      }
+  pos++;
+  while ((pos = scan_backward_(0, pos, '\n', '\n')) >= 0) {
+    if (++lineCount >= nLines) {
+      IS_UTF8_ALIGNED2(this, (pos+1))
+      return pos + 1;
     }
-    pos--;
   }
   return 0;
 }
@@ -1058,110 +1163,210 @@ int Fl_Text_Buffer::rewind_lines(int startPos, int nLines)
  Find a matching string in the buffer.
  */
 int Fl_Text_Buffer::search_forward(int startPos, const char *searchString,
-				   int *foundPos, int matchCase) const 
+				   int *foundPos, int matchCase) const
 {
   IS_UTF8_ALIGNED2(this, (startPos))
   IS_UTF8_ALIGNED(searchString)
-  
+
   if (!searchString)
     return 0;
-  int bp;
-  const char *sp;
-  if (matchCase) {
-    while (startPos < length()) {
-      bp = startPos;
-      sp = searchString;
-      for (;;) {
-        char c = *sp;
-        // we reached the end of the "needle", so we found the string!
-        if (!c) {
-          *foundPos = startPos;
-          return 1;
-        }
-        int l = fl_utf8len1(c);
-        if (memcmp(sp, address(bp), l))
-          break;
-        sp += l; bp += l;
+  if (startPos < 0)
+    startPos = 0;
+  int len = (int) strlen(searchString);
+  if (!len) {
+    if (startPos >= mLength)
+      return 0;
+    *foundPos = startPos;
+    return 1;
+  }
+  int fold = byte_fold(searchString, matchCase);
+  if (fold >= 0) {
+    // the string can be compared byte by byte, search each segment at once
+    int pos = startPos;
+    while (pos < mLength) {
+      int segStart, segLen;
+      const char *seg = segment(pos, &segStart, &segLen);
+      int segEnd = segStart + segLen;
+      const char *p = fl_text_find(seg + (pos - segStart), segEnd - pos,
+                                   searchString, len, fold);
+      if (p) {
+        *foundPos = segStart + int(p - seg);
+        return 1;
       }
-      startPos = next_char(startPos);
-    }
-  } else {
-    while (startPos < length()) {
-      bp = startPos;
-      sp = searchString;
-      for (;;) {
-        // we reached the end of the "needle", so we found the string!
-        if (!*sp) {
-          *foundPos = startPos;
+      // matches that continue in the next segment
+      for (int i = max(pos, segEnd - len + 1); i < segEnd; i++) {
+        if (match_(i, searchString, len, fold)) {
+          *foundPos = i;
           return 1;
         }
-        int l;
-        unsigned int b = char_at(bp);
-        unsigned int s = fl_utf8decode(sp, 0, &l);
-        if (fl_tolower(b)!=fl_tolower(s))
-          break;
-        sp += l; 
-        bp = next_char(bp);
       }
-      startPos = next_char(startPos);
+      pos = segEnd;
     }
-  }  
+    return 0;
+  }
+  // compare characters without case; if the first one is ASCII we can
+  // still skip quickly to the next byte that may start a match
+  unsigned int c = (unsigned char) searchString[0];
+  for (int pos = startPos; pos < mLength; pos = next_char(pos)) {
+    if (c < 0x80) {
+      pos = scan_forward_(pos, mLength, fl_tolower(c), fl_toupper(c));
+      if (pos < 0)
+        break;
+    }
+    if (match_nocase_(pos, searchString)) {
+      *foundPos = pos;
+      return 1;
+    }
+  }
   return 0;
 }
 
 int Fl_Text_Buffer::search_backward(int startPos, const char *searchString,
-				    int *foundPos, int matchCase) const 
+				    int *foundPos, int matchCase) const
 {
   IS_UTF8_ALIGNED2(this, (startPos))
   IS_UTF8_ALIGNED(searchString)
-  
-  if (!searchString)
+
+  if (!searchString || startPos < 0)
     return 0;
-  int bp;
-  const char *sp;
-  if (matchCase) {
-    while (startPos >= 0) {
-      bp = startPos;
-      sp = searchString;
-      for (;;) {
-        char c = *sp;
-        // we reached the end of the "needle", so we found the string!
-        if (!c) {
-          *foundPos = startPos;
-          return 1;
-        }
-        int l = fl_utf8len1(c);
-        if (memcmp(sp, address(bp), l))
-          break;
-        sp += l; bp += l;
+  if (startPos > mLength)
+    startPos = mLength;
+  int len = (int) strlen(searchString);
+  if (!len) {
+    *foundPos = startPos;
+    return 1;
+  }
+  int fold = byte_fold(searchString, matchCase);
+  unsigned int c = (unsigned char) searchString[0];
+  if (fold < 0 && c >= 0x80) {
+    // no shortcut for a non-ASCII first character without case
+    for (int pos = startPos; pos >= 0; pos = prev_char(pos)) {
+      if (match_nocase_(pos, searchString)) {
+        *foundPos = pos;
+        return 1;
       }
-      startPos = prev_char(startPos);
     }
-  } else {
-    while (startPos >= 0) {
-      bp = startPos;
-      sp = searchString;
-      for (;;) {
-        // we reached the end of the "needle", so we found the string!
-        if (!*sp) {
-          *foundPos = startPos;
-          return 1;
-        }
-        int l;
-        unsigned int b = char_at(bp);
-        unsigned int s = fl_utf8decode(sp, 0, &l);
-        if (fl_tolower(b)!=fl_tolower(s))
-          break;
-        sp += l; 
-        bp = next_char(bp);
-      }
-      startPos = prev_char(startPos);
+    return 0;
+  }
+  // go back from one candidate for the first byte to the next
+  char c1 = c, c2 = c;
+  if (!matchCase) {
+    c1 = fl_tolower(c);
+    c2 = fl_toupper(c);
+  }
+  int pos = startPos + 1;
+  while ((pos = scan_backward_(0, pos, c1, c2)) >= 0) {
+    if (fold >= 0 ? match_(pos, searchString, len, fold)
+                  : match_nocase_(pos, searchString)) {
+      *foundPos = pos;
+      return 1;
     }
-  }  
+  }
   return 0;
 }
 
 
+/*
+ Return how a search string can be compared: 0 if byte by byte, 1 if byte
+ by byte with ASCII case folding, and -1 if character by character, which
+ is needed for non-ASCII strings that are searched without case.
+ */
+int Fl_Text_Buffer::byte_fold(const char *s, int matchCase)
+{
+  if (matchCase)
+    return 0;
+  for (; *s; s++)
+    if (*s & 0x80)
+      return -1;
+  return 1;
+}
+
+
+/*
+ Return the first position in [start, end) holding the byte c1 or c2,
+ or -1.
+ */
+int Fl_Text_Buffer::scan_forward_(int start, int end, char c1, char c2) const
+{
+  if (end > mLength)
+    end = mLength;
+  int pos = start;
+  while (pos < end) {
+    int segStart, segLen;
+    const char *seg = segment(pos, &segStart, &segLen);
+    int n = min(segStart + segLen, end) - pos;
+    const char *p = fl_text_scan_forward(seg + (pos - segStart), n, c1, c2);
+    if (p)
+      return segStart + int(p - seg);
+    pos += n;
+  }
+  return -1;
+}
+
+
+/*
+ Return the last position in [start, end) holding the byte c1 or c2,
+ or -1.
+ */
+int Fl_Text_Buffer::scan_backward_(int start, int end, char c1, char c2) const
+{
+  if (end > mLength)
+    end = mLength;
+  int pos = end;
+  while (pos > start) {
+    int segStart, segLen;
+    const char *seg = segment(pos - 1, &segStart, &segLen);
+    int from = max(segStart, start);
+    const char *p = fl_text_scan_backward(seg + (from - segStart), pos - from, c1, c2);
+    if (p)
+      return segStart + int(p - seg);
+    pos = from;
+  }
+  return -1;
+}
+
+
+/*
+ Return non-zero if the len bytes of s are found at pos, see byte_fold().
+ */
+int Fl_Text_Buffer::match_(int pos, const char *s, int len, int fold) const
+{
+  if (pos < 0 || pos + len > mLength)
+    return 0;
+  while (len > 0) {
+    int segStart, segLen;
+    const char *seg = segment(pos, &segStart, &segLen);
+    int n = min(segStart + segLen - pos, len);
+    if (!fl_text_equal(seg + (pos - segStart), s, n, fold))
+      return 0;
+    pos += n;
+    s += n;
+    len -= n;
+  }
+  return 1;
+}
+
+
+/*
+ Return non-zero if the characters of s are found at pos, ignoring case.
+ */
+int Fl_Text_Buffer::match_nocase_(int pos, const char *s) const
+{
+  while (*s) {
+    if (pos >= mLength)
+      return 0;
+    int l;
+    unsigned int b = char_at(pos);
+    unsigned int c = fl_utf8decode(s, 0, &l);
+    if (fl_tolower(b) != fl_tolower(c))
+      return 0;
+    s += l;
+    pos = next_char(pos);
+  }
+  return 1;
+}
+
+
 
 /*
  Insert a string into the buffer.
@@ -1174,33 +1379,30 @@ int Fl_Text_Buffer::insert_(int pos, const char *text)
   
   int insertedLength = (int) strlen(text);
   
-  /* Prepare the buffer to receive the new text.  If the new text fits in
-   the current buffer, just move the gap (if necessary) to where
-   the text should be inserted.  If the new text is too large, reallocate
-   the buffer with a gap large enough to accomodate the new text and a
-   gap of mPreferredGapSize */
-  if (insertedLength > mGapEnd - mGapStart)
-    reallocate_with_gap(pos, insertedLength + mPreferredGapSize);
-  else if (pos != mGapStart)
-    move_gap(pos);
-  
-  /* Insert the new text (pos now corresponds to the start of the gap) */
-  memcpy(&mBuf[pos], text, insertedLength);
-  mGapStart += insertedLength;
+  if (mPieces) {
+    mPieces->insert(pos, text, insertedLength);
+  } else {
+    /* Prepare the buffer to receive the new text.  If the new text fits in
+     the current buffer, just move the gap (if necessary) to where
+     the text should be inserted.  If the new text is too large, reallocate
+     the buffer with a gap large enough to accomodate the new text and a
+     gap of mPreferredGapSize */
+    if (insertedLength > mGapEnd - mGapStart)
+      reallocate_with_gap(pos, insertedLength + mPreferredGapSize);
+    else if (pos != mGapStart)
+      move_gap(pos);
+
+    /* Insert the new text (pos now corresponds to the start of the gap) */
+    memcpy(&mBuf[pos], text, insertedLength);
+    mGapStart += insertedLength;
+  }
   mLength += insertedLength;
+  if (mLineIndex)
+    mLineIndex->inserted(pos, insertedLength);
   update_selections(pos, 0, insertedLength);
   
-  if (mCanUndo) {
-    if (undowidget == this && undoat == pos && undoinsert) {
-      undoinsert += insertedLength;
-    } else {
-      undoinsert = insertedLength;
-      undoyankcut = (undoat == pos) ? undocut : 0;
-    }
-    undoat = pos + insertedLength;
-    undocut = 0;
-    undowidget = this;
-  }
+  if (mCanUndo)
+    mUndo->inserted(pos, insertedLength);
   
   return insertedLength;
 }
@@ -1214,42 +1416,25 @@ void Fl_Text_Buffer::remove_(int start, int end)
 {
   /* if the gap is not contiguous to the area to remove, move it there */
   
-  if (mCanUndo) {
-    if (undowidget == this && undoat == end && undocut) {
-      undobuffersize(undocut + end - start + 1);
-      memmove(undobuffer + end - start, undobuffer, undocut);
-      undocut += end - start;
-    } else {
-      undocut = end - start;
-      undobuffersize(undocut);
-    }
-    undoat = start;
-    undoinsert = 0;
-    undoyankcut = 0;
-    undowidget = this;
-  }
+  if (mCanUndo)
+    mUndo->removing(start, end);
   
-  if (start > mGapStart) {
-    if (mCanUndo)
-      memcpy(undobuffer, mBuf + (mGapEnd - mGapStart) + start,
-	     end - start);
-    move_gap(start);
-  } else if (end < mGapStart) {
-    if (mCanUndo)
-      memcpy(undobuffer, mBuf + start, end - start);
-    move_gap(end);
+  if (mLineIndex)
+    mLineIndex->removed(start, end);
+
+  if (mPieces) {
+    mPieces->remove(start, end);
   } else {
-    int prelen = mGapStart - start;
-    if (mCanUndo) {
-      memcpy(undobuffer, mBuf + start, prelen);
-      memcpy(undobuffer + prelen, mBuf + mGapEnd, end - start - prelen);
-    }
+    if (start > mGapStart)
+      move_gap(start);
+    else if (end < mGapStart)
+      move_gap(end);
+
+    /* expand the gap to encompass the deleted characters */
+    mGapEnd += end - mGapStart;
+    mGapStart = start;
   }
   
-  /* expand the gap to encompass the deleted characters */
-  mGapEnd += end - mGapStart;
-  mGapStart = start;
-  
   /* update the length */
   mLength -= end - start;
   
@@ -1354,7 +1539,6 @@ void Fl_Text_Buffer::remove_selection_(Fl_Text_Selection * sel)
   if (!sel->position(&start, &end))
     return;
   remove(start, end);
-  //undoyankcut = undocut;
 }
 
 
@@ -1406,6 +1590,80 @@ void Fl_Text_Buffer::call_predelete_callbacks(int pos, int nDeleted) const {
 } 
 
 
+/*
+ Prepare the callbacks for a change that deletes nDeleted bytes at pos.
+ A change that only replaces text inserted by the pending change of a
+ batch is merged into it: nobody has seen that text yet, so nobody has
+ to be told before it goes away.
+ */
+int Fl_Text_Buffer::begin_change_(int pos, int nDeleted, char **deletedText)
+{
+  *deletedText = NULL;
+  if (mBatchPending && pos >= mBatchPos &&
+      pos + nDeleted <= mBatchPos + mBatchInserted)
+    return 1;
+  flush_batch_();
+  call_predelete_callbacks(pos, nDeleted);
+  if (nDeleted) {
+    for (int i = 0; i < mNModifyProcs; i++) {
+      if (mCbDeletedText[i]) {
+        *deletedText = text_range(pos, pos + nDeleted);
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+ Send or record a change that was prepared by begin_change_().
+ */
+void Fl_Text_Buffer::end_change_(int merged, int pos, int nDeleted,
+                                 int nInserted, char *deletedText)
+{
+  if (merged) {
+    mBatchInserted += nInserted - nDeleted;
+  } else if (mBatchLevel > 0) {
+    mBatchPending = 1;
+    mBatchPos = pos;
+    mBatchDeleted = nDeleted;
+    mBatchInserted = nInserted;
+    mBatchDeletedText = deletedText;
+  } else {
+    call_modify_callbacks(pos, nDeleted, nInserted, 0, deletedText);
+    free(deletedText);
+  }
+}
+
+
+/*
+ Send the pending change of a batch.
+ */
+void Fl_Text_Buffer::flush_batch_()
+{
+  if (!mBatchPending)
+    return;
+  // the callbacks may change the buffer again
+  char *deletedText = mBatchDeletedText;
+  mBatchPending = 0;
+  mBatchDeletedText = NULL;
+  call_modify_callbacks(mBatchPos, mBatchDeleted, mBatchInserted, 0,
+                        deletedText);
+  free(deletedText);
+}
+
+
+/*
+ End a batch of changes.
+ */
+void Fl_Text_Buffer::end_batch()
+{
+  if (mBatchLevel > 0 && --mBatchLevel == 0)
+    flush_batch_();
+}
+
+
 /*
  Redisplay a new selected area.
  Unicode safe.
@@ -1418,6 +1676,10 @@ void Fl_Text_Buffer::redisplay_selection(Fl_Text_Selection *
   int oldStart, oldEnd, newStart, newEnd, ch1Start, ch1End, ch2Start,
   ch2End;
   
+  /* The positions refer to the current text, the displays must have been
+   told about all changes of a batch first */
+  ((Fl_Text_Buffer *) this)->flush_batch_();
+
   /* If either selection is rectangular, add an additional character to
    the end of the selection to request the redraw routines to wipe out
    the parts of the selection beyond the end of the line */
@@ -1462,6 +1724,42 @@ void Fl_Text_Buffer::redisplay_selection(Fl_Text_Selection *
 }
 
 
+/*
+ Return the contiguous run of text around pos.
+ */
+const char *Fl_Text_Buffer::segment(int pos, int *start, int *len) const
+{
+  if (mPieces)
+    return mPieces->segment(pos, start, len);
+  if (pos < mGapStart) {
+    *start = 0;
+    *len = mGapStart;
+    return mBuf;
+  }
+  *start = mGapStart;
+  *len = mLength - mGapStart;
+  return mBuf + mGapEnd;
+}
+
+
+/*
+ Return the address of a byte in the piece table.
+ */
+const char *Fl_Text_Buffer::piece_address(int pos) const
+{
+  return mPieces->address(pos);
+}
+
+
+/*
+ Return the address of a byte in the piece table that may be written to.
+ */
+char *Fl_Text_Buffer::piece_writable_address(int pos)
+{
+  return mPieces->writable_address(pos);
+}
+
+
 /*
  Move the gap around without changing buffer content.
  Unicode safe. Pos must be at a character boundary.
@@ -1559,23 +1857,27 @@ void Fl_Text_Selection::update(int pos, int nDeleted, int nInserted)
  StartPos must be at a character boundary, searchChar is UCS-4 encoded.
  */
 int Fl_Text_Buffer::findchar_forward(int startPos, unsigned searchChar,
-				     int *foundPos) const 
+				     int *foundPos) const
 {
   if (startPos >= mLength) {
     *foundPos = mLength;
     return 0;
   }
-  
+
   if (startPos<0)
     startPos = 0;
-  
-  for ( ; startPos<mLength; startPos = next_char(startPos)) {
-    if (searchChar == char_at(startPos)) {
-      *foundPos = startPos;
+
+  char s[8];
+  int len = fl_utf8encode(searchChar, s);
+  int pos = startPos;
+  while ((pos = scan_forward_(pos, mLength, s[0], s[0])) >= 0) {
+    if (len == 1 || match_(pos, s, len, 0)) {
+      *foundPos = pos;
       return 1;
     }
+    pos++;
   }
-  
+
   *foundPos = mLength;
   return 0;
 }
@@ -1591,17 +1893,20 @@ int Fl_Text_Buffer::findchar_backward(int startPos, unsigned int searchChar,
     *foundPos = 0;
     return 0;
   }
-  
+
   if (startPos > mLength)
     startPos = mLength;
-  
-  for (startPos = prev_char(startPos); startPos>=0; startPos = prev_char(startPos)) {
-    if (searchChar == char_at(startPos)) {
-      *foundPos = startPos;
+
+  char s[8];
+  int len = fl_utf8encode(searchChar, s);
+  int pos = startPos;
+  while ((pos = scan_backward_(0, pos, s[0], s[0])) >= 0) {
+    if (len == 1 || match_(pos, s, len, 0)) {
+      *foundPos = pos;
       return 1;
     }
   }
-  
+
   *foundPos = 0;
   return 0;
 }
@@ -1678,6 +1983,50 @@ static int general_input_filter(char *buffer, int buflen,
 }
 #endif // EXAMPLE_ENCODING
 
+/*
+ Transcode the UTF-8 or CP1252 encoded text between *src and end to UTF-8
+ in dst, which has room for dstlen bytes. This is the input filter of
+ insertfile() and mapfile(). Stops before a UTF-8 sequence that is cut off
+ by end, or that does not fit into dst, and advances *src to it. Sets
+ *input_was_changed if the result differs from the input.
+ Returns the number of bytes stored in dst.
+ */
+static int utf8_transcode(const char **src, const char *end, char *dst, int dstlen,
+                          int *input_was_changed)
+{
+  // p - work pointer to the input
+  // q - work pointer to dst[]
+  // l - length of utf8 sequence being worked on
+  // lp - fl_utf8decode() length of utf8 sequence being worked on
+  // lq - fl_utf8encode() length of utf8 sequence being worked on
+  // u - utf8 decoded sequence as a single multibyte unsigned integer
+  const char *p = *src;
+  char *q = dst, multibyte[5];
+  int l, lp, lq;
+  unsigned u;
+  while (p < end) {
+    l = fl_utf8len1(*p);		// anticipate length of utf8 sequence
+    if (p + l > end) break;		// cut off, the caller must get more input
+    while ( l > 0) {
+      u = fl_utf8decode(p, p+l, &lp);	// get single utf8 encoded char as a Unicode value
+      lq = fl_utf8encode(u, multibyte);	// re-encode Unicode value to utf8 in multibyte[]
+      if (lp != l || lq != l) *input_was_changed = true;
+
+      if (q + lq > dst + dstlen) {	// encoding would walk off end of dst[]?
+        *src = p;
+        return (int) (q - dst);
+      }
+      memcpy(q, multibyte, lq);
+      q += lq;
+      p += lp;
+      l -= lp;
+    }
+  }
+  *src = p;
+  return (int) (q - dst);
+}
+
+
 /*
  filter that produces, from an input stream fed by reading from fp,
  a UTF-8-encoded output stream written in buffer.
@@ -1700,16 +2049,12 @@ static int utf8_input_filter(char *buffer, 		// result buffer we fill with utf8
   // p - work pointer to line[]
   // q - work pointer to buffer[]
   // l - length of utf8 sequence being worked on
-  // lp - fl_utf8decode() length of utf8 sequence being worked on
-  // lq - fl_utf8encode() length of utf8 sequence being worked on
   // r - bytes read from last fread()
-  // u - utf8 decoded sequence as a single multibyte unsigned integer
-  char *p, *q, multibyte[5];
-  int l, lp, lq, r;
-  unsigned u;
+  char *p, *q;
+  int l, r;
   p = line;
   q = buffer;
-  while (q < buffer + buflen) {
+  for (;;) {
     if (p >= endline) {			// walked off end of input file's line buffer?
       r = (int) fread(line, 1, sline, fp);	// read another block of sline bytes from file
       endline = line + r; 
@@ -1729,24 +2074,14 @@ static int utf8_input_filter(char *buffer, 		// result buffer we fill with utf8
       p = line;
       if (endline - line < l) break;	// sequence *still* extends past end? stop loop
     }
-    while ( l > 0) {
-      u = fl_utf8decode(p, p+l, &lp);	// get single utf8 encoded char as a Unicode value
-      lq = fl_utf8encode(u, multibyte);	// re-encode Unicode value to utf8 in multibyte[]
-      if (lp != l || lq != l) *input_was_changed = true;
-
-      if (q + lq > buffer + buflen) {	// encoding would walk off end of buffer[]?
-	memmove(line, p, endline - p);	// re-jigger line[] buffer for next call
-	endline -= (p - line);		// adjust end of line[] buffer for next call
-	return (int) (q - buffer);		// return what's decoded so far, caller will consume buffer
-      }
-      memcpy(q, multibyte, lq);
-      q += lq; 
-      p += lp;
-      l -= lp;
-    }
+    const char *s = p;
+    q += utf8_transcode(&s, endline, q, (int) (buffer + buflen - q), input_was_changed);
+    p = (char *) s;
+    if (p < endline && p + fl_utf8len1(*p) <= endline)
+      break;				// buffer[] is full, keep the rest for the next call
   }
-  memmove(line, p, endline - p);
-  endline -= (p - line);
+  memmove(line, p, endline - p);	// re-jigger line[] buffer for next call
+  endline -= (p - line);		// adjust end of line[] buffer for next call
   return (int) (q - buffer);
 }
 
@@ -1798,6 +2133,310 @@ const char *Fl_Text_Buffer::file_encoding_warning_message =
 }
 
 
+// files smaller than this are read by mapfile() instead of mapped
+static const size_t MAP_MIN = 1024 * 1024;
+
+
+/**
+ Loads a text file into the buffer by mapping it into memory.
+
+ If the buffer uses the PIECE_TABLE storage, the file is mapped read-only
+ and the buffer text refers to the mapped pages directly. Nothing is read
+ or copied up front, so that even very large files are loaded almost
+ instantly; edits are stored separately and leave the file untouched.
+
+ The text is assumed to be UTF-8 encoded. It is checked in idle time and,
+ with priority, in the parts that are shown by an Fl_Text_Display (see
+ check_utf8()). If an encoding error is found, the text of the file is
+ transcoded from CP1252 like insertfile() would, which copies it. Edits
+ and selections are kept, the undo history is cleared, and
+ transcoding_warning_action is called.
+
+ If the buffer uses the GAP_BUFFER storage, if the file is smaller than
+ 1 MB, or if the file can not be mapped on this platform, this is the same
+ as loadfile().
+
+ \note The mapped file must not be changed by other processes while it is
+ in the buffer. Changed bytes show up in the buffer text, and if the file
+ is truncated, reading the text that was cut off raises SIGBUS on POSIX
+ systems (an access violation on Windows) and terminates the program.
+ Use loadfile() for files that other programs may write to, e.g. logs.
+
+ \note Line ends are not converted. On Windows, insertfile() reads files
+ in text mode and converts CR LF to LF, mapfile() keeps the CR LF.
+
+ \param file name of the file, UTF-8 encoded
+ \return 0 on success, non-zero on error, see insertfile()
+ \since FLTK 1.4.0
+ */
+int Fl_Text_Buffer::mapfile(const char *file)
+{
+  if (!mPieces)
+    return loadfile(file);
+
+  size_t size = 0;
+  char *data = (char *) Fl::system_driver()->map_file(file, &size);
+  if (data && (size > INT_MAX || size < MAP_MIN)) {
+    Fl::system_driver()->unmap_file(data, size);
+    data = NULL;
+  }
+  if (!data)
+    return loadfile(file);
+
+  char *deletedText;
+  int deletedLength = mLength;
+  flush_batch_();
+  begin_change_(0, deletedLength, &deletedText);
+
+  mPieces->clear();
+  unmap_();
+  mMapping = data;
+  mMappingSize = (int) size;
+  mMappingChecked = 0;
+  mPieces->insert_external(0, mMapping, mMappingSize);
+  mLength = mMappingSize;
+  if (mLineIndex)
+    mLineIndex->reset();
+  mUndo->clear();
+  input_file_was_transcoded = 0;
+  Fl::add_idle(check_utf8_cb, this);
+
+  update_selections(0, deletedLength, 0);
+  end_change_(0, 0, deletedLength, mLength, deletedText);
+  return 0;
+}
+
+
+/*
+ Return the first byte sequence between p and end that utf8_input_filter()
+ would transcode, or NULL if there is none. A sequence that is cut off by
+ end is not checked, *last is set to its start (or to end).
+ */
+static const char *find_utf8_error(const char *p, const char *end,
+                                   const char **last)
+{
+  char multibyte[5];
+  while (p < end) {
+    if (!(*p & 0x80)) {
+      p++;
+      continue;
+    }
+    int l = fl_utf8len1(*p);
+    if (p + l > end)
+      break;
+    int lp;
+    unsigned u = fl_utf8decode(p, p + l, &lp);
+    if (lp != l || fl_utf8encode(u, multibyte) != l)
+      return p;
+    p += l;
+  }
+  *last = p;
+  return NULL;
+}
+
+
+/**
+ Checks the memory mapped text between \p start and \p end for UTF-8
+ encoding errors.
+
+ This is called by Fl_Text_Display for the visible text, so that files
+ loaded with mapfile() are checked where the user looks first. If an error
+ is found, the buffer is transcoded as soon as the application is idle.
+ Text that was not loaded by mapfile() is not checked.
+
+ \param start, end byte offsets of the text to check
+ \since FLTK 1.4.0
+ */
+void Fl_Text_Buffer::check_utf8(int start, int end)
+{
+  if (!mMapping || mMappingChecked >= mMappingSize)
+    return;
+  if (end > mLength)
+    end = mLength;
+  while (start < end) {
+    int segStart, segLen;
+    const char *seg = segment(start, &segStart, &segLen);
+    const char *p = seg + (start - segStart);
+    const char *e = seg + min(segStart + segLen, end) - segStart;
+    start = segStart + segLen;
+    if (p < mMapping || p >= mMapping + mMappingSize)
+      continue;                 // edited text, always UTF-8
+    // text before the checked part of the mapping needs no further checks
+    if (e <= mMapping + mMappingChecked)
+      continue;
+    if (p < mMapping + mMappingChecked)
+      p = mMapping + mMappingChecked;
+    const char *last;
+    if (find_utf8_error(p, e, &last) ||
+        (last < e && e == mMapping + mMappingSize)) {
+      Fl::remove_idle(check_utf8_cb, this);
+      if (!Fl::has_timeout(transcode_cb, this))
+        Fl::add_timeout(0.0, transcode_cb, this);
+      return;
+    }
+  }
+}
+
+
+/*
+ Idle callback that checks the next part of the file mapping. Every call
+ checks at most CHECK_CHUNK bytes, so that Fl::wait() handles events in
+ between.
+ */
+static const int CHECK_CHUNK = 64 * 1024;
+
+void Fl_Text_Buffer::check_utf8_cb(void *v)
+{
+  Fl_Text_Buffer *buf = (Fl_Text_Buffer *) v;
+  const char *p = buf->mMapping + buf->mMappingChecked;
+  const char *end = buf->mMapping + buf->mMappingSize;
+  const char *e = min(buf->mMappingSize - buf->mMappingChecked, CHECK_CHUNK) + p;
+  const char *last;
+  if (find_utf8_error(p, e, &last) || (last < e && e == end)) {
+    Fl::remove_idle(check_utf8_cb, buf);
+    buf->transcode_();
+    return;
+  }
+  buf->mMappingChecked = (int) (last - buf->mMapping);
+  if (last == end)
+    Fl::remove_idle(check_utf8_cb, buf);
+}
+
+
+void Fl_Text_Buffer::transcode_cb(void *v)
+{
+  ((Fl_Text_Buffer *) v)->transcode_();
+}
+
+
+// transcode_() reads this many bytes of the mapping at a time
+static const int TRANSCODE_CHUNK = 16 * 1024;
+
+/*
+ Transcode the bytes of a UTF-8 sequence that is cut off by end from CP1252,
+ fl_utf8decode() reads them as single bytes. Returns the number of bytes
+ stored in dst, which has room for 3 bytes per input byte.
+ */
+static int transcode_cut(const char *p, const char *end, char *dst)
+{
+  char *q = dst;
+  while (p < end) {
+    int lp;
+    unsigned u = fl_utf8decode(p, end, &lp);
+    q += fl_utf8encode(u, q);
+    p += lp;
+  }
+  return (int) (q - dst);
+}
+
+
+/*
+ Transcode the next chunk of the text between *p and end into dst, which
+ has room for 3 * TRANSCODE_CHUNK + 16 bytes, and advance *p. A UTF-8
+ sequence that is cut off by end is transcoded from CP1252 if keepCut is
+ set, or dropped like insertfile() drops it at the end of a file. Sets
+ *changed if the result differs from the input. Returns the number of bytes
+ stored in dst.
+ */
+static int transcode_chunk(const char **p, const char *end, char *dst,
+                           int keepCut, int *changed)
+{
+  const char *e = end - *p > TRANSCODE_CHUNK ? *p + TRANSCODE_CHUNK : end;
+  int n = utf8_transcode(p, e, dst, 3 * TRANSCODE_CHUNK, changed);
+  if (*p < e && e == end) {
+    if (keepCut) {
+      n += transcode_cut(*p, end, dst + n);
+      *changed = 1;
+    }
+    *p = end;
+  }
+  return n;
+}
+
+
+/*
+ Replace the parts of the buffer that are not UTF-8 encoded by their UTF-8
+ transcoding, with the same filter that insertfile() uses for files that
+ are not UTF-8 encoded.
+
+ Only the text that still comes from the file mapping is transcoded, one
+ piece at a time from the end, and inserted in small chunks, so that no
+ copy of the whole text is made. Edited text is always UTF-8. The
+ selections are updated like for any other change. The undo history is
+ cleared, because its positions refer to the text before the transcoding.
+ Pieces whose transcoding would make the buffer larger than INT_MAX bytes
+ are left as they are.
+ */
+void Fl_Text_Buffer::transcode_()
+{
+  if (!mMapping)
+    return;
+  Fl::remove_idle(check_utf8_cb, this);
+  Fl::remove_timeout(transcode_cb, this);
+  mMappingChecked = mMappingSize;
+
+  char *chunk = (char *) malloc(3 * TRANSCODE_CHUNK + 16);
+  int changed = 0, failed = 0, mapped = 0;
+  char canUndo = mCanUndo;
+  mCanUndo = 0;
+  begin_batch();
+  for (int pos = mLength; pos > 0; ) {
+    int segStart, segLen;
+    const char *seg = segment(pos - 1, &segStart, &segLen);
+    pos = segStart;
+    if (seg < mMapping || seg >= mMapping + mMappingSize)
+      continue;                 // edited text, always UTF-8
+    const char *end = seg + segLen, *last, *p;
+    if (!find_utf8_error(seg, end, &last) && last == end) {
+      mapped = 1;
+      continue;
+    }
+    int keepCut = segStart + segLen < mLength || end < mMapping + mMappingSize;
+    int segChanged = 0;
+    size_t n = 0;
+    for (p = seg; p < end; )
+      n += transcode_chunk(&p, end, chunk, keepCut, &segChanged);
+    if ((size_t) (mLength - segLen) + n > INT_MAX) {
+      failed = mapped = 1;
+      continue;
+    }
+    // the mapping stays valid after its piece was removed
+    remove(segStart, segStart + segLen);
+    for (p = seg; p < end; ) {
+      int k = transcode_chunk(&p, end, chunk, keepCut, &segChanged);
+      chunk[k] = 0;
+      insert(segStart, chunk);
+      segStart += k;
+    }
+    changed |= segChanged;
+  }
+  end_batch();
+  mCanUndo = canUndo;
+  mUndo->clear();
+  free(chunk);
+  if (!mapped)
+    unmap_();
+  input_file_was_transcoded = changed;
+  if ((changed || failed) && transcoding_warning_action)
+    transcoding_warning_action(this);
+}
+
+
+/*
+ Release the file mapping. The piece table must no longer refer to it.
+ */
+void Fl_Text_Buffer::unmap_()
+{
+  if (!mMapping)
+    return;
+  Fl::remove_idle(check_utf8_cb, this);
+  Fl::remove_timeout(transcode_cb, this);
+  Fl::system_driver()->unmap_file(mMapping, mMappingSize);
+  mMapping = NULL;
+  mMappingSize = mMappingChecked = 0;
+}
+
+
 /*
  Write text to file.
  Unicode safe.
@@ -32,6 +32,11 @@
 #include <FL/Fl_Text_Display.H>
 #include <FL/Fl_Window.H>
 #include "Fl_Screen_Driver.H"
+#include "Fl_Text_Line_Widths.H"
+#include "Fl_Text_Width_Cache.H"
+#include "Fl_Text_Wrap_Counter.H"
+#include "Fl_Text_Restyler.H"
+#include "Fl_Thread_Pool.H"
 
 #undef min
 #undef max
@@ -73,9 +78,21 @@
  stack in the draw_vline() method for drawing strings */
 #define MAX_DISP_LINE_LEN 1000
 
+/* In continuous wrap mode, buffers of at least this size are counted by
+ worker threads, and changes of at least this size make the display count
+ all lines again, see count_wrapped_lines() */
+#define WRAP_COUNT_ASYNC_SIZE (1024 * 1024)
+#define WRAP_RECOUNT_SIZE (1024 * 1024)
+
+/* Seconds between two checks for new counts of the worker threads */
+#define WRAP_COUNT_INTERVAL 0.02
+
+/* Seconds between two checks for the styles of a highlighter that runs in
+ a worker thread, see highlighter() */
+#define HIGHLIGHT_INTERVAL 0.02
+
 static int max( int i1, int i2 );
 static int min( int i1, int i2 );
-static int countlines( const char *string );
 
 /* The variables below are used in a timer event to allow smooth
  scrolling of the text area when the pointer has left the area. */
@@ -137,6 +154,12 @@ Fl_Text_Display::Fl_Text_Display(int X, int Y, int W, int H, const char* l)
   mMaxsize = 0;
   mSuppressResync = 0;
   mNLinesDeleted = 0;
+  mNNewlinesDeleted = 0;
+  mLineWidths = new Fl_Text_Line_Widths;
+  mWidthCache = new Fl_Text_Width_Cache;
+  mWrapCounter = new Fl_Text_Wrap_Counter(wrap_measure_cb, this);
+  mHighlighter = 0;
+  mRestyler = new Fl_Text_Restyler;
   mModifyingTabDistance = 0;	// XXX: UNUSED
   mColumnScale = 0;
   mCursor_color = FL_FOREGROUND_COLOR;
@@ -203,6 +226,14 @@ Fl_Text_Display::~Fl_Text_Display() {
     mBuffer->remove_modify_callback(buffer_modified_cb, this);
     mBuffer->remove_predelete_callback(buffer_predelete_cb, this);
   }
+  if (mLineWidths->idle)
+    Fl::remove_idle(line_widths_idle_cb, this);
+  Fl::remove_timeout(wrap_count_timeout_cb, this);
+  Fl::remove_timeout(highlight_timeout_cb, this);
+  delete mWrapCounter;
+  delete mRestyler;
+  delete mLineWidths;
+  delete mWidthCache;
   if (mLineStarts) delete[] mLineStarts;
   if (linenumber_format_) {
     free((void*)linenumber_format_);
@@ -353,20 +384,20 @@ void Fl_Text_Display::buffer( Fl_Text_Buffer *buf ) {
    of the display and remove our callback from it */
   if ( buf == mBuffer) return;
   if ( mBuffer != 0 ) {
-    // we must provide a copy of the buffer that we are deleting!
-    char *deletedText = mBuffer->text();
-    buffer_modified_cb( 0, 0, mBuffer->length(), 0, deletedText, this );
-    free(deletedText);
+    // act as if all of the text was deleted
+    buffer_predelete_cb( 0, mBuffer->length(), this );
+    buffer_modified_cb( 0, 0, mBuffer->length(), 0, 0, this );
     mNBufferLines = 0;
     mBuffer->remove_modify_callback( buffer_modified_cb, this );
     mBuffer->remove_predelete_callback( buffer_predelete_cb, this );
+    mWrapCounter->clear();
   }
 
   /* Add the buffer to the display, and attach a callback to the buffer for
    receiving modification information when the buffer contents change */
   mBuffer = buf;
   if (mBuffer) {
-    mBuffer->add_modify_callback( buffer_modified_cb, this );
+    mBuffer->add_modify_callback( buffer_modified_cb, this, 0 );
     mBuffer->add_predelete_callback( buffer_predelete_cb, this );
 
     /* Update the display */
@@ -414,6 +445,11 @@ void Fl_Text_Display::highlight_data(Fl_Text_Buffer *styleBuffer,
                                      int nStyles, char unfinishedStyle,
                                      Unfinished_Style_Cb unfinishedHighlightCB,
                                      void *cbArg ) {
+  if (mHighlighter && styleBuffer != mRestyler->styles()) {
+    Fl::remove_timeout(highlight_timeout_cb, this);
+    mRestyler->clear();
+    mHighlighter = 0;
+  }
   mStyleBuffer = styleBuffer;
   mStyleTable = styleTable;
   mNStyles = nStyles;
@@ -427,19 +463,306 @@ void Fl_Text_Display::highlight_data(Fl_Text_Buffer *styleBuffer,
 }
 
 
+/**
+ \brief Attach (or remove) a syntax highlighter.
+
+ Instead of a style buffer that the application keeps in step with the
+ text, as with highlight_data(), the display keeps its own style buffer.
+ Text that is inserted gets the style 'A', the first entry of the style
+ table, and the styles of the changed lines are computed by the
+ highlighter when they are shown, after the current event was handled.
+ Lines that are never shown are never highlighted.
+
+ If Fl_Text_Highlighter::threaded() is set, larger parts of the text are
+ highlighted by a worker thread, and are drawn in the style 'A' until the
+ styles are known. Small changes, as made by typing, are highlighted at
+ once.
+
+ The highlighter and the style table are managed by the caller, and must
+ exist as long as they are used by the display.
+
+ \param h the highlighter, or NULL to remove the highlighter and the styles
+ \param styleTable a list of styles indexed by the style bytes set by \p h
+ \param nStyles number of styles in the style table
+ \see highlight_data(), Fl_Text_Highlighter
+ */
+void Fl_Text_Display::highlighter(Fl_Text_Highlighter *h,
+                                  const Style_Table_Entry *styleTable,
+                                  int nStyles) {
+  Fl::remove_timeout(highlight_timeout_cb, this);
+  mRestyler->clear();
+  if (!h) {
+    if (mHighlighter) {
+      mHighlighter = 0;
+      mStyleBuffer = 0;
+      mStyleTable = 0;
+      mNStyles = 0;
+      mColumnScale = 0;
+      mRestyler->reset(0);
+      damage(FL_DAMAGE_EXPOSE);
+    }
+    return;
+  }
+  mRestyler->reset(mBuffer ? mBuffer->length() : 0);
+  highlight_data(mRestyler->styles(), styleTable, nStyles, 0, 0, 0);
+  mHighlighter = h;
+  update_highlights();
+}
+
+
 
 /**
  \brief Find the longest line of all visible lines.
 
+ If lines are not wrapped, the widths of all lines of the buffer are
+ cached. Lines that are not visible are measured in idle time, and the
+ longest of them is included in the result as soon as it is known.
+
  \return the width of the longest visible line in pixels
  */
 int Fl_Text_Display::longest_vline() const {
   int longest = 0;
-  for (int i = 0; i < mNVisibleLines; i++)
-    longest = max(longest, measure_vline(i));
+  Fl_Text_Line_Widths *lw = line_widths();
+  for (int i = 0; i < mNVisibleLines; i++) {
+    if (!lw || mLineStarts[i] < 0) {
+      longest = max(longest, measure_vline(i));
+      continue;
+    }
+    // without wrapping, visible line i is buffer line mTopLineNum-1+i
+    int line = mTopLineNum - 1 + i;
+    int w = lw->lookup(line);
+    if (w < 0) {
+      w = measure_vline(i);
+      lw->width(line, w);
+    }
+    longest = max(longest, w);
+  }
+  if (lw)
+    longest = max(longest, lw->longest());
   return longest;
 }
 
+
+/**
+ \brief Return the line width cache, or NULL if lines are wrapped.
+
+ Forgets the cached widths if the fonts have changed, and starts
+ measuring the lines that are not known yet in idle time.
+ */
+Fl_Text_Line_Widths *Fl_Text_Display::line_widths() const {
+  if (mContinuousWrap || !mBuffer)
+    return 0;
+  mLineWidths->sync(mNBufferLines + 1, textfont(), textsize(),
+                    mStyleTable, mNStyles);
+  if (mLineWidths->unknown() && !mLineWidths->idle) {
+    mLineWidths->idle = 1;
+    Fl::add_idle(line_widths_idle_cb, (void *)this);
+  }
+  return mLineWidths;
+}
+
+
+/**
+ \brief Return the number of the buffer line containing \p pos, counting
+ from 0.
+
+ Lines are counted from the top of the display if possible.
+ */
+int Fl_Text_Display::buffer_line(int pos) const {
+  if (!mContinuousWrap && pos >= mFirstChar && mFirstChar <= mBuffer->length())
+    return mTopLineNum - 1 + mBuffer->count_lines(mFirstChar, pos);
+  return mBuffer->count_lines(0, pos);
+}
+
+
+void Fl_Text_Display::line_widths_idle_cb(void *cbArg) {
+  ((Fl_Text_Display *)cbArg)->measure_lines_idle();
+}
+
+
+/**
+ \brief Measure some of the lines whose width is not cached yet.
+
+ Called in idle time until all lines are measured. Updates the horizontal
+ scrollbar if a longer line is found.
+ */
+void Fl_Text_Display::measure_lines_idle() {
+  Fl_Text_Line_Widths *lw = line_widths();
+  if (!lw || !lw->unknown() || !visible_r()) {
+    // restarted by longest_vline() when needed again
+    Fl::remove_idle(line_widths_idle_cb, this);
+    mLineWidths->idle = 0;
+    return;
+  }
+  int oldLongest = lw->longest();
+  int length = mBuffer->length();
+  int line = lw->scan_line(), pos = lw->scan_pos();
+  int budget = 64 * 1024;       // bytes measured at most in one call
+  for (int n = 0; n < 4096 && budget > 0 && lw->unknown(); n++) {
+    if (line >= lw->lines() || pos > length) {
+      line = 0;
+      pos = 0;
+    }
+    int end = mBuffer->line_end(pos);
+    if (lw->width(line) < 0) {
+      lw->width(line, end > pos ? handle_vline(GET_WIDTH, pos, end - pos,
+                                               0, 0, 0, 0, 0, 0) : 0);
+      budget -= end - pos + 1;
+    }
+    line++;
+    pos = end + 1;
+  }
+  lw->scan(line, pos);
+  if (lw->longest() != oldLongest) {
+    if (!mHScrollBar->visible() && lw->longest() > text_area.w)
+      recalc_display();
+    else
+      update_h_scrollbar();
+  }
+}
+
+
+/**
+ \brief Return statistics of the cache of line widths.
+
+ If lines are not wrapped, the width of every line of the buffer is cached
+ to find the longest line for the horizontal scrollbar. The lines that are
+ not visible are measured in idle time.
+
+ \param[out] hits number of visible lines whose width was cached
+ \param[out] misses number of visible lines that had to be measured
+ \param[out] measured number of lines whose width is currently known
+ \param[out] lines number of lines in the cache
+ */
+void Fl_Text_Display::line_width_stats(unsigned long *hits, unsigned long *misses,
+                                       int *measured, int *lines) const {
+  if (hits) *hits = mLineWidths->hits();
+  if (misses) *misses = mLineWidths->misses();
+  if (measured) *measured = mLineWidths->lines() - mLineWidths->unknown();
+  if (lines) *lines = mLineWidths->lines();
+}
+
+/**
+ \brief Count the wrapped lines of the buffer, and of the text above the
+ first visible character.
+
+ Sets mNBufferLines and mTopLineNum, mFirstChar must be at a line start.
+
+ Large buffers are split into chunks that are counted by worker threads.
+ Until they are done, the counts are estimated from the chunks that are
+ counted already, and update_wrap_counts() refines them in a timeout. The
+ counts are kept up to date when the text is changed, hence they are not
+ counted again as long as the wrap margin and the fonts stay the same.
+ */
+void Fl_Text_Display::count_wrapped_lines() {
+  Fl_Text_Buffer *buf = buffer();
+  if (!mContinuousWrap || buf->length() < WRAP_COUNT_ASYNC_SIZE ||
+      !Fl_Thread_Pool::shared()->threads()) {
+    if (mWrapCounter->active()) {
+      mWrapCounter->clear();
+      Fl::remove_timeout(wrap_count_timeout_cb, this);
+    }
+    mNBufferLines = count_lines(0, buf->length(), true);
+    mTopLineNum = count_lines(0, mFirstChar, true) + 1;
+    return;
+  }
+  int wrapPix = mWrapMarginPix ? mWrapMarginPix : text_area.w;
+  int tabPix = (int)col_to_x(buf->tab_distance());
+  unsigned fonts = wrap_fonts();
+  if (mWrapCounter->same_layout(buf, wrapPix, tabPix, fonts))
+    return;
+  mWrapCounter->start(buf, mStyleBuffer, mNStyles, wrapPix, tabPix, fonts);
+  if (!Fl::has_timeout(wrap_count_timeout_cb, this))
+    Fl::add_timeout(WRAP_COUNT_INTERVAL, wrap_count_timeout_cb, this);
+  mNBufferLines = mWrapCounter->lines();
+  int lines, start = mWrapCounter->chunk_start(mFirstChar, &lines);
+  mTopLineNum = lines + count_lines(start, mFirstChar, true) + 1;
+}
+
+
+/**
+ \brief Return a hash of the fonts used to wrap lines.
+ */
+unsigned Fl_Text_Display::wrap_fonts() const {
+  unsigned h = (unsigned)textfont() * 31 + (unsigned)textsize();
+  for (int i = 0; i < mNStyles; i++)
+    h = (h * 31 + (unsigned)mStyleTable[i].font) * 31 + (unsigned)mStyleTable[i].size;
+  h = h * 31 + (unsigned)(fl_graphics_driver->scale() * 1000);
+  return h * 31 + (unsigned)(fl_intptr_t)mStyleBuffer;
+}
+
+
+/**
+ \brief Return the position of the start of line \p lineNum, counting
+ from 1 at the start of the buffer.
+
+ Same as skip_lines(0, lineNum - 1, true), but if the wrapped lines of
+ a large buffer are counted by count_wrapped_lines(), lines are skipped
+ from the nearest counted chunk.
+ */
+int Fl_Text_Display::position_of_line(int lineNum) {
+  if (!mWrapCounter->active())
+    return skip_lines(0, lineNum - 1, true);
+  int lines, start = mWrapCounter->find_line(lineNum - 1, &lines);
+  return skip_lines(start, lineNum - 1 - lines, true);
+}
+
+
+double Fl_Text_Display::wrap_measure_cb(const char *s, int len, int slot, void *cbArg) {
+  return ((Fl_Text_Display *)cbArg)->string_width(s, len, slot ? 'A' + slot - 1 : 0);
+}
+
+
+void Fl_Text_Display::wrap_count_timeout_cb(void *cbArg) {
+  ((Fl_Text_Display *)cbArg)->update_wrap_counts();
+}
+
+
+/**
+ \brief Take the counts of the worker threads, see count_wrapped_lines().
+
+ Replaces the estimated number of lines by the counted number, and
+ updates the vertical scrollbar. Called in a timeout until all lines
+ are counted.
+ */
+void Fl_Text_Display::update_wrap_counts() {
+  if (mWrapCounter->poll()) {
+    mNBufferLines = mWrapCounter->lines();
+    int lines, start = mWrapCounter->chunk_start(mFirstChar, &lines);
+    mTopLineNum = lines + count_lines(start, mFirstChar, true) + 1;
+    mTopLineNumHint = mTopLineNum;
+    if (!mVScrollBar->visible() && mNBufferLines >= mNVisibleLines)
+      recalc_display();
+    else
+      update_v_scrollbar();
+  }
+  if (mWrapCounter->busy())
+    Fl::repeat_timeout(WRAP_COUNT_INTERVAL, wrap_count_timeout_cb, this);
+}
+
+
+void Fl_Text_Display::highlight_timeout_cb(void *cbArg) {
+  ((Fl_Text_Display *)cbArg)->update_highlights();
+}
+
+
+/**
+ \brief Compute the styles of the visible lines, see highlighter().
+
+ Takes the styles of the worker thread, if it is done, and highlights the
+ visible lines that were changed, or starts the worker thread on them.
+ Called in a timeout while the worker thread is busy.
+ */
+void Fl_Text_Display::update_highlights() {
+  if (!mHighlighter || !mBuffer) return;
+  int start, end;
+  if (mRestyler->update(mBuffer, mHighlighter, mFirstChar, mLastChar, &start, &end))
+    redisplay_range(start, end);
+  if (mRestyler->busy() && !Fl::has_timeout(highlight_timeout_cb, this))
+    Fl::add_timeout(HIGHLIGHT_INTERVAL, highlight_timeout_cb, this);
+}
+
+
 /**
  \brief Change the size of the displayed text area.
 
@@ -534,9 +857,8 @@ void Fl_Text_Display::recalc_display() {
     if (mContinuousWrap && !mWrapMarginPix && text_area.w != oldTAWidth) {
 
       int oldFirstChar = mFirstChar;
-      mNBufferLines = count_lines(0, buffer()->length(), true);
       mFirstChar = line_start(mFirstChar);
-      mTopLineNum = count_lines(0, mFirstChar, true)+1;
+      count_wrapped_lines();
       absolute_top_line_number(oldFirstChar);
 #ifdef DEBUG2
       printf("    mNBufferLines=%d\n", mNBufferLines);
@@ -732,6 +1054,14 @@ void Fl_Text_Display::redisplay_range(int startpos, int endpos) {
   IS_UTF8_ALIGNED2(buffer(), startpos)
   IS_UTF8_ALIGNED2(buffer(), endpos)
 
+  /* The styles of the range may have changed, and with them the widths */
+  if (mStyleBuffer && !mContinuousWrap && !mLineWidths->locked && mBuffer) {
+    int start = max(0, min(startpos, mBuffer->length()));
+    int end = max(start, min(endpos, mBuffer->length()));
+    mLineWidths->invalidate(buffer_line(start), mBuffer->line_start(start),
+                            buffer_line(end));
+  }
+
   if (damage_range1_start == -1 && damage_range1_end == -1) {
     damage_range1_start = startpos;
     damage_range1_end = endpos;
@@ -934,14 +1264,13 @@ void Fl_Text_Display::wrap_mode(int wrap, int wrapMargin) {
   }
 
   if (buffer()) {
-    /* wrapping can change the total number of lines, re-count */
-    mNBufferLines = count_lines(0, buffer()->length(), true);
-
     /* changing wrap margins or changing from wrapped mode to non-wrapped
      can leave the character at the top no longer at a line start, and/or
      change the line number */
     mFirstChar = line_start(mFirstChar);
-    mTopLineNum = count_lines(0, mFirstChar, true) + 1;
+
+    /* wrapping can change the total number of lines, re-count */
+    count_wrapped_lines();
 
     reset_absolute_top_line_number();
 
@@ -1634,7 +1963,12 @@ void Fl_Text_Display::previous_word() {
  */
 void Fl_Text_Display::buffer_predelete_cb(int pos, int nDeleted, void *cbArg) {
   Fl_Text_Display *textD = (Fl_Text_Display *)cbArg;
-  if (textD->mContinuousWrap) {
+  /* Count the deleted lines now, so that the buffer does not have to copy
+   the deleted text for buffer_modified_cb() */
+  textD->mNNewlinesDeleted =
+    nDeleted == 0 ? 0 : textD->mBuffer->count_lines( pos, pos + nDeleted );
+  /* large changes are not measured, see buffer_modified_cb() */
+  if (textD->mContinuousWrap && nDeleted < WRAP_RECOUNT_SIZE) {
   /* Note: we must perform this measurement, even if there is not a
    single character deleted; the number of "deleted" lines is the
    number of visual lines spanned by the real line in which the
@@ -1665,7 +1999,9 @@ void Fl_Text_Display::buffer_predelete_cb(int pos, int nDeleted, void *cbArg) {
  \param nInserted number of bytes we inserted (must be UTF-8 aligned!)
  \param nDeleted number of bytes deleted (must be UTF-8 aligned!)
  \param nRestyled ??
- \param deletedText this is what was removed, must not be NULL if nDeleted is set
+ \param deletedText this is what was removed, or NULL; in continuous wrap mode
+        without it all lines are counted again, unless buffer_predelete_cb()
+        counted the deleted lines before the text was deleted
  \param cbArg "this" pointer for static callback function
  */
 void Fl_Text_Display::buffer_modified_cb( int pos, int nInserted, int nDeleted,
@@ -1676,26 +2012,71 @@ void Fl_Text_Display::buffer_modified_cb( int pos, int nInserted, int nDeleted,
   int oldFirstChar = textD->mFirstChar;
   int scrolled, origCursorPos = textD->mCursorPos;
   int wrapModStart = 0, wrapModEnd = 0;
+  int recount = textD->mContinuousWrap &&
+                (nInserted >= WRAP_RECOUNT_SIZE || nDeleted >= WRAP_RECOUNT_SIZE);
+  /* find_wrap_range() needs the deleted text unless buffer_predelete_cb()
+   counted the deleted lines already; batched callbacks don't pass it */
+  if (textD->mContinuousWrap && nDeleted != 0 && !deletedText && !textD->mSuppressResync)
+    recount = 1;
 
   IS_UTF8_ALIGNED2(buf, pos)
   IS_UTF8_ALIGNED2(buf, oldFirstChar)
 
+  /* keep the styles of a highlighter in step with the text; the changed
+   lines are highlighted after the current event, see highlighter() */
+  if ( textD->mHighlighter && (nInserted != 0 || nDeleted != 0) ) {
+    textD->mRestyler->changed(pos, nDeleted, nInserted);
+    if (!Fl::has_timeout(highlight_timeout_cb, textD))
+      Fl::add_timeout(0.0, highlight_timeout_cb, textD);
+  }
+
   /* buffer modification cancels vertical cursor motion column */
   if ( nInserted != 0 || nDeleted != 0 )
     textD->mCursorPreferredXPos = -1;
 
   /* Count the number of lines inserted and deleted, and in the case
    of continuous wrap mode, how much has changed */
-  if (textD->mContinuousWrap) {
+  if (recount) {
+    /* a large part of the text was replaced: count all lines again below,
+     instead of counting the lines of the old and the new text */
+    linesInserted = linesDeleted = 0;
+    textD->mSuppressResync = 0;
+    textD->mLineWidths->reset(0);
+  } else if (textD->mContinuousWrap) {
     textD->find_wrap_range(deletedText, pos, nInserted, nDeleted,
                            &wrapModStart, &wrapModEnd, &linesInserted, &linesDeleted);
+    /* keep the counts of a large buffer up to date, see count_wrapped_lines() */
+    if ( (nInserted != 0 || nDeleted != 0) && textD->mWrapCounter->active() ) {
+      textD->mWrapCounter->changed(pos, nDeleted, nInserted);
+      if (!Fl::has_timeout(wrap_count_timeout_cb, textD))
+        Fl::add_timeout(WRAP_COUNT_INTERVAL, wrap_count_timeout_cb, textD);
+    }
+    /* line widths are only cached without wrapping, see longest_vline() */
+    if ( (nInserted != 0 || nDeleted != 0) && textD->mLineWidths->lines() )
+      textD->mLineWidths->reset(0);
   } else {
     linesInserted = nInserted == 0 ? 0 : buf->count_lines( pos, pos + nInserted );
-    linesDeleted = nDeleted == 0 ? 0 : countlines( deletedText );
+    linesDeleted = nDeleted == 0 ? 0 : textD->mNNewlinesDeleted;
+    /* Forget the widths of the changed lines while mTopLineNum still
+     refers to the old text */
+    if ( nInserted != 0 || nDeleted != 0 )
+      textD->mLineWidths->changed( textD->buffer_line(pos), buf->line_start(pos),
+                                   linesDeleted, linesInserted );
   }
 
   /* Update the line starts and mTopLineNum */
-  if ( nInserted != 0 || nDeleted != 0 ) {
+  if ( recount ) {
+    if ( pos + nDeleted <= oldFirstChar )
+      textD->mFirstChar += nInserted - nDeleted;
+    else if ( pos < oldFirstChar )
+      textD->mFirstChar = pos;
+    textD->mFirstChar = textD->line_start( min(textD->mFirstChar, buf->length()) );
+    textD->mWrapCounter->clear();
+    textD->count_wrapped_lines();
+    textD->calc_line_starts( 0, textD->mNVisibleLines );
+    textD->calc_last_char();
+    scrolled = 1;
+  } else if ( nInserted != 0 || nDeleted != 0 ) {
     if (textD->mContinuousWrap) {
       textD->update_line_starts( wrapModStart, wrapModEnd-wrapModStart,
                                 nDeleted + pos-wrapModStart + (wrapModEnd-(pos+nInserted)),
@@ -1711,9 +2092,9 @@ void Fl_Text_Display::buffer_modified_cb( int pos, int nInserted, int nDeleted,
    (non-wrapped) line number of the text displayed */
   if (textD->maintaining_absolute_top_line_number() &&
       (nInserted != 0 || nDeleted != 0)) {
-    if (deletedText && (pos + nDeleted < oldFirstChar))
+    if (pos + nDeleted < oldFirstChar)
       textD->mAbsTopLineNum += buf->count_lines(pos, pos + nInserted) -
-                               countlines(deletedText);
+                               (nDeleted == 0 ? 0 : textD->mNNewlinesDeleted);
     else if (pos < oldFirstChar)
       textD->reset_absolute_top_line_number();
   }
@@ -1800,8 +2181,11 @@ void Fl_Text_Display::buffer_modified_cb( int pos, int nInserted, int nDeleted,
   IS_UTF8_ALIGNED2(buf, startDispPos)
   IS_UTF8_ALIGNED2(buf, endDispPos)
 
-  /* Redisplay computed range */
+  /* Redisplay computed range. The widths of changed lines are already
+   forgotten, and selecting text does not change them */
+  textD->mLineWidths->locked++;
   textD->redisplay_range( startDispPos, endDispPos );
+  textD->mLineWidths->locked--;
 }
 
 
@@ -2169,20 +2553,27 @@ int Fl_Text_Display::find_x(const char *s, int len, int style, int x) const {
   int cursor_pos = x<0; // STR #2788
   x = x<0 ? -x : x;     // STR #2788
 
-  // TODO: use binary search which may be quicker.
-  int i = 0;
-  int last_w = 0;       // STR #2788
-  while (i<len) {
-    int cl = fl_utf8len1(s[i]);
-    int w = int( string_width(s, i+cl, style) );
-    if (w>x) {
-      if (cursor_pos && (w-x < x-last_w)) return i+cl; // STR #2788
-      return i;
-    }
-    last_w = w;        // STR #2788
-    i += cl;
+  // binary search for the first character that ends right of x
+  int lo = 0, hi = len;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    while (mid > lo && (s[mid] & 0xc0) == 0x80) mid--;
+    int cl = fl_utf8len1(s[mid]);
+    if (cl < 1) cl = 1;
+    if (int( string_width(s, mid+cl, style) ) > x)
+      hi = mid;
+    else
+      lo = mid + cl;
+  }
+  if (lo >= len) return len;
+  int cl = fl_utf8len1(s[lo]);
+  if (cl < 1) cl = 1;
+  if (cursor_pos) {    // STR #2788
+    int w = int( string_width(s, lo+cl, style) );
+    int last_w = lo ? int( string_width(s, lo, style) ) : 0;
+    if (w-x < x-last_w) return lo+cl;
   }
-  return len;
+  return lo;
 }
 
 
@@ -2529,6 +2920,9 @@ int Fl_Text_Display::position_style( int lineStartPos, int lineLen, int lineInde
 /**
  \brief Find the width of a string in the font of a particular style.
 
+ Widths of short strings are cached, and ASCII text in fixed width fonts
+ is not measured at all.
+
  \param string the text
  \param length number of bytes in string
  \param style index into style table
@@ -2552,7 +2946,7 @@ double Fl_Text_Display::string_width( const char *string, int length, int style
     fsize = textsize();
   }
   fl_font( font, fsize );
-  return fl_width( string, length );
+  return mWidthCache->width( font, fsize, string, length );
 }
 
 
@@ -2661,7 +3055,10 @@ void Fl_Text_Display::offset_line_starts( int newTopLineNum ) {
    lineStarts array) */
   lastLineNum = oldTopLineNum + nVisLines - 1;
   if ( newTopLineNum < oldTopLineNum && newTopLineNum < -lineDelta ) {
-    mFirstChar = skip_lines( 0, newTopLineNum - 1, true );
+    mFirstChar = position_of_line( newTopLineNum );
+  } else if ( mWrapCounter->active() && abs(lineDelta) > nVisLines ) {
+    /* far away in a large buffer, start at the nearest counted chunk */
+    mFirstChar = position_of_line( newTopLineNum );
   } else if ( newTopLineNum < oldTopLineNum ) {
     mFirstChar = rewind_lines( mFirstChar, -lineDelta );
   } else if ( newTopLineNum < lastLineNum ) {
@@ -2748,7 +3145,7 @@ void Fl_Text_Display::update_line_starts(int pos, int charsInserted,
         mTopLineNum = 1;
         mFirstChar = 0;
       } else
-        mFirstChar = skip_lines( 0, mTopLineNum - 1, true );
+        mFirstChar = position_of_line( mTopLineNum );
     }
     calc_line_starts( 0, nVisLines - 1 );
     /* calculate lastChar by finding the end of the last displayed line */
@@ -3072,23 +3469,6 @@ static int min( int i1, int i2 ) {
 }
 
 
-/**
- Count the number of newlines in a null-terminated text string;
- */
-static int countlines( const char *string ) {
-  IS_UTF8_ALIGNED(string)
-
-  const char * c;
-  int lineCount = 0;
-
-  if (!string) return 0;
-
-  for ( c = string; *c != '\0'; c++ )
-    if ( *c == '\n' ) lineCount++;
-  return lineCount;
-}
-
-
 /**
  \brief Returns the width in pixels of the displayed line pointed to by "visLineNum".
  \param visLineNum index into visible lines array
@@ -3303,7 +3683,7 @@ void Fl_Text_Display::find_wrap_range(const char *deletedText, int pos,
   length = (pos-countFrom) + nDeleted +(countTo-(pos+nInserted));
   deletedTextBuf = new Fl_Text_Buffer(length);
   deletedTextBuf->copy(buffer(), countFrom, pos, 0);
-  if (nDeleted != 0)
+  if (nDeleted != 0 && deletedText)
     deletedTextBuf->insert(pos-countFrom, deletedText);
   deletedTextBuf->copy(buffer(), pos+nInserted, countTo, pos-countFrom+nDeleted);
   /* Note that we need to take into account an offset for the style buffer:
@@ -3545,7 +3925,7 @@ void Fl_Text_Display::wrapped_line_counter(Fl_Text_Buffer *buf, int startPos,
   *retPos = buf->length();
   *retLines = nLines;
   if (countLastLineMissingNewLine && colNum > 0)
-    *retLines = buf->next_char(*retLines);
+    (*retLines)++;
   *retLineStart = lineStart;
   *retLineEnd = buf->length();
 }
@@ -3728,6 +4108,9 @@ void Fl_Text_Display::draw(void) {
   // don't even try if there is no associated text buffer!
   if (!buffer()) { draw_box(); return; }
 
+  // text loaded by Fl_Text_Buffer::mapfile() is checked where it is shown
+  buffer()->check_utf8(mFirstChar, mLastChar);
+
   fl_push_clip(x(),y(),w(),h());	// prevent drawing outside widget area
 
   // background color -- change if inactive
@@ -3848,6 +4231,11 @@ void Fl_Text_Display::draw(void) {
   draw_line_numbers(true);
 
   fl_pop_clip();
+
+  // lines that were scrolled into view may need new styles
+  if (mHighlighter && !Fl::has_timeout(highlight_timeout_cb, this) &&
+      mRestyler->dirty(mBuffer, mFirstChar, mLastChar))
+    Fl::add_timeout(0.0, highlight_timeout_cb, this);
 }
 
 
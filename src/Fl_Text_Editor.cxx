@@ -135,6 +135,8 @@ static struct {
 //{ FL_Clear,	  0,                        Fl_Text_Editor::delete_to_eol },
   { 'z',          FL_CTRL,                  Fl_Text_Editor::kf_undo	  },
   { '/',          FL_CTRL,                  Fl_Text_Editor::kf_undo	  },
+  { 'z',          FL_CTRL|FL_SHIFT,         Fl_Text_Editor::kf_redo	  },
+  { 'y',          FL_CTRL,                  Fl_Text_Editor::kf_redo	  },
   { 'x',          FL_CTRL,                  Fl_Text_Editor::kf_cut        },
   { FL_Delete,    FL_SHIFT,                 Fl_Text_Editor::kf_cut        },
   { 'c',          FL_CTRL,                  Fl_Text_Editor::kf_copy       },
@@ -602,10 +604,30 @@ int Fl_Text_Editor::kf_undo(int , Fl_Text_Editor* e) {
   Fl::copy("", 0, 0);
   int crsr;
   int ret = e->buffer()->undo(&crsr);
-  e->insert_position(crsr);
-  e->show_insert_position();
-  e->set_changed();
-  if (e->when()&FL_WHEN_CHANGED) e->do_callback();
+  if (ret) {
+    e->insert_position(crsr);
+    e->show_insert_position();
+    e->set_changed();
+    if (e->when()&FL_WHEN_CHANGED) e->do_callback();
+  }
+  return ret;
+}
+
+/** Redo the last undone edit in the current buffer of editor \p 'e'.
+    Also deselects previous selection.
+    The key value \p 'c' is currently unused.
+*/
+int Fl_Text_Editor::kf_redo(int , Fl_Text_Editor* e) {
+  e->buffer()->unselect();
+  Fl::copy("", 0, 0);
+  int crsr;
+  int ret = e->buffer()->redo(&crsr);
+  if (ret) {
+    e->insert_position(crsr);
+    e->show_insert_position();
+    e->set_changed();
+    if (e->when()&FL_WHEN_CHANGED) e->do_callback();
+  }
   return ret;
 }
 
@@ -0,0 +1,313 @@
+//
+// "$Id$"
+//
+// Line index for the Fl_Text_Buffer class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Line_Index.H"
+#include <FL/Fl_Text_Buffer.H>
+#include <stdlib.h>
+
+/*
+ New chunks are CHUNK_SIZE bytes long. Chunks grow while text is typed
+ into them, up to MAX_CHUNK_SIZE bytes; larger inserts create new chunks.
+ */
+static const int CHUNK_SIZE = 4 * 1024;
+static const int MAX_CHUNK_SIZE = 4 * CHUNK_SIZE;
+
+
+Fl_Text_Line_Index::Fl_Text_Line_Index(const Fl_Text_Buffer *buf)
+{
+  buf_ = buf;
+  seed_ = 0x2545f491;
+  root_ = chunks(0, buf_->length());
+}
+
+
+Fl_Text_Line_Index::~Fl_Text_Line_Index()
+{
+  free_tree(root_);
+}
+
+
+void Fl_Text_Line_Index::reset()
+{
+  free_tree(root_);
+  root_ = chunks(0, buf_->length());
+}
+
+
+/*
+ Update the index after len bytes were inserted at pos. Small inserts
+ grow the chunk that contains pos, larger ones get chunks of their own.
+ */
+void Fl_Text_Line_Index::inserted(int pos, int len)
+{
+  if (len <= 0)
+    return;
+
+  // find the chunk that ends at or contains pos
+  Chunk *t = root_;
+  int base = 0;
+  while (t) {
+    int cs = base + total(t->left), ce = cs + t->len;
+    if (pos <= cs && t->left) t = t->left;
+    else if (pos > ce && t->right) { base = ce; t = t->right; }
+    else break;
+  }
+
+  if (t && t->len + len <= MAX_CHUNK_SIZE) {
+    int nl = buf_->count_lines_(pos, pos + len);
+    // walk the same path again and update all subtree sizes
+    Chunk *c = root_;
+    base = 0;
+    while (c) {
+      int cs = base + total(c->left), ce = cs + c->len;
+      c->total += len;
+      c->totalNl += nl;
+      if (c == t) break;
+      if (pos <= cs && c->left) c = c->left;
+      else { base = ce; c = c->right; }
+    }
+    t->len += len;
+    t->nl += nl;
+    return;
+  }
+
+  Chunk *l, *r;
+  split(root_, 0, pos, l, r);
+  root_ = join(join(l, chunks(pos, len)), r);
+}
+
+
+/*
+ Update the index before the bytes between start and end are removed.
+ */
+void Fl_Text_Line_Index::removed(int start, int end)
+{
+  if (end <= start)
+    return;
+  Chunk *l, *m, *r;
+  split(root_, 0, start, l, m);
+  split(m, start, end - start, m, r);
+  free_tree(m);
+  root_ = join(l, r);
+}
+
+
+/*
+ Return the number of newlines between the start of the text and pos.
+ */
+int Fl_Text_Line_Index::lines_before(int pos) const
+{
+  int n = 0, base = 0;
+  const Chunk *t = root_;
+  while (t) {
+    int cs = base + total(t->left), ce = cs + t->len;
+    if (pos < cs) {
+      t = t->left;
+    } else if (pos >= ce) {
+      n += total_nl(t->left) + t->nl;
+      base = ce;
+      t = t->right;
+    } else {
+      return n + total_nl(t->left) + buf_->count_lines_(cs, pos);
+    }
+  }
+  return n;
+}
+
+
+/*
+ Return the position of the n-th newline in the text, n starting at 1.
+ Returns -1 if the text has less than n newlines.
+ */
+int Fl_Text_Line_Index::newline_pos(int n) const
+{
+  if (n < 1 || n > total_nl(root_))
+    return -1;
+  int base = 0;
+  const Chunk *t = root_;
+  while (t) {
+    int ln = total_nl(t->left);
+    if (n <= ln) {
+      t = t->left;
+    } else if (n <= ln + t->nl) {
+      return buf_->skip_lines_(base + total(t->left), n - ln) - 1;
+    } else {
+      n -= ln + t->nl;
+      base += total(t->left) + t->len;
+      t = t->right;
+    }
+  }
+  return -1;
+}
+
+
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::new_chunk(int len, int nl)
+{
+  Chunk *c = (Chunk *)malloc(sizeof(Chunk));
+  c->len = c->total = len;
+  c->nl = c->totalNl = nl;
+  c->prio = random();
+  c->left = c->right = 0;
+  return c;
+}
+
+
+void Fl_Text_Line_Index::free_tree(Chunk *c)
+{
+  if (!c)
+    return;
+  free_tree(c->left);
+  free_tree(c->right);
+  free(c);
+}
+
+
+/*
+ Create a tree of new chunks for len bytes of text starting at start.
+ */
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::chunks(int start, int len)
+{
+  Chunk *t = 0;
+  for (int end = start + len; start < end; start += CHUNK_SIZE) {
+    int n = end - start < CHUNK_SIZE ? end - start : CHUNK_SIZE;
+    t = merge(t, new_chunk(n, buf_->count_lines_(start, start + n)));
+  }
+  return t;
+}
+
+
+/*
+ Split tree t, whose text starts at byte offset base, into l, holding
+ the chunks before pos, and r. A chunk that straddles pos is cut in two;
+ the newlines of its parts are counted in the buffer.
+ */
+void Fl_Text_Line_Index::split(Chunk *t, int base, int pos, Chunk *&l, Chunk *&r)
+{
+  if (!t) {
+    l = r = 0;
+    return;
+  }
+  int lt = total(t->left);
+  if (pos <= lt) {
+    split(t->left, base, pos, l, t->left);
+    update(t);
+    r = t;
+  } else if (pos >= lt + t->len) {
+    split(t->right, base + lt + t->len, pos - lt - t->len, t->right, r);
+    update(t);
+    l = t;
+  } else {
+    int off = pos - lt;
+    int nl = buf_->count_lines_(base + lt, base + pos);
+    Chunk *tail = new_chunk(t->len - off, t->nl - nl);
+    Chunk *right = t->right;
+    t->len = off;
+    t->nl = nl;
+    t->right = 0;
+    update(t);
+    l = t;
+    r = merge(tail, right);
+  }
+}
+
+
+/*
+ Concatenate two trees. All text in l comes before all text in r.
+ */
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::merge(Chunk *l, Chunk *r)
+{
+  if (!l) return r;
+  if (!r) return l;
+  if (l->prio > r->prio) {
+    l->right = merge(l->right, r);
+    update(l);
+    return l;
+  }
+  r->left = merge(l, r->left);
+  update(r);
+  return r;
+}
+
+
+/*
+ Concatenate two trees and combine the chunks at the seam if they are
+ small, so that repeated edits at the same place do not fragment the index.
+ */
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::join(Chunk *l, Chunk *r)
+{
+  if (!l || !r)
+    return merge(l, r);
+  Chunk *a = pop_last(l);
+  Chunk *b = pop_first(r);
+  if (a->len + b->len <= CHUNK_SIZE) {
+    a->len += b->len;
+    a->nl += b->nl;
+    update(a);
+    free(b);
+    return merge(merge(l, a), r);
+  }
+  return merge(merge(merge(l, a), b), r);
+}
+
+
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::pop_first(Chunk *&t)
+{
+  Chunk *c;
+  if (!t->left) {
+    c = t;
+    t = t->right;
+    c->right = 0;
+  } else {
+    c = pop_first(t->left);
+    update(t);
+  }
+  update(c);
+  return c;
+}
+
+
+Fl_Text_Line_Index::Chunk *Fl_Text_Line_Index::pop_last(Chunk *&t)
+{
+  Chunk *c;
+  if (!t->right) {
+    c = t;
+    t = t->left;
+    c->left = 0;
+  } else {
+    c = pop_last(t->right);
+    update(t);
+  }
+  update(c);
+  return c;
+}
+
+
+/*
+ Simple xorshift generator for the treap priorities.
+ */
+unsigned Fl_Text_Line_Index::random()
+{
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  return seed_;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,237 @@
+//
+// "$Id$"
+//
+// Line width cache for the Fl_Text_Display class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Line_Widths.H"
+#include <stdlib.h>
+#include <string.h>
+
+
+// Adds w to the max-heap h with n entries.
+static void heap_push(int *&h, int &n, int &alloc, int w)
+{
+  if (n >= alloc) {
+    alloc = alloc ? 2 * alloc : 256;
+    h = (int *)realloc(h, alloc * sizeof(int));
+  }
+  int i = n++;
+  while (i > 0 && h[(i - 1) / 2] < w) {
+    h[i] = h[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h[i] = w;
+}
+
+// Moves h[i] down to its place in the max-heap h with n entries.
+static void heap_sift_down(int *h, int n, int i)
+{
+  int w = h[i];
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= n)
+      break;
+    if (c + 1 < n && h[c + 1] > h[c])
+      c++;
+    if (h[c] <= w)
+      break;
+    h[i] = h[c];
+    i = c;
+  }
+  h[i] = w;
+}
+
+// Removes the largest entry of the max-heap h with n entries.
+static void heap_pop(int *h, int &n)
+{
+  h[0] = h[--n];
+  if (n > 0)
+    heap_sift_down(h, n, 0);
+}
+
+
+Fl_Text_Line_Widths::Fl_Text_Line_Widths()
+{
+  w_ = 0;
+  n_ = alloc_ = 0;
+  unknown_ = 0;
+  heap_ = gone_ = 0;
+  nHeap_ = allocHeap_ = nGone_ = allocGone_ = 0;
+  scanLine_ = scanPos_ = 0;
+  hits_ = misses_ = 0;
+  font_ = size_ = -1;
+  styles_ = 0;
+  nStyles_ = 0;
+  idle = 0;
+  locked = 0;
+}
+
+
+Fl_Text_Line_Widths::~Fl_Text_Line_Widths()
+{
+  free(w_);
+  free(heap_);
+  free(gone_);
+}
+
+
+void Fl_Text_Line_Widths::reset(int n)
+{
+  if (n > alloc_) {
+    alloc_ = n + n / 4 + 64;
+    w_ = (int *)realloc(w_, alloc_ * sizeof(int));
+  }
+  memset(w_, 0xff, n * sizeof(int));
+  n_ = unknown_ = n;
+  nHeap_ = nGone_ = 0;
+  scanLine_ = scanPos_ = 0;
+}
+
+
+void Fl_Text_Line_Widths::sync(int n, int font, int size, const void *styles,
+                               int nStyles)
+{
+  if (n == n_ && font == font_ && size == size_ && styles == styles_ &&
+      nStyles == nStyles_)
+    return;
+  font_ = font;
+  size_ = size;
+  styles_ = styles;
+  nStyles_ = nStyles;
+  reset(n);
+}
+
+
+void Fl_Text_Line_Widths::changed(int line, int pos, int nDeleted, int nInserted)
+{
+  int n = n_ + nInserted - nDeleted;
+  if (line < 0 || line + nDeleted >= n_) {
+    reset(n > 0 ? n : 0);
+    return;
+  }
+  invalidate(line, pos, line + nDeleted);
+  if (n > alloc_) {
+    alloc_ = n + n / 4 + 64;
+    w_ = (int *)realloc(w_, alloc_ * sizeof(int));
+  }
+  int tail = line + nDeleted + 1;
+  memmove(w_ + line + nInserted + 1, w_ + tail, (n_ - tail) * sizeof(int));
+  if (nInserted > nDeleted)
+    memset(w_ + tail, 0xff, (nInserted - nDeleted) * sizeof(int));
+  unknown_ += nInserted - nDeleted;
+  n_ = n;
+}
+
+
+void Fl_Text_Line_Widths::invalidate(int first, int pos, int last)
+{
+  if (first < 0)
+    first = 0;
+  if (last >= n_)
+    last = n_ - 1;
+  for (int i = first; i <= last; i++) {
+    if (w_[i] < 0)
+      continue;
+    remove(w_[i]);
+    w_[i] = -1;
+    unknown_++;
+  }
+  compact();
+  rewind(first, pos);
+}
+
+
+int Fl_Text_Line_Widths::lookup(int line)
+{
+  int w = width(line);
+  if (w < 0)
+    misses_++;
+  else
+    hits_++;
+  return w;
+}
+
+
+void Fl_Text_Line_Widths::width(int line, int w)
+{
+  if (line < 0 || line >= n_ || w < 0)
+    return;
+  if (w_[line] == w)
+    return;
+  if (w_[line] < 0)
+    unknown_--;
+  else
+    remove(w_[line]);
+  w_[line] = w;
+  add(w);
+  compact();
+}
+
+
+int Fl_Text_Line_Widths::longest()
+{
+  while (nGone_ > 0 && gone_[0] == heap_[0]) {
+    heap_pop(heap_, nHeap_);
+    heap_pop(gone_, nGone_);
+  }
+  return nHeap_ > 0 ? heap_[0] : 0;
+}
+
+
+void Fl_Text_Line_Widths::add(int w)
+{
+  heap_push(heap_, nHeap_, allocHeap_, w);
+}
+
+
+void Fl_Text_Line_Widths::remove(int w)
+{
+  heap_push(gone_, nGone_, allocGone_, w);
+}
+
+
+/*
+ Widths that are smaller than the longest one stay in the heaps until they
+ get to the top, so both heaps are rebuilt from the known widths when most
+ of their entries are gone.
+ */
+void Fl_Text_Line_Widths::compact()
+{
+  if (nGone_ <= 1024 || nGone_ <= nHeap_ / 2)
+    return;
+  nHeap_ = nGone_ = 0;
+  for (int i = 0; i < n_; i++)
+    if (w_[i] >= 0)
+      heap_[nHeap_++] = w_[i];
+  for (int i = nHeap_ / 2 - 1; i >= 0; i--)
+    heap_sift_down(heap_, nHeap_, i);
+}
+
+
+/*
+ Makes sure that the idle scan does not miss the given line.
+ */
+void Fl_Text_Line_Widths::rewind(int line, int pos)
+{
+  if (line <= scanLine_) {
+    scanLine_ = line;
+    scanPos_ = pos;
+  }
+}
+
+//
+// End of "$Id$".
+//
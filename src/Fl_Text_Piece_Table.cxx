@@ -0,0 +1,438 @@
+//
+// "$Id$"
+//
+// Piece table text storage for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Piece_Table.H"
+#include <stdlib.h>
+#include <string.h>
+
+// Atomic operations for the cache of segment(), or no cache if the
+// compiler has none
+#if defined(_WIN32)
+#  include <windows.h>
+#  define FL_PIECE_CACHE 1
+#elif defined(__GNUC__)
+#  define FL_PIECE_CACHE 1
+#else
+#  define FL_PIECE_CACHE 0
+#endif
+
+/*
+ Inserted text is appended to storage blocks of this size. Larger inserts
+ get their own blocks of up to MAX_CHUNK bytes each, so that even very
+ large documents are never stored in one contiguous memory block.
+ */
+static const int BLOCK_SIZE = 64 * 1024;
+static const int MAX_CHUNK = 1024 * 1024;
+
+/*
+ Writing through writable_address() copies this many bytes of a mapped
+ file into the storage blocks.
+ */
+static const int COPY_CHUNK = 4096;
+
+// returned for positions at or after the end of the text
+static const char empty_text[] = "";
+
+// returned by writable_address() for positions at or after the end of the text
+static char no_text[4];
+
+
+Fl_Text_Piece_Table::Fl_Text_Piece_Table()
+{
+  root_ = 0;
+  blocks_ = 0;
+  nPieces_ = 0;
+  seed_ = 0x9e3779b9;
+  cacheData_ = 0;
+  cacheStart_ = cacheLen_ = 0;
+  cacheBusy_ = 0;
+}
+
+
+Fl_Text_Piece_Table::~Fl_Text_Piece_Table()
+{
+  clear();
+}
+
+
+/*
+ Remove all pieces and free all text storage.
+ */
+void Fl_Text_Piece_Table::clear()
+{
+  free_tree(root_);
+  root_ = 0;
+  while (blocks_) {
+    Block *next = blocks_->next;
+    free(blocks_);
+    blocks_ = next;
+  }
+  invalidate();
+}
+
+
+/*
+ Return the piece that contains the byte at pos. The offset of the first
+ byte of the piece is returned in start, its size in len.
+ If pos is not inside the text, an empty string is returned, start is set
+ to length() and len to 0.
+ */
+const char *Fl_Text_Piece_Table::segment(int pos, int *start, int *len) const
+{
+  int cached = lock_cache();
+  if (cached && cacheData_ && pos >= cacheStart_ && pos < cacheStart_ + cacheLen_) {
+    const char *data = cacheData_;
+    *start = cacheStart_;
+    *len = cacheLen_;
+    unlock_cache();
+    return data;
+  }
+  const Piece *t = root_;
+  int base = 0;
+  while (t && pos >= 0) {
+    int lt = total(t->left);
+    if (pos < base + lt) {
+      t = t->left;
+    } else if (pos < base + lt + t->len) {
+      *start = base + lt;
+      *len = t->len;
+      if (cached) {
+        cacheData_ = t->data;
+        cacheStart_ = *start;
+        cacheLen_ = *len;
+        unlock_cache();
+      }
+      return t->data;
+    } else {
+      base += lt + t->len;
+      t = t->right;
+    }
+  }
+  if (cached)
+    unlock_cache();
+  *start = length();
+  *len = 0;
+  return empty_text;
+}
+
+
+/*
+ Take the cache of segment() if no other thread uses it. Returns 0 if the
+ cache is busy, or if there are no atomic operations to guard it.
+ */
+int Fl_Text_Piece_Table::lock_cache() const
+{
+#if defined(_WIN32)
+  return InterlockedExchange((LONG volatile *)&cacheBusy_, 1) == 0;
+#elif FL_PIECE_CACHE
+  return __atomic_exchange_n(&cacheBusy_, 1, __ATOMIC_ACQUIRE) == 0;
+#else
+  return 0;
+#endif
+}
+
+
+void Fl_Text_Piece_Table::unlock_cache() const
+{
+#if defined(_WIN32)
+  InterlockedExchange((LONG volatile *)&cacheBusy_, 0);
+#elif FL_PIECE_CACHE
+  __atomic_store_n(&cacheBusy_, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+
+/*
+ Return the address of the byte at pos. The returned memory is contiguous
+ up to the end of the piece only, which is always at a character boundary.
+ */
+const char *Fl_Text_Piece_Table::address(int pos) const
+{
+  int start, len;
+  const char *s = segment(pos, &start, &len);
+  if (!len)
+    return empty_text;
+  return s + (pos - start);
+}
+
+
+/*
+ Return the address of the byte at pos for writing. If the byte is in a
+ piece that is stored elsewhere (a mapped file, which is read-only), up
+ to COPY_CHUNK bytes from pos on are copied into the storage blocks and
+ replace that part of the piece, so that the file is never written.
+ */
+char *Fl_Text_Piece_Table::writable_address(int pos)
+{
+  const Piece *t = root_;
+  int base = 0;
+  while (t) {
+    int lt = total(t->left);
+    if (pos < base + lt) {
+      t = t->left;
+    } else if (pos < base + lt + t->len) {
+      break;
+    } else {
+      base += lt + t->len;
+      t = t->right;
+    }
+  }
+  if (!t || pos < 0)
+    return no_text;
+  int off = pos - base - total(t->left);
+  if (!t->external)
+    return (char *)t->data + off;   // our own storage blocks
+
+  // copy whole UTF-8 characters
+  const char *src = t->data + off;
+  int n = t->len - off;
+  if (n > COPY_CHUNK) {
+    n = COPY_CHUNK;
+    while (n > 1 && (src[n] & 0xc0) == 0x80)
+      n--;
+  }
+  const char *s = store(src, n);
+  invalidate();
+  Piece *l, *m, *r;
+  split(root_, pos, l, m);
+  split(m, n, m, r);
+  free_tree(m);
+  root_ = merge(merge(l, new_piece(s, n)), r);
+  return (char *)s;
+}
+
+
+/*
+ Copy the bytes between start and end to dest.
+ */
+void Fl_Text_Piece_Table::copy(int start, int end, char *dest) const
+{
+  while (start < end) {
+    int segStart, segLen;
+    const char *s = segment(start, &segStart, &segLen);
+    if (!segLen)
+      break;
+    int n = segStart + segLen - start;
+    if (n > end - start)
+      n = end - start;
+    memcpy(dest, s + (start - segStart), n);
+    dest += n;
+    start += n;
+  }
+}
+
+
+/*
+ Insert text at pos. Text that follows the previously inserted text in
+ storage (e.g. while typing) extends the previous piece instead of
+ creating a new one.
+ */
+void Fl_Text_Piece_Table::insert(int pos, const char *text, int len)
+{
+  if (len <= 0)
+    return;
+  invalidate();
+
+  Piece *l, *r;
+  split(root_, pos, l, r);
+  while (len > 0) {
+    int n = len;
+    if (n > MAX_CHUNK) {
+      // do not split a UTF-8 sequence between two pieces
+      n = MAX_CHUNK;
+      while (n > 0 && (text[n] & 0xc0) == 0x80)
+        n--;
+      if (!n)
+        n = MAX_CHUNK;
+    }
+    const char *s = store(text, n);
+    Piece *last = l;
+    while (last && last->right)
+      last = last->right;
+    if (last && last->data + last->len == s) {
+      for (Piece *p = l; p; p = p->right)
+        p->total += n;
+      last->len += n;
+    } else {
+      l = merge(l, new_piece(s, n));
+    }
+    text += n;
+    len -= n;
+  }
+  root_ = merge(l, r);
+}
+
+
+/*
+ Insert len bytes at pos without copying them. This is used for text that
+ is memory mapped from a file; the caller must keep data valid until the
+ text is removed with clear().
+ */
+void Fl_Text_Piece_Table::insert_external(int pos, const char *data, int len)
+{
+  if (len <= 0)
+    return;
+  invalidate();
+
+  Piece *l, *r;
+  split(root_, pos, l, r);
+  root_ = merge(merge(l, new_piece(data, len, 1)), r);
+}
+
+
+/*
+ Remove the bytes between start and end. The text storage itself is not
+ reclaimed until clear() is called.
+ */
+void Fl_Text_Piece_Table::remove(int start, int end)
+{
+  if (end <= start)
+    return;
+  invalidate();
+
+  Piece *l, *m, *r;
+  split(root_, start, l, m);
+  split(m, end - start, m, r);
+  free_tree(m);
+  root_ = merge(l, r);
+}
+
+
+Fl_Text_Piece_Table::Piece *Fl_Text_Piece_Table::new_piece(const char *data, int len, int external)
+{
+  Piece *p = (Piece *)malloc(sizeof(Piece));
+  p->data = data;
+  p->len = p->total = len;
+  p->external = external;
+  p->prio = random();
+  p->left = p->right = 0;
+  nPieces_++;
+  return p;
+}
+
+
+void Fl_Text_Piece_Table::free_tree(Piece *p)
+{
+  if (!p)
+    return;
+  free_tree(p->left);
+  free_tree(p->right);
+  free(p);
+  nPieces_--;
+}
+
+
+/*
+ Split tree t into l, holding the bytes before pos, and r, holding the
+ bytes from pos on. A piece that straddles pos is cut in two.
+ */
+void Fl_Text_Piece_Table::split(Piece *t, int pos, Piece *&l, Piece *&r)
+{
+  if (!t) {
+    l = r = 0;
+    return;
+  }
+  int lt = total(t->left);
+  if (pos <= lt) {
+    split(t->left, pos, l, t->left);
+    update(t);
+    r = t;
+  } else if (pos >= lt + t->len) {
+    split(t->right, pos - lt - t->len, t->right, r);
+    update(t);
+    l = t;
+  } else {
+    int off = pos - lt;
+    Piece *tail = new_piece(t->data + off, t->len - off, t->external);
+    Piece *right = t->right;
+    t->len = off;
+    t->right = 0;
+    update(t);
+    l = t;
+    r = merge(tail, right);
+  }
+}
+
+
+/*
+ Concatenate two trees. All bytes in l come before all bytes in r.
+ */
+Fl_Text_Piece_Table::Piece *Fl_Text_Piece_Table::merge(Piece *l, Piece *r)
+{
+  if (!l) return r;
+  if (!r) return l;
+  if (l->prio > r->prio) {
+    l->right = merge(l->right, r);
+    update(l);
+    return l;
+  }
+  r->left = merge(l, r->left);
+  update(r);
+  return r;
+}
+
+
+/*
+ Append text to the storage blocks and return its address.
+ */
+const char *Fl_Text_Piece_Table::store(const char *text, int len)
+{
+  Block *b = blocks_;
+  if (len > BLOCK_SIZE / 4) {
+    // large inserts get a block of their own, but keep the current block
+    // in front so that we can continue to fill it
+    b = (Block *)malloc(sizeof(Block) + len);
+    b->size = b->used = len;
+    if (blocks_) {
+      b->next = blocks_->next;
+      blocks_->next = b;
+    } else {
+      b->next = 0;
+      blocks_ = b;
+    }
+    memcpy(b->text(), text, len);
+    return b->text();
+  }
+  if (!b || b->size - b->used < len) {
+    b = (Block *)malloc(sizeof(Block) + BLOCK_SIZE);
+    b->size = BLOCK_SIZE;
+    b->used = 0;
+    b->next = blocks_;
+    blocks_ = b;
+  }
+  char *s = b->text() + b->used;
+  memcpy(s, text, len);
+  b->used += len;
+  return s;
+}
+
+
+/*
+ Simple xorshift generator for the treap priorities.
+ */
+unsigned Fl_Text_Piece_Table::random()
+{
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  return seed_;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,318 @@
+//
+// "$Id$"
+//
+// Lazy syntax highlighting for the Fl_Text_Display class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Restyler.H"
+#include "Fl_Thread_Pool.H"
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Text_Highlighter.H>
+#include <stdlib.h>
+#include <string.h>
+
+// the style of text that was not highlighted yet
+static const char DEFAULT_STYLE = 'A';
+
+// smaller parts of the text are always highlighted in the main thread
+static const int SYNC_SIZE = 16 * 1024;
+
+// with more dirty ranges, they are merged into one
+static const int MAX_RANGES = 64;
+
+
+/*
+ Highlights a copy of some lines in a worker thread.
+ */
+class Fl_Text_Restyler::Job : public Fl_Thread_Pool::Job {
+public:
+  Fl_Text_Highlighter *highlighter;
+  char *text, *style;
+  int start, end;
+  char prev;
+  int stale;            // the text was changed, the result is useless
+
+  Job() : highlighter(0), text(0), style(0), start(0), end(0), prev(0), stale(0) {}
+  void run() { highlighter->highlight(text, end - start, style, prev); }
+};
+
+
+Fl_Text_Restyler::Fl_Text_Restyler()
+{
+  styles_ = new Fl_Text_Buffer;
+  styles_->canUndo(0);
+  ranges_ = 0;
+  nranges_ = nalloc_ = 0;
+  job_ = new Job;
+  running_ = 0;
+}
+
+
+Fl_Text_Restyler::~Fl_Text_Restyler()
+{
+  clear();
+  delete job_;
+  delete styles_;
+  free(ranges_);
+}
+
+
+void Fl_Text_Restyler::reset(int length)
+{
+  clear();
+  char *s = (char *)malloc(length + 1);
+  memset(s, DEFAULT_STYLE, length);
+  s[length] = 0;
+  styles_->text(s);
+  free(s);
+  mark(0, length + 1);
+}
+
+
+void Fl_Text_Restyler::clear()
+{
+  if (running_) {
+    Fl_Thread_Pool::shared()->cancel(job_);
+    running_ = 0;
+  }
+  free(job_->text);
+  free(job_->style);
+  job_->text = job_->style = 0;
+  nranges_ = 0;
+}
+
+
+void Fl_Text_Restyler::changed(int pos, int nDeleted, int nInserted)
+{
+  char *s = (char *)malloc(nInserted + 1);
+  memset(s, DEFAULT_STYLE, nInserted);
+  s[nInserted] = 0;
+  styles_->replace(pos, pos + nDeleted, s);
+  free(s);
+
+  int delta = nInserted - nDeleted, deletedEnd = pos + nDeleted;
+  for (int i = 0; i < nranges_; i++) {
+    Range &r = ranges_[i];
+    if (r.start >= deletedEnd) {
+      r.start += delta;
+      r.end += delta;
+    } else if (r.end > pos) {
+      if (r.start > pos) r.start = pos;
+      r.end = r.end > deletedEnd ? r.end + delta : pos;
+      if (r.end <= r.start) r.end = r.start + 1;
+    }
+  }
+  // a job is still useful if the text it copied did not change
+  if (running_ && !job_->stale) {
+    if (deletedEnd < job_->start) {
+      job_->start += delta;
+      job_->end += delta;
+    } else if (pos < job_->end) {
+      job_->stale = 1;
+    }
+  }
+  // the line behind the inserted text is dirty too: it may have been split
+  // from the text in front, and its newline is not new, so that apply()
+  // sees if the lines behind it must be highlighted again
+  mark(pos, pos + nInserted + 1);
+}
+
+
+int Fl_Text_Restyler::dirty(const Fl_Text_Buffer *buf, int start, int end) const
+{
+  int s = buf->line_start(start), e = buf->line_end(end);
+  for (int i = 0; i < nranges_ && ranges_[i].start <= e; i++)
+    if (ranges_[i].end > s)
+      return 1;
+  return 0;
+}
+
+
+int Fl_Text_Restyler::update(const Fl_Text_Buffer *buf, Fl_Text_Highlighter *h,
+                             int start, int end, int *changedStart, int *changedEnd)
+{
+  Fl_Thread_Pool *pool = Fl_Thread_Pool::shared();
+  int changed = 0;
+  *changedStart = *changedEnd = -1;
+  if (running_) {
+    if (!pool->done(job_))
+      return 0;
+    running_ = 0;
+    if (!job_->stale)
+      changed |= apply(job_->start, job_->end, job_->style, changedStart, changedEnd);
+    free(job_->text);
+    free(job_->style);
+    job_->text = job_->style = 0;
+  }
+  // the pieces are highlighted in order, each one needs the style in front
+  int pieceStart, pieceEnd;
+  while (next_piece(buf, start, end, &pieceStart, &pieceEnd)) {
+    int len = pieceEnd - pieceStart;
+    char *style = styles_->text_range(pieceStart, pieceEnd);
+    char prev = pieceStart > 0 ? styles_->byte_at(pieceStart - 1) : 0;
+    if (len > SYNC_SIZE && h->threaded() && pool->threads()) {
+      job_->highlighter = h;
+      job_->text = buf->text_range(pieceStart, pieceEnd);
+      job_->style = style;
+      job_->start = pieceStart;
+      job_->end = pieceEnd;
+      job_->prev = prev;
+      job_->stale = 0;
+      pool->submit(job_);
+      running_ = 1;
+      break;
+    }
+    if (len > 0) {
+      char *text = buf->text_range(pieceStart, pieceEnd);
+      h->highlight(text, len, style, prev);
+      free(text);
+    }
+    changed |= apply(pieceStart, pieceEnd, style, changedStart, changedEnd);
+    free(style);
+  }
+  return changed;
+}
+
+
+/*
+ Find the first dirty text in the lines from start to end, and return
+ the lines containing it up to end, including the newline of the last
+ line. Returns 0 if there is no dirty text.
+ */
+int Fl_Text_Restyler::next_piece(const Fl_Text_Buffer *buf, int start, int end,
+                                 int *pieceStart, int *pieceEnd) const
+{
+  int s = buf->line_start(start), e = buf->line_end(end);
+  for (int i = 0; i < nranges_ && ranges_[i].start <= e; i++) {
+    const Range &r = ranges_[i];
+    if (r.end <= s)
+      continue;
+    *pieceStart = buf->line_start(r.start > s ? r.start : s);
+    *pieceEnd = buf->line_end(r.end - 1 < e ? r.end - 1 : e);
+    if (*pieceEnd < buf->length())
+      *pieceEnd = buf->next_char(*pieceEnd);
+    return 1;
+  }
+  return 0;
+}
+
+
+/*
+ Store the new styles of the text from start to end, which is no longer
+ dirty. If the style of the last byte changed, the text behind it becomes
+ dirty. Extends the range of changed styles, and returns 1 if there are
+ any.
+ */
+int Fl_Text_Restyler::apply(int start, int end, char *style,
+                            int *changedStart, int *changedEnd)
+{
+  int length = styles_->length(), len = end - start;
+  unmark(start, end < length ? end : length + 1);
+  for (int i = 0; i < len; i++)
+    if (!style[i]) style[i] = DEFAULT_STYLE;
+  char *old = styles_->text_range(start, end);
+  int first = 0, last = len;
+  while (first < len && old[first] == style[first])
+    first++;
+  if (first == len) {
+    free(old);
+    return 0;
+  }
+  while (old[last - 1] == style[last - 1])
+    last--;
+  if (end < length && old[len - 1] != style[len - 1])
+    mark(end, length);
+  free(old);
+  style[last] = 0;
+  styles_->replace(start + first, start + last, style + first);
+  if (*changedStart < 0 || start + first < *changedStart)
+    *changedStart = start + first;
+  if (start + last > *changedEnd)
+    *changedEnd = start + last;
+  return 1;
+}
+
+
+/*
+ Add the range from start to end to the dirty text.
+ */
+void Fl_Text_Restyler::mark(int start, int end)
+{
+  int i = 0, j;
+  while (i < nranges_ && ranges_[i].end < start)
+    i++;
+  for (j = i; j < nranges_ && ranges_[j].start <= end; j++) {
+    if (ranges_[j].start < start) start = ranges_[j].start;
+    if (ranges_[j].end > end) end = ranges_[j].end;
+  }
+  if (j == i) {
+    insert_ranges(i, 1);
+  } else if (j > i + 1) {
+    memmove(ranges_ + i + 1, ranges_ + j, (nranges_ - j) * sizeof(Range));
+    nranges_ -= j - i - 1;
+  }
+  ranges_[i].start = start;
+  ranges_[i].end = end;
+  if (nranges_ > MAX_RANGES) {
+    ranges_[0].end = ranges_[nranges_ - 1].end;
+    nranges_ = 1;
+  }
+}
+
+
+/*
+ Remove the range from start to end from the dirty text.
+ */
+void Fl_Text_Restyler::unmark(int start, int end)
+{
+  for (int i = 0; i < nranges_; i++) {
+    Range &r = ranges_[i];
+    if (r.end <= start || r.start >= end)
+      continue;
+    if (r.start < start && r.end > end) {
+      int e = r.end;
+      r.end = start;
+      insert_ranges(i + 1, 1);
+      ranges_[i + 1].start = end;
+      ranges_[i + 1].end = e;
+      return;
+    }
+    if (r.start < start) {
+      r.end = start;
+    } else if (r.end > end) {
+      r.start = end;
+    } else {
+      memmove(ranges_ + i, ranges_ + i + 1, (nranges_ - i - 1) * sizeof(Range));
+      nranges_--;
+      i--;
+    }
+  }
+}
+
+
+void Fl_Text_Restyler::insert_ranges(int i, int n)
+{
+  if (nranges_ + n > nalloc_) {
+    nalloc_ = nalloc_ ? 2 * nalloc_ : 16;
+    if (nalloc_ < nranges_ + n) nalloc_ = nranges_ + n;
+    ranges_ = (Range *)realloc(ranges_, nalloc_ * sizeof(Range));
+  }
+  memmove(ranges_ + i + n, ranges_ + i, (nranges_ - i) * sizeof(Range));
+  nranges_ += n;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,295 @@
+//
+// "$Id$"
+//
+// Text scanning functions for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Scan.H"
+#include <string.h>
+
+/*
+ The AVX2 loops are compiled with a target attribute and used when the CPU
+ supports AVX2, so the library does not need to be built for AVX2 to use them.
+ */
+#if defined(__AVX2__)
+#  define FL_SCAN_AVX2 1
+#  define FL_SCAN_AVX2_TARGET
+#  include <immintrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ >= 5)
+#  define FL_SCAN_AVX2 1
+#  define FL_SCAN_AVX2_DISPATCH 1
+#  define FL_SCAN_AVX2_TARGET __attribute__((target("avx2")))
+#  include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define FL_SCAN_SSE2 1
+#  include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && (defined(FL_SCAN_SSE2) || defined(FL_SCAN_AVX2))
+#  include <intrin.h>
+#endif
+
+typedef unsigned char uchar;
+
+static inline uchar lower(uchar c) { return (c >= 'A' && c <= 'Z') ? c + 32 : c; }
+static inline uchar upper(uchar c) { return (c >= 'a' && c <= 'z') ? c - 32 : c; }
+
+#if defined(FL_SCAN_SSE2) || defined(FL_SCAN_AVX2)
+
+// index of the lowest and highest bit set in a non-zero mask
+static inline int first_bit(unsigned m) {
+#  ifdef _MSC_VER
+  unsigned long i; _BitScanForward(&i, m); return (int)i;
+#  else
+  return __builtin_ctz(m);
+#  endif
+}
+
+static inline int last_bit(unsigned m) {
+#  ifdef _MSC_VER
+  unsigned long i; _BitScanReverse(&i, m); return (int)i;
+#  else
+  return 31 - __builtin_clz(m);
+#  endif
+}
+
+#endif
+
+
+#ifdef FL_SCAN_AVX2
+
+// 1 if the AVX2 loops below may be used, checked once
+static int use_avx2() {
+#  ifdef FL_SCAN_AVX2_DISPATCH
+  static int avx2 = -1;
+  if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return avx2;
+#  else
+  return 1;
+#  endif
+}
+
+/*
+ The AVX2 loops process 32 bytes at a time. They return a match or advance
+ the position p past the bytes they checked, the caller checks the rest.
+ */
+FL_SCAN_AVX2_TARGET
+static const char *scan_forward_avx2(const uchar *&p, const uchar *e, char c1, char c2)
+{
+  __m256i a1 = _mm256_set1_epi8(c1), a2 = _mm256_set1_epi8(c2);
+  for (; e - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned m = (unsigned)_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, a1), _mm256_cmpeq_epi8(x, a2)));
+    if (m) return (const char *)p + first_bit(m);
+  }
+  return 0;
+}
+
+FL_SCAN_AVX2_TARGET
+static const char *scan_backward_avx2(const uchar *b, const uchar *&p, char c1, char c2)
+{
+  __m256i a1 = _mm256_set1_epi8(c1), a2 = _mm256_set1_epi8(c2);
+  while (p - b >= 32) {
+    p -= 32;
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned m = (unsigned)_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, a1), _mm256_cmpeq_epi8(x, a2)));
+    if (m) return (const char *)p + last_bit(m);
+  }
+  return 0;
+}
+
+FL_SCAN_AVX2_TARGET
+static int count_avx2(const uchar *&p, const uchar *e, char c)
+{
+  int count = 0;
+  __m256i a = _mm256_set1_epi8(c), az = _mm256_setzero_si256();
+  while (e - p >= 32) {
+    __m256i acc = az;
+    for (int i = 0; i < 255 && e - p >= 32; i++, p += 32)
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), a));
+    __m256i sum = _mm256_sad_epu8(acc, az);
+    __m128i s2 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    count += _mm_cvtsi128_si32(s2) + _mm_cvtsi128_si32(_mm_srli_si128(s2, 8));
+  }
+  return count;
+}
+
+FL_SCAN_AVX2_TARGET
+static const char *find_avx2(const uchar *&p, const uchar *last, const char *needle, int len,
+                             int fold, uchar f1, uchar f2, uchar l1, uchar l2)
+{
+  __m256i af1 = _mm256_set1_epi8(f1), af2 = _mm256_set1_epi8(f2);
+  __m256i al1 = _mm256_set1_epi8(l1), al2 = _mm256_set1_epi8(l2);
+  for (; last - p >= 31; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i y = _mm256_loadu_si256((const __m256i *)(p + len - 1));
+    unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, af1), _mm256_cmpeq_epi8(x, af2)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(y, al1), _mm256_cmpeq_epi8(y, al2))));
+    for (; m; m &= m - 1) {
+      const char *c = (const char *)p + first_bit(m);
+      if (fl_text_equal(c, needle, len, fold))
+        return c;
+    }
+  }
+  return 0;
+}
+
+#endif // FL_SCAN_AVX2
+
+
+const char *fl_text_scan_forward(const char *s, int n, char c1, char c2)
+{
+  const uchar *p = (const uchar *)s, *e = p + n;
+#ifdef FL_SCAN_AVX2
+  if (use_avx2()) {
+    const char *r = scan_forward_avx2(p, e, c1, c2);
+    if (r) return r;
+  }
+#endif
+#ifdef FL_SCAN_SSE2
+  __m128i b1 = _mm_set1_epi8(c1), b2 = _mm_set1_epi8(c2);
+  for (; e - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    unsigned m = (unsigned)_mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(x, b1), _mm_cmpeq_epi8(x, b2)));
+    if (m) return (const char *)p + first_bit(m);
+  }
+#endif
+  for (; p < e; p++)
+    if (*p == (uchar)c1 || *p == (uchar)c2)
+      return (const char *)p;
+  return 0;
+}
+
+
+const char *fl_text_scan_backward(const char *s, int n, char c1, char c2)
+{
+  const uchar *b = (const uchar *)s, *p = b + n;
+#ifdef FL_SCAN_AVX2
+  if (use_avx2()) {
+    const char *r = scan_backward_avx2(b, p, c1, c2);
+    if (r) return r;
+  }
+#endif
+#ifdef FL_SCAN_SSE2
+  __m128i b1 = _mm_set1_epi8(c1), b2 = _mm_set1_epi8(c2);
+  while (p - b >= 16) {
+    p -= 16;
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    unsigned m = (unsigned)_mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(x, b1), _mm_cmpeq_epi8(x, b2)));
+    if (m) return (const char *)p + last_bit(m);
+  }
+#endif
+  while (p > b) {
+    p--;
+    if (*p == (uchar)c1 || *p == (uchar)c2)
+      return (const char *)p;
+  }
+  return 0;
+}
+
+
+/*
+ The vector versions add the comparison results (0 or -1 per byte) into
+ byte counters, and sum up the counters before they can overflow.
+ */
+int fl_text_count(const char *s, int n, char c)
+{
+  const uchar *p = (const uchar *)s, *e = p + n;
+  int count = 0;
+#ifdef FL_SCAN_AVX2
+  if (use_avx2())
+    count += count_avx2(p, e, c);
+#endif
+#ifdef FL_SCAN_SSE2
+  __m128i b = _mm_set1_epi8(c), bz = _mm_setzero_si128();
+  while (e - p >= 16) {
+    __m128i acc = bz;
+    for (int i = 0; i < 255 && e - p >= 16; i++, p += 16)
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), b));
+    __m128i sum = _mm_sad_epu8(acc, bz);
+    count += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+  }
+#endif
+  for (; p < e; p++)
+    if (*p == (uchar)c)
+      count++;
+  return count;
+}
+
+
+int fl_text_equal(const char *a, const char *b, int n, int fold)
+{
+  if (!fold)
+    return !memcmp(a, b, n);
+  for (int i = 0; i < n; i++)
+    if (lower(a[i]) != lower(b[i]))
+      return 0;
+  return 1;
+}
+
+
+/*
+ Candidate positions are found by comparing the first and the last byte of
+ the needle at all positions of a vector at once, only the candidates are
+ then compared completely. This rejects most positions for typical text.
+ */
+const char *fl_text_find(const char *s, int n, const char *needle, int len, int fold)
+{
+  if (len <= 0 || len > n)
+    return len <= 0 ? s : 0;
+  uchar f1 = needle[0], l1 = needle[len - 1], f2 = f1, l2 = l1;
+  if (fold) {
+    f1 = lower(f1); f2 = upper(f1);
+    l1 = lower(l1); l2 = upper(l1);
+  }
+  const uchar *p = (const uchar *)s;
+  const uchar *last = p + (n - len);   // last possible start of a match
+#ifdef FL_SCAN_AVX2
+  if (use_avx2()) {
+    const char *r = find_avx2(p, last, needle, len, fold, f1, f2, l1, l2);
+    if (r) return r;
+  }
+#endif
+#ifdef FL_SCAN_SSE2
+  __m128i bf1 = _mm_set1_epi8(f1), bf2 = _mm_set1_epi8(f2);
+  __m128i bl1 = _mm_set1_epi8(l1), bl2 = _mm_set1_epi8(l2);
+  for (; last - p >= 15; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i y = _mm_loadu_si128((const __m128i *)(p + len - 1));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_and_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, bf1), _mm_cmpeq_epi8(x, bf2)),
+      _mm_or_si128(_mm_cmpeq_epi8(y, bl1), _mm_cmpeq_epi8(y, bl2))));
+    for (; m; m &= m - 1) {
+      const char *c = (const char *)p + first_bit(m);
+      if (fl_text_equal(c, needle, len, fold))
+        return c;
+    }
+  }
+#endif
+  for (; p <= last; p++) {
+    if ((*p == f1 || *p == f2) && fl_text_equal((const char *)p, needle, len, fold))
+      return (const char *)p;
+  }
+  return 0;
+}
+
+//
+// End of "$Id$".
+//
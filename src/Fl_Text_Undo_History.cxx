@@ -0,0 +1,264 @@
+//
+// "$Id$"
+//
+// Undo history for the Fl_Text_Buffer class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Undo_History.H"
+#include <FL/Fl_Text_Buffer.H>
+#include <stdlib.h>
+#include <string.h>
+
+// default memory limit of the undo history of a buffer
+static const int DEFAULT_LIMIT = 1024 * 1024;
+
+
+Fl_Text_Undo_History::Fl_Text_Undo_History(Fl_Text_Buffer *buf)
+{
+  buf_ = buf;
+  undo_.init();
+  redo_.init();
+  open_ = 0;
+  replaying_ = 0;
+  limit_ = DEFAULT_LIMIT;
+}
+
+
+Fl_Text_Undo_History::~Fl_Text_Undo_History()
+{
+  undo_.release();
+  redo_.release();
+}
+
+
+void Fl_Text_Undo_History::clear()
+{
+  undo_.release();
+  redo_.release();
+  open_ = 0;
+}
+
+
+/*
+ Record an insertion. Typing extends the current action until a new line
+ is started.
+ */
+void Fl_Text_Undo_History::inserted(int pos, int len)
+{
+  if (replaying_ || len <= 0)
+    return;
+  redo_.clear();
+  Action *a = open_ ? undo_.top() : 0;
+  if (a && a->pos + a->ins == pos && (pos == a->pos || buf_->byte_at(pos - 1) != '\n'))
+    a->ins += len;
+  else
+    undo_.push(pos, len, 0);
+  open_ = 1;
+  trim();
+}
+
+
+/*
+ Record a removal and save the removed text. Deleting text that was just
+ typed shrinks the current action, backspacing and deleting forward
+ extend it.
+ */
+void Fl_Text_Undo_History::removing(int start, int end)
+{
+  if (replaying_ || end <= start)
+    return;
+  redo_.clear();
+  int len = end - start;
+  Action *a = open_ ? undo_.top() : 0;
+  char *dest;
+  if (a && a->ins && start >= a->pos && end == a->pos + a->ins) {
+    a->ins -= len;
+    if (!a->ins && !a->del)
+      undo_.pop();
+    return;
+  } else if (a && !a->ins && end == a->pos) {
+    dest = undo_.extend(len, 1);
+    a->pos = start;
+  } else if (a && !a->ins && start == a->pos) {
+    dest = undo_.extend(len, 0);
+  } else {
+    a = undo_.push(start, 0, len);
+    dest = undo_.mem + a->text;
+  }
+  buf_->copy_range_(start, end, dest);
+  open_ = 1;
+  trim();
+}
+
+
+/*
+ Revert the top action of one stack and push the opposite action onto
+ the other one.
+ */
+int Fl_Text_Undo_History::apply(Stack &from, Stack &to, int *cursorPos)
+{
+  if (!from.n)
+    return 0;
+  Action a = *from.top();
+  Action *b = to.push(a.pos, a.del, a.ins);
+  buf_->copy_range_(a.pos, a.pos + a.ins, to.mem + b->text);
+
+  const char *text = from.mem + a.text;
+  replaying_ = 1;
+  if (a.ins && a.del)
+    buf_->replace(a.pos, a.pos + a.ins, text);
+  else if (a.ins)
+    buf_->remove(a.pos, a.pos + a.ins);
+  else
+    buf_->insert(a.pos, text);
+  replaying_ = 0;
+
+  from.pop();
+  open_ = 0;
+  if (cursorPos)
+    *cursorPos = buf_->mCursorPosHint;
+  trim();
+  return 1;
+}
+
+
+void Fl_Text_Undo_History::limit(int bytes)
+{
+  limit_ = bytes > 0 ? bytes : 0;
+  trim();
+}
+
+
+/*
+ Forget the oldest actions while the history uses more memory than
+ allowed. Some more is released at once, so that this does not have
+ to be done again for every following edit.
+ */
+void Fl_Text_Undo_History::trim()
+{
+  int total = bytes();
+  if (!limit_ || total <= limit_)
+    return;
+  int target = limit_ - limit_ / 4;
+  int k = 0;
+  while (k < undo_.n - 1 && total > target)
+    total -= undo_.act[k++].del + 1 + (int)sizeof(Action);
+  undo_.drop(k);
+  k = 0;
+  while (k < redo_.n && total > target)
+    total -= redo_.act[k++].del + 1 + (int)sizeof(Action);
+  redo_.drop(k);
+}
+
+
+void Fl_Text_Undo_History::Stack::init()
+{
+  act = 0;
+  n = nalloc = 0;
+  mem = 0;
+  used = size = 0;
+}
+
+
+void Fl_Text_Undo_History::Stack::release()
+{
+  free(act);
+  free(mem);
+  init();
+}
+
+
+/*
+ Make room for len more bytes of text and return the address of the
+ first free byte.
+ */
+char *Fl_Text_Undo_History::Stack::reserve(int len)
+{
+  if (used + len > size) {
+    int s = size ? size : 256;
+    while (s < used + len)
+      s *= 2;
+    mem = (char *)realloc(mem, s);
+    size = s;
+  }
+  return mem + used;
+}
+
+
+/*
+ Add a new action, and room for the del bytes of text it deleted.
+ */
+Fl_Text_Undo_History::Action *Fl_Text_Undo_History::Stack::push(int pos, int ins, int del)
+{
+  if (n == nalloc) {
+    nalloc = nalloc ? 2 * nalloc : 16;
+    act = (Action *)realloc(act, nalloc * sizeof(Action));
+  }
+  reserve(del + 1);
+  Action *a = act + n++;
+  a->pos = pos;
+  a->ins = ins;
+  a->del = del;
+  a->text = used;
+  used += del + 1;
+  mem[used - 1] = 0;
+  return a;
+}
+
+
+/*
+ Add room for len bytes to the text of the top action, in front of or
+ after the current text, and return the address of that room. The text
+ of the top action is always at the end of the memory block.
+ */
+char *Fl_Text_Undo_History::Stack::extend(int len, int front)
+{
+  reserve(len);
+  Action *a = top();
+  char *s = mem + a->text;
+  if (front)
+    memmove(s + len, s, a->del + 1);
+  else
+    s += a->del;
+  a->del += len;
+  used += len;
+  mem[used - 1] = 0;
+  return s;
+}
+
+
+/*
+ Remove the k oldest actions.
+ */
+void Fl_Text_Undo_History::Stack::drop(int k)
+{
+  if (k <= 0)
+    return;
+  int off = k < n ? act[k].text : used;
+  memmove(mem, mem + off, used - off);
+  used -= off;
+  memmove(act, act + k, (n - k) * sizeof(Action));
+  n -= k;
+  for (int i = 0; i < n; i++)
+    act[i].text -= off;
+  if (size > 1024 && used < size / 4) {
+    size /= 2;
+    mem = (char *)realloc(mem, size);
+  }
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,111 @@
+//
+// "$Id$"
+//
+// Text width cache for the Fl_Text_Display class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Width_Cache.H"
+#include <FL/fl_draw.H>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+Fl_Text_Width_Cache::Fl_Text_Width_Cache()
+{
+  runs_ = 0;
+  memset(fonts_, 0, sizeof(fonts_));
+  hits_ = misses_ = 0;
+}
+
+
+Fl_Text_Width_Cache::~Fl_Text_Width_Cache()
+{
+  free(runs_);
+}
+
+
+double Fl_Text_Width_Cache::width(Fl_Font font, Fl_Fontsize size,
+                                  const char *s, int len)
+{
+  if (len <= 0)
+    return 0;
+  Key key;
+  key.driver = fl_graphics_driver;
+  key.scale = fl_graphics_driver->scale();
+  key.font = font;
+  key.size = size;
+
+  double fixed = fixed_width(key);
+  if (fixed > 0) {
+    int i = 0;
+    while (i < len && s[i] >= 0x20 && s[i] < 0x7f)
+      i++;
+    if (i == len) {
+      hits_++;
+      return len * fixed;
+    }
+  }
+  if (len > MAX_RUN) {
+    misses_++;
+    return fl_width(s, len);
+  }
+
+  unsigned h = 2166136261U ^ (unsigned)font ^ ((unsigned)size << 16);
+  for (int i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619U;
+  if (!runs_)
+    runs_ = (Run *)calloc(NRUNS, sizeof(Run));
+  Run &r = runs_[(h ^ (h >> 15)) % NRUNS];
+  if (r.len == len && same(r.key, key) && !memcmp(r.text, s, len)) {
+    hits_++;
+    return r.width;
+  }
+  misses_++;
+  r.key = key;
+  r.len = (unsigned char)len;
+  memcpy(r.text, s, len);
+  r.width = fl_width(s, len);
+  return r.width;
+}
+
+
+/*
+ Return the width of all printable ASCII characters if the current font
+ is a fixed width font, or 0.
+ */
+double Fl_Text_Width_Cache::fixed_width(const Key &key)
+{
+  Font &f = fonts_[((unsigned)key.font * 7 + (unsigned)key.size) % NFONTS];
+  if (f.key.driver && same(f.key, key))
+    return f.width;
+  f.key = key;
+  // a few characters of very different widths in proportional fonts,
+  // and a string of them to make sure that widths add up
+  static const char probe[] = "iWm.0 _";
+  const int n = sizeof(probe) - 1;
+  double w = fl_width(probe, 1);
+  f.width = w;
+  for (int i = 1; i < n; i++)
+    if (fabs(fl_width(probe + i, 1) - w) > 0.001)
+      f.width = 0;
+  if (f.width > 0 && fabs(fl_width(probe, n) - n * w) > 0.001)
+    f.width = 0;
+  return f.width;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,638 @@
+//
+// "$Id$"
+//
+// Background line wrapping for the Fl_Text_Display class of the Fast Light Tool Kit (FLTK).
+//
+// Copyright 2001-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "Fl_Text_Wrap_Counter.H"
+#include "Fl_Thread_Pool.H"
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/fl_utf8.h>
+#include <stdlib.h>
+#include <string.h>
+
+// preferred size of a chunk in bytes, chunks end at the next newline
+static const int CHUNK_SIZE = 256 * 1024;
+
+// the most characters a job reports as missing in its width table
+static const int MAX_MISSING = 64;
+
+/*
+ A character as it is looked up in the width table: its length, its style
+ slot and its bytes, padded with 0. The length is never 0, so that an
+ unused entry of the hash table can be recognized.
+ */
+enum { KEY_SIZE = 8, KEY_BYTES = 6 };
+
+
+/*
+ Widths of characters in the fonts of all style slots. Jobs only read
+ the table. When new widths must be added while jobs use it, the counter
+ makes a copy, so that the jobs do not see the change.
+ */
+struct Fl_Text_Wrap_Counter::Widths {
+  int users;                    // the counter and the jobs using the table
+  unsigned char slot[256];      // style byte -> style slot
+  int nslots;
+  double *ascii;                // nslots * 128 widths, < 0 if unknown
+  unsigned char *keys;          // hash table of other characters
+  double *other;
+  int size, used;
+
+  static Widths *create(int nStyles);
+  Widths *copy() const;
+  void release();
+  double find(const unsigned char *key) const;
+  void add(const unsigned char *key, double w);
+};
+
+
+static unsigned hash_key(const unsigned char *key)
+{
+  unsigned h = 2166136261U;
+  for (int i = 0; i < KEY_SIZE; i++)
+    h = (h ^ key[i]) * 16777619U;
+  return h;
+}
+
+
+/*
+ A job wrapping the lines of one chunk in a worker thread, the same way
+ as Fl_Text_Display::wrapped_line_counter() does.
+ */
+class Fl_Text_Wrap_Counter::Job : public Fl_Thread_Pool::Job {
+public:
+  char *text;                   // copy of the chunk
+  unsigned char *style;         // copy of its styles, or NULL
+  int len;
+  Widths *widths;
+  int wrapPix, tabPix;
+  int lines, lastCol;           // the results
+  int nmissing;                 // characters not found in the width table
+  unsigned char missing[MAX_MISSING][KEY_SIZE];
+
+  Job() : text(0), style(0), widths(0), nmissing(0) {}
+  ~Job() { free(text); free(style); }
+  void run();
+
+private:
+  int next(int p) const {
+    p += fl_utf8len1(text[p]);
+    return p < len ? p : len;
+  }
+  int prev(int p) const {
+    if (p == 0) return -1;
+    do {
+      if (--p == 0) return 0;
+    } while ((text[p] & 0xc0) == 0x80);
+    return p;
+  }
+  double width(int i, int xPix, int stylePos);
+};
+
+
+double Fl_Text_Wrap_Counter::Job::width(int i, int xPix, int stylePos)
+{
+  const unsigned char *s = (const unsigned char *)text + i;
+  if (*s == '\t')
+    return (((xPix / tabPix) + 1) * tabPix) - xPix;
+  int slot = style ? widths->slot[style[stylePos]] : 0;
+  if (*s < 0x80 && widths->ascii[slot * 128 + *s] >= 0)
+    return widths->ascii[slot * 128 + *s];
+  unsigned char key[KEY_SIZE];
+  int n = fl_utf8len1(*s);
+  memset(key, 0, KEY_SIZE);
+  key[0] = n;
+  key[1] = slot;
+  for (int k = 0; k < n && k < KEY_BYTES && i + k < len; k++)
+    key[2 + k] = s[k];
+  double w = widths->find(key);
+  if (w >= 0)
+    return w;
+  // remember the character, the result of this run will not be used
+  for (int k = 0; k < nmissing; k++)
+    if (!memcmp(missing[k], key, KEY_SIZE))
+      return 0;
+  if (nmissing < MAX_MISSING)
+    memcpy(missing[nmissing++], key, KEY_SIZE);
+  return 0;
+}
+
+
+/*
+ Count the line breaks of the chunk. The chunk starts at the start of a
+ line and ends after a newline or at the end of the buffer, hence the
+ result is the same as if the lines of the whole buffer were counted.
+ */
+void Fl_Text_Wrap_Counter::Job::run()
+{
+  int nLines = 0, colNum = 0, lineStart = 0, newLineStart = 0;
+  double w = 0;
+  nmissing = 0;
+  for (int p = 0; p < len; p = next(p)) {
+    if (text[p] == '\n') {
+      nLines++;
+      lineStart = next(p);
+      colNum = 0;
+      w = 0;
+    } else {
+      colNum++;
+      w += width(p, (int)w, p);
+    }
+    if (w > wrapPix) {
+      int b, foundBreak = 0;
+      for (b = p; b >= lineStart; b = prev(b)) {
+        if (text[b] == '\t' || text[b] == ' ') {
+          newLineStart = next(b);
+          colNum = 0;
+          w = 0;
+          int iMax = next(p);
+          for (int i = next(b); i < iMax; i = next(i)) {
+            w += width(i, (int)w, i);
+            colNum++;
+          }
+          foundBreak = 1;
+          break;
+        }
+      }
+      if (b < lineStart) b = lineStart;
+      if (!foundBreak) {
+        // the display measures the first character with the style at p
+        newLineStart = p > next(lineStart) ? p : next(lineStart);
+        colNum++;
+        w = width(b, 0, p);
+      }
+      nLines++;
+      lineStart = newLineStart;
+    }
+  }
+  lines = nLines;
+  lastCol = colNum;
+}
+
+
+Fl_Text_Wrap_Counter::Fl_Text_Wrap_Counter(Measure_Cb measure, void *arg)
+{
+  measure_ = measure;
+  arg_ = arg;
+  buf_ = 0;
+  styleBuf_ = 0;
+  nStyles_ = wrapPix_ = tabPix_ = 0;
+  fonts_ = 0;
+  chunks_ = 0;
+  nchunks_ = nalloc_ = 0;
+  todo_ = running_ = next_ = 0;
+  widths_ = 0;
+}
+
+
+Fl_Text_Wrap_Counter::~Fl_Text_Wrap_Counter()
+{
+  clear();
+  free(chunks_);
+}
+
+
+void Fl_Text_Wrap_Counter::clear()
+{
+  for (int i = 0; i < nchunks_; i++)
+    cancel(i);
+  nchunks_ = 0;
+  todo_ = running_ = next_ = 0;
+  buf_ = 0;
+  if (widths_) {
+    widths_->release();
+    widths_ = 0;
+  }
+}
+
+
+int Fl_Text_Wrap_Counter::same_layout(const Fl_Text_Buffer *buf, int wrapPix,
+                                      int tabPix, unsigned fonts) const
+{
+  return nchunks_ && buf == buf_ && wrapPix == wrapPix_ &&
+         tabPix == tabPix_ && fonts == fonts_;
+}
+
+
+void Fl_Text_Wrap_Counter::start(const Fl_Text_Buffer *buf,
+                                 const Fl_Text_Buffer *styleBuf, int nStyles,
+                                 int wrapPix, int tabPix, unsigned fonts)
+{
+  clear();
+  buf_ = buf;
+  styleBuf_ = nStyles > 0 ? styleBuf : 0;
+  nStyles_ = styleBuf_ ? nStyles : 0;
+  wrapPix_ = wrapPix;
+  tabPix_ = tabPix > 0 ? tabPix : 1;
+  fonts_ = fonts;
+
+  // most text is printable ASCII, measure it at once
+  widths_ = Widths::create(nStyles_);
+  for (int slot = 0; slot < widths_->nslots; slot++) {
+    for (int c = ' '; c < 127; c++) {
+      char s = (char)c;
+      widths_->ascii[slot * 128 + c] = measure_(&s, 1, slot, arg_);
+    }
+  }
+
+  insert_chunks(0, 1);
+  chunks_[0].start = 0;
+  chunks_[0].newlines = 0;
+  chunks_[0].lines = -1;
+  chunks_[0].lastCol = 0;
+  chunks_[0].job = 0;
+  todo_ = 1;
+  split(0);
+  poll();
+}
+
+
+/*
+ Return the end of chunk i, which is the start of the next chunk.
+ */
+int Fl_Text_Wrap_Counter::chunk_end(int i) const
+{
+  return i + 1 < nchunks_ ? chunks_[i + 1].start : buf_->length();
+}
+
+
+/*
+ Return the last chunk starting at or before pos.
+ */
+int Fl_Text_Wrap_Counter::find(int pos) const
+{
+  int lo = 0, hi = nchunks_ - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (chunks_[mid].start <= pos) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+
+/*
+ Return the average number of line breaks per byte of the chunks that
+ are counted, or 0 if there are none.
+ */
+double Fl_Text_Wrap_Counter::ratio() const
+{
+  double lines = 0, bytes = 0;
+  for (int i = 0; i < nchunks_; i++) {
+    if (chunks_[i].lines < 0) continue;
+    lines += chunks_[i].lines;
+    bytes += chunk_end(i) - chunks_[i].start;
+  }
+  return bytes > 0 ? lines / bytes : 0;
+}
+
+
+/*
+ Return the line breaks of a chunk, estimated if it is not counted yet:
+ every newline is a line break, long lines are wrapped as often as those
+ of the text that is already counted.
+ */
+int Fl_Text_Wrap_Counter::estimate(int i, double ratio) const
+{
+  const Chunk &c = chunks_[i];
+  if (c.lines >= 0)
+    return c.lines;
+  int n = int((chunk_end(i) - c.start) * ratio + 0.5);
+  return n > c.newlines ? n : c.newlines;
+}
+
+
+int Fl_Text_Wrap_Counter::lines() const
+{
+  if (!nchunks_)
+    return 0;
+  double r = ratio();
+  int n = 0;
+  for (int i = 0; i < nchunks_; i++)
+    n += estimate(i, r);
+  // as Fl_Text_Display::wrapped_line_counter() does for the last line
+  const Chunk &last = chunks_[nchunks_ - 1];
+  if (last.lines >= 0 && last.lastCol > 0)
+    n++;
+  return n;
+}
+
+
+int Fl_Text_Wrap_Counter::chunk_start(int pos, int *lines) const
+{
+  int i = find(pos), n = 0;
+  double r = ratio();
+  for (int k = 0; k < i; k++)
+    n += estimate(k, r);
+  *lines = n;
+  return chunks_[i].start;
+}
+
+
+int Fl_Text_Wrap_Counter::find_line(int line, int *lines) const
+{
+  double r = ratio();
+  int n = 0, i;
+  for (i = 0; i < nchunks_ - 1; i++) {
+    int c = estimate(i, r);
+    if (n + c > line)
+      break;
+    n += c;
+  }
+  *lines = n;
+  return chunks_[i].start;
+}
+
+
+void Fl_Text_Wrap_Counter::insert_chunks(int i, int n)
+{
+  if (nchunks_ + n > nalloc_) {
+    nalloc_ = nalloc_ ? 2 * nalloc_ : 64;
+    if (nalloc_ < nchunks_ + n) nalloc_ = nchunks_ + n;
+    chunks_ = (Chunk *)realloc(chunks_, nalloc_ * sizeof(Chunk));
+  }
+  memmove(chunks_ + i + n, chunks_ + i, (nchunks_ - i) * sizeof(Chunk));
+  nchunks_ += n;
+}
+
+
+void Fl_Text_Wrap_Counter::remove_chunks(int i, int n)
+{
+  memmove(chunks_ + i, chunks_ + i + n, (nchunks_ - i - n) * sizeof(Chunk));
+  nchunks_ -= n;
+}
+
+
+/*
+ Split chunk i, which must not be counted, into chunks of about
+ CHUNK_SIZE bytes if it is much larger.
+ */
+void Fl_Text_Wrap_Counter::split(int i)
+{
+  int start = chunks_[i].start, end = chunk_end(i);
+  if (end - start < 2 * CHUNK_SIZE) {
+    chunks_[i].newlines = buf_->count_lines(start, end);
+    return;
+  }
+  int pos = start;
+  for (int k = i;; k++) {
+    int e = end;
+    if (end - pos >= 2 * CHUNK_SIZE) {
+      e = buf_->line_end(pos + CHUNK_SIZE) + 1;
+      if (e > end) e = end;
+    }
+    chunks_[k].start = pos;
+    chunks_[k].newlines = buf_->count_lines(pos, e);
+    chunks_[k].lines = -1;
+    chunks_[k].lastCol = 0;
+    chunks_[k].job = 0;
+    pos = e;
+    if (pos >= end)
+      break;
+    insert_chunks(k + 1, 1);
+    todo_++;
+  }
+}
+
+
+/*
+ Take back the job of chunk i, whether it is finished or not.
+ */
+void Fl_Text_Wrap_Counter::cancel(int i)
+{
+  Job *job = chunks_[i].job;
+  if (!job)
+    return;
+  Fl_Thread_Pool::shared()->cancel(job);
+  job->widths->release();
+  delete job;
+  chunks_[i].job = 0;
+  running_--;
+}
+
+
+void Fl_Text_Wrap_Counter::submit(int i)
+{
+  int start = chunks_[i].start, end = chunk_end(i);
+  Job *job = new Job;
+  job->len = end - start;
+  job->text = buf_->text_range(start, end);
+  if (styleBuf_) {
+    job->style = (unsigned char *)calloc(job->len + 1, 1);
+    int n = styleBuf_->length() - start;
+    if (n > job->len) n = job->len;
+    if (n > 0) {
+      char *s = styleBuf_->text_range(start, start + n);
+      memcpy(job->style, s, n);
+      free(s);
+    }
+  }
+  job->widths = widths_;
+  widths_->users++;
+  job->wrapPix = wrapPix_;
+  job->tabPix = tabPix_;
+  chunks_[i].job = job;
+  running_++;
+  Fl_Thread_Pool::shared()->submit(job);
+}
+
+
+int Fl_Text_Wrap_Counter::poll()
+{
+  if (!nchunks_)
+    return 0;
+  Fl_Thread_Pool *pool = Fl_Thread_Pool::shared();
+  int changed = 0, nmissing = 0;
+  unsigned char *missing = 0;
+  for (int i = 0; i < nchunks_; i++) {
+    Job *job = chunks_[i].job;
+    if (!job || !pool->done(job))
+      continue;
+    if (job->nmissing) {
+      missing = (unsigned char *)realloc(missing,
+                                         (nmissing + job->nmissing) * KEY_SIZE);
+      memcpy(missing + nmissing * KEY_SIZE, job->missing, job->nmissing * KEY_SIZE);
+      nmissing += job->nmissing;
+      if (i < next_) next_ = i;
+    } else {
+      chunks_[i].lines = job->lines;
+      chunks_[i].lastCol = job->lastCol;
+      todo_--;
+      changed = 1;
+    }
+    cancel(i);
+  }
+  if (nmissing) {
+    measure(missing, nmissing);
+    free(missing);
+  }
+  // keep the workers busy, but do not copy much more text than they need
+  int maxJobs = 2 * pool->threads();
+  if (maxJobs < 1) maxJobs = 1;
+  while (running_ < maxJobs && next_ < nchunks_) {
+    if (chunks_[next_].lines < 0 && !chunks_[next_].job)
+      submit(next_);
+    next_++;
+  }
+  return changed;
+}
+
+
+void Fl_Text_Wrap_Counter::changed(int pos, int nDeleted, int nInserted)
+{
+  if (!nchunks_)
+    return;
+  // the chunks touched by the change, and the next one if the newline
+  // that ended the last of them was deleted
+  int first = find(pos), last = first;
+  if (nDeleted > 0) {
+    last = find(pos + nDeleted - 1);
+    if (last + 1 < nchunks_ && chunks_[last + 1].start == pos + nDeleted)
+      last++;
+  }
+  for (int k = first; k <= last; k++) {
+    cancel(k);
+    if (chunks_[k].lines < 0) todo_--;
+  }
+  remove_chunks(first + 1, last - first);
+  int delta = nInserted - nDeleted;
+  for (int k = first + 1; k < nchunks_; k++)
+    chunks_[k].start += delta;
+  chunks_[first].lines = -1;
+  todo_++;
+  if (first < next_) next_ = first;
+  split(first);
+}
+
+
+/*
+ Measure the characters that jobs did not find in the width table, and
+ add them to the table.
+ */
+void Fl_Text_Wrap_Counter::measure(const unsigned char *keys, int n)
+{
+  if (widths_->users > 1) {
+    // jobs still use the table
+    Widths *w = widths_->copy();
+    widths_->release();
+    widths_ = w;
+  }
+  for (int i = 0; i < n; i++) {
+    const unsigned char *key = keys + i * KEY_SIZE;
+    if (widths_->find(key) < 0)
+      widths_->add(key, measure_((const char *)key + 2, key[0], key[1], arg_));
+  }
+}
+
+
+Fl_Text_Wrap_Counter::Widths *Fl_Text_Wrap_Counter::Widths::create(int nStyles)
+{
+  Widths *w = (Widths *)calloc(1, sizeof(Widths));
+  w->users = 1;
+  // the same style as Fl_Text_Display::string_width() uses
+  for (int b = 0; b < 256; b++) {
+    int si = b - 'A';
+    if (si < 0) si = 0;
+    else if (si >= nStyles) si = nStyles - 1;
+    w->slot[b] = (nStyles && b) ? si + 1 : 0;
+  }
+  w->nslots = nStyles + 1;
+  w->ascii = (double *)malloc(w->nslots * 128 * sizeof(double));
+  for (int i = 0; i < w->nslots * 128; i++)
+    w->ascii[i] = -1;
+  return w;
+}
+
+
+Fl_Text_Wrap_Counter::Widths *Fl_Text_Wrap_Counter::Widths::copy() const
+{
+  Widths *w = (Widths *)malloc(sizeof(Widths));
+  *w = *this;
+  w->users = 1;
+  w->ascii = (double *)malloc(nslots * 128 * sizeof(double));
+  memcpy(w->ascii, ascii, nslots * 128 * sizeof(double));
+  if (size) {
+    w->keys = (unsigned char *)malloc(size * KEY_SIZE);
+    memcpy(w->keys, keys, size * KEY_SIZE);
+    w->other = (double *)malloc(size * sizeof(double));
+    memcpy(w->other, other, size * sizeof(double));
+  }
+  return w;
+}
+
+
+void Fl_Text_Wrap_Counter::Widths::release()
+{
+  if (--users)
+    return;
+  free(ascii);
+  free(keys);
+  free(other);
+  free(this);
+}
+
+
+/*
+ Return the width of a character, or -1 if it is unknown.
+ */
+double Fl_Text_Wrap_Counter::Widths::find(const unsigned char *key) const
+{
+  if (key[0] == 1 && key[2] < 0x80)
+    return ascii[key[1] * 128 + key[2]];
+  if (!size)
+    return -1;
+  for (unsigned h = hash_key(key) & (size - 1);; h = (h + 1) & (size - 1)) {
+    const unsigned char *e = keys + h * KEY_SIZE;
+    if (!e[0])
+      return -1;
+    if (!memcmp(e, key, KEY_SIZE))
+      return other[h];
+  }
+}
+
+
+void Fl_Text_Wrap_Counter::Widths::add(const unsigned char *key, double w)
+{
+  if (key[0] == 1 && key[2] < 0x80) {
+    ascii[key[1] * 128 + key[2]] = w;
+    return;
+  }
+  if (2 * (used + 1) > size) {
+    // grow the hash table, keeping it at most half full
+    int oldSize = size;
+    unsigned char *oldKeys = keys;
+    double *oldOther = other;
+    size = size ? 2 * size : 256;
+    keys = (unsigned char *)calloc(size, KEY_SIZE);
+    other = (double *)malloc(size * sizeof(double));
+    used = 0;
+    for (int i = 0; i < oldSize; i++)
+      if (oldKeys[i * KEY_SIZE])
+        add(oldKeys + i * KEY_SIZE, oldOther[i]);
+    free(oldKeys);
+    free(oldOther);
+  }
+  unsigned h = hash_key(key) & (size - 1);
+  while (keys[h * KEY_SIZE])
+    h = (h + 1) & (size - 1);
+  memcpy(keys + h * KEY_SIZE, key, KEY_SIZE);
+  other[h] = w;
+  used++;
+}
+
+//
+// End of "$Id$".
+//
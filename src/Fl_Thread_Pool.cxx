@@ -0,0 +1,358 @@
+//
+// "$Id$"
+//
+// Worker thread pool for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "config_lib.h"
+#include "Fl_Thread_Pool.H"
+#include <stdlib.h>
+
+// the most worker threads that are started, whatever the number of CPUs
+static const int MAX_THREADS = 16;
+
+// job states
+enum { IDLE, QUEUED, RUNNING };
+
+#if defined(FL_CFG_SYS_WIN32)
+////////////////////////////////////////////////////////////////
+// Windows threading...
+#  include <windows.h>
+#  include <process.h>
+
+struct Fl_Thread_Pool_Sys {
+  CRITICAL_SECTION cs;
+  HANDLE work;          // semaphore counting the queued jobs
+  HANDLE done;          // manual-reset event, set when a job is finished
+  int nwait;            // threads waiting for the done event
+  int nrelease;         // threads that the last broadcast releases
+  int gen;              // counts the broadcasts
+};
+
+static int cpu_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+}
+
+static unsigned __stdcall win32_worker(void *pool) {
+  return (unsigned)(size_t)Fl_Thread_Pool::worker(pool);
+}
+
+static void sys_init(void **sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)malloc(sizeof(Fl_Thread_Pool_Sys));
+  InitializeCriticalSection(&s->cs);
+  s->work = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+  s->done = CreateEvent(NULL, TRUE, FALSE, NULL);
+  s->nwait = s->nrelease = s->gen = 0;
+  *sys = s;
+}
+
+static void sys_lock(void *sys) { EnterCriticalSection(&((Fl_Thread_Pool_Sys *)sys)->cs); }
+static void sys_unlock(void *sys) { LeaveCriticalSection(&((Fl_Thread_Pool_Sys *)sys)->cs); }
+
+static int sys_start(void *, Fl_Thread_Pool *pool) {
+  HANDLE h = (HANDLE)_beginthreadex(NULL, 0, win32_worker, pool, 0, NULL);
+  if (!h) return 0;
+  CloseHandle(h);
+  return 1;
+}
+
+// must be called with the lock held, releases it while waiting; the
+// semaphore counts every queued job, so a job that was cancelled wakes
+// up a worker once more, which then finds the queue empty
+static void sys_wait_work(void *sys) {
+  sys_unlock(sys);
+  WaitForSingleObject(((Fl_Thread_Pool_Sys *)sys)->work, INFINITE);
+  sys_lock(sys);
+}
+
+static void sys_signal_work(void *sys) {
+  ReleaseSemaphore(((Fl_Thread_Pool_Sys *)sys)->work, 1, NULL);
+}
+
+/*
+ The done event wakes all waiting threads like pthread_cond_broadcast().
+ An auto-reset event would wake only one of them. The manual-reset event
+ stays set until every thread that was waiting when it was set has woken
+ up, threads that start waiting later ignore it until the next broadcast.
+ */
+static void sys_wait_done(void *sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)sys;
+  int gen = s->gen;
+  s->nwait++;
+  for (;;) {
+    sys_unlock(sys);
+    WaitForSingleObject(s->done, INFINITE);
+    sys_lock(sys);
+    if (s->nrelease > 0 && s->gen != gen)
+      break;
+  }
+  s->nwait--;
+  if (--s->nrelease == 0)
+    ResetEvent(s->done);
+}
+
+// must be called with the lock held
+static void sys_signal_done(void *sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)sys;
+  if (s->nwait > 0) {
+    s->nrelease = s->nwait;
+    s->gen++;
+    SetEvent(s->done);
+  }
+}
+
+// calls init() once, other threads wait until it returned
+static void sys_once(void (*init)()) {
+  static LONG volatile state = 0;       // 0: not called, 1: running, 2: done
+  if (InterlockedCompareExchange(&state, 1, 0) == 0) {
+    init();
+    InterlockedExchange(&state, 2);
+    return;
+  }
+  while (InterlockedCompareExchange(&state, 2, 2) != 2)
+    Sleep(0);
+}
+
+#elif defined(HAVE_PTHREAD)
+////////////////////////////////////////////////////////////////
+// POSIX threading...
+#  include <pthread.h>
+#  include <unistd.h>
+
+struct Fl_Thread_Pool_Sys {
+  pthread_mutex_t mutex;
+  pthread_cond_t work;  // signalled when a job is queued
+  pthread_cond_t done;  // signalled when a job is finished
+};
+
+static int cpu_count() {
+#  ifdef _SC_NPROCESSORS_ONLN
+  return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#  else
+  return 1;
+#  endif
+}
+
+static void sys_init(void **sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)malloc(sizeof(Fl_Thread_Pool_Sys));
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->work, NULL);
+  pthread_cond_init(&s->done, NULL);
+  *sys = s;
+}
+
+static void sys_lock(void *sys) { pthread_mutex_lock(&((Fl_Thread_Pool_Sys *)sys)->mutex); }
+static void sys_unlock(void *sys) { pthread_mutex_unlock(&((Fl_Thread_Pool_Sys *)sys)->mutex); }
+
+static int sys_start(void *, Fl_Thread_Pool *pool) {
+  pthread_t t;
+  if (pthread_create(&t, NULL, Fl_Thread_Pool::worker, pool))
+    return 0;
+  pthread_detach(t);
+  return 1;
+}
+
+static void sys_wait_work(void *sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)sys;
+  pthread_cond_wait(&s->work, &s->mutex);
+}
+
+static void sys_signal_work(void *sys) {
+  pthread_cond_signal(&((Fl_Thread_Pool_Sys *)sys)->work);
+}
+
+static void sys_wait_done(void *sys) {
+  Fl_Thread_Pool_Sys *s = (Fl_Thread_Pool_Sys *)sys;
+  pthread_cond_wait(&s->done, &s->mutex);
+}
+
+static void sys_signal_done(void *sys) {
+  pthread_cond_broadcast(&((Fl_Thread_Pool_Sys *)sys)->done);
+}
+
+static void sys_once(void (*init)()) {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, init);
+}
+
+#else
+////////////////////////////////////////////////////////////////
+// No threads, jobs are run at once...
+
+static void sys_init(void **sys) { *sys = 0; }
+static void sys_lock(void *) {}
+static void sys_unlock(void *) {}
+static int sys_start(void *, Fl_Thread_Pool *) { return 0; }
+static void sys_wait_work(void *) {}
+static void sys_signal_work(void *) {}
+static void sys_wait_done(void *) {}
+static void sys_signal_done(void *) {}
+static void sys_once(void (*init)()) {
+  static int done = 0;
+  if (!done) { done = 1; init(); }
+}
+
+#  define FL_THREAD_POOL_SYNC 1
+
+#endif
+
+
+static Fl_Thread_Pool *shared_pool = 0;
+
+void Fl_Thread_Pool::create_shared()
+{
+  shared_pool = new Fl_Thread_Pool;
+}
+
+
+/*
+ Fl_RGB_Image::copy() uses the pool to scale large images and may be called
+ from any thread, so the pool is created once under a lock.
+ */
+Fl_Thread_Pool *Fl_Thread_Pool::shared()
+{
+  sys_once(create_shared);
+  return shared_pool;
+}
+
+
+Fl_Thread_Pool::Fl_Thread_Pool()
+{
+  first_ = last_ = 0;
+  started_ = 0;
+  sys_init(&sys_);
+#ifdef FL_THREAD_POOL_SYNC
+  nthreads_ = 0;
+#else
+  // leave one CPU to the user interface, but always have a worker
+  nthreads_ = cpu_count() - 1;
+  if (nthreads_ < 1) nthreads_ = 1;
+  if (nthreads_ > MAX_THREADS) nthreads_ = MAX_THREADS;
+#endif
+}
+
+
+/*
+ Start the worker threads. If no thread can be started, jobs are run
+ at once from now on. Must be called with the lock held, the workers
+ wait for the lock before they look at the queue.
+ */
+void Fl_Thread_Pool::start()
+{
+  started_ = 1;
+  int n = 0;
+  while (n < nthreads_ && sys_start(sys_, this))
+    n++;
+  nthreads_ = n;
+}
+
+
+int Fl_Thread_Pool::threads()
+{
+  sys_lock(sys_);
+  int n = nthreads_;
+  sys_unlock(sys_);
+  return n;
+}
+
+
+/*
+ Jobs may be submitted from any thread, so the workers are started with
+ the lock held, by the first thread that gets it.
+ */
+void Fl_Thread_Pool::submit(Job *job)
+{
+  sys_lock(sys_);
+  if (!started_) start();
+  if (!nthreads_) {
+    sys_unlock(sys_);
+    job->run();
+    return;
+  }
+  job->next_ = 0;
+  job->state_ = QUEUED;
+  if (last_) last_->next_ = job;
+  else first_ = job;
+  last_ = job;
+  sys_signal_work(sys_);
+  sys_unlock(sys_);
+}
+
+
+int Fl_Thread_Pool::done(Job *job)
+{
+  sys_lock(sys_);
+  int state = job->state_;
+  sys_unlock(sys_);
+  return state == IDLE;
+}
+
+
+void Fl_Thread_Pool::cancel(Job *job)
+{
+  sys_lock(sys_);
+  if (job->state_ == QUEUED) {
+    Job *prev = 0;
+    for (Job *j = first_; j; prev = j, j = j->next_) {
+      if (j != job) continue;
+      if (prev) prev->next_ = j->next_;
+      else first_ = j->next_;
+      if (last_ == j) last_ = prev;
+      break;
+    }
+    job->state_ = IDLE;
+  }
+  while (job->state_ == RUNNING)
+    sys_wait_done(sys_);
+  sys_unlock(sys_);
+}
+
+
+void *Fl_Thread_Pool::worker(void *pool)
+{
+  ((Fl_Thread_Pool *)pool)->work();
+  return 0;
+}
+
+
+/*
+ The loop of every worker thread: take the first job from the queue and
+ run it, or wait for one.
+ */
+void Fl_Thread_Pool::work()
+{
+  sys_lock(sys_);
+  for (;;) {
+    Job *job = first_;
+    if (!job) {
+      sys_wait_work(sys_);
+      continue;
+    }
+    first_ = job->next_;
+    if (!first_) last_ = 0;
+    job->state_ = RUNNING;
+    sys_unlock(sys_);
+    job->run();
+    sys_lock(sys_);
+    job->state_ = IDLE;
+    sys_signal_done(sys_);
+  }
+}
+
+//
+// End of "$Id$".
+//
@@ -19,10 +19,12 @@
 #include <FL/Fl.H>
 #include <FL/Fl_Widget.H>
 #include <FL/Fl_Group.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/Fl_Tooltip.H>
 #include <FL/fl_draw.H>
 #include <stdlib.h>
 #include "flstring.h"
+#include "Fl_Group_Index.H"
 
 
 ////////////////////////////////////////////////////////////////
@@ -140,6 +142,11 @@ Fl_Widget::Fl_Widget(int X, int Y, int W, int H, const char* L) {
 
 void Fl_Widget::resize(int X, int Y, int W, int H) {
   x_ = X; y_ = Y; w_ = W; h_ = H;
+  // the spatial index of the parent is no longer valid. Some widgets make
+  // themselves the parent of an internal widget although they are not a
+  // group, e.g. Fl_Value_Input, so check that the parent is one:
+  Fl_Group *g = parent_ ? parent_->as_group() : 0;
+  if (g && g->index_) g->index_->invalidate();
 }
 
 // this is useful for parent widgets to call to resize children:
@@ -168,6 +175,7 @@ extern void fl_throw_focus(Fl_Widget*); // in Fl_x.cxx
 */
 Fl_Widget::~Fl_Widget() {
   Fl::clear_widget_pointer(this);
+  Fl_Profiler::forget(this);
   if (flags() & COPIED_LABEL) free((void *)(label_.value));
   if (flags() & COPIED_TOOLTIP) free((void *)(tooltip_));
   // remove from parent group
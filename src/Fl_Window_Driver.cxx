@@ -25,6 +25,7 @@
 
 #include "Fl_Window_Driver.H"
 #include <FL/Fl_Overlay_Window.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/fl_draw.H>
 #include <FL/Fl.H>
 #include <FL/platform.H>
@@ -44,11 +45,23 @@ pWindow(win)
   shape_data_ = NULL;
   wait_for_expose_value = 0;
   other_xid = 0;
+  frame_times = NULL;
+  frame_count = 0;
 }
 
 
 Fl_Window_Driver::~Fl_Window_Driver()
 {
+  free(frame_times);
+}
+
+/** Records the time that flush() took, keeping the last FRAME_TIMES times. */
+void Fl_Window_Driver::add_frame_time(double t)
+{
+  if (!frame_times) frame_times = (double*)malloc(FRAME_TIMES * sizeof(double));
+  frame_times[frame_count % FRAME_TIMES] = t;
+  frame_count++;
+  if (frame_count >= 2 * FRAME_TIMES) frame_count -= FRAME_TIMES;
 }
 
 int Fl_Window_Driver::minw() {return pWindow->minw;}
@@ -80,7 +93,10 @@ void Fl_Window_Driver::flush_menu() { pWindow->Fl_Window::flush(); }
  Draw the window content.
  A new driver can add code before or after drawing an individua window.
  */
-void Fl_Window_Driver::draw() { pWindow->draw(); }
+void Fl_Window_Driver::draw() {
+  Fl_Profiler::Scope scope(Fl_Profiler::DRAW, pWindow);
+  pWindow->draw();
+}
 
 /**
  Prepare this window for rendering.
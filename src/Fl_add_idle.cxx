@@ -20,6 +20,7 @@
 // Replaces the older set_idle() call (which is used to implement this)
 
 #include <FL/Fl.H>
+#include <FL/Fl_Profiler.H>
 
 struct idle_cb {
   void (*cb)(void*);
@@ -37,6 +38,7 @@ static idle_cb* freelist;
 static void call_idle() {
   idle_cb* p = first;
   last = p; first = p->next;
+  Fl_Profiler::Scope scope(Fl_Profiler::IDLE);
   p->cb(p->data); // this may call add_idle() or remove_idle()!
 }
 
@@ -787,7 +787,7 @@ double Fl_Cocoa_Screen_Driver::wait(double time_to_wait)
     if (Fl::idle) time_to_wait = 0.0;
   }
   if (fl_mac_os_version < 101100) NSDisableScreenUpdates(); // 10.3 Makes updates to all windows appear as a single event
-  Fl::flush();
+  paced_flush();
   if (fl_mac_os_version < 101100) NSEnableScreenUpdates(); // 10.3
   if (Fl::idle && !in_idle) // 'idle' may have been set within flush()
     time_to_wait = 0.0;
@@ -18,6 +18,7 @@
 
 #include "config_lib.h"
 #include <FL/Fl.H>
+#include <FL/Fl_Profiler.H>
 #include "Fl_System_Driver.H"
 
 #include <stdlib.h>
@@ -66,67 +67,201 @@
    returns the most recent value!
 */
 
-#ifndef FL_DOXYGEN
+/*
+   Callbacks registered with Fl::awake(Fl_Awake_Handler, void*) are kept
+   in an unbounded multi-producer, single-consumer queue: any thread can
+   add a callback without taking a lock, and only the main thread takes
+   them out. The queue is a linked list of nodes, with an extra stub node
+   that is put back whenever the queue becomes empty. Producers exchange
+   the head pointer and then link the previous head to their node, so the
+   consumer may briefly see a node that is not linked yet.
+
+   The main thread is woken only when the queue goes from empty to not
+   empty, and takes at most AWAKE_BATCH callbacks per wakeup, so that it
+   still handles events when threads add callbacks faster than they can
+   be called. If callbacks are left, it wakes itself again.
+*/
+
+// Atomic operations on the queue, or a mutex if the compiler has none
+#if defined(_WIN32)
+#  include <windows.h>
+#  define FL_AWAKE_ATOMIC 1
+#elif defined(__GNUC__)
+#  define FL_AWAKE_ATOMIC 1
+#else
+#  define FL_AWAKE_ATOMIC 0
+#endif
+
+struct Fl_Awake_Node {
+  Fl_Awake_Node *next;
+  Fl_Awake_Handler func;
+  void *data;
+};
+
+static Fl_Awake_Node awake_stub;
+static Fl_Awake_Node *awake_head = &awake_stub; // the last node, changed by all threads
+static Fl_Awake_Node *awake_tail = &awake_stub; // the first node, main thread only
+static long awake_depth;        // callbacks that are added and not taken
+
+// the old ring buffer, not used anymore
 Fl_Awake_Handler *Fl::awake_ring_;
 void **Fl::awake_data_;
 int Fl::awake_ring_size_;
 int Fl::awake_ring_head_;
 int Fl::awake_ring_tail_;
-#endif
 
-static const int AWAKE_RING_SIZE = 1024;
+static const int AWAKE_BATCH = 1024;
+
+#if !FL_AWAKE_ATOMIC
 static void lock_ring();
 static void unlock_ring();
+#endif
 
-/** Adds an awake handler for use in awake(). */
-int Fl::add_awake_handler_(Fl_Awake_Handler func, void *data)
-{
-  int ret = 0;
+static Fl_Awake_Node *exchange_node(Fl_Awake_Node **p, Fl_Awake_Node *n) {
+#if defined(_WIN32)
+  return (Fl_Awake_Node *)InterlockedExchangePointer((PVOID volatile *)p, n);
+#elif FL_AWAKE_ATOMIC
+  return __atomic_exchange_n(p, n, __ATOMIC_ACQ_REL);
+#else
   lock_ring();
-  if (!awake_ring_) {
-    awake_ring_size_ = AWAKE_RING_SIZE;
-    awake_ring_ = (Fl_Awake_Handler*)malloc(awake_ring_size_*sizeof(Fl_Awake_Handler));
-    awake_data_ = (void**)malloc(awake_ring_size_*sizeof(void*));
-    // explicitly initialize the head and tail indices
-    awake_ring_head_= awake_ring_tail_ = 0;
-  }
-  // The next head index we will want (not the current index):
-  // We use this to check if the ring-buffer is full or not
-  // (and to update awake_ring_head_ if we do use the current index.)
-  int next_head = awake_ring_head_ + 1;
-  if (next_head >= awake_ring_size_) {
-    next_head = 0;
+  Fl_Awake_Node *r = *p;
+  *p = n;
+  unlock_ring();
+  return r;
+#endif
+}
+
+static Fl_Awake_Node *load_node(Fl_Awake_Node **p) {
+#if defined(_WIN32)
+  Fl_Awake_Node *r = *(Fl_Awake_Node *volatile *)p;
+  MemoryBarrier();
+  return r;
+#elif FL_AWAKE_ATOMIC
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+  lock_ring();
+  Fl_Awake_Node *r = *p;
+  unlock_ring();
+  return r;
+#endif
+}
+
+static void store_node(Fl_Awake_Node **p, Fl_Awake_Node *n) {
+#if defined(_WIN32)
+  MemoryBarrier();
+  *(Fl_Awake_Node *volatile *)p = n;
+#elif FL_AWAKE_ATOMIC
+  __atomic_store_n(p, n, __ATOMIC_RELEASE);
+#else
+  lock_ring();
+  *p = n;
+  unlock_ring();
+#endif
+}
+
+// adds d to the depth and returns the old depth
+static long add_depth(long d) {
+#if defined(_WIN32)
+  return InterlockedExchangeAdd((LONG volatile *)&awake_depth, (LONG)d);
+#elif FL_AWAKE_ATOMIC
+  return __atomic_fetch_add(&awake_depth, d, __ATOMIC_ACQ_REL);
+#else
+  lock_ring();
+  long r = awake_depth;
+  awake_depth += d;
+  unlock_ring();
+  return r;
+#endif
+}
+
+static void push_node(Fl_Awake_Node *n) {
+  n->next = 0;
+  Fl_Awake_Node *prev = exchange_node(&awake_head, n);
+  store_node(&prev->next, n);
+}
+
+// Takes the first node, or returns NULL if there is none, or if the
+// first one is not linked yet
+static Fl_Awake_Node *pop_node() {
+  Fl_Awake_Node *tail = awake_tail;
+  Fl_Awake_Node *next = load_node(&tail->next);
+  if (tail == &awake_stub) {
+    if (!next) return 0;
+    awake_tail = tail = next;
+    next = load_node(&tail->next);
   }
-  // check that the ring buffer is not full, and that it exists
-  if ((!awake_ring_) || (next_head == awake_ring_tail_)) {
-    // ring is non-existent or full. Return -1 as an error indicator.
-    ret = -1;
-  } else {
-    awake_ring_[awake_ring_head_] = func;
-    awake_data_[awake_ring_head_] = data;
-    awake_ring_head_ = next_head;
+  if (!next) {
+    if (tail != load_node(&awake_head)) return 0;
+    // tail is the last node: put the stub behind it so it can be taken
+    push_node(&awake_stub);
+    next = load_node(&tail->next);
+    if (!next) return 0;
   }
-  unlock_ring();
-  return ret;
+  awake_tail = next;
+  return tail;
+}
+
+/*
+ Adds a callback to the queue. Returns the number of callbacks that were
+ in the queue before, or -1 if there is no memory.
+ */
+static long push_awake_handler(Fl_Awake_Handler func, void *data) {
+  Fl_Awake_Node *n = (Fl_Awake_Node *)malloc(sizeof(Fl_Awake_Node));
+  if (!n) return -1;
+  n->func = func;
+  n->data = data;
+  long depth = add_depth(1);
+  push_node(n);
+  return depth;
 }
 
-/** Gets the last stored awake handler for use in awake(). */
+/** Adds an awake handler for use in awake(). */
+int Fl::add_awake_handler_(Fl_Awake_Handler func, void *data)
+{
+  return push_awake_handler(func, data) < 0 ? -1 : 0;
+}
+
+/** Gets the first stored awake handler for use in awake().
+    Must be called in the main thread only. */
 int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
 {
-  int ret = 0;
-  lock_ring();
-  if ((!awake_ring_) || (awake_ring_head_ == awake_ring_tail_)) {
-    ret = -1;
-  } else {
-    func = awake_ring_[awake_ring_tail_];
-    data = awake_data_[awake_ring_tail_];
-    ++awake_ring_tail_;
-    if (awake_ring_tail_ >= awake_ring_size_) {
-      awake_ring_tail_ = 0;
-    }
+  Fl_Awake_Node *n = pop_node();
+  if (!n) return -1;
+  func = n->func;
+  data = n->data;
+  free(n);
+  add_depth(-1);
+  return 0;
+}
+
+/*
+ Calls the stored awake handlers in the main thread, at most AWAKE_BATCH
+ of them. If there are more, or some are not linked into the queue yet,
+ wakes the main thread again, because no other thread will.
+ */
+void Fl::do_awake_handlers_()
+{
+  Fl_Awake_Handler func;
+  void *data;
+  for (int i = 0; i < AWAKE_BATCH && get_awake_handler_(func, data) == 0; i++) {
+    Fl_Profiler::Scope scope(Fl_Profiler::AWAKE);
+    func(data);
   }
-  unlock_ring();
-  return ret;
+  if (awake_queue_depth() > 0)
+    Fl::awake();
+}
+
+/**
+ Returns the number of callbacks that were registered with
+ Fl::awake(Fl_Awake_Handler, void*) and were not called yet.
+
+ This may be called in any thread, e.g. to watch if the main thread
+ keeps up with the callbacks of worker threads.
+*/
+int Fl::awake_queue_depth()
+{
+  long depth = add_depth(0);
+  return depth > 0 ? (int)depth : 0;
 }
 
 /**
@@ -134,15 +269,18 @@ int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
  Registers a function that will be 
  called by the main thread during the next message handling cycle. 
  Returns 0 if the callback function was registered, 
- and -1 if registration failed. Over a thousand awake callbacks can be
- registered simultaneously.
+ and -1 if registration failed. The number of callbacks that can be
+ registered is only limited by memory, and registering one does not
+ take a lock. The main thread is only woken up by the first callback
+ that is registered while it is busy.
  
- \see Fl::awake(void* message=0)
+ \see Fl::awake(void* message=0), Fl::awake_queue_depth()
 */
 int Fl::awake(Fl_Awake_Handler func, void *data) {
-  int ret = add_awake_handler_(func, data);
-  Fl::awake();
-  return ret;
+  long depth = push_awake_handler(func, data);
+  if (depth < 0) return -1;
+  if (depth == 0) Fl::awake();
+  return 0;
 }
 
 /** \fn int Fl::lock()
@@ -207,9 +345,12 @@ extern void (*fl_unlock_function)();
 
 // The main thread's ID
 static DWORD main_thread;
+static int lock_ready;
 
 // Microsoft's version of a MUTEX...
 CRITICAL_SECTION cs;
+
+#if !FL_AWAKE_ATOMIC
 CRITICAL_SECTION *cs_ring;
 
 void unlock_ring() {
@@ -223,6 +364,7 @@ void lock_ring() {
   }
   EnterCriticalSection(cs_ring);
 }
+#endif // !FL_AWAKE_ATOMIC
 
 //
 // 'unlock_function()' - Release the lock.
@@ -240,15 +382,21 @@ static void lock_function() {
   EnterCriticalSection(&cs);
 }
 
+int Fl_WinAPI_System_Driver::init_awake() {
+  if (!main_thread) main_thread = GetCurrentThreadId();
+  return 0;
+}
+
 int Fl_WinAPI_System_Driver::lock() {
-  if (!main_thread) InitializeCriticalSection(&cs);
+  if (!lock_ready) InitializeCriticalSection(&cs);
 
   lock_function();
 
-  if (!main_thread) {
+  if (!lock_ready) {
     fl_lock_function   = lock_function;
     fl_unlock_function = unlock_function;
-    main_thread        = GetCurrentThreadId();
+    lock_ready         = 1;
+    init_awake();
   }
   return 0;
 }
@@ -333,23 +481,21 @@ static void thread_awake_cb(int fd, void*) {
   if (read(fd, &thread_message_, sizeof(void*))==0) { 
     /* This should never happen */
   }
-  Fl_Awake_Handler func;
-  void *data;
-  while (Fl::get_awake_handler_(func, data)==0) {
-    (*func)(data);
-  }
+  Fl::do_awake_handlers_();
 }
 
 // These pointers are in Fl_x.cxx:
 extern void (*fl_lock_function)();
 extern void (*fl_unlock_function)();
 
-int Fl_Posix_System_Driver::lock() {
+int Fl_Posix_System_Driver::init_awake() {
   if (!thread_filedes[1]) {
     // Initialize thread communication pipe to let threads awake FLTK
     // from Fl::wait()
     if (pipe(thread_filedes)==-1) {
       /* this should not happen */
+      thread_filedes[1] = 0;
+      return -1;
     }
 
     // Make the write side of the pipe non-blocking to avoid deadlock
@@ -361,6 +507,15 @@ int Fl_Posix_System_Driver::lock() {
     // Fl::awake() from a thread will "wake up" the main thread in
     // Fl::wait().
     Fl::add_fd(thread_filedes[0], FL_READ, thread_awake_cb);
+  }
+  return 0;
+}
+
+int Fl_Posix_System_Driver::lock() {
+  static int lock_ready = 0;
+  if (!lock_ready) {
+    lock_ready = 1;
+    init_awake();
 
     // Set lock/unlock functions for this system, using a system-supplied
     // recursive mutex if supported...
@@ -386,7 +541,8 @@ void Fl_Posix_System_Driver::unlock() {
   fl_unlock_function();
 }
 
-// Mutex code for the awake ring buffer
+#if !FL_AWAKE_ATOMIC
+// Mutex code for the awake queue
 static pthread_mutex_t *ring_mutex;
 
 void unlock_ring() {
@@ -400,16 +556,20 @@ void lock_ring() {
   }
   pthread_mutex_lock(ring_mutex);
 }
+#endif // !FL_AWAKE_ATOMIC
 
 #else // ! HAVE_PTHREAD
 
 void Fl_Posix_System_Driver::awake(void*) {}
+int Fl_Posix_System_Driver::init_awake() { return 1; }
 int Fl_Posix_System_Driver::lock() { return 1; }
 void Fl_Posix_System_Driver::unlock() {}
 void* Fl_Posix_System_Driver::thread_message() { return NULL; }
 
+#if !FL_AWAKE_ATOMIC
 void lock_ring() {}
 void unlock_ring() {}
+#endif
 
 #endif // HAVE_PTHREAD
 
@@ -420,6 +580,7 @@ void unlock_ring() {}
 // TODO: can these functions be moved to the system drivers?
 #ifdef __ANDROID__
 
+#if !FL_AWAKE_ATOMIC
 static void unlock_ring()
 {
   // TODO: implement me
@@ -429,6 +590,7 @@ static void lock_ring()
 {
   // TODO: implement me
 }
+#endif
 
 static void unlock_function()
 {
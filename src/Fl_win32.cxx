@@ -66,6 +66,7 @@ void fl_cleanup_dc_list(void);
 #include <FL/fl_draw.H>
 #include <FL/Enumerations.H>
 #include <FL/Fl_Tooltip.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/Fl_Paged_Device.H>
 #include <FL/Fl_Image_Surface.H>
 #include "flstring.h"
@@ -394,13 +395,9 @@ extern int fl_send_system_handlers(void *e);
 MSG fl_msg;
 
 // A local helper function to flush any pending callback requests
-// from the awake ring-buffer
+// from the awake queue
 static void process_awake_handler_requests(void) {
-  Fl_Awake_Handler func;
-  void *data;
-  while (Fl::get_awake_handler_(func, data) == 0) {
-    func(data);
-  }
+  Fl::do_awake_handlers_();
 }
 
 // This is never called with time_to_wait < 0.0.
@@ -441,8 +438,10 @@ double Fl_WinAPI_Screen_Driver::wait(double time_to_wait) {
 	  revents |= FL_WRITE;
 	if (fl_wsk_fd_is_set(f, &fdt[2]))
 	  revents |= FL_EXCEPT;
-	if (fd[i].events & revents)
+	if (fd[i].events & revents) {
+	  Fl_Profiler::Scope scope(Fl_Profiler::FD);
 	  fd[i].cb(f, fd[i].arg);
+	}
       }
       time_to_wait = 0.0; // just peek for any messages
     } else {
@@ -464,7 +463,10 @@ double Fl_WinAPI_Screen_Driver::wait(double time_to_wait) {
 
   time_to_wait = (time_to_wait > 10000 ? 10000 : time_to_wait);
   int t_msec = (int)(time_to_wait * 1000.0 + 0.5);
-  MsgWaitForMultipleObjects(0, NULL, FALSE, t_msec, QS_ALLINPUT);
+  {
+    Fl_Profiler::Scope scope(Fl_Profiler::WAIT);
+    MsgWaitForMultipleObjects(0, NULL, FALSE, t_msec, QS_ALLINPUT);
+  }
 
   fl_lock_function();
 
@@ -489,30 +491,28 @@ double Fl_WinAPI_Screen_Driver::wait(double time_to_wait) {
   }
 
   // The following conditional test:
-  //    (Fl::awake_ring_head_ != Fl::awake_ring_tail_)
+  //    (Fl::awake_queue_depth() > 0)
   // is a workaround / fix for STR #3143. This works, but a better solution
   // would be to understand why the PostThreadMessage() messages are not
   // seen by the main window if it is being dragged/ resized at the time.
-  // If a worker thread posts an awake callback to the ring buffer
+  // If a worker thread posts an awake callback to the awake queue
   // whilst the main window is unresponsive (if a drag or resize operation
   // is in progress) we may miss the PostThreadMessage(). So here, we check if
-  // there is anything pending in the awake ring buffer and if so process
-  // it. This is not strictly thread safe (for speed it compares the head
-  // and tail indices without first locking the ring buffer) but is intended
-  // only as a fall-back recovery mechanism if the awake processing stalls.
-  // If the test erroneously returns true (may happen if we test the indices
-  // whilst they are being modified) we will call process_awake_handler_requests()
+  // there is anything pending in the awake queue and if so process it.
+  // This is intended only as a fall-back recovery mechanism if the awake
+  // processing stalls. If the test returns true for a callback that is
+  // still being added, we will call process_awake_handler_requests()
   // unnecessarily, but this has no harmful consequences so is safe to do.
   // Note also that if we miss the PostThreadMessage(), then thread_message_
   // will not be updated, so this is not a perfect solution, but it does
   // recover and process any pending awake callbacks.
-  // Normally the ring buffer head and tail indices will match and this
-  // comparison will do nothing. Addresses STR #3143
-  if (Fl::awake_ring_head_ != Fl::awake_ring_tail_) {
+  // Normally the awake queue is empty and this comparison will do
+  // nothing. Addresses STR #3143
+  if (Fl::awake_queue_depth() > 0) {
     process_awake_handler_requests();
   }
 
-  Fl::flush();
+  paced_flush();
 
   // This should return 0 if only timer events were handled:
   return 1;
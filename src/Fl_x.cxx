@@ -29,6 +29,7 @@
 #  include <FL/Fl_Window.H>
 #  include <FL/fl_utf8.h>
 #  include <FL/Fl_Tooltip.H>
+#  include <FL/Fl_Profiler.H>
 #  include <FL/fl_draw.H>
 #  include <FL/Fl_Paged_Device.H>
 #  include <FL/Fl_Shared_Image.H>
@@ -116,7 +117,160 @@ struct FD {
 
 static FD *fd = 0;
 
+#  if USE_EPOLL
+
+#    include <sys/epoll.h>
+#    include <errno.h>
+
+// With epoll the kernel keeps the set of file descriptors, so that a wait
+// takes time for the descriptors that are ready only. The handlers are kept
+// in an array indexed by file descriptor, with one handler for each of the
+// events POLLIN, POLLOUT and POLLERR. If epoll is not available at runtime,
+// the arrays above are used with poll() or select().
+
+struct Epoll_Handler {
+  void (*cb)(int, void*);
+  void* arg;
+};
+
+struct Epoll_FD {
+  Epoll_Handler h[3];
+  short events;         // the events that have a handler
+  short always;         // epoll refused the descriptor, it is always ready
+  unsigned serial;      // the last wait that called the handlers
+};
+
+static const int epoll_bits[3] = {POLLIN, POLLOUT, POLLERR};
+static const int EPOLL_MAX_EVENTS = 64;
+
+static int epoll_fd = -2;       // -2: not created yet, -1: not available
+static Epoll_FD *epoll_fds = 0;
+static int epoll_size = 0;
+static int epoll_always = 0;    // number of descriptors that are always ready
+static unsigned epoll_serial = 0; // counts the waits
+
+static int use_epoll() {
+  if (epoll_fd == -2) epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  return epoll_fd >= 0;
+}
+
+// tell epoll about the events of descriptor n that have a handler, always
+// if a handler was added: the descriptor may be a new one with the number
+// of one that was closed, which the kernel forgot
+static void epoll_update(int n, int added) {
+  Epoll_FD &f = epoll_fds[n];
+  int events = 0;
+  for (int k = 0; k < 3; k++)
+    if (f.h[k].cb) events |= epoll_bits[k];
+  if (events == f.events && !added) return;
+  if (!f.events) nfds++;
+  else if (!events) nfds--;
+  int op = !f.events ? EPOLL_CTL_ADD : events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+  if (f.always) {       // the kernel does not know the descriptor
+    f.always = 0;
+    epoll_always--;
+    op = EPOLL_CTL_ADD;
+  }
+  if (events || op != EPOLL_CTL_ADD) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (events & POLLIN) ev.events |= EPOLLIN;
+    if (events & POLLOUT) ev.events |= EPOLLOUT;
+    if (events & POLLERR) ev.events |= EPOLLERR;
+    ev.data.fd = n;
+    int r = epoll_ctl(epoll_fd, op, n, &ev);
+    if (r < 0 && op == EPOLL_CTL_ADD && errno == EEXIST)
+      r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, n, &ev);
+    else if (r < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+      r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, n, &ev);
+    // regular files cannot be watched, but poll() says they are ready
+    if (r < 0 && op != EPOLL_CTL_DEL && errno == EPERM) {
+      f.always = 1;
+      epoll_always++;
+    }
+  }
+  f.events = events;
+}
+
+static void epoll_add_fd(int n, int events, void (*cb)(int, void*), void *v) {
+  if (n < 0) return;
+  if (n >= epoll_size) {
+    int size = epoll_size ? 2 * epoll_size : 64;
+    while (size <= n) size *= 2;
+    Epoll_FD *temp = (Epoll_FD*)realloc(epoll_fds, size*sizeof(Epoll_FD));
+    if (!temp) return;
+    memset(temp + epoll_size, 0, (size - epoll_size)*sizeof(Epoll_FD));
+    epoll_fds = temp;
+    epoll_size = size;
+  }
+  for (int k = 0; k < 3; k++) {
+    if (!(events & epoll_bits[k])) continue;
+    epoll_fds[n].h[k].cb = cb;
+    epoll_fds[n].h[k].arg = v;
+  }
+  epoll_update(n, 1);
+}
+
+static void epoll_remove_fd(int n, int events) {
+  if (n < 0 || n >= epoll_size) return;
+  for (int k = 0; k < 3; k++)
+    if (events & epoll_bits[k]) epoll_fds[n].h[k].cb = 0;
+  epoll_update(n, 0);
+}
+
+// Call the handlers of descriptor n for the events in revents, unless they
+// were called in this wait already, and return 1 if they were called. Like
+// with poll(), errors and hangups are reported to every handler. A handler
+// may add and remove descriptors, so that the array is read again each time.
+static int epoll_dispatch(int n, int revents) {
+  if (n < 0 || n >= epoll_size || epoll_fds[n].serial == epoll_serial) return 0;
+  epoll_fds[n].serial = epoll_serial;
+  Epoll_Handler h[3];
+  memcpy(h, epoll_fds[n].h, sizeof(h));
+  for (int k = 0; k < 3; k++) {
+    if (!h[k].cb || !(revents & (epoll_bits[k] | POLLERR))) continue;
+    if (n >= epoll_size || epoll_fds[n].h[k].cb != h[k].cb ||
+        epoll_fds[n].h[k].arg != h[k].arg) continue;
+    int j;
+    for (j = 0; j < k; j++)     // one call for several events
+      if (h[j].cb == h[k].cb && h[j].arg == h[k].arg &&
+          (revents & (epoll_bits[j] | POLLERR))) break;
+    if (j == k) {
+      Fl_Profiler::Scope scope(Fl_Profiler::FD);
+      h[k].cb(n, h[k].arg);
+    }
+  }
+  return 1;
+}
+
+// call the handlers of the n descriptors returned by epoll_wait(), and of
+// those that are always ready, and return how many were not called before
+// in this wait
+static int epoll_dispatch_events(const epoll_event *events, int n) {
+  int called = 0;
+  for (int i = 0; i < n; i++) {
+    int e = events[i].events, revents = 0;
+    if (e & EPOLLIN) revents |= POLLIN;
+    if (e & EPOLLOUT) revents |= POLLOUT;
+    if (e & (EPOLLERR | EPOLLHUP)) revents |= POLLERR;
+    called += epoll_dispatch(events[i].data.fd, revents);
+  }
+  if (n >= 0 && epoll_always) {
+    for (int f = 0; f < epoll_size; f++)
+      if (epoll_fds[f].always) called += epoll_dispatch(f, POLLIN | POLLOUT);
+  }
+  return n < 0 ? n : called;
+}
+
+#  endif /* USE_EPOLL */
+
 void Fl_X11_System_Driver::add_fd(int n, int events, void (*cb)(int, void*), void *v) {
+#  if USE_EPOLL
+  if (use_epoll()) {
+    epoll_add_fd(n, events, cb, v);
+    return;
+  }
+#  endif
   remove_fd(n,events);
   int i = nfds++;
   if (i >= fd_array_size) {
@@ -159,6 +313,12 @@ void Fl_X11_System_Driver::add_fd(int n, void (*cb)(int, void*), void* v) {
 }
 
 void Fl_X11_System_Driver::remove_fd(int n, int events) {
+#  if USE_EPOLL
+  if (use_epoll()) {
+    epoll_remove_fd(n, events);
+    return;
+  }
+#  endif
   int i,j;
 # if !USE_POLL
   maxfd = -1; // recalculate maxfd on the fly
@@ -240,6 +400,32 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
   // so we must check for already-read events:
   if (fl_display && XQLength(fl_display)) {do_queued_events(); return 1;}
 
+#  if USE_EPOLL
+  if (epoll_fd >= 0) {
+    epoll_event events[EPOLL_MAX_EVENTS];
+    int ms = time_to_wait < 2147483.648 ? int(time_to_wait*1000 + .5) : -1;
+    if (epoll_always) ms = 0;
+    fl_unlock_function();
+    int n;
+    {
+      Fl_Profiler::Scope scope(Fl_Profiler::WAIT);
+      n = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, ms);
+    }
+    fl_lock_function();
+    if (!++epoll_serial) epoll_serial = 1;
+    int total = epoll_dispatch_events(events, n), called = total;
+    // like poll(), give every ready descriptor one chance in one wait: epoll
+    // returns descriptors that are still ready after the others, so ask
+    // again until all of them were called or no new one comes back
+    while (n == EPOLL_MAX_EVENTS && called > 0 && total < nfds) {
+      n = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, 0);
+      called = n > 0 ? epoll_dispatch_events(events, n) : 0;
+      total += called;
+    }
+    return total;
+  }
+#  endif
+
 #  if !USE_POLL
   fd_set fdt[3];
   fdt[0] = fdsets[0];
@@ -250,21 +436,24 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
 
   fl_unlock_function();
 
-  if (time_to_wait < 2147483.648) {
+  {
+    Fl_Profiler::Scope scope(Fl_Profiler::WAIT);
+    if (time_to_wait < 2147483.648) {
 #  if USE_POLL
-    n = ::poll(pollfds, nfds, int(time_to_wait*1000 + .5));
+      n = ::poll(pollfds, nfds, int(time_to_wait*1000 + .5));
 #  else
-    timeval t;
-    t.tv_sec = int(time_to_wait);
-    t.tv_usec = int(1000000 * (time_to_wait-t.tv_sec));
-    n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],&t);
+      timeval t;
+      t.tv_sec = int(time_to_wait);
+      t.tv_usec = int(1000000 * (time_to_wait-t.tv_sec));
+      n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],&t);
 #  endif
-  } else {
+    } else {
 #  if USE_POLL
-    n = ::poll(pollfds, nfds, -1);
+      n = ::poll(pollfds, nfds, -1);
 #  else
-    n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],0);
+      n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],0);
 #  endif
+    }
   }
 
   fl_lock_function();
@@ -272,14 +461,20 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
   if (n > 0) {
     for (int i=0; i<nfds; i++) {
 #  if USE_POLL
-      if (pollfds[i].revents) fd[i].cb(pollfds[i].fd, fd[i].arg);
+      if (pollfds[i].revents) {
+        Fl_Profiler::Scope scope(Fl_Profiler::FD);
+        fd[i].cb(pollfds[i].fd, fd[i].arg);
+      }
 #  else
       int f = fd[i].fd;
       short revents = 0;
       if (FD_ISSET(f,&fdt[0])) revents |= POLLIN;
       if (FD_ISSET(f,&fdt[1])) revents |= POLLOUT;
       if (FD_ISSET(f,&fdt[2])) revents |= POLLERR;
-      if (fd[i].events & revents) fd[i].cb(f, fd[i].arg);
+      if (fd[i].events & revents) {
+        Fl_Profiler::Scope scope(Fl_Profiler::FD);
+        fd[i].cb(f, fd[i].arg);
+      }
 #  endif
     }
   }
@@ -290,6 +485,12 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
 int Fl_X11_Screen_Driver::poll_or_select() {
   if (XQLength(fl_display)) return 1;
   if (!nfds) return 0; // nothing to select or poll
+#  if USE_EPOLL
+  if (epoll_fd >= 0) {
+    epoll_event event;
+    return epoll_always ? 1 : epoll_wait(epoll_fd, &event, 1, 0);
+  }
+#  endif
 #  if USE_POLL
   return ::poll(pollfds, nfds, 0);
 #  else
@@ -287,7 +287,7 @@ double Fl_Android_Screen_Driver::wait(double time_to_wait)
       pClearDesktop = false;
       pContentChanged = true;
     }
-    Fl::flush();
+    paced_flush();
   } else {
     // if there is wait time, show the pending changes and then handle the events
     // FIXME: kludge to erase a window after it was hidden
@@ -297,7 +297,7 @@ double Fl_Android_Screen_Driver::wait(double time_to_wait)
       pClearDesktop = false;
       pContentChanged = true;
     }
-    Fl::flush();
+    paced_flush();
     if (Fl::idle && !in_idle) // 'idle' may have been set within flush()
       time_to_wait = 0.0;
     fl_unlock_function();
@@ -387,7 +387,7 @@ Fl_PicoAndroid_Screen_Driver::~Fl_PicoAndroid_Screen_Driver()
 
 double Fl_PicoAndroid_Screen_Driver::wait(double time_to_wait)
 {
-  Fl::flush();
+  paced_flush();
     // Read all pending events.
     int ident;
     int events;
@@ -50,7 +50,7 @@ Fl_PicoSDL_Screen_Driver::~Fl_PicoSDL_Screen_Driver()
 
 double Fl_PicoSDL_Screen_Driver::wait(double time_to_wait)
 {
-  Fl::flush();
+  paced_flush();
   SDL_Event e;
   Fl_Window *window = Fl::first_window();
   if (SDL_PollEvent(&e)) {
@@ -31,6 +31,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <pwd.h>
 #include <unistd.h>
 #include <time.h>
@@ -121,6 +123,24 @@ const char *Fl_Posix_System_Driver::getpwnam(const char *login) {
   return pwd ? pwd->pw_dir : NULL;
 }
 
+void *Fl_Posix_System_Driver::map_file(const char *f, size_t *size) {
+  int fd = ::open(f, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void *addr = NULL;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) addr = NULL;
+    else *size = (size_t)st.st_size;
+  }
+  ::close(fd);
+  return addr;
+}
+
+void Fl_Posix_System_Driver::unmap_file(void *addr, size_t size) {
+  if (addr) munmap(addr, size);
+}
+
 
 void Fl_Posix_System_Driver::gettime(time_t *sec, int *usec) {
   struct timeval tv;
@@ -129,6 +149,15 @@ void Fl_Posix_System_Driver::gettime(time_t *sec, int *usec) {
   *usec = tv.tv_usec;
 }
 
+double Fl_Posix_System_Driver::monotonic_time() {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+  return Fl_System_Driver::monotonic_time();
+}
+
 //
 // End of "$Id$".
 //
@@ -24,6 +24,7 @@
 #include <FL/platform.H>
 #include <FL/Fl_Graphics_Driver.H>
 #include <FL/Fl_RGB_Image.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/fl_ask.H>
 #include <stdio.h>
 
@@ -371,6 +372,7 @@ static LRESULT CALLBACK s_TimerProc(HWND hwnd, UINT msg,
         void*              data = win32_timers[id].data;
         delete_timer(win32_timers[id]);
         if (cb) {
+          Fl_Profiler::Scope scope(Fl_Profiler::TIMEOUT);
           (*cb)(data);
         }
       }
@@ -225,6 +225,31 @@ FILE *Fl_WinAPI_System_Driver::fopen(const char *fnam, const char *mode) {
   return _wfopen(wbuf, wbuf1);
 }
 
+void *Fl_WinAPI_System_Driver::map_file(const char *fnam, size_t *size) {
+  utf8_to_wchar(fnam, wbuf);
+  HANDLE file = CreateFileW(wbuf, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+  void *addr = NULL;
+  LARGE_INTEGER fsize;
+  if (GetFileSizeEx(file, &fsize) && fsize.QuadPart > 0 &&
+      (unsigned long long)fsize.QuadPart <= (size_t)-1) {
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+      addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      // the view keeps the mapping alive
+      CloseHandle(mapping);
+      if (addr) *size = (size_t)fsize.QuadPart;
+    }
+  }
+  CloseHandle(file);
+  return addr;
+}
+
+void Fl_WinAPI_System_Driver::unmap_file(void *addr, size_t size) {
+  if (addr) UnmapViewOfFile(addr);
+}
+
 int Fl_WinAPI_System_Driver::system(const char *cmd) {
 # ifdef __MINGW32__
   return ::system(fl_utf2mbcs(cmd));
@@ -954,6 +979,15 @@ void Fl_WinAPI_System_Driver::gettime(time_t *sec, int *usec) {
   *usec = t.millitm * 1000;
 }
 
+double Fl_WinAPI_System_Driver::monotonic_time() {
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER count;
+  if (!frequency.QuadPart && !QueryPerformanceFrequency(&frequency))
+    return Fl_System_Driver::monotonic_time();
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)frequency.QuadPart;
+}
+
 //
 // End of "$Id$".
 //
@@ -28,6 +28,7 @@
 #include <FL/fl_ask.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Image_Surface.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/Fl_Tooltip.H>
 #include <FL/filename.H>
 #include <sys/time.h>
@@ -65,47 +66,192 @@ extern const char *fl_bg2;
 //
 
 
+// Continuously-adjusted error value, this is a number for how late
+// (< 0) or early (> 0) we were at calling the last timeout. This appears to make repeat_timeout
+// very accurate even when processing takes a significant portion of the
+// time interval:
+static double missed_timeout_by;
+
+// Greater than 0 while a timeout callback is called
+static int in_timeout;
+
 ////////////////////////////////////////////////////////////////////////
-// Timeouts are stored in a sorted list (*first_timeout), so only the
-// first one needs to be checked to see if any should be called.
-// Allocated, but unused (free) Timeout structs are stored in another
-// linked list (*free_timeout).
+// Timeouts are stored in a binary heap ordered by their deadline on the
+// monotonic clock, so only the first one needs to be checked to see if
+// any should be called, and adding or removing one takes O(log n) time.
+// Every timeout knows its index in the heap, and the timeouts are also
+// hashed by callback and argument, so that Fl::has_timeout() and
+// Fl::remove_timeout() find them without searching the heap.
+// Allocated, but unused (free) Timeout structs are stored in a linked
+// list (*free_timeout).
 
 struct Timeout {
-  double time;
+  double time;          // deadline on the monotonic clock
+  unsigned long seq;    // order of timeouts with the same deadline
   void (*cb)(void*);
   void* arg;
-  Timeout* next;
+  int index;            // position in the heap
+  Timeout* next;        // next in the same hash bucket, or free
 };
-static Timeout* first_timeout, *free_timeout;
-
-// I avoid the overhead of getting the current time when we have no
-// timeouts by setting this flag instead of getting the time.
-// In this case calling elapse_timeouts() does nothing, but records
-// the current time, and the next call will actually elapse time.
-static char reset_clock = 1;
-
-static void elapse_timeouts() {
-  static struct timeval prevclock;
-  struct timeval newclock;
-  gettimeofday(&newclock, NULL);
-  double elapsed = newclock.tv_sec - prevclock.tv_sec +
-    (newclock.tv_usec - prevclock.tv_usec)/1000000.0;
-  prevclock.tv_sec = newclock.tv_sec;
-  prevclock.tv_usec = newclock.tv_usec;
-  if (reset_clock) {
-    reset_clock = 0;
-  } else if (elapsed > 0) {
-    for (Timeout* t = first_timeout; t; t = t->next) t->time -= elapsed;
+
+static Timeout** timeout_heap;
+static int num_timeouts, timeout_heap_size;
+static Timeout** timeout_hash;
+static int timeout_hash_size;   // a power of 2
+static Timeout* free_timeout;
+static unsigned long timeout_seq;
+
+// Timeouts that are due this much later than the first one are called in
+// the same wakeup, so that timers of similar periods are batched
+#define TIMEOUT_SLACK 0.001
+
+// The time on the monotonic clock when it was read last, in seconds
+static double clock_now;
+
+static double read_clock() {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return clock_now = ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return clock_now = tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static inline bool timeout_before(const Timeout* a, const Timeout* b) {
+  return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void timeout_heap_set(int i, Timeout* t) {
+  timeout_heap[i] = t;
+  t->index = i;
+}
+
+// move the timeout at index i down to its place in the heap, the subtrees
+// below it must be in heap order already
+static void timeout_heap_down(int i) {
+  Timeout* t = timeout_heap[i];
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= num_timeouts) break;
+    if (c + 1 < num_timeouts && timeout_before(timeout_heap[c + 1], timeout_heap[c])) c++;
+    if (!timeout_before(timeout_heap[c], t)) break;
+    timeout_heap_set(i, timeout_heap[c]);
+    i = c;
   }
+  timeout_heap_set(i, t);
 }
 
+// move the timeout at index i up or down to its place in the heap
+static void timeout_heap_fix(int i) {
+  Timeout* t = timeout_heap[i];
+  while (i > 0 && timeout_before(t, timeout_heap[(i - 1) / 2])) {
+    timeout_heap_set(i, timeout_heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  timeout_heap_set(i, t);
+  timeout_heap_down(i);
+}
+
+static unsigned timeout_hash_index(void (*cb)(void*), void* arg) {
+  unsigned long h = (unsigned long)(fl_intptr_t)cb * 31 + (unsigned long)(fl_intptr_t)arg;
+  h ^= h >> 17;
+  h *= 0x9e3779b1UL;
+  return (unsigned)(h ^ (h >> 15)) & (timeout_hash_size - 1);
+}
+
+static void timeout_hash_insert(Timeout* t) {
+  if (num_timeouts >= timeout_hash_size) {
+    int old_size = timeout_hash_size;
+    Timeout** old_hash = timeout_hash;
+    timeout_hash_size = old_size ? 2 * old_size : 64;
+    timeout_hash = (Timeout**)calloc(timeout_hash_size, sizeof(Timeout*));
+    for (int i = 0; i < old_size; i++) {
+      for (Timeout* u = old_hash[i]; u;) {
+        Timeout* next = u->next;
+        unsigned h = timeout_hash_index(u->cb, u->arg);
+        u->next = timeout_hash[h];
+        timeout_hash[h] = u;
+        u = next;
+      }
+    }
+    free(old_hash);
+  }
+  unsigned h = timeout_hash_index(t->cb, t->arg);
+  t->next = timeout_hash[h];
+  timeout_hash[h] = t;
+}
+
+static void timeout_hash_remove(Timeout* t) {
+  Timeout** p = &timeout_hash[timeout_hash_index(t->cb, t->arg)];
+  while (*p != t) p = &((*p)->next);
+  *p = t->next;
+}
+
+static void add_to_heap(double time, void (*cb)(void*), void* arg) {
+  Timeout* t = free_timeout;
+  if (t) {
+    free_timeout = t->next;
+  } else {
+    t = new Timeout;
+  }
+  t->time = time;
+  t->seq = timeout_seq++;
+  t->cb = cb;
+  t->arg = arg;
+  timeout_hash_insert(t);
+  if (num_timeouts >= timeout_heap_size) {
+    timeout_heap_size = timeout_heap_size ? 2 * timeout_heap_size : 64;
+    timeout_heap = (Timeout**)realloc(timeout_heap, timeout_heap_size * sizeof(Timeout*));
+  }
+  timeout_heap_set(num_timeouts++, t);
+  timeout_heap_fix(t->index);
+}
+
+// remove the timeout from the heap and the hash table, and free it
+static void remove_from_heap(Timeout* t) {
+  int i = t->index;
+  timeout_hash_remove(t);
+  Timeout* last = timeout_heap[--num_timeouts];
+  if (last != t) {
+    timeout_heap_set(i, last);
+    timeout_heap_fix(i);
+  }
+  t->next = free_timeout;
+  free_timeout = t;
+}
+
+// Call the timeouts that are due. Timeouts that are added by the
+// callbacks are not called before the next wait, even if they are due.
+static void call_timeouts() {
+  double now = read_clock();
+  unsigned long seq = timeout_seq;
+  while (num_timeouts) {
+    Timeout* t = timeout_heap[0];
+    if (t->time > now + TIMEOUT_SLACK || t->seq >= seq) break;
+    missed_timeout_by = t->time - now;
+    // We must remove timeout from the heap before doing the callback:
+    void (*cb)(void*) = t->cb;
+    void *argp = t->arg;
+    remove_from_heap(t);
+    // Now it is safe for the callback to do add_timeout:
+    Fl_Profiler::Scope scope(Fl_Profiler::TIMEOUT);
+    in_timeout++;
+    cb(argp);
+    in_timeout--;
+  }
+}
+
+// The time until the first timeout is due, if it is less than time_to_wait
+static double time_to_first_timeout(double time_to_wait) {
+  if (num_timeouts) {
+    double t = timeout_heap[0]->time - read_clock();
+    if (t < time_to_wait) time_to_wait = t >= 0.0 ? t : 0.0;
+  }
+  return time_to_wait;
+}
 
-// Continuously-adjusted error value, this is a number <= 0 for how late
-// we were at calling the last timeout. This appears to make repeat_timeout
-// very accurate even when processing takes a significant portion of the
-// time interval:
-static double missed_timeout_by;
 
 /**
  Creates a driver that manages all screen and display related calls.
@@ -439,25 +585,7 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
 {
   static char in_idle;
 
-  if (first_timeout) {
-    elapse_timeouts();
-    Timeout *t;
-    while ((t = first_timeout)) {
-      if (t->time > 0) break;
-      // The first timeout in the array has expired.
-      missed_timeout_by = t->time;
-      // We must remove timeout from array before doing the callback:
-      void (*cb)(void*) = t->cb;
-      void *argp = t->arg;
-      first_timeout = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
-      // Now it is safe for the callback to do add_timeout:
-      cb(argp);
-    }
-  } else {
-    reset_clock = 1; // we are not going to check the clock
-  }
+  if (num_timeouts) call_timeouts();
   Fl::run_checks();
   if (Fl::idle) {
     if (!in_idle) {
@@ -468,22 +596,19 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
     // the idle function may turn off idle, we can then wait:
     if (Fl::idle) time_to_wait = 0.0;
   }
-  if (first_timeout && first_timeout->time < time_to_wait)
-    time_to_wait = first_timeout->time;
+  time_to_wait = time_to_first_timeout(time_to_wait);
   if (time_to_wait <= 0.0) {
     // do flush second so that the results of events are visible:
     int ret = this->poll_or_select_with_delay(0.0);
-    Fl::flush();
+    paced_flush();
     return ret;
   } else {
     // do flush first so that user sees the display:
-    Fl::flush();
+    paced_flush();
     if (Fl::idle && !in_idle) // 'idle' may have been set within flush()
       time_to_wait = 0.0;
-    else if (first_timeout && first_timeout->time < time_to_wait) {
-      // another timeout may have been queued within flush(), see STR #3188
-      time_to_wait = first_timeout->time >= 0.0 ? first_timeout->time : 0.0;
-    }
+    else // another timeout may have been queued within flush(), see STR #3188
+      time_to_wait = time_to_first_timeout(time_to_wait);
     return this->poll_or_select_with_delay(time_to_wait);
   }
 }
@@ -491,12 +616,8 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
 
 int Fl_X11_Screen_Driver::ready()
 {
-  if (first_timeout) {
-    elapse_timeouts();
-    if (first_timeout->time <= 0) return 1;
-  } else {
-    reset_clock = 1;
-  }
+  if (num_timeouts && timeout_heap[0]->time <= read_clock() + TIMEOUT_SLACK)
+    return 1;
   return this->poll_or_select();
 }
 
@@ -634,34 +755,27 @@ const char *Fl_X11_Screen_Driver::get_system_scheme()
 //
 
 void Fl_X11_Screen_Driver::add_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
-  elapse_timeouts();
+  read_clock();
   missed_timeout_by = 0;
   repeat_timeout(time, cb, argp);
 }
 
 void Fl_X11_Screen_Driver::repeat_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
-  time += missed_timeout_by; if (time < -.05) time = 0;
-  Timeout* t = free_timeout;
-  if (t) {
-      free_timeout = t->next;
-  } else {
-      t = new Timeout;
+  // outside of a timeout callback the clock may not have been read lately
+  if (!in_timeout) {
+    read_clock();
+    missed_timeout_by = 0;
   }
-  t->time = time;
-  t->cb = cb;
-  t->arg = argp;
-  // insert-sort the new timeout:
-  Timeout** p = &first_timeout;
-  while (*p && (*p)->time <= time) p = &((*p)->next);
-  t->next = *p;
-  *p = t;
+  time += missed_timeout_by; if (time < -.05) time = 0;
+  add_to_heap(clock_now + time, cb, argp);
 }
 
 /**
   Returns true if the timeout exists and has not been called yet.
 */
 int Fl_X11_Screen_Driver::has_timeout(Fl_Timeout_Handler cb, void *argp) {
-  for (Timeout* t = first_timeout; t; t = t->next)
+  if (!num_timeouts) return 0;
+  for (Timeout* t = timeout_hash[timeout_hash_index(cb, argp)]; t; t = t->next)
     if (t->cb == cb && t->arg == argp) return 1;
   return 0;
 }
@@ -674,15 +788,32 @@ int Fl_X11_Screen_Driver::has_timeout(Fl_Timeout_Handler cb, void *argp) {
 	This may change in the future.
 */
 void Fl_X11_Screen_Driver::remove_timeout(Fl_Timeout_Handler cb, void *argp) {
-  for (Timeout** p = &first_timeout; *p;) {
-    Timeout* t = *p;
-    if (t->cb == cb && (t->arg == argp || !argp)) {
-      *p = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
-    } else {
-      p = &(t->next);
+  if (!num_timeouts) return;
+  if (argp) {
+    // only the timeouts in one bucket can match
+    Timeout* t = timeout_hash[timeout_hash_index(cb, argp)];
+    while (t) {
+      Timeout* next = t->next;
+      if (t->cb == cb && t->arg == argp) remove_from_heap(t);
+      t = next;
+    }
+  } else {
+    // remove all matching timeouts at once, and rebuild the heap
+    int n = 0;
+    for (int i = 0; i < num_timeouts; i++) {
+      Timeout* t = timeout_heap[i];
+      if (t->cb == cb) {
+        timeout_hash_remove(t);
+        t->next = free_timeout;
+        free_timeout = t;
+      } else {
+        timeout_heap_set(n++, t);
+      }
     }
+    num_timeouts = n;
+    // sifting down from the last parent to the root orders the subtrees
+    // bottom up; moving timeouts up would break the subtrees not done yet
+    for (int i = n / 2 - 1; i >= 0; i--) timeout_heap_down(i);
   }
 }
 
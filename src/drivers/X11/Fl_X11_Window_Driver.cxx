@@ -227,6 +227,8 @@ void Fl_X11_Window_Driver::flush_double(int erase_overlay)
       other_xid = fl_create_offscreen(w(), h());
     pWindow->clear_damage(FL_DAMAGE_ALL);
   }
+  // with a damage region, only its rectangles must be copied to the window
+  int partial = i->region && !erase_overlay && damage_rects.count();
     if (pWindow->damage() & ~FL_DAMAGE_EXPOSE) {
       fl_clip_region(i->region); i->region = 0;
       fl_window = other_xid;
@@ -235,6 +237,13 @@ void Fl_X11_Window_Driver::flush_double(int erase_overlay)
     }
   if (erase_overlay) fl_clip_region(0);
   int X = 0, Y = 0, W = 0, H = 0;
+  if (partial) {
+    for (int n = 0; n < damage_rects.count(); n++) {
+      damage_rects.rect(n, X, Y, W, H);
+      if (other_xid) fl_copy_offscreen(X, Y, W, H, other_xid, X, Y);
+    }
+    return;
+  }
   fl_clip_box(0, 0, w(), h(), X, Y, W, H);
   if (other_xid) fl_copy_offscreen(X, Y, W, H, other_xid, X, Y);
 }
@@ -49,6 +49,7 @@
 #include "Fl_Xlib_Graphics_Driver.H"
 #include "../X11/Fl_X11_Screen_Driver.H"
 #include "../X11/Fl_X11_Window_Driver.H"
+#include "Fl_Xlib_Image_Converters.H"
 #  include <FL/Fl.H>
 #  include <FL/fl_draw.H>
 #  include <FL/platform.H>
@@ -59,6 +60,11 @@
 #if HAVE_XRENDER
 #include <X11/extensions/Xrender.h>
 #endif
+#if USE_XSHM
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
 
 static XImage xi;	// template used to pass info to X
 static int bytes_per_pixel;
@@ -67,6 +73,7 @@ static int scanline_mask;
 
 static void (*converter)(const uchar *from, uchar *to, int w, int delta);
 static void (*mono_converter)(const uchar *from, uchar *to, int w, int delta);
+static const Fl_Xlib_Converter_Info *converters; // see Fl_Xlib_Image_Converters.H
 
 static int dir;		// direction-alternator
 static int ri,gi,bi;	// saved error-diffusion value
@@ -254,36 +261,6 @@ static void m565_converter(const uchar *from,uchar *to,int w, int delta) {
   ri = r;
 }
 
-////////////////////////////////////////////////////////////////
-// 24bit TrueColor converters:
-
-static void rgb_converter(const uchar *from, uchar *to, int w, int delta) {
-  int d = delta-3;
-  for (; w--; from += d) {
-    *to++ = *from++;
-    *to++ = *from++;
-    *to++ = *from++;
-  }
-}
-
-static void bgr_converter(const uchar *from, uchar *to, int w, int delta) {
-  for (; w--; from += delta) {
-    uchar r = from[0];
-    uchar g = from[1];
-    *to++ = from[2];
-    *to++ = g;
-    *to++ = r;
-  }
-}
-
-static void rrr_converter(const uchar *from, uchar *to, int w, int delta) {
-  for (; w--; from += delta) {
-    *to++ = *from;
-    *to++ = *from;
-    *to++ = *from;
-  }
-}
-
 ////////////////////////////////////////////////////////////////
 // 32bit TrueColor converters on a 32 or 64-bit machine:
 
@@ -308,44 +285,6 @@ static void rrr_converter(const uchar *from, uchar *to, int w, int delta) {
   U32 *t = (U32*)to; for (; w--; from += delta) *t++ = f
 #  endif
 
-static void rgbx_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((unsigned(from[0])<<24)+(from[1]<<16)+(from[2]<<8));
-}
-
-static void xbgr_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((from[0])+(from[1]<<8)+(from[2]<<16));
-}
-
-static void xrgb_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((from[0]<<16)+(from[1]<<8)+(from[2]));
-}
-
-static void argb_premul_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((unsigned(from[3]) << 24) +
-             (((from[0] * from[3]) / 255) << 16) +
-             (((from[1] * from[3]) / 255) << 8) +
-             ((from[2] * from[3]) / 255));
-}
-
-static void depth2_to_argb_premul_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((unsigned(from[1]) << 24) +
-            (((from[0] * from[1]) / 255) << 16) +
-            (((from[0] * from[1]) / 255) << 8) +
-            ((from[0] * from[1]) / 255));
-}
-
-static void bgrx_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32((from[0]<<8)+(from[1]<<16)+(unsigned(from[2])<<24));
-}
-
-static void rrrx_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32(unsigned(*from) * 0x1010100U);
-}
-
-static void xrrr_converter(const uchar *from, uchar *to, int w, int delta) {
-  INNARDS32(*from * 0x10101U);
-}
-
 static void
 color32_converter(const uchar *from, uchar *to, int w, int delta) {
   INNARDS32(
@@ -364,6 +303,7 @@ static void figure_out_visual() {
 
   fl_xpixel(FL_BLACK); // setup fl_redmask, etc, in fl_color.cxx
   fl_xpixel(FL_WHITE); // also make sure white is allocated
+  converters = fl_xlib_converters();
 
   static XPixmapFormatValues *pfvlist;
   static int FL_NUM_pfv;
@@ -427,11 +367,11 @@ static void figure_out_visual() {
   case 3:
     if (xi.byte_order) {rs = 16-rs; gs = 16-gs; bs = 16-bs;}
     if (rs == 0 && gs == 8 && bs == 16) {
-      converter = rgb_converter;
-      mono_converter = rrr_converter;
+      converter = converters[FL_XLIB_RGB].fast;
+      mono_converter = converters[FL_XLIB_RRR].fast;
     } else if (rs == 16 && gs == 8 && bs == 0) {
-      converter = bgr_converter;
-      mono_converter = rrr_converter;
+      converter = converters[FL_XLIB_BGR].fast;
+      mono_converter = converters[FL_XLIB_RRR].fast;
     } else {
       Fl::fatal("Can't do arbitrary 24bit color");
     }
@@ -441,17 +381,17 @@ static void figure_out_visual() {
     if ((xi.byte_order!=0) != WORDS_BIGENDIAN)
       {rs = 24-rs; gs = 24-gs; bs = 24-bs;}
     if (rs == 0 && gs == 8 && bs == 16) {
-      converter = xbgr_converter;
-      mono_converter = xrrr_converter;
+      converter = converters[FL_XLIB_XBGR].fast;
+      mono_converter = converters[FL_XLIB_XRRR].fast;
     } else if (rs == 24 && gs == 16 && bs == 8) {
-      converter = rgbx_converter;
-      mono_converter = rrrx_converter;
+      converter = converters[FL_XLIB_RGBX].fast;
+      mono_converter = converters[FL_XLIB_RRRX].fast;
     } else if (rs == 8 && gs == 16 && bs == 24) {
-      converter = bgrx_converter;
-      mono_converter = rrrx_converter;
+      converter = converters[FL_XLIB_BGRX].fast;
+      mono_converter = converters[FL_XLIB_RRRX].fast;
     } else if (rs == 16 && gs == 8 && bs == 0) {
-      converter = xrgb_converter;
-      mono_converter = xrrr_converter;
+      converter = converters[FL_XLIB_XRGB].fast;
+      mono_converter = converters[FL_XLIB_XRRR].fast;
     } else {
       xi.byte_order = WORDS_BIGENDIAN;
       converter = color32_converter;
@@ -467,6 +407,144 @@ static void figure_out_visual() {
 
 #  define MAXBUFFER 0x40000 // 256k
 
+#if USE_XSHM
+////////////////////////////////////////////////////////////////
+// Large images are converted into an XImage in shared memory, so that
+// the X server reads the pixels from there instead of the socket. The
+// images are kept and reused by the next call, one for the depth of the
+// visual and one for ARGB32 images. The server may still read an image
+// after XShmPutImage returns, so the next call waits for it with XSync.
+// An image is freed when many images in a row needed much less of it, so
+// that drawing one large image does not keep its memory until the end.
+
+#  define SHM_MIN_SIZE 0x10000 // smaller images are sent with XPutImage
+#  define SHM_SHRINK 4 // an image is freed when it is this many times larger
+#  define SHM_SHRINK_DRAWS 16 // than needed for this many draws in a row
+
+struct Fl_Shm_Image {
+  XImage *image;
+  XShmSegmentInfo info;
+  int busy;		// the server may not have read the image yet
+  int small;		// draws in a row that needed much less memory
+};
+static Fl_Shm_Image shm_images[2];
+static int shm_state;	// 0 = not tested, 1 = usable, -1 = not available
+static int shm_error;
+
+static int shm_error_handler(Display *, XErrorEvent *) {
+  shm_error = 1;
+  return 0;
+}
+
+static void free_shm_image(Fl_Shm_Image &s) {
+  XShmDetach(fl_display, &s.info);
+  XSync(fl_display, False);
+  shmdt(s.info.shmaddr);
+  s.image->data = 0;
+  XDestroyImage(s.image);
+  s.image = 0;
+  s.busy = 0;
+  s.small = 0;
+}
+
+// Counts the draws that needed much less memory than the image has, and
+// frees it if there were too many of them.
+static void shm_check_size(Fl_Shm_Image &s, int w, int h) {
+  if (!s.image) return;
+  if ((double)w * h * SHM_SHRINK > (double)s.image->width * s.image->height)
+    s.small = 0;
+  else if (++s.small >= SHM_SHRINK_DRAWS)
+    free_shm_image(s);
+}
+
+// Returns a shared image of at least w by h pixels that may be written,
+// or NULL if MIT-SHM can't be used, e.g. for a remote display.
+static XImage *shm_image(int which, int depth, int w, int h) {
+  if (!shm_state) shm_state = XShmQueryExtension(fl_display) ? 1 : -1;
+  if (shm_state < 0) return 0;
+  Fl_Shm_Image &s = shm_images[which];
+  shm_check_size(s, w, h);
+  if (s.image) {
+    if (s.image->depth == depth && s.image->width >= w && s.image->height >= h) {
+      if (s.busy) XSync(fl_display, False);
+      s.busy = 0;
+      return s.image;
+    }
+    if (s.image->depth == depth) {
+      if (s.image->width > w) w = s.image->width;
+      if (s.image->height > h) h = s.image->height;
+    }
+    free_shm_image(s);
+  }
+  // a width of 8n pixels keeps the lines aligned for the STORETYPE converters
+  w = (w + 7) & ~7;
+  XImage *image = XShmCreateImage(fl_display, fl_visual->visual, depth, ZPixmap,
+                                  0, &s.info, w, h);
+  if (!image) {shm_state = -1; return 0;}
+  s.info.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT|0600);
+  if (s.info.shmid < 0) {XDestroyImage(image); shm_state = -1; return 0;}
+  s.info.shmaddr = image->data = (char *)shmat(s.info.shmid, 0, 0);
+  s.info.readOnly = True;
+  if (s.info.shmaddr == (char *)-1) {
+    shmctl(s.info.shmid, IPC_RMID, 0);
+    image->data = 0;
+    XDestroyImage(image);
+    shm_state = -1;
+    return 0;
+  }
+  // the attach fails with an X error if the server can't share our memory
+  XSync(fl_display, False);
+  XErrorHandler old_handler = XSetErrorHandler(shm_error_handler);
+  shm_error = 0;
+  XShmAttach(fl_display, &s.info);
+  XSync(fl_display, False);
+  XSetErrorHandler(old_handler);
+  // the segment is removed once both the server and we detach from it
+  shmctl(s.info.shmid, IPC_RMID, 0);
+  if (shm_error) {
+    shmdt(s.info.shmaddr);
+    image->data = 0;
+    XDestroyImage(image);
+    shm_state = -1;
+    return 0;
+  }
+  s.image = image;
+  return image;
+}
+
+// Converts the image into shared memory and sends it to the server.
+// Returns 0 if it must be sent with XPutImage.
+static int shm_innards(const uchar *buf, int X, int Y, int W, int dx, int dy, int w, int h,
+                       int delta, int linedelta, Fl_Draw_Image_Cb cb, void *userdata,
+                       void (*conv)(const uchar *, uchar *, int, int), bool alpha, GC gc)
+{
+  if (w * h * bytes_per_pixel < SHM_MIN_SIZE) {
+    shm_check_size(shm_images[alpha], w, h);
+    return 0;
+  }
+  // the server reads the memory as it is, without swapping bytes for us
+  if (xi.byte_order != ImageByteOrder(fl_display)) return 0;
+  XImage *image = shm_image(alpha, xi.depth, w, h);
+  if (!image || image->bits_per_pixel != xi.bits_per_pixel) return 0;
+  uchar *to = (uchar *)image->data;
+  if (buf) {
+    buf += delta*dx+linedelta*dy;
+    for (int j=0; j<h; j++, buf += linedelta, to += image->bytes_per_line)
+      conv(buf, to, w, delta);
+  } else {
+    STORETYPE* linebuf = new STORETYPE[(W*delta+(sizeof(STORETYPE)-1))/sizeof(STORETYPE)];
+    for (int j=0; j<h; j++, to += image->bytes_per_line) {
+      cb(userdata, dx, dy+j, w, (uchar*)linebuf);
+      conv((uchar*)linebuf, to, w, delta);
+    }
+    delete[] linebuf;
+  }
+  XShmPutImage(fl_display, fl_window, gc, image, 0, 0, X+dx, Y+dy, w, h, False);
+  shm_images[alpha].busy = 1;
+  return 1;
+}
+#endif // USE_XSHM
+
 static void innards(const uchar *buf, int X, int Y, int W, int H,
 		    int delta, int linedelta, int mono,
 		    Fl_Draw_Image_Cb cb, void* userdata,
@@ -490,7 +568,7 @@ static void innards(const uchar *buf, int X, int Y, int W, int H,
   if (alpha) {
     // This flag states the destination format is ARGB32 (big-endian), pre-multiplied.
     bytes_per_pixel = 4;
-    conv = (mono ? depth2_to_argb_premul_converter : argb_premul_converter);
+    conv = converters[mono ? FL_XLIB_GRAY_ARGB_PREMUL : FL_XLIB_ARGB_PREMUL].fast;
     xi.depth = 32;
     xi.bits_per_pixel = 32;
 
@@ -512,17 +590,21 @@ static void innards(const uchar *buf, int X, int Y, int W, int H,
 #  if 0	// set this to 1 to allow 32-bit shortcut
       delta == 4 &&
 #    if WORDS_BIGENDIAN
-      conv == rgbx_converter
+      conv == converters[FL_XLIB_RGBX].fast
 #    else
-      conv == xbgr_converter
+      conv == converters[FL_XLIB_XBGR].fast
 #    endif
       ||
 #  endif
-      conv == rgb_converter && delta==3
+      conv == converters[FL_XLIB_RGB].fast && delta==3
       ) && !(linedelta&scanline_add)) {
     xi.data = (char *)(buf+delta*dx+linedelta*dy);
     xi.bytes_per_line = linedelta;
 
+#if USE_XSHM
+  } else if (shm_innards(buf, X, Y, W, dx, dy, w, h, delta, linedelta,
+                         cb, userdata, conv, alpha, gc)) {
+#endif
   } else {
     int linesize = ((w*bytes_per_pixel+scanline_add)&scanline_mask)/sizeof(STORETYPE);
     int blocking = h;
@@ -639,63 +721,68 @@ void Fl_Xlib_Graphics_Driver::draw_fixed(Fl_Bitmap *bm, int X, int Y, int W, int
 }
 
 
-// Composite an image with alpha on systems that don't have accelerated
-// alpha compositing...
-static void alpha_blend(Fl_RGB_Image *img, int X, int Y, int W, int H, int cx, int cy) {
-  int ld = img->ld();
-  if (ld == 0) ld = img->data_w() * img->d();
-  uchar *srcptr = (uchar*)img->array + cy * ld + cx * img->d();
-  int srcskip = ld - img->d() * W;
+// this handler ignores the error of an XGetImage outside of the drawable
+extern "C" {
+  static int xgetimage_error_handler(Display *, XErrorEvent *) {
+    return 0;
+  }
+}
+
+// Composites an image with alpha on systems without XRender. src holds the
+// premultiplied pixels made by cache(), ld pixels apart. With 8 bits per
+// color in 32 bit pixels, the pixels under the image are fetched with
+// XGetImage and blended in place. Other visuals go through fl_read_image()
+// and fl_draw_image().
+static void alpha_blend(const U32 *src, int ld, int X, int Y, int W, int H, GC gc) {
+  const Visual *v = fl_visual->visual;
+  XImage *image = 0;
+  if (v->red_mask == 0xff0000 && v->green_mask == 0xff00 && v->blue_mask == 0xff) {
+    XErrorHandler old_handler = XSetErrorHandler(xgetimage_error_handler);
+    image = XGetImage(fl_display, fl_window, X, Y, W, H, AllPlanes, ZPixmap);
+    XSetErrorHandler(old_handler);
+  }
+  if (image && image->bits_per_pixel == 32 &&
+      image->byte_order == (WORDS_BIGENDIAN ? MSBFirst : LSBFirst)) {
+    Fl_Xlib_Converter blend = converters[FL_XLIB_BLEND_PREMUL].fast;
+    for (int y = 0; y < H; y++)
+      blend((const uchar *)(src + y * ld), (uchar *)image->data + y * image->bytes_per_line, W, 4);
+    XPutImage(fl_display, fl_window, gc, image, 0, 0, X, Y, W, H);
+    XDestroyImage(image);
+    return;
+  }
+  if (image) XDestroyImage(image);
 
   uchar *dst = new uchar[W * H * 3];
   uchar *dstptr = dst;
-
   fl_read_image(dst, X, Y, W, H, 0);
-
-  uchar srcr, srcg, srcb, srca;
-  uchar dstr, dstg, dstb, dsta;
-
-  if (img->d() == 2) {
-    // Composite grayscale + alpha over RGB...
-    for (int y = H; y > 0; y--, srcptr+=srcskip)
-      for (int x = W; x > 0; x--) {
-        srcg = *srcptr++;
-        srca = *srcptr++;
-
-        dstr = dstptr[0];
-        dstg = dstptr[1];
-        dstb = dstptr[2];
-        dsta = 255 - srca;
-
-        *dstptr++ = (srcg * srca + dstr * dsta) >> 8;
-        *dstptr++ = (srcg * srca + dstg * dsta) >> 8;
-        *dstptr++ = (srcg * srca + dstb * dsta) >> 8;
-      }
-  } else {
-    // Composite RGBA over RGB...
-    for (int y = H; y > 0; y--, srcptr+=srcskip)
-      for (int x = W; x > 0; x--) {
-        srcr = *srcptr++;
-        srcg = *srcptr++;
-        srcb = *srcptr++;
-        srca = *srcptr++;
-
-        dstr = dstptr[0];
-        dstg = dstptr[1];
-        dstb = dstptr[2];
-        dsta = 255 - srca;
-
-        *dstptr++ = (srcr * srca + dstr * dsta) >> 8;
-        *dstptr++ = (srcg * srca + dstg * dsta) >> 8;
-        *dstptr++ = (srcb * srca + dstb * dsta) >> 8;
-      }
+  for (int y = 0; y < H; y++) {
+    const U32 *srcptr = src + y * ld;
+    for (int x = 0; x < W; x++, srcptr++, dstptr += 3) {
+      unsigned dsta = 255 - (*srcptr >> 24);
+      dstptr[0] = ((*srcptr >> 16) & 255) + dstptr[0] * dsta / 255;
+      dstptr[1] = ((*srcptr >> 8) & 255) + dstptr[1] * dsta / 255;
+      dstptr[2] = (*srcptr & 255) + dstptr[2] * dsta / 255;
+    }
   }
-
   fl_draw_image(dst, X, Y, W, H, 3, 0);
-
   delete[] dst;
 }
 
+// Composites an image with alpha that cache() could not keep premultiplied,
+// converting one row at a time.
+static void alpha_blend(Fl_RGB_Image *img, int X, int Y, int W, int H, int cx, int cy, GC gc) {
+  int d = img->d(), ld = img->ld();
+  if (ld == 0) ld = img->data_w() * d;
+  U32 *row = (U32 *)malloc(W * sizeof(U32));
+  if (!row) return;
+  Fl_Xlib_Converter conv = converters[d == 2 ? FL_XLIB_GRAY_ARGB_PREMUL : FL_XLIB_ARGB_PREMUL].fast;
+  for (int y = 0; y < H; y++) {
+    conv(img->array + (cy + y) * ld + cx * d, (uchar *)row, W, d);
+    alpha_blend(row, W, X, Y + y, W, 1, gc);
+  }
+  free(row);
+}
+
 void Fl_Xlib_Graphics_Driver::cache(Fl_RGB_Image *img) {
   Fl_Image_Surface *surface;
   int depth = img->d();
@@ -706,7 +793,21 @@ void Fl_Xlib_Graphics_Driver::cache(Fl_RGB_Image *img) {
     surface = new Fl_Image_Surface(img->data_w(), img->data_h(), 0, pixmap);
     depth |= FL_IMAGE_WITH_ALPHA;
   } else {
-    *Fl_Graphics_Driver::id(img) = 0;
+    // keep the pixels premultiplied for alpha_blend()
+    if (!bytes_per_pixel) figure_out_visual();
+    int w = img->data_w(), h = img->data_h(), ld = img->ld();
+    if (ld == 0) ld = w * depth;
+    U32 *pixels = (U32 *)malloc(w * h * sizeof(U32));
+    if (pixels) {
+      Fl_Xlib_Converter conv = converters[depth == 2 ? FL_XLIB_GRAY_ARGB_PREMUL : FL_XLIB_ARGB_PREMUL].fast;
+      for (int y = 0; y < h; y++)
+        conv(img->array + y * ld, (uchar *)(pixels + y * w), w, depth);
+    } // else draw_fixed() converts the pixels it draws each time
+    int *pw, *ph;
+    cache_w_h(img, pw, ph);
+    *pw = w;
+    *ph = h;
+    *Fl_Graphics_Driver::id(img) = (fl_uintptr_t)pixels;
     return;
   }
   Fl_Surface_Device::push_current(surface);
@@ -740,7 +841,14 @@ void Fl_Xlib_Graphics_Driver::draw_fixed(Fl_RGB_Image *img, int X, int Y, int W,
   float keep = d->scale(nscreen);
   d->scale(nscreen, 1);
   push_no_clip();
-  alpha_blend(img, X, Y, W, H, cx, cy);
+  const U32 *pixels = (const U32 *)*Fl_Graphics_Driver::id(img);
+  if (pixels) {
+    int *pw, *ph;
+    cache_w_h(img, pw, ph);
+    alpha_blend(pixels + cy * *pw + cx, *pw, X, Y, W, H, gc_);
+  } else {
+    alpha_blend(img, X, Y, W, H, cx, cy, gc_);
+  }
   pop_clip();
   d->scale(nscreen, keep);
   Fl_Graphics_Driver::scale(s);
@@ -766,20 +874,26 @@ void Fl_Xlib_Graphics_Driver::draw_rgb(Fl_RGB_Image *rgb, int XP, int YP, int WP
   cache_size(rgb, Wfull, Hfull);
   scale_and_render_pixmap( *Fl_Graphics_Driver::id(rgb), rgb->d(),
                                  rgb->data_w() / double(Wfull), rgb->data_h() / double(Hfull),
-                          cx*scale(), cy*scale(), (X + offset_x_)*scale(), (Y + offset_y_)*scale(), W, H);
+                          cx*scale(), cy*scale(), (X + offset_x_)*scale(), (Y + offset_y_)*scale(), W, H,
+                          Fl_Graphics_Driver::mask(rgb));
 }
 
 /* Draws with Xrender an Fl_Offscreen with optional scaling and accounting for transparency if necessary.
- XP,YP,WP,HP are in drawing units
+ XP,YP,WP,HP are in drawing units.
+ If picture is not NULL, the Picture of the pixmap is kept there for the next call.
  */
-int Fl_Xlib_Graphics_Driver::scale_and_render_pixmap(Fl_Offscreen pixmap, int depth, double scale_x, double scale_y, int srcx, int srcy, int XP, int YP, int WP, int HP) {
+int Fl_Xlib_Graphics_Driver::scale_and_render_pixmap(Fl_Offscreen pixmap, int depth, double scale_x, double scale_y, int srcx, int srcy, int XP, int YP, int WP, int HP, fl_uintptr_t *picture) {
   bool has_alpha = (depth == 2 || depth == 4);
   XRenderPictureAttributes srcattr;
   memset(&srcattr, 0, sizeof(XRenderPictureAttributes));
   static XRenderPictFormat *fmt24 = XRenderFindStandardFormat(fl_display, PictStandardRGB24);
   static XRenderPictFormat *fmt32 = XRenderFindStandardFormat(fl_display, PictStandardARGB32);
   static XRenderPictFormat *dstfmt = XRenderFindVisualFormat(fl_display, fl_visual->visual);
-  Picture src = XRenderCreatePicture(fl_display, pixmap, has_alpha ?fmt32:fmt24, 0, &srcattr);
+  Picture src = picture ? (Picture)*picture : 0;
+  if (!src) {
+    src = XRenderCreatePicture(fl_display, pixmap, has_alpha ?fmt32:fmt24, 0, &srcattr);
+    if (picture) *picture = (fl_uintptr_t)src;
+  }
   Picture dst = XRenderCreatePicture(fl_display, fl_window, dstfmt, 0, &srcattr);
   if (!src || !dst) {
     fprintf(stderr, "Failed to create Render pictures (%lu %lu)\n", src, dst);
@@ -790,7 +904,7 @@ int Fl_Xlib_Graphics_Driver::scale_and_render_pixmap(Fl_Offscreen pixmap, int de
   if (clipr)
     XRenderSetPictureClipRegion(fl_display, dst, clipr);
   unscale_clip(r);
-  if (scale_x != 1 || scale_y != 1) {
+  if (scale_x != 1 || scale_y != 1 || picture) { // a kept picture may have been scaled before
     XTransform mat = {{
       { XDoubleToFixed( scale_x ), XDoubleToFixed( 0 ),       XDoubleToFixed( 0 ) },
       { XDoubleToFixed( 0 ),       XDoubleToFixed( scale_y ), XDoubleToFixed( 0 ) },
@@ -800,17 +914,26 @@ int Fl_Xlib_Graphics_Driver::scale_and_render_pixmap(Fl_Offscreen pixmap, int de
   }
   XRenderComposite(fl_display, (has_alpha ? PictOpOver : PictOpSrc), src, None, dst, srcx, srcy, 0, 0,
                    XP, YP, WP, HP);
-  XRenderFreePicture(fl_display, src);
+  if (!picture) XRenderFreePicture(fl_display, src);
   XRenderFreePicture(fl_display, dst);
   return 1;
 }
 
 #endif // HAVE_XRENDER
 
-void Fl_Xlib_Graphics_Driver::uncache(Fl_RGB_Image*, fl_uintptr_t &id_, fl_uintptr_t &mask_)
+void Fl_Xlib_Graphics_Driver::uncache(Fl_RGB_Image *img, fl_uintptr_t &id_, fl_uintptr_t &mask_)
 {
+#if HAVE_XRENDER
+  if (mask_) { // the Picture kept by draw_rgb()
+    XRenderFreePicture(fl_display, (Picture)mask_);
+    mask_ = 0;
+  }
+#endif
   if (id_) {
-    XFreePixmap(fl_display, (Fl_Offscreen)id_);
+    if ((img->d() == 2 || img->d() == 4) && !fl_can_do_alpha_blending())
+      free((void *)id_); // the premultiplied pixels made by cache()
+    else
+      XFreePixmap(fl_display, (Fl_Offscreen)id_);
     id_ = 0;
   }
 }
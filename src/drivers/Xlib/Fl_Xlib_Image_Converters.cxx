@@ -0,0 +1,491 @@
+//
+// "$Id$"
+//
+// Pixel format converters of the Xlib graphics driver for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <config.h>
+#include "Fl_Xlib_Image_Converters.H"
+
+// The vector versions assume a little-endian CPU. On x86 they are compiled
+// for AVX2 and SSSE3 with target attributes and picked by the CPU flags,
+// 64-bit ARM always has NEON.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ >= 5)
+#  define FL_CONVERT_X86 1
+#  include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#  define FL_CONVERT_NEON 1
+#  include <arm_neon.h>
+#endif
+
+////////////////////////////////////////////////////////////////
+// 24bit TrueColor converters:
+
+static void rgb_converter(const uchar *from, uchar *to, int w, int delta) {
+  int d = delta-3;
+  for (; w--; from += d) {
+    *to++ = *from++;
+    *to++ = *from++;
+    *to++ = *from++;
+  }
+}
+
+static void bgr_converter(const uchar *from, uchar *to, int w, int delta) {
+  for (; w--; from += delta) {
+    uchar r = from[0];
+    uchar g = from[1];
+    *to++ = from[2];
+    *to++ = g;
+    *to++ = r;
+  }
+}
+
+static void rrr_converter(const uchar *from, uchar *to, int w, int delta) {
+  for (; w--; from += delta) {
+    *to++ = *from;
+    *to++ = *from;
+    *to++ = *from;
+  }
+}
+
+////////////////////////////////////////////////////////////////
+// 32bit TrueColor converters:
+
+#define INNARDS32(f) \
+  U32 *t = (U32*)to; for (; w--; from += delta) *t++ = f
+
+static void rgbx_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((unsigned(from[0])<<24)+(from[1]<<16)+(from[2]<<8));
+}
+
+static void xbgr_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((from[0])+(from[1]<<8)+(from[2]<<16));
+}
+
+static void xrgb_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((from[0]<<16)+(from[1]<<8)+(from[2]));
+}
+
+static void bgrx_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((from[0]<<8)+(from[1]<<16)+(unsigned(from[2])<<24));
+}
+
+static void rrrx_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32(unsigned(*from) * 0x1010100U);
+}
+
+static void xrrr_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32(*from * 0x10101U);
+}
+
+static void argb_premul_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((unsigned(from[3]) << 24) +
+             (((from[0] * from[3]) / 255) << 16) +
+             (((from[1] * from[3]) / 255) << 8) +
+             ((from[2] * from[3]) / 255));
+}
+
+static void gray_argb_premul_converter(const uchar *from, uchar *to, int w, int delta) {
+  INNARDS32((unsigned(from[1]) << 24) +
+            (((from[0] * from[1]) / 255) << 16) +
+            (((from[0] * from[1]) / 255) << 8) +
+            ((from[0] * from[1]) / 255));
+}
+
+static inline unsigned div255(unsigned x) {
+  return (x + 1 + (x >> 8)) >> 8;
+}
+
+// The result of src OVER dst stays below 256 in every byte, because the
+// color bytes of src are at most its alpha.
+static void blend_premul_converter(const uchar *from, uchar *to, int w, int delta) {
+  U32 *t = (U32*)to;
+  for (; w--; from += delta, t++) {
+    U32 s = *(const U32*)from, d = *t, ia = 255 - (s >> 24);
+    *t = (d & 0xff000000U) + (s & 0xffffff) +
+         (div255(((d >> 16) & 255) * ia) << 16) +
+         (div255(((d >> 8) & 255) * ia) << 8) +
+         div255((d & 255) * ia);
+  }
+}
+
+////////////////////////////////////////////////////////////////
+// Vector versions of the 32bit converters.
+//
+// Most 32bit converters only move bytes: byte k of every output pixel
+// (in memory order) is byte pattern[k] of the input pixel, or 0 for -1.
+// A byte shuffle with a mask made from the pattern converts 4 pixels of
+// up to 4 bytes at a time. Loads must stay inside the line, so the last
+// pixels are left to the plain converter.
+//
+// x/255 is computed as (x + 1 + (x >> 8)) >> 8, which is exact for all
+// products of two bytes.
+
+#if FL_CONVERT_X86 || FL_CONVERT_NEON
+
+static const signed char xrgb_pattern[4] = { 2, 1, 0, -1};
+static const signed char xbgr_pattern[4] = { 0, 1, 2, -1};
+static const signed char rgbx_pattern[4] = {-1, 2, 1, 0};
+static const signed char bgrx_pattern[4] = {-1, 0, 1, 2};
+static const signed char xrrr_pattern[4] = { 0, 0, 0, -1};
+static const signed char rrrx_pattern[4] = {-1, 0, 0, 0};
+
+// fills n bytes of a shuffle mask for lanes of 16 bytes
+static void shuffle_mask(char *mask, int n, int delta, const signed char *pattern) {
+  for (int i = 0; i < n; i++) {
+    int c = pattern[i & 3];
+    mask[i] = c < 0 ? (char)0x80 : (char)(((i & 15) >> 2) * delta + c);
+  }
+}
+
+// A converter that does the first pixels with a vector function, and the
+// rest with the plain one. The vector function returns the number of
+// pixels it converted.
+#define VECTOR_SHUFFLE(isa, name, min_delta) \
+static void name##_##isa(const uchar *from, uchar *to, int w, int delta) { \
+  int n = (delta >= min_delta && delta <= 4) ? \
+    shuffle_##isa(from, to, w, delta, name##_pattern) : 0; \
+  name##_converter(from + n * delta, to + 4 * n, w - n, delta); \
+}
+
+#define VECTOR_PREMUL(isa, name, pixel_size) \
+static void name##_##isa(const uchar *from, uchar *to, int w, int delta) { \
+  int n = delta == pixel_size ? name##_##isa##_innards(from, to, w) : 0; \
+  name##_converter(from + n * delta, to + 4 * n, w - n, delta); \
+}
+
+#define VECTOR_CONVERTERS(isa) \
+  VECTOR_SHUFFLE(isa, xrgb, 3) \
+  VECTOR_SHUFFLE(isa, xbgr, 3) \
+  VECTOR_SHUFFLE(isa, rgbx, 3) \
+  VECTOR_SHUFFLE(isa, bgrx, 3) \
+  VECTOR_SHUFFLE(isa, xrrr, 1) \
+  VECTOR_SHUFFLE(isa, rrrx, 1) \
+  VECTOR_PREMUL(isa, argb_premul, 4) \
+  VECTOR_PREMUL(isa, gray_argb_premul, 2) \
+  VECTOR_PREMUL(isa, blend_premul, 4)
+
+#if FL_CONVERT_X86
+
+__attribute__((target("ssse3")))
+static inline __m128i div255_ssse3(__m128i x) {
+  x = _mm_add_epi16(x, _mm_add_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(1)));
+  return _mm_srli_epi16(x, 8);
+}
+
+__attribute__((target("ssse3")))
+static int shuffle_ssse3(const uchar *from, uchar *to, int w, int delta,
+                         const signed char *pattern) {
+  char m[16];
+  shuffle_mask(m, 16, delta, pattern);
+  __m128i mask = _mm_loadu_si128((const __m128i *)m);
+  int n = 0;
+  for (; n + 4 <= w && (w - n - 1) * delta >= 16; n += 4, from += 4 * delta, to += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)from);
+    _mm_storeu_si128((__m128i *)to, _mm_shuffle_epi8(x, mask));
+  }
+  return n;
+}
+
+__attribute__((target("ssse3")))
+static int argb_premul_ssse3_innards(const uchar *from, uchar *to, int w) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+  const __m128i order = _mm_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+  int n = 0;
+  for (; n + 4 <= w; n += 4, from += 16, to += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)from);
+    __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+    __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+    __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+    lo = div255_ssse3(_mm_mullo_epi16(lo, alo));
+    hi = div255_ssse3(_mm_mullo_epi16(hi, ahi));
+    __m128i p = _mm_packus_epi16(lo, hi);
+    p = _mm_or_si128(_mm_andnot_si128(alpha, p), _mm_and_si128(alpha, x));
+    _mm_storeu_si128((__m128i *)to, _mm_shuffle_epi8(p, order));
+  }
+  return n;
+}
+
+__attribute__((target("ssse3")))
+static int gray_argb_premul_ssse3_innards(const uchar *from, uchar *to, int w) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi16((short)0xff00);
+  const __m128i order0 = _mm_setr_epi8(0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7);
+  const __m128i order1 = _mm_setr_epi8(8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15);
+  int n = 0;
+  for (; n + 8 <= w; n += 8, from += 16, to += 32) {
+    __m128i x = _mm_loadu_si128((const __m128i *)from);
+    __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+    __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xf5), 0xf5);
+    __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xf5), 0xf5);
+    lo = div255_ssse3(_mm_mullo_epi16(lo, alo));
+    hi = div255_ssse3(_mm_mullo_epi16(hi, ahi));
+    __m128i p = _mm_packus_epi16(lo, hi);
+    p = _mm_or_si128(_mm_andnot_si128(alpha, p), _mm_and_si128(alpha, x));
+    _mm_storeu_si128((__m128i *)to, _mm_shuffle_epi8(p, order0));
+    _mm_storeu_si128((__m128i *)(to + 16), _mm_shuffle_epi8(p, order1));
+  }
+  return n;
+}
+
+__attribute__((target("ssse3")))
+static int blend_premul_ssse3_innards(const uchar *from, uchar *to, int w) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i high = _mm_set1_epi32((int)0xff000000);
+  const __m128i ones = _mm_set1_epi16(255);
+  int n = 0;
+  for (; n + 4 <= w; n += 4, from += 16, to += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i *)from);
+    __m128i d = _mm_loadu_si128((const __m128i *)to);
+    __m128i slo = _mm_unpacklo_epi8(s, zero), shi = _mm_unpackhi_epi8(s, zero);
+    __m128i ilo = _mm_sub_epi16(ones, _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xff), 0xff));
+    __m128i ihi = _mm_sub_epi16(ones, _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xff), 0xff));
+    __m128i lo = div255_ssse3(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ilo));
+    __m128i hi = div255_ssse3(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ihi));
+    __m128i r = _mm_add_epi8(_mm_packus_epi16(lo, hi), s);
+    r = _mm_or_si128(_mm_andnot_si128(high, r), _mm_and_si128(high, d));
+    _mm_storeu_si128((__m128i *)to, r);
+  }
+  return n;
+}
+
+VECTOR_CONVERTERS(ssse3)
+
+// The AVX2 versions work on two lanes of 16 bytes, which hold the
+// pixels 0-3 and 4-7 of the shuffles and premultiplied RGBA, and the
+// pixels 0-7 and 8-15 of premultiplied gray+alpha.
+
+__attribute__((target("avx2")))
+static inline __m256i div255_avx2(__m256i x) {
+  x = _mm256_add_epi16(x, _mm256_add_epi16(_mm256_srli_epi16(x, 8), _mm256_set1_epi16(1)));
+  return _mm256_srli_epi16(x, 8);
+}
+
+__attribute__((target("avx2")))
+static int shuffle_avx2(const uchar *from, uchar *to, int w, int delta,
+                        const signed char *pattern) {
+  char m[32];
+  shuffle_mask(m, 32, delta, pattern);
+  __m256i mask = _mm256_loadu_si256((const __m256i *)m);
+  int n = 0;
+  for (; n + 8 <= w && (w - n - 1) * delta >= 4 * delta + 16;
+       n += 8, from += 8 * delta, to += 32) {
+    __m256i x = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)from)),
+      _mm_loadu_si128((const __m128i *)(from + 4 * delta)), 1);
+    _mm256_storeu_si256((__m256i *)to, _mm256_shuffle_epi8(x, mask));
+  }
+  return n + shuffle_ssse3(from, to, w - n, delta, pattern);
+}
+
+__attribute__((target("avx2")))
+static int argb_premul_avx2_innards(const uchar *from, uchar *to, int w) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+  const __m256i order = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15,
+                                         2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+  int n = 0;
+  for (; n + 8 <= w; n += 8, from += 32, to += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)from);
+    __m256i lo = _mm256_unpacklo_epi8(x, zero), hi = _mm256_unpackhi_epi8(x, zero);
+    __m256i alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xff), 0xff);
+    __m256i ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xff), 0xff);
+    lo = div255_avx2(_mm256_mullo_epi16(lo, alo));
+    hi = div255_avx2(_mm256_mullo_epi16(hi, ahi));
+    __m256i p = _mm256_packus_epi16(lo, hi);
+    p = _mm256_or_si256(_mm256_andnot_si256(alpha, p), _mm256_and_si256(alpha, x));
+    _mm256_storeu_si256((__m256i *)to, _mm256_shuffle_epi8(p, order));
+  }
+  return n + argb_premul_ssse3_innards(from, to, w - n);
+}
+
+__attribute__((target("avx2")))
+static int gray_argb_premul_avx2_innards(const uchar *from, uchar *to, int w) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha = _mm256_set1_epi16((short)0xff00);
+  const __m256i order0 = _mm256_setr_epi8(0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7,
+                                          0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7);
+  const __m256i order1 = _mm256_setr_epi8(8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15,
+                                          8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15);
+  int n = 0;
+  for (; n + 16 <= w; n += 16, from += 32, to += 64) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)from);
+    __m256i lo = _mm256_unpacklo_epi8(x, zero), hi = _mm256_unpackhi_epi8(x, zero);
+    __m256i alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xf5), 0xf5);
+    __m256i ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xf5), 0xf5);
+    lo = div255_avx2(_mm256_mullo_epi16(lo, alo));
+    hi = div255_avx2(_mm256_mullo_epi16(hi, ahi));
+    __m256i p = _mm256_packus_epi16(lo, hi);
+    p = _mm256_or_si256(_mm256_andnot_si256(alpha, p), _mm256_and_si256(alpha, x));
+    __m256i a = _mm256_shuffle_epi8(p, order0), b = _mm256_shuffle_epi8(p, order1);
+    _mm256_storeu_si256((__m256i *)to, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(to + 32), _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  return n + gray_argb_premul_ssse3_innards(from, to, w - n);
+}
+
+__attribute__((target("avx2")))
+static int blend_premul_avx2_innards(const uchar *from, uchar *to, int w) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i high = _mm256_set1_epi32((int)0xff000000);
+  const __m256i ones = _mm256_set1_epi16(255);
+  int n = 0;
+  for (; n + 8 <= w; n += 8, from += 32, to += 32) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)from);
+    __m256i d = _mm256_loadu_si256((const __m256i *)to);
+    __m256i slo = _mm256_unpacklo_epi8(s, zero), shi = _mm256_unpackhi_epi8(s, zero);
+    __m256i ilo = _mm256_sub_epi16(ones, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(slo, 0xff), 0xff));
+    __m256i ihi = _mm256_sub_epi16(ones, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(shi, 0xff), 0xff));
+    __m256i lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ilo));
+    __m256i hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ihi));
+    __m256i r = _mm256_add_epi8(_mm256_packus_epi16(lo, hi), s);
+    r = _mm256_or_si256(_mm256_andnot_si256(high, r), _mm256_and_si256(high, d));
+    _mm256_storeu_si256((__m256i *)to, r);
+  }
+  return n + blend_premul_ssse3_innards(from, to, w - n);
+}
+
+VECTOR_CONVERTERS(avx2)
+
+#endif // FL_CONVERT_X86
+
+#if FL_CONVERT_NEON
+
+static inline uint8x16_t premul_neon(uint8x16_t c, uint8x16_t a) {
+  uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+  uint16x8_t hi = vmull_high_u8(c, a);
+  lo = vaddq_u16(lo, vaddq_u16(vshrq_n_u16(lo, 8), vdupq_n_u16(1)));
+  hi = vaddq_u16(hi, vaddq_u16(vshrq_n_u16(hi, 8), vdupq_n_u16(1)));
+  return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+}
+
+static int shuffle_neon(const uchar *from, uchar *to, int w, int delta,
+                        const signed char *pattern) {
+  char m[16];
+  shuffle_mask(m, 16, delta, pattern);
+  uint8x16_t mask = vld1q_u8((const uint8_t *)m); // 0x80 gives 0
+  int n = 0;
+  for (; n + 4 <= w && (w - n - 1) * delta >= 16; n += 4, from += 4 * delta, to += 16)
+    vst1q_u8(to, vqtbl1q_u8(vld1q_u8(from), mask));
+  return n;
+}
+
+static int argb_premul_neon_innards(const uchar *from, uchar *to, int w) {
+  int n = 0;
+  for (; n + 16 <= w; n += 16, from += 64, to += 64) {
+    uint8x16x4_t x = vld4q_u8(from), y;
+    y.val[0] = premul_neon(x.val[2], x.val[3]);
+    y.val[1] = premul_neon(x.val[1], x.val[3]);
+    y.val[2] = premul_neon(x.val[0], x.val[3]);
+    y.val[3] = x.val[3];
+    vst4q_u8(to, y);
+  }
+  return n;
+}
+
+static int gray_argb_premul_neon_innards(const uchar *from, uchar *to, int w) {
+  int n = 0;
+  for (; n + 16 <= w; n += 16, from += 32, to += 64) {
+    uint8x16x2_t x = vld2q_u8(from);
+    uint8x16x4_t y;
+    y.val[0] = y.val[1] = y.val[2] = premul_neon(x.val[0], x.val[1]);
+    y.val[3] = x.val[1];
+    vst4q_u8(to, y);
+  }
+  return n;
+}
+
+static inline uint8x16_t blend_neon(uint8x16_t s, uint8x16_t d, uint8x16_t ia) {
+  return vaddq_u8(s, premul_neon(d, ia));
+}
+
+static int blend_premul_neon_innards(const uchar *from, uchar *to, int w) {
+  int n = 0;
+  for (; n + 16 <= w; n += 16, from += 64, to += 64) {
+    uint8x16x4_t s = vld4q_u8(from), d = vld4q_u8(to);
+    uint8x16_t ia = vmvnq_u8(s.val[3]);
+    d.val[0] = blend_neon(s.val[0], d.val[0], ia);
+    d.val[1] = blend_neon(s.val[1], d.val[1], ia);
+    d.val[2] = blend_neon(s.val[2], d.val[2], ia);
+    vst4q_u8(to, d);
+  }
+  return n;
+}
+
+VECTOR_CONVERTERS(neon)
+
+#endif // FL_CONVERT_NEON
+
+#endif // FL_CONVERT_X86 || FL_CONVERT_NEON
+
+////////////////////////////////////////////////////////////////
+
+#define PLAIN(name) { #name, name##_converter, name##_converter }
+
+static Fl_Xlib_Converter_Info converters[FL_XLIB_CONVERTERS] = {
+  PLAIN(rgb),
+  PLAIN(bgr),
+  PLAIN(rrr),
+  PLAIN(rgbx),
+  PLAIN(xbgr),
+  PLAIN(xrgb),
+  PLAIN(bgrx),
+  PLAIN(rrrx),
+  PLAIN(xrrr),
+  PLAIN(argb_premul),
+  PLAIN(gray_argb_premul),
+  PLAIN(blend_premul)
+};
+
+static const char *converter_isa;
+
+#define USE_VECTOR_CONVERTERS(isa) \
+  converters[FL_XLIB_RGBX].fast = rgbx_##isa; \
+  converters[FL_XLIB_XBGR].fast = xbgr_##isa; \
+  converters[FL_XLIB_XRGB].fast = xrgb_##isa; \
+  converters[FL_XLIB_BGRX].fast = bgrx_##isa; \
+  converters[FL_XLIB_RRRX].fast = rrrx_##isa; \
+  converters[FL_XLIB_XRRR].fast = xrrr_##isa; \
+  converters[FL_XLIB_ARGB_PREMUL].fast = argb_premul_##isa; \
+  converters[FL_XLIB_GRAY_ARGB_PREMUL].fast = gray_argb_premul_##isa; \
+  converters[FL_XLIB_BLEND_PREMUL].fast = blend_premul_##isa
+
+const Fl_Xlib_Converter_Info *fl_xlib_converters() {
+  if (converter_isa) return converters;
+  converter_isa = "none";
+#if FL_CONVERT_X86
+  if (__builtin_cpu_supports("avx2")) {
+    USE_VECTOR_CONVERTERS(avx2);
+    converter_isa = "AVX2";
+  } else if (__builtin_cpu_supports("ssse3")) {
+    USE_VECTOR_CONVERTERS(ssse3);
+    converter_isa = "SSSE3";
+  }
+#elif FL_CONVERT_NEON
+  USE_VECTOR_CONVERTERS(neon);
+  converter_isa = "NEON";
+#endif
+  return converters;
+}
+
+const char *fl_xlib_converter_isa() {
+  fl_xlib_converters();
+  return converter_isa;
+}
+
+//
+// End of "$Id$".
+//
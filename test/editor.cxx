@@ -40,6 +40,7 @@
 #include <FL/Fl_Return_Button.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <FL/Fl_Text_Editor.H>
+#include <FL/Fl_Text_Highlighter.H>
 #include <FL/filename.H>
 
 int                changed = 0;
@@ -56,7 +57,6 @@ const int line_num_width = 75;
 
 // Syntax highlighting stuff...
 #define TS 14 // default editor textsize
-Fl_Text_Buffer     *stylebuf = 0;
 Fl_Text_Display::Style_Table_Entry
                    styletable[] = {	// Style table
 		     { FL_BLACK,      FL_COURIER,           TS }, // A - Plain
@@ -293,125 +293,22 @@ style_parse(const char *text,
 
 
 //
-// 'style_init()' - Initialize the style buffer...
+// 'Style_Highlighter' - Highlight the lines that Fl_Text_Display shows...
 //
 
-void
-style_init(void) {
-  char *style = new char[textbuf->length() + 1];
-  char *text = textbuf->text();
-
-  memset(style, 'A', textbuf->length());
-  style[textbuf->length()] = '\0';
-
-  if (!stylebuf) stylebuf = new Fl_Text_Buffer(textbuf->length());
-
-  style_parse(text, style, textbuf->length());
-
-  stylebuf->text(style);
-  delete[] style;
-  free(text);
-}
-
-
-//
-// 'style_unfinished_cb()' - Update unfinished styles.
-//
-
-void
-style_unfinished_cb(int, void*) {
-}
-
+class Style_Highlighter : public Fl_Text_Highlighter {
+public:
+  Style_Highlighter() { threaded(1); }	// style_parse() is thread safe
 
-//
-// 'style_update()' - Update the style buffer...
-//
-
-void
-style_update(int        pos,		// I - Position of update
-             int        nInserted,	// I - Number of inserted chars
-	     int        nDeleted,	// I - Number of deleted chars
-             int        /*nRestyled*/,	// I - Number of restyled chars
-	     const char * /*deletedText*/,// I - Text that was deleted
-             void       *cbArg) {	// I - Callback data
-  int	start,				// Start of text
-	end;				// End of text
-  char	last,				// Last style on line
-	*style,				// Style data
-	*text;				// Text data
-
-
-  // If this is just a selection change, just unselect the style buffer...
-  if (nInserted == 0 && nDeleted == 0) {
-    stylebuf->unselect();
-    return;
-  }
-
-  // Track changes in the text buffer...
-  if (nInserted > 0) {
-    // Insert characters into the style buffer...
-    style = new char[nInserted + 1];
-    memset(style, 'A', nInserted);
-    style[nInserted] = '\0';
-
-    stylebuf->replace(pos, pos + nDeleted, style);
-    delete[] style;
-  } else {
-    // Just delete characters in the style buffer...
-    stylebuf->remove(pos, pos + nDeleted);
+  void highlight(const char *text, int len, char *style, char prev) {
+    // Only block comments and strings continue on the next line...
+    style[0] = (prev == 'C' || prev == 'D') ? prev : 'A';
+    style_parse(text, style, len);
   }
+};
 
-  // Select the area that was just updated to avoid unnecessary
-  // callbacks...
-  stylebuf->select(pos, pos + nInserted - nDeleted);
-
-  // Re-parse the changed region; we do this by parsing from the
-  // beginning of the previous line of the changed region to the end of
-  // the line of the changed region...  Then we check the last
-  // style character and keep updating if we have a multi-line
-  // comment character...
-  start = textbuf->line_start(pos);
-//  if (start > 0) start = textbuf->line_start(start - 1);
-  end   = textbuf->line_end(pos + nInserted);
-  text  = textbuf->text_range(start, end);
-  style = stylebuf->text_range(start, end);
-  if (start==end)
-    last = 0;
-  else
-    last  = style[end - start - 1];
-
-//  printf("start = %d, end = %d, text = \"%s\", style = \"%s\", last='%c'...\n",
-//         start, end, text, style, last);
-
-  style_parse(text, style, end - start);
-
-//  printf("new style = \"%s\", new last='%c'...\n",
-//         style, style[end - start - 1]);
-
-  stylebuf->replace(start, end, style);
-  ((Fl_Text_Editor *)cbArg)->redisplay_range(start, end);
-
-  if (start==end || last != style[end - start - 1]) {
-//    printf("Recalculate the rest of the buffer style\n");
-    // Either the user deleted some text, or the last character
-    // on the line changed styles, so reparse the
-    // remainder of the buffer...
-    free(text);
-    free(style);
-
-    end   = textbuf->length();
-    text  = textbuf->text_range(start, end);
-    style = stylebuf->text_range(start, end);
-
-    style_parse(text, style, end - start);
-
-    stylebuf->replace(start, end, style);
-    ((Fl_Text_Editor *)cbArg)->redisplay_range(start, end);
-  }
+Style_Highlighter  highlighter;
 
-  free(text);
-  free(style);
-}
 
 // Editor window functions and class...
 void save_cb();
@@ -737,7 +634,6 @@ void close_cb(Fl_Widget*, void* v) {
 
   w->hide();
   w->editor->buffer(0);
-  textbuf->remove_modify_callback(style_update, w->editor);
   textbuf->remove_modify_callback(changed_cb, w);
   Fl::delete_widget(w);
 
@@ -903,9 +799,8 @@ Fl_Window* new_view() {
     w->editor->textsize(TS);
   //w->editor->wrap_mode(Fl_Text_Editor::WRAP_AT_BOUNDS, 250);
     w->editor->buffer(textbuf);
-    w->editor->highlight_data(stylebuf, styletable,
-                              sizeof(styletable) / sizeof(styletable[0]),
-			      'A', style_unfinished_cb, 0);
+    w->editor->highlighter(&highlighter, styletable,
+                           sizeof(styletable) / sizeof(styletable[0]));
 
 #ifdef DEV_TEST
 
@@ -942,8 +837,7 @@ Fl_Window* new_view() {
   w->size_range(300,200);
   w->callback((Fl_Callback *)close_cb, w);
 
-  textbuf->add_modify_callback(style_update, w->editor);
-  textbuf->add_modify_callback(changed_cb, w);
+  textbuf->add_modify_callback(changed_cb, w, 0);
   textbuf->call_modify_callbacks();
   num_windows++;
   return w;
@@ -956,7 +850,6 @@ void cb(const char *fname) {
 int main(int argc, char **argv) {
   textbuf = new Fl_Text_Buffer;
 //textbuf->transcoding_warning_action = NULL;
-  style_init();
   fl_open_callback(cb);
 
   Fl_Window* window = new_view();
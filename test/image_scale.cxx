@@ -0,0 +1,164 @@
+//
+// "$Id$"
+//
+// Fl_RGB_Image::copy() scaling benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Scales a 4K image down to full HD and thumbnail sizes with every
+// scaling method, once in the calling thread only and once with the
+// worker threads, and checks that both give the same pixels.
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Spinner.H>
+#include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Image.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/Fl_Image_Resample.H"
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+static Fl_Spinner *runs_spinner;
+static Fl_Text_Buffer *log_buffer;
+
+static double now() {
+#ifdef _WIN32
+  LARGE_INTEGER f, t;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 0.000001 * tv.tv_usec;
+#endif
+}
+
+static void show(const char *fmt, double a = 0, double b = 0, double c = 0, double d = 0) {
+  char line[200];
+  snprintf(line, sizeof(line), fmt, a, b, c, d);
+  log_buffer->append(line);
+  fputs(line, stdout);
+  fflush(stdout);
+  Fl::check();
+}
+
+static const int W = 3840, H = 2160;
+
+static const int sizes[][2] = {{1920, 1080}, {640, 360}, {256, 144}, {128, 72}};
+
+static const char *method_name[] = {"nearest", "bilinear", "lanczos"};
+
+// scales the image n times, returns the copy and the seconds per copy
+static Fl_Image *run(Fl_RGB_Image *img, int w, int h, int n, double &t) {
+  Fl_Image *copy = 0;
+  t = now();
+  for (int k = 0; k < n; k++) {
+    delete copy;
+    copy = img->copy(w, h);
+  }
+  t = (now() - t) / n;
+  return copy;
+}
+
+static void run_cb(Fl_Widget *w, void *) {
+  int runs = (int)runs_spinner->value();
+  w->deactivate();
+  log_buffer->text("");
+  char fmt[100];
+  snprintf(fmt, sizeof(fmt), "%d x %d image, vector instructions: %s\n\n",
+           W, H, fl_resample_isa());
+  show(fmt);
+
+  // a smooth picture with some noise and a fine pattern that aliases
+  uchar *pixels = (uchar *)malloc(W * H * 4);
+  unsigned seed = 12345;
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      uchar *p = pixels + (y * W + x) * 4;
+      seed = seed * 1103515245 + 12345;
+      int noise = (seed >> 16) & 15;
+      p[0] = (uchar)(x * 255 / W);
+      p[1] = (uchar)(((x / 3 + y / 3) & 1) ? 200 + noise : 40 + noise);
+      p[2] = (uchar)(128 + 127 * sin(x * 0.01) * cos(y * 0.013));
+      p[3] = (uchar)(y * 255 / H);
+    }
+  }
+
+  Fl_RGB_Scaling old_scaling = Fl_Image::RGB_scaling();
+  for (int d = 1; d <= 4; d++) {
+    // use the first d channels of the picture
+    uchar *data = new uchar[W * H * d];
+    for (int i = 0; i < W * H; i++) memcpy(data + i * d, pixels + i * 4 + (d == 2 ? 2 : 0), d);
+    Fl_RGB_Image *img = new Fl_RGB_Image(data, W, H, d);
+    for (int m = FL_RGB_SCALING_NEAREST; m <= FL_RGB_SCALING_LANCZOS; m++) {
+      Fl_Image::RGB_scaling((Fl_RGB_Scaling)m);
+      for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int sw = sizes[s][0], sh = sizes[s][1];
+        double t1, t2;
+        int old = fl_resample_threads(1);
+        Fl_Image *c1 = run(img, sw, sh, runs, t1);
+        fl_resample_threads(old);
+        Fl_Image *c2 = run(img, sw, sh, runs, t2);
+        int same = !memcmp(c1->data()[0], c2->data()[0], sw * sh * d);
+        snprintf(fmt, sizeof(fmt),
+                 "d=%d %-8s -> %4d x %-4d  1 thread %%7.2f ms  threads %%7.2f ms  %%4.1fx  %%6.1f MPixel/s%s\n",
+                 d, method_name[m], sw, sh, same ? "" : "  MISMATCH");
+        show(fmt, t1 * 1000, t2 * 1000, t2 > 0 ? t1 / t2 : 0,
+             t2 > 0 ? (double)W * H / t2 / 1e6 : 0);
+        delete c1;
+        delete c2;
+      }
+    }
+    delete img;
+    delete[] data;
+    show("\n");
+  }
+  Fl_Image::RGB_scaling(old_scaling);
+
+  free(pixels);
+  show("Done.\n");
+  w->activate();
+}
+
+int main(int argc, char **argv) {
+  Fl_Double_Window *win = new Fl_Double_Window(760, 400, "Fl_RGB_Image::copy() scaling benchmark");
+  runs_spinner = new Fl_Spinner(80, 10, 80, 25, "Runs:");
+  runs_spinner->range(1, 100);
+  runs_spinner->value(3);
+  Fl_Button *run = new Fl_Button(170, 10, 80, 25, "Run");
+  run->callback(run_cb);
+  log_buffer = new Fl_Text_Buffer();
+  Fl_Text_Display *display = new Fl_Text_Display(10, 45, 740, 345);
+  display->buffer(log_buffer);
+  display->textfont(FL_COURIER);
+  win->resizable(display);
+  win->end();
+  win->show(argc, argv);
+  return Fl::run();
+}
+
+//
+// End of "$Id$".
+//
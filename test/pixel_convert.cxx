@@ -0,0 +1,175 @@
+//
+// "$Id$"
+//
+// fl_draw_image() pixel converter benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Runs every pixel format converter of the X11 fl_draw_image() on full HD
+// frames, once with the plain C++ loop and once with the vector version
+// picked for this CPU, and checks that both give the same pixels.
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/platform.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Spinner.H>
+#include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+static Fl_Spinner *frames_spinner;
+static Fl_Text_Buffer *log_buffer;
+
+static double now() {
+#ifdef _WIN32
+  LARGE_INTEGER f, t;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 0.000001 * tv.tv_usec;
+#endif
+}
+
+static void show(const char *fmt, double a = 0, double b = 0, double c = 0, double d = 0) {
+  char line[200];
+  snprintf(line, sizeof(line), fmt, a, b, c, d);
+  log_buffer->append(line);
+  fputs(line, stdout);
+  fflush(stdout);
+  Fl::check();
+}
+
+#ifdef USE_X11
+
+#include "../src/drivers/Xlib/Fl_Xlib_Image_Converters.H"
+
+static const int W = 1920, H = 1080;
+
+// the input pixel sizes each converter is used with
+static const int gray_sizes[] = {1, 2, 0};
+static const int color_sizes[] = {3, 4, 0};
+static const int alpha_sizes[] = {4, 0};
+static const int gray_alpha_sizes[] = {2, 0};
+
+static const int *input_sizes(int i) {
+  switch (i) {
+    case FL_XLIB_RRR: case FL_XLIB_RRRX: case FL_XLIB_XRRR: return gray_sizes;
+    case FL_XLIB_ARGB_PREMUL: case FL_XLIB_BLEND_PREMUL: return alpha_sizes;
+    case FL_XLIB_GRAY_ARGB_PREMUL: return gray_alpha_sizes;
+    default: return color_sizes;
+  }
+}
+
+static int output_size(int i) {
+  return (i == FL_XLIB_RGB || i == FL_XLIB_BGR || i == FL_XLIB_RRR) ? 3 : 4;
+}
+
+// converts the frame n times, returns the seconds per frame
+static double run(Fl_Xlib_Converter conv, const uchar *in, int delta, uchar *out,
+                  int outsize, int n) {
+  double t = now();
+  for (int k = 0; k < n; k++)
+    for (int y = 0; y < H; y++)
+      conv(in + y * W * delta, out + y * W * outsize, W, delta);
+  return (now() - t) / n;
+}
+
+static void run_cb(Fl_Widget *w, void *) {
+  int frames = (int)frames_spinner->value();
+  w->deactivate();
+  log_buffer->text("");
+  const Fl_Xlib_Converter_Info *conv = fl_xlib_converters();
+  char fmt[100];
+  snprintf(fmt, sizeof(fmt), "%d x %d frames, vector instructions: %s\n\n",
+           W, H, fl_xlib_converter_isa());
+  show(fmt);
+
+  uchar *in = (uchar *)malloc(W * H * 4);
+  uchar *out1 = (uchar *)malloc(W * H * 4), *out2 = (uchar *)malloc(W * H * 4);
+  unsigned seed = 12345;
+  for (int i = 0; i < W * H * 4; i++) {
+    seed = seed * 1103515245 + 12345;
+    in[i] = (uchar)(seed >> 16);
+  }
+  // the blend needs premultiplied pixels
+  uchar *pre = (uchar *)malloc(W * H * 4);
+  conv[FL_XLIB_ARGB_PREMUL].plain(in, pre, W * H, 4);
+
+  for (int i = 0; i < FL_XLIB_CONVERTERS; i++) {
+    int outsize = output_size(i);
+    for (const int *d = input_sizes(i); *d; d++) {
+      // the blend reads what it writes, the others must write every byte
+      memset(out1, i == FL_XLIB_BLEND_PREMUL ? 0x80 : 0, W * H * 4);
+      memset(out2, i == FL_XLIB_BLEND_PREMUL ? 0x80 : 0xff, W * H * 4);
+      const uchar *src = i == FL_XLIB_BLEND_PREMUL ? pre : in;
+      double t1 = run(conv[i].plain, src, *d, out1, outsize, frames);
+      double t2 = run(conv[i].fast, src, *d, out2, outsize, frames);
+      int same = !memcmp(out1, out2, W * H * outsize);
+      snprintf(fmt, sizeof(fmt),
+               "%-16s %d->%d  plain %%7.2f ms  vector %%7.2f ms  %%5.1fx  %%5.2f GB/s%s\n",
+               conv[i].name, *d, outsize, same ? "" : "  MISMATCH");
+      show(fmt, t1 * 1000, t2 * 1000, t2 > 0 ? t1 / t2 : 0,
+           t2 > 0 ? (double)W * H * (*d + outsize) / t2 / 1e9 : 0);
+    }
+  }
+
+  free(in);
+  free(pre);
+  free(out1);
+  free(out2);
+  show("\nDone.\n");
+  w->activate();
+}
+
+#else
+
+static void run_cb(Fl_Widget *, void *) {
+  log_buffer->text("");
+  show("This benchmark tests the converters of the X11 graphics driver.\n");
+}
+
+#endif // USE_X11
+
+int main(int argc, char **argv) {
+  Fl_Double_Window *win = new Fl_Double_Window(680, 340, "fl_draw_image() converter benchmark");
+  frames_spinner = new Fl_Spinner(80, 10, 80, 25, "Frames:");
+  frames_spinner->range(1, 1000);
+  frames_spinner->value(20);
+  Fl_Button *run = new Fl_Button(170, 10, 80, 25, "Run");
+  run->callback(run_cb);
+  log_buffer = new Fl_Text_Buffer();
+  Fl_Text_Display *display = new Fl_Text_Display(10, 45, 660, 285);
+  display->buffer(log_buffer);
+  display->textfont(FL_COURIER);
+  win->resizable(display);
+  win->end();
+  win->show(argc, argv);
+  return Fl::run();
+}
+
+//
+// End of "$Id$".
+//
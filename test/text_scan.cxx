@@ -0,0 +1,220 @@
+//
+// "$Id$"
+//
+// Fl_Text_Buffer search benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Compares the vectorized search and line counting functions of
+// Fl_Text_Buffer with the character by character loops that were used
+// before, on a large buffer (500 MB by default).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Spinner.H>
+#include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/fl_utf8.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+static Fl_Spinner *size_spinner;
+static Fl_Text_Buffer *log_buffer;
+
+static double now() {
+#ifdef _WIN32
+  LARGE_INTEGER f, t;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 0.000001 * tv.tv_usec;
+#endif
+}
+
+static void show(const char *fmt, double a = 0, double b = 0, double c = 0) {
+  char line[200];
+  snprintf(line, sizeof(line), fmt, a, b, c);
+  log_buffer->append(line);
+  fputs(line, stdout);
+  fflush(stdout);
+  Fl::check();
+}
+
+// The old implementations, one character at a time
+
+static int old_count_lines(Fl_Text_Buffer *buf) {
+  int n = 0, len = buf->length();
+  for (int i = 0; i < len; i++)
+    if (buf->byte_at(i) == '\n')
+      n++;
+  return n;
+}
+
+static int old_findchar_forward(Fl_Text_Buffer *buf, unsigned c) {
+  int len = buf->length();
+  for (int i = 0; i < len; i = buf->next_char(i))
+    if (buf->char_at(i) == c)
+      return i;
+  return -1;
+}
+
+static int old_search_forward(const Fl_Text_Buffer *buf, const char *s, int matchCase) {
+  int len = buf->length();
+  for (int pos = 0; pos < len; pos = buf->next_char(pos)) {
+    int bp = pos;
+    const char *sp = s;
+    for (;;) {
+      if (!*sp)
+        return pos;
+      if (bp >= len)
+        break;
+      int l;
+      if (matchCase) {
+        l = fl_utf8len1(*sp);
+        if (memcmp(sp, buf->address(bp), l))
+          break;
+        bp += l;
+      } else {
+        unsigned int b = buf->char_at(bp);
+        unsigned int c = fl_utf8decode(sp, 0, &l);
+        if (fl_tolower(b) != fl_tolower(c))
+          break;
+        bp = buf->next_char(bp);
+      }
+      sp += l;
+    }
+  }
+  return -1;
+}
+
+// The new implementations
+
+static int new_count_lines(Fl_Text_Buffer *buf) {
+  return buf->count_lines(0, buf->length());
+}
+
+static int new_findchar_forward(Fl_Text_Buffer *buf, unsigned c) {
+  int pos;
+  return buf->findchar_forward(0, c, &pos) ? pos : -1;
+}
+
+static int new_search_forward(Fl_Text_Buffer *buf, const char *s, int matchCase) {
+  int pos;
+  return buf->search_forward(0, s, &pos, matchCase) ? pos : -1;
+}
+
+static void compare(const char *name, double told, double tnew, int same) {
+  char fmt[100];
+  snprintf(fmt, sizeof(fmt), "%-26s old %%8.3f s  new %%8.3f s  %%6.1fx%s\n",
+           name, same ? "" : "  MISMATCH");
+  show(fmt, told, tnew, tnew > 0 ? told / tnew : 0);
+}
+
+// Fills the buffer with lines of lower case words, using no 'z' so that
+// the search strings below are never found and the whole text is scanned.
+static void fill(Fl_Text_Buffer *buf, int size) {
+  static const int CHUNK = 1024 * 1024;
+  char *chunk = (char *)malloc(CHUNK + 1);
+  unsigned seed = 12345;
+  int col = 0;
+  for (int i = 0; i < CHUNK; i++) {
+    seed = seed * 1103515245 + 12345;
+    int r = (seed >> 16) % 32;
+    if (col > 60 && r < 4) { chunk[i] = '\n'; col = 0; }
+    else if (r >= 25) { chunk[i] = ' '; col++; }
+    else { chunk[i] = 'a' + r; col++; }
+  }
+  chunk[CHUNK] = 0;
+  for (int n = 0; n < size; n += CHUNK) {
+    if (size - n < CHUNK)
+      chunk[size - n] = 0;
+    buf->append(chunk);
+  }
+  free(chunk);
+  // move the gap to the middle, so that both halves are scanned
+  buf->insert(buf->length() / 2, "\xc3\xa4");
+}
+
+static void run_cb(Fl_Widget *w, void *) {
+  int mb = (int)size_spinner->value();
+  w->deactivate();
+  log_buffer->text("");
+  show("Filling a %g MB buffer...\n", mb);
+  Fl_Text_Buffer *buf = new Fl_Text_Buffer(mb * 1024 * 1024 + 1024);
+  fill(buf, mb * 1024 * 1024);
+  show("%.0f lines\n\n", buf->count_lines(0, buf->length()));
+
+  double t0, t1, t2;
+  int r1, r2;
+
+  t0 = now(); r1 = old_count_lines(buf);
+  t1 = now(); r2 = new_count_lines(buf);
+  t2 = now(); compare("count lines", t1 - t0, t2 - t1, r1 == r2);
+
+  t0 = now(); r1 = old_findchar_forward(buf, '\t');
+  t1 = now(); r2 = new_findchar_forward(buf, '\t');
+  t2 = now(); compare("findchar ASCII", t1 - t0, t2 - t1, r1 == r2);
+
+  t0 = now(); r1 = old_findchar_forward(buf, 0x20ac);
+  t1 = now(); r2 = new_findchar_forward(buf, 0x20ac);
+  t2 = now(); compare("findchar UTF-8", t1 - t0, t2 - t1, r1 == r2);
+
+  t0 = now(); r1 = old_search_forward(buf, "the zebra", 1);
+  t1 = now(); r2 = new_search_forward(buf, "the zebra", 1);
+  t2 = now(); compare("search, match case", t1 - t0, t2 - t1, r1 == r2);
+
+  t0 = now(); r1 = old_search_forward(buf, "The Zebra", 0);
+  t1 = now(); r2 = new_search_forward(buf, "The Zebra", 0);
+  t2 = now(); compare("search, ignore case", t1 - t0, t2 - t1, r1 == r2);
+
+  t0 = now(); r1 = old_search_forward(buf, "Zebra \xc3\x84", 0);
+  t1 = now(); r2 = new_search_forward(buf, "Zebra \xc3\x84", 0);
+  t2 = now(); compare("search UTF-8, ignore case", t1 - t0, t2 - t1, r1 == r2);
+
+  delete buf;
+  show("\nDone.\n");
+  w->activate();
+}
+
+int main(int argc, char **argv) {
+  Fl_Double_Window *win = new Fl_Double_Window(640, 300, "Fl_Text_Buffer search benchmark");
+  size_spinner = new Fl_Spinner(110, 10, 80, 25, "Buffer (MB):");
+  size_spinner->range(1, 1500);
+  size_spinner->value(500);
+  Fl_Button *run = new Fl_Button(200, 10, 80, 25, "Run");
+  run->callback(run_cb);
+  log_buffer = new Fl_Text_Buffer();
+  Fl_Text_Display *display = new Fl_Text_Display(10, 45, 620, 245);
+  display->buffer(log_buffer);
+  display->textfont(FL_COURIER);
+  win->resizable(display);
+  win->end();
+  win->show(argc, argv);
+  return Fl::run();
+}
+
+//
+// End of "$Id$".
+//
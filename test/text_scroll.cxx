@@ -0,0 +1,174 @@
+//
+// "$Id$"
+//
+// Fl_Text_Display scrolling benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Scrolls through a buffer of 100000 lines of highlighted code and reports
+// how many frames per second are drawn, with a proportional or a fixed
+// width font, and with or without wrapping lines.
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Check_Button.H>
+#include <FL/Fl_Choice.H>
+#include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+static const int LINES = 100000;
+static const int FRAMES = 300;
+
+static Fl_Text_Display *display;
+static Fl_Text_Buffer *text_buffer, *style_buffer, *log_buffer;
+static Fl_Choice *font_choice;
+static Fl_Check_Button *wrap_button;
+
+static Fl_Text_Display::Style_Table_Entry styles[] = {
+  { FL_BLACK,      FL_HELVETICA,        14 }, // A - plain
+  { FL_DARK_BLUE,  FL_HELVETICA_BOLD,   14 }, // B - keywords
+  { FL_DARK_GREEN, FL_HELVETICA_ITALIC, 14 }, // C - comments
+  { FL_DARK_RED,   FL_HELVETICA,        14 }  // D - strings
+};
+
+static double now() {
+#ifdef _WIN32
+  LARGE_INTEGER f, t;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 0.000001 * tv.tv_usec;
+#endif
+}
+
+static void show(const char *line) {
+  log_buffer->append(line);
+  fputs(line, stdout);
+  fflush(stdout);
+}
+
+// Appends one word to the text and its style to the style buffer.
+static void add(char *text, char *style, int *n, const char *word, char s) {
+  int len = (int) strlen(word);
+  memcpy(text + *n, word, len);
+  memset(style + *n, s, len);
+  *n += len;
+}
+
+// Fills the buffers with lines that look a bit like highlighted C code.
+static void fill() {
+  static const char *keywords[] = { "int ", "return ", "if ", "for ", "static " };
+  static const char *names[] = { "count", "width", "buffer", "x", "pos", "length" };
+  int size = LINES * 100;
+  char *text = (char *) malloc(size + 1);
+  char *style = (char *) malloc(size + 1);
+  int n = 0;
+  unsigned seed = 12345;
+  for (int line = 0; line < LINES; line++) {
+    seed = seed * 1103515245 + 12345;
+    int r = (seed >> 16) % 16;
+    add(text, style, &n, "    ", 'A');
+    add(text, style, &n, keywords[r % 5], 'B');
+    add(text, style, &n, names[r % 6], 'A');
+    add(text, style, &n, " = ", 'A');
+    add(text, style, &n, names[(r + 3) % 6], 'A');
+    if (r < 5) {
+      add(text, style, &n, "(\"some text\");", 'D');
+    } else {
+      add(text, style, &n, " + ", 'A');
+      add(text, style, &n, names[(r + 1) % 6], 'A');
+      add(text, style, &n, ";", 'A');
+    }
+    if (r > 10)
+      add(text, style, &n, " // a comment that explains the line above", 'C');
+    add(text, style, &n, "\n", 'A');
+  }
+  text[n] = style[n] = 0;
+  text_buffer->text(text);
+  style_buffer->text(style);
+  free(text);
+  free(style);
+}
+
+static void run_cb(Fl_Widget *w, void *) {
+  Fl_Font font = font_choice->value() ? FL_COURIER : FL_HELVETICA;
+  for (int i = 0; i < 4; i++)
+    styles[i].font = font + (i == 1 ? FL_BOLD : i == 2 ? FL_ITALIC : 0);
+  display->textfont(font);
+  display->highlight_data(style_buffer, styles, 4, 'A', 0, 0);
+  display->wrap_mode(wrap_button->value() ? Fl_Text_Display::WRAP_AT_BOUNDS
+                                          : Fl_Text_Display::WRAP_NONE, 0);
+  display->scroll(1, 0);
+  display->redraw();
+  w->deactivate();
+  Fl::flush();
+
+  // scroll by a few lines per frame, like a user dragging the scrollbar
+  double t0 = now();
+  for (int frame = 0; frame < FRAMES; frame++) {
+    display->scroll(1 + frame * 37, 0);
+    Fl::flush();
+  }
+  double t = now() - t0;
+
+  char line[200];
+  snprintf(line, sizeof(line), "%-12s %-8s %7.1f frames per second\n",
+           font_choice->text(), wrap_button->value() ? "wrap" : "no wrap",
+           FRAMES / t);
+  show(line);
+  w->activate();
+}
+
+int main(int argc, char **argv) {
+  Fl_Double_Window *win = new Fl_Double_Window(640, 520, "Fl_Text_Display scrolling benchmark");
+  font_choice = new Fl_Choice(50, 10, 120, 25, "Font:");
+  font_choice->add("Proportional");
+  font_choice->add("Fixed width");
+  font_choice->value(0);
+  wrap_button = new Fl_Check_Button(180, 10, 100, 25, "Wrap lines");
+  Fl_Button *run = new Fl_Button(290, 10, 80, 25, "Run");
+  run->callback(run_cb);
+
+  text_buffer = new Fl_Text_Buffer();
+  style_buffer = new Fl_Text_Buffer();
+  fill();
+  display = new Fl_Text_Display(10, 45, 620, 345);
+  display->buffer(text_buffer);
+
+  log_buffer = new Fl_Text_Buffer();
+  Fl_Text_Display *log = new Fl_Text_Display(10, 400, 620, 110);
+  log->buffer(log_buffer);
+  log->textfont(FL_COURIER);
+  win->resizable(display);
+  win->end();
+  win->show(argc, argv);
+  return Fl::run();
+}
+
+//
+// End of "$Id$".
+//
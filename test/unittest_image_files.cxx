@@ -0,0 +1,143 @@
+//
+// "$Id$"
+//
+// Unit tests for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Browser.H>
+#include <FL/Fl_BMP_Image.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// --- truncated image file tests ----------------------------------------------
+//
+// Writes BMP files that end in the middle of the pixels, small ones that
+// are read through a buffer and large ones that are mapped into memory,
+// and checks that the rows in the file are loaded and the others are black.
+//
+class ImageFileTest : public Fl_Group {
+  Fl_Browser *results;
+  int done;
+
+  static uchar pixel(int x, int y, int c) {
+    return (uchar)(((x * 7 + y * 13 + c * 5) & 0x7f) | 0x80);
+  }
+
+  static void put16(FILE *f, int v) {
+    putc(v & 255, f);
+    putc((v >> 8) & 255, f);
+  }
+  static void put32(FILE *f, int v) {
+    put16(f, v & 0xffff);
+    put16(f, (v >> 16) & 0xffff);
+  }
+
+  // writes a 24 bit BMP file of w by h pixels, cut off after rows rows
+  // and a half, and returns the number of bytes in it or 0
+  static int write_bmp(const char *name, int w, int h, int rows) {
+    FILE *f = fopen(name, "wb");
+    if (!f) return 0;
+    int ld = (w * 3 + 3) & ~3;
+    putc('B', f); putc('M', f);
+    put32(f, 54 + ld * h);
+    put32(f, 0);
+    put32(f, 54);
+    put32(f, 40);
+    put32(f, w);
+    put32(f, h);
+    put16(f, 1);
+    put16(f, 24);
+    put32(f, 0);
+    put32(f, ld * h);
+    put32(f, 2835);
+    put32(f, 2835);
+    put32(f, 0);
+    put32(f, 0);
+    // the rows go from the bottom up, in BGR order
+    uchar *row = new uchar[ld];
+    memset(row, 0, ld);
+    int size = 54;
+    for (int y = h - 1; y >= h - 1 - rows; y--) {
+      for (int x = 0; x < w; x++)
+        for (int c = 0; c < 3; c++)
+          row[x * 3 + 2 - c] = pixel(x, y, c);
+      int n = y == h - 1 - rows ? ld / 2 : ld;
+      size += (int)fwrite(row, 1, n, f);
+    }
+    delete[] row;
+    return fclose(f) ? 0 : size;
+  }
+
+  void check(const char *label, int w, int h, int rows) {
+    char name[1024], line[1200];
+    const char *tmp = getenv("TMPDIR");
+    snprintf(name, sizeof(name), "%s/fltk_unittest_truncated.bmp", tmp ? tmp : "/tmp");
+    int size = write_bmp(name, w, h, rows);
+    if (!size) {
+      snprintf(line, sizeof(line), "@C1can't write %s", name);
+      results->add(line);
+      return;
+    }
+    // leave garbage in memory that the image may get
+    uchar *junk = new uchar[w * h * 3];
+    memset(junk, 0x55, w * h * 3);
+    delete[] junk;
+    Fl_BMP_Image img(name);
+    int ok = img.w() == w && img.h() == h && img.d() == 3;
+    const uchar *p = ok ? (const uchar *)img.data()[0] : 0;
+    for (int y = 0; ok && y < h; y++)
+      for (int x = 0; ok && x < w; x++)
+        for (int c = 0; ok && c < 3; c++)
+          ok = p[(y * w + x) * 3 + c] == (y >= h - rows ? pixel(x, y, c) : 0);
+    snprintf(line, sizeof(line), "%s%s: %d of %d bytes, %s", ok ? "" : "@C1",
+             label, size, 54 + ((w * 3 + 3) & ~3) * h,
+             ok ? "rows read, rest black" : "WRONG PIXELS");
+    results->add(line);
+    ::remove(name);
+  }
+
+public:
+  static Fl_Widget *create() {
+    return new ImageFileTest(TESTAREA_X, TESTAREA_Y, TESTAREA_W, TESTAREA_H);
+  }
+  ImageFileTest(int x, int y, int w, int h) : Fl_Group(x, y, w, h) {
+    done = 0;
+    results = new Fl_Browser(x + 10, y + 30, w - 20, h - 40,
+                             "Truncated image files:");
+    results->align(FL_ALIGN_TOP_LEFT);
+    end();
+  }
+  void run() {
+    check("small BMP, buffered", 61, 50, 20);
+    check("large BMP, mapped", 301, 200, 77);
+    check("BMP cut off in the first row", 301, 200, 0);
+  }
+  void show() {
+    Fl_Group::show();
+    if (!done) {
+      done = 1;
+      run();
+    }
+  }
+};
+
+UnitTest image_files("truncated image files", ImageFileTest::create);
+
+//
+// End of "$Id$"
+//
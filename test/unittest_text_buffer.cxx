@@ -0,0 +1,435 @@
+//
+// "$Id$"
+//
+// Unit tests for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Browser.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// --- Fl_Text_Buffer::mapfile() tests -----------------------------------------
+//
+// Writes files of a few MB, loads them with loadfile() into a gap buffer and
+// with mapfile() into a piece table, lets the piece table check the mapped
+// text in idle time, and compares the texts.
+//
+class MapfileTestBuffer : public Fl_Text_Buffer {
+public:
+  MapfileTestBuffer() : Fl_Text_Buffer(0, 0, PIECE_TABLE) { }
+  // true while the mapped text was not checked completely
+  int checking() { return mMapping && mMappingChecked < mMappingSize; }
+};
+
+class MapfileTest : public Fl_Group {
+  Fl_Browser *results;
+  int done;
+
+  // writes size bytes of text made of word, with extra inserted at pos,
+  // or appended if pos is negative
+  static int write_file(const char *name, const char *word, int size,
+                        const char *extra, int pos) {
+    FILE *f = fopen(name, "wb");
+    if (!f) return 0;
+    int wl = (int)strlen(word), n = 0;
+    while (n < size) {
+      if (extra && pos >= 0 && n <= pos && pos < n + wl) {
+        fputs(extra, f);
+        n += (int)strlen(extra);
+      }
+      fputs(word, f);
+      n += wl;
+    }
+    if (extra && pos < 0) fputs(extra, f);
+    return !fclose(f);
+  }
+
+  void check(const char *label, const char *word, int size,
+             const char *extra, int pos) {
+    char name[1024], line[1200];
+    const char *tmp = getenv("TMPDIR");
+    snprintf(name, sizeof(name), "%s/fltk_unittest_mapfile.txt", tmp ? tmp : "/tmp");
+    if (!write_file(name, word, size, extra, pos)) {
+      snprintf(line, sizeof(line), "@C1can't write %s", name);
+      results->add(line);
+      return;
+    }
+    Fl_Text_Buffer gap;
+    gap.transcoding_warning_action = NULL;
+    gap.loadfile(name);
+    MapfileTestBuffer pieces;
+    pieces.transcoding_warning_action = NULL;
+    int err = pieces.mapfile(name);
+    for (int i = 0; i < 100000 && pieces.checking(); i++)
+      Fl::wait(0.0);
+    char *a = gap.text(), *b = pieces.text();
+    int same = !err && gap.length() == pieces.length() && !strcmp(a, b) &&
+      gap.input_file_was_transcoded == pieces.input_file_was_transcoded;
+    snprintf(line, sizeof(line), "%s%s: %d bytes%s, %s", same ? "" : "@C1", label,
+             pieces.length(), pieces.input_file_was_transcoded ? ", transcoded" : "",
+             same ? "same text" : "DIFFERENT TEXT");
+    results->add(line);
+    free(a);
+    free(b);
+    ::remove(name);
+  }
+
+public:
+  static Fl_Widget *create() {
+    return new MapfileTest(TESTAREA_X, TESTAREA_Y, TESTAREA_W, TESTAREA_H);
+  }
+  MapfileTest(int x, int y, int w, int h) : Fl_Group(x, y, w, h) {
+    done = 0;
+    results = new Fl_Browser(x + 10, y + 30, w - 20, h - 40,
+                             "Fl_Text_Buffer::mapfile() compared to loadfile():");
+    results->align(FL_ALIGN_TOP_LEFT);
+    end();
+  }
+  void run() {
+    const int MB = 1024 * 1024;
+    check("ASCII", "Hello, World!\n", 2 * MB, NULL, 0);
+    check("UTF-8", "Gr\xc3\xbc\xc3\x9f \xe2\x82\xac \xf0\x9f\x98\x80\n", 2 * MB, NULL, 0);
+    check("CP1252 at the start", "Hello\n", 2 * MB, "\xe4\xf6\xfc\x80", 0);
+    check("CP1252 at the end", "Hello\n", 3 * MB, "caf\xe9\n", 3 * MB - 10);
+    check("cut off UTF-8 at the end", "Gr\xc3\xbc\xc3\x9f\n", 2 * MB, "\xe2\x82", -1);
+    check("small file with CP1252", "caf\xe9\n", 1000, NULL, 0);
+  }
+  void show() {
+    Fl_Group::show();
+    if (!done) {
+      done = 1;
+      run();
+    }
+  }
+};
+
+UnitTest mapfile("text buffer mapfile", MapfileTest::create);
+
+//
+// --- Fl_Text_Buffer editing tests --------------------------------------------
+//
+// Makes random edits in buffers of both storage engines, with and without
+// a line index and a mapped file, and compares them with a plain copy of
+// the text. Checks that undo and redo restore the texts before and after
+// the edits, and that batched modify callbacks describe the same changes
+// as unbatched ones.
+//
+class TextEditTest : public Fl_Group {
+  Fl_Browser *results;
+  int done;
+  unsigned seed;
+
+  // the plain copy of the text, and the copy kept by a modify callback
+  struct Model {
+    char *text;
+    int len;
+    Model() : text((char *)malloc(1)), len(0) { text[0] = 0; }
+    ~Model() { free(text); }
+    void replace(int pos, int nDel, const char *ins, int nIns) {
+      char *t = (char *)malloc(len - nDel + nIns + 1);
+      memcpy(t, text, pos);
+      memcpy(t + pos, ins, nIns);
+      memcpy(t + pos + nIns, text + pos + nDel, len - pos - nDel + 1);
+      free(text);
+      text = t;
+      len += nIns - nDel;
+    }
+    int count_lines(int a, int b) const {
+      int n = 0;
+      if (b > len) b = len;
+      for (; a < b; a++) if (text[a] == '\n') n++;
+      return n;
+    }
+    int line_start(int x) const {
+      while (x > 0 && text[x - 1] != '\n') x--;
+      return x;
+    }
+    int line_end(int x) const {
+      while (x < len && text[x] != '\n') x++;
+      return x;
+    }
+    int skip_lines(int x, int n) const {
+      if (n == 0) return x;
+      for (int p = x, k = 0; p < len; p++)
+        if (text[p] == '\n' && ++k >= n) return p + 1;
+      return x > len ? x : len;
+    }
+    int rewind_lines(int x, int n) const {
+      int p = x - 1;
+      if (p <= 0) return 0;
+      if (p >= len) p = len - 1;
+      for (int k = -1; p >= 0; p--)
+        if (text[p] == '\n' && ++k >= n) return p + 1;
+      return 0;
+    }
+  };
+
+  struct Shadow {
+    Model model;
+    Fl_Text_Buffer *buf;
+    int calls, bad;
+  };
+
+  unsigned rnd(unsigned n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+  }
+
+  // random ASCII text with newlines, nul terminated
+  void random_text(char *t, int n) {
+    for (int i = 0; i < n; i++)
+      t[i] = rnd(6) ? (char)('a' + rnd(26)) : '\n';
+    t[n] = 0;
+  }
+
+  static unsigned hash(const char *s, int n) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < n; i++) h = (h ^ (uchar)s[i]) * 16777619u;
+    return h;
+  }
+
+  // applies a change reported by the buffer to the shadow copy
+  static void shadow_cb(int pos, int nInserted, int nDeleted, int,
+                        const char *deletedText, void *v) {
+    Shadow *s = (Shadow *)v;
+    s->calls++;
+    if (pos < 0 || pos + nDeleted > s->model.len) {
+      s->bad++;
+      return;
+    }
+    if (deletedText && strncmp(deletedText, s->model.text + pos, nDeleted))
+      s->bad++;
+    char *t = s->buf->text_range(pos, pos + nInserted);
+    s->model.replace(pos, nDeleted, t, nInserted);
+    free(t);
+  }
+
+  // makes a random edit in buf and model, returns 0 if they differ then;
+  // writes through writable_address() are not seen by undo and callbacks
+  int random_edit(Fl_Text_Buffer &buf, Model &m, int writes = 0) {
+    char t[200];
+    int pos = (int)rnd(m.len + 1), n = (int)rnd(m.len - pos + 1);
+    if (n > 150) n = (int)rnd(150);
+    int op = (int)rnd(writes ? 4 : 3);
+    if (op == 0) {
+      int k = (int)rnd(120);
+      random_text(t, k);
+      buf.insert(pos, t);
+      m.replace(pos, 0, t, k);
+    } else if (op == 1) {
+      buf.remove(pos, pos + n);
+      m.replace(pos, n, "", 0);
+    } else if (op == 2) {
+      int k = (int)rnd(60);
+      random_text(t, k);
+      buf.replace(pos, pos + n, t);
+      m.replace(pos, n, t, k);
+    } else if (pos < m.len && m.text[pos] != '\n') {
+      char c = (char)('A' + rnd(26));
+      *buf.writable_address(pos) = c;
+      m.text[pos] = c;
+    }
+    return buf.length() == m.len;
+  }
+
+  // writes size bytes of random lines to name, and into m
+  int write_file(const char *name, int size, Model &m) {
+    char *t = (char *)malloc(size + 1);
+    random_text(t, size);
+    m.replace(0, m.len, t, size);
+    free(t);
+    FILE *f = fopen(name, "wb");
+    if (!f) return 0;
+    fwrite(m.text, 1, m.len, f);
+    return !fclose(f);
+  }
+
+  void file_name(char *name, int size) {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(name, size, "%s/fltk_unittest_edits.txt", tmp ? tmp : "/tmp");
+  }
+
+  void check_edits(const char *label, Fl_Text_Buffer::Storage storage,
+                   int indexed, int mapped) {
+    char name[1024], line[1200];
+    Fl_Text_Buffer buf(0, 64, storage);
+    Model m;
+    if (indexed) buf.index_lines(1);
+    if (mapped) {
+      file_name(name, sizeof(name));
+      if (!write_file(name, 2 * 1024 * 1024, m) || buf.mapfile(name)) {
+        snprintf(line, sizeof(line), "@C1can't map %s", name);
+        results->add(line);
+        return;
+      }
+    }
+    int same = buf.length() == m.len, edits, total = mapped ? 1000 : 3000;
+    for (edits = 0; same && edits < total; edits++) {
+      same = random_edit(buf, m, 1);
+      // the lines are counted in a part of the text, the copy is slow
+      int x = (int)rnd(m.len + 1), y = x + (int)rnd(20000), n = (int)rnd(5);
+      same = same && buf.count_lines(x, y) == m.count_lines(x, y) &&
+        buf.line_start(x) == m.line_start(x) && buf.line_end(x) == m.line_end(x) &&
+        buf.skip_lines(x, n) == m.skip_lines(x, n) &&
+        buf.rewind_lines(y, n) == m.rewind_lines(y, n);
+      if (same && (edits % 100 == 0 || edits == total - 1)) {
+        char *t = buf.text();
+        same = !strcmp(t, m.text);
+        free(t);
+      }
+    }
+    snprintf(line, sizeof(line), "%s%s: %d edits, %s", same ? "" : "@C1", label,
+             edits, same ? "same text and lines" : "DIFFERENT TEXT OR LINES");
+    results->add(line);
+    if (mapped) ::remove(name);
+  }
+
+  void check_undo(const char *label, Fl_Text_Buffer::Storage storage) {
+    enum { N = 300 };
+    unsigned before[N + 1];
+    int lens[N + 1];
+    char line[200];
+    Fl_Text_Buffer buf(0, 64, storage);
+    Model m;
+    buf.undo_memory_limit(0);
+    before[0] = hash(m.text, m.len);
+    lens[0] = 0;
+    // mix typing runs, which are undone in steps, with other edits
+    for (int i = 0; i < N; i++) {
+      if (rnd(2)) {
+        char c[2] = { (char)('a' + rnd(26)), 0 };
+        if (!rnd(8)) c[0] = '\n';
+        int pos = i && rnd(4) ? buf.length() : (int)rnd(m.len + 1);
+        buf.insert(pos, c);
+        m.replace(pos, 0, c, 1);
+      } else {
+        random_edit(buf, m);
+      }
+      before[i + 1] = hash(m.text, m.len);
+      lens[i + 1] = m.len;
+    }
+    // every undo must go back to the text before one of the edits, in
+    // order, and the redos must come back the same way
+    int k = N, undos = 0, redos = 0, ok = 1;
+    while (ok && buf.undo()) {
+      undos++;
+      char *t = buf.text();
+      unsigned h = hash(t, buf.length());
+      free(t);
+      int j = k - 1;
+      while (j >= 0 && (before[j] != h || lens[j] != buf.length())) j--;
+      ok = j >= 0;
+      k = j;
+    }
+    // edits that changed nothing leave equal texts
+    ok = ok && before[k] == before[0] && lens[k] == 0 && !buf.can_undo();
+    while (ok && buf.redo()) {
+      redos++;
+      char *t = buf.text();
+      unsigned h = hash(t, buf.length());
+      free(t);
+      int j = k + 1;
+      while (j <= N && (before[j] != h || lens[j] != buf.length())) j++;
+      ok = j <= N;
+      k = j;
+    }
+    ok = ok && before[k] == before[N] && lens[k] == lens[N] &&
+      undos == redos && !buf.can_redo();
+    snprintf(line, sizeof(line), "%s%s: %d edits, %d undos, %d redos, %s",
+             ok ? "" : "@C1", label, N, undos, redos,
+             ok ? "same texts" : "DIFFERENT TEXTS");
+    results->add(line);
+  }
+
+  void check_batch(const char *label, int deletedText) {
+    char line[200];
+    Fl_Text_Buffer a, b;
+    Shadow sa, sb;
+    sa.buf = &a; sb.buf = &b;
+    sa.calls = sb.calls = sa.bad = sb.bad = 0;
+    a.add_modify_callback(shadow_cb, &sa, deletedText);
+    b.add_modify_callback(shadow_cb, &sb, deletedText);
+    Model ma, mb;
+    unsigned s = seed;
+    for (int i = 0; i < 200; i++) {
+      b.begin_batch();
+      // appended lines are merged, the other edits flush the batch
+      for (int j = (int)rnd(20); j > 0; j--) {
+        char t[100];
+        random_text(t, (int)rnd(80));
+        strcat(t, "\n");
+        a.append(t);
+        b.append(t);
+      }
+      unsigned s2 = seed;
+      random_edit(a, ma);
+      seed = s2;
+      random_edit(b, mb);
+      b.end_batch();
+    }
+    seed = s;
+    char *ta = a.text(), *tb = b.text();
+    int ok = !strcmp(ta, tb) && !strcmp(sa.model.text, ta) &&
+      !strcmp(sb.model.text, tb) && !sa.bad && !sb.bad;
+    free(ta);
+    free(tb);
+    snprintf(line, sizeof(line), "%s%s: %d callbacks batched, %d unbatched, %s",
+             ok ? "" : "@C1", label, sb.calls, sa.calls,
+             ok ? "same changes" : "DIFFERENT CHANGES");
+    results->add(line);
+  }
+
+public:
+  static Fl_Widget *create() {
+    return new TextEditTest(TESTAREA_X, TESTAREA_Y, TESTAREA_W, TESTAREA_H);
+  }
+  TextEditTest(int x, int y, int w, int h) : Fl_Group(x, y, w, h) {
+    done = 0;
+    seed = 1;
+    results = new Fl_Browser(x + 10, y + 30, w - 20, h - 40,
+                             "Fl_Text_Buffer edits compared to a plain copy:");
+    results->align(FL_ALIGN_TOP_LEFT);
+    end();
+  }
+  void run() {
+    check_edits("gap buffer", Fl_Text_Buffer::GAP_BUFFER, 0, 0);
+    check_edits("gap buffer, line index", Fl_Text_Buffer::GAP_BUFFER, 1, 0);
+    check_edits("piece table", Fl_Text_Buffer::PIECE_TABLE, 0, 0);
+    check_edits("piece table, line index", Fl_Text_Buffer::PIECE_TABLE, 1, 0);
+    check_edits("mapped file", Fl_Text_Buffer::PIECE_TABLE, 0, 1);
+    check_edits("mapped file, line index", Fl_Text_Buffer::PIECE_TABLE, 1, 1);
+    check_undo("undo and redo, gap buffer", Fl_Text_Buffer::GAP_BUFFER);
+    check_undo("undo and redo, piece table", Fl_Text_Buffer::PIECE_TABLE);
+    check_batch("batched callbacks", 1);
+    check_batch("batched callbacks without deleted text", 0);
+  }
+  void show() {
+    Fl_Group::show();
+    if (!done) {
+      done = 1;
+      run();
+    }
+  }
+};
+
+UnitTest text_edits("text buffer edits", TextEditTest::create);
+
+//
+// End of "$Id$"
+//
@@ -0,0 +1,121 @@
+//
+// "$Id$"
+//
+// Unit tests for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2020 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Browser.H>
+#include <stdio.h>
+
+//
+// --- Fl::add_timeout() and Fl::remove_timeout() tests -----------------------
+//
+// Adds many timeouts in random order, removes some of them one by one and
+// all timeouts of another callback at once, and checks that the others are
+// called in the order of their delays and that the removed ones are not.
+//
+class TimeoutTest : public Fl_Group {
+  enum { N = 300 };
+  Fl_Browser *results;
+  int done;
+  int removed[N];
+  int order[N];         // the timeouts in the order they were called
+  int nCalled, nStray;
+  static TimeoutTest *current;
+
+  static void called_cb(void *v) {
+    TimeoutTest *t = current;
+    int i = (int)((int *)v - t->removed);
+    if (t->nCalled < N) t->order[t->nCalled] = i;
+    t->nCalled++;
+  }
+  static void stray_cb(void *) {
+    current->nStray++;
+  }
+  static double delay(int i) { return 0.01 + i * 0.002; }
+
+public:
+  static Fl_Widget *create() {
+    return new TimeoutTest(TESTAREA_X, TESTAREA_Y, TESTAREA_W, TESTAREA_H);
+  }
+  TimeoutTest(int x, int y, int w, int h) : Fl_Group(x, y, w, h) {
+    done = 0;
+    results = new Fl_Browser(x + 10, y + 30, w - 20, h - 40,
+                             "Fl::add_timeout() and Fl::remove_timeout():");
+    results->align(FL_ALIGN_TOP_LEFT);
+    end();
+  }
+  void run() {
+    char line[200];
+    int i, shuffled[N];
+    current = this;
+    nCalled = nStray = 0;
+    for (i = 0; i < N; i++) shuffled[i] = i;
+    unsigned r = 12345;
+    for (i = N - 1; i > 0; i--) {
+      r = r * 1103515245 + 12345;
+      int j = (int)((r >> 8) % (unsigned)(i + 1)), k = shuffled[i];
+      shuffled[i] = shuffled[j];
+      shuffled[j] = k;
+    }
+    // mix the timeouts to remove with the others, so that removing them
+    // leaves holes all over the heap
+    for (i = 0; i < N; i++) {
+      int k = shuffled[i];
+      removed[k] = (k % 7 == 3);
+      Fl::add_timeout(delay(k), called_cb, removed + k);
+      Fl::add_timeout(delay(shuffled[N - 1 - i]) + 0.001, stray_cb);
+    }
+    int expected = 0;
+    for (i = 0; i < N; i++) {
+      if (removed[i]) Fl::remove_timeout(called_cb, removed + i);
+      else expected++;
+    }
+    Fl::remove_timeout(stray_cb);
+    for (i = 0; i < 1000 && nCalled < expected; i++)
+      Fl::wait(0.01);
+    Fl::wait(0.05);     // give the removed timeouts a chance to be called
+    int inOrder = nCalled == expected;
+    for (i = 1; i < expected && inOrder; i++)
+      inOrder = order[i - 1] < order[i];
+    int removedCalled = nStray;
+    for (i = 0; i < nCalled && i < N; i++)
+      if (removed[order[i]]) removedCalled++;
+    snprintf(line, sizeof(line), "%s%d of %d timeouts called, %s",
+             inOrder ? "" : "@C1", nCalled, expected,
+             inOrder ? "in order" : "NOT IN ORDER");
+    results->add(line);
+    snprintf(line, sizeof(line), "%s%d removed timeouts called",
+             removedCalled ? "@C1" : "", removedCalled);
+    results->add(line);
+  }
+  void show() {
+    Fl_Group::show();
+    if (!done) {
+      done = 1;
+      run();
+    }
+  }
+};
+
+TimeoutTest *TimeoutTest::current = 0;
+
+UnitTest timeouts("timeouts", TimeoutTest::create);
+
+//
+// End of "$Id$"
+//
@@ -154,6 +154,9 @@ public:
 #include "unittest_scrollbarsize.cxx"
 #include "unittest_schemes.cxx"
 #include "unittest_simple_terminal.cxx"
+#include "unittest_text_buffer.cxx"
+#include "unittest_image_files.cxx"
+#include "unittest_timeouts.cxx"
 
 // callback whenever the browser value changes
 void Browser_CB(Fl_Widget*, void*) {